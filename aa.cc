@@ -87,6 +87,31 @@ const Aa Aa::Y    = Aa('Y');
 const Aa Aa::STOP = Aa('*');
 
 const std::string Aa::valid_chars = "*ACDEFGHIKLMNPQRSTVWY";
+size_t
+Aa::normalize(char *dst, const char *src, size_t n) {
+    //valid letters by low nibble, in rows 0x40 ('@', 'A' to 'O') and 0x50 ('P' to '_')
+    const __m256i letters4 = _mm256_setr_epi8(
+        0, -1, 0, -1, -1, -1, -1, -1, -1, -1, 0, -1, -1, -1, -1, 0,
+        0, -1, 0, -1, -1, -1, -1, -1, -1, -1, 0, -1, -1, -1, -1, 0);
+    const __m256i letters5 = _mm256_setr_epi8(
+        -1, -1, -1, -1, -1, 0, -1, -1, 0, -1, 0, 0, 0, 0, 0, 0,
+        -1, -1, -1, -1, -1, 0, -1, -1, 0, -1, 0, 0, 0, 0, 0, 0);
+    const __m256i nibble = _mm256_set1_epi8(0x0F), high = _mm256_set1_epi8(static_cast<char>(0xF0));
+    const __m256i x40 = _mm256_set1_epi8(0x40), x50 = _mm256_set1_epi8(0x50), stop = _mm256_set1_epi8('*');
+    const __m256i before_a = _mm256_set1_epi8('a' - 1), after_z = _mm256_set1_epi8('z' + 1), lower = _mm256_set1_epi8(0x20);
+    return mm256_normalize(dst, src, n, [&](__m256i &v)->uint32_t {
+        const __m256i is_lower = _mm256_and_si256(_mm256_cmpgt_epi8(v, before_a), _mm256_cmpgt_epi8(after_z, v));
+        v = _mm256_sub_epi8(v, _mm256_and_si256(is_lower, lower));
+        const __m256i low  = _mm256_and_si256(v, nibble);
+        const __m256i row  = _mm256_and_si256(v, high);
+        const __m256i valid = _mm256_or_si256(
+            _mm256_or_si256(_mm256_and_si256(_mm256_cmpeq_epi8(row, x40), _mm256_shuffle_epi8(letters4, low)),
+                            _mm256_and_si256(_mm256_cmpeq_epi8(row, x50), _mm256_shuffle_epi8(letters5, low))),
+            _mm256_cmpeq_epi8(v, stop));
+        return static_cast<uint32_t>(_mm256_movemask_epi8(valid));
+    }, normalize_char);
+}
+
 const Aas Aas::all                = Aa::valid_chars;
 const Aas Aas::all_coding         = Aa::valid_chars.substr(1);
 
@@ -106,22 +131,32 @@ TranslationTable::TranslationTable(const Aas &aas) {
 
 const TranslationTable StandardTranslationTable(Aas("KNNKTTTTIIIMRSSRQHHQPPPPLLLLRRRR*YY*SSSSLFFL*CCWEDDEAAAAVVVVGGGG"));
 
-Aas::Aas(const Cdns &cdns, const TranslationTable &ttable) {
-    clear();
-    resize(cdns.size());
-    mm256_translate_cdns(data(), cdns.c_data(), cdns.size(), ttable.data());
+namespace {
+
+/** Bytes mm256_translate_cdns() writes for n codons. */
+size_t
+translated_size(size_t n) {
+    return (n + ccb::REGISTER_SIZE - 1) / ccb::REGISTER_SIZE * ccb::REGISTER_SIZE;
+}
+
+}; //namespace
+
+Aas::Aas(CdnsView cdns, const TranslationTable &ttable) {
+    set_from_cdns(cdns, ttable);
 }
 
 void
-Aas::set_from_cdns(const Cdns &cdns, const TranslationTable &ttable) {
+Aas::set_from_cdns(CdnsView cdns, const TranslationTable &ttable) {
     clear();
     resize(cdns.size());
     mm256_translate_cdns(data(), cdns.c_data(), cdns.size(), ttable.data());
+    zero_tail(translated_size(size()));
 }
 
 Aas::Aas(Cdns &&cdns,  const TranslationTable &ttable) {
     swap_buffers(cdns);
     mm256_translate_cdns(data(), c_data(), size(), ttable.data());
+    zero_tail(translated_size(size()));
 }
 
 };
\ No newline at end of file
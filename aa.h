@@ -84,6 +84,9 @@ public:
     static char 
     normalize_char(char c) { c = std::toupper(c); return (valid_chars.find(c) == std::string::npos) ? 0 : c; }
 
+    /** Vectorized normalize_char() over n chars (see mm256_normalize()) @return the number of valid chars written to dst */
+    static size_t normalize(char *dst, const char *src, size_t n);
+
     /**
       * Attempt char to Aa conversion.
       *
@@ -101,6 +104,13 @@ private:
     char v = '*';
 };
 
+/** Translate the n codons at src into amino acids at dst, which may be src,
+  * with the table at ttable (see TranslationTable::data()). Reads and writes
+  * whole registers, so both need the padding of a Polymer's buffer.
+  */
+void
+mm256_translate_cdns(char *dst, const char *src, size_t n, const Aa *ttable);
+
 class TranslationTable {
 public:
     TranslationTable() = default;
@@ -133,10 +143,12 @@ public:
     Aas(Aas &&aas) { swap_buffers(aas); }
     Aas &operator=(Aas &&aas) noexcept { swap_buffers(aas); return *this; }
 
-    Aas(const Cdns &, const TranslationTable &ttable=StandardTranslationTable);
+    Aas(const Cdns &cdns, const TranslationTable &ttable=StandardTranslationTable) : Aas(CdnsView(cdns), ttable) {}
     Aas(Cdns &&, const TranslationTable &ttable=StandardTranslationTable);
 
-    void set_from_cdns(const Cdns &, const TranslationTable &ttable=StandardTranslationTable);
+    explicit Aas(CdnsView, const TranslationTable &ttable=StandardTranslationTable);
+
+    void set_from_cdns(CdnsView, const TranslationTable &ttable=StandardTranslationTable);
 
     Aas(Nts &&dna, const TranslationTable &ttable=StandardTranslationTable) : Aas(Cdns(std::move(dna)), ttable) {}
 
@@ -144,6 +156,8 @@ public:
     Aas(const std::string &s) : Polymer(s) {}
 };
 
+using AasView = PolymerView<Aa>; ///< A view of an Aas or of a slice of one.
+
 };
 
 template<>
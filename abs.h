@@ -73,16 +73,16 @@ public:
 
     void trim(const std::pair<size_t, size_t> &how_much); 
 
-    size_t query(const Cdns &cdns) const;
+    size_t query(CdnsView cdns) const { return query(cdns.cbegin(), cdns.cend()); }
     size_t query(Cdns::const_iterator lo, Cdns::const_iterator hi) const;
 
     size_t query_and_align(Cdns::const_iterator lo, Cdns::const_iterator hi, Alignment &result) const;
-    size_t query_and_align(const Cdns &cdns, Alignment &result) const {
+    size_t query_and_align(CdnsView cdns, Alignment &result) const {
         return query_and_align(cdns.cbegin(), cdns.cend(), result);
     };
 
     size_t query_and_align(Aas::const_iterator lo, Aas::const_iterator hi, Alignment &result) const;
-    size_t query_and_align(const Aas &aas, Alignment &result) const {
+    size_t query_and_align(AasView aas, Alignment &result) const {
         return query_and_align(aas.cbegin(), aas.cend(), result);
     };
 
@@ -133,7 +133,7 @@ struct Alignment {
     void clear();              ///< Reset for use in another call to nw_align_aas or other function.
 
     template<typename M>
-    std::string build_string(const Polymer<M> &q) const {
+    std::string build_string(PolymerView<M> q) const {
         return build_string<M>(q.cbegin(), q.cend());
     }
 
@@ -245,7 +245,7 @@ nw_align(typename Polymer<M>::const_iterator q_lo,
 
     const size_t q_size = q_hi - q_lo;
     const size_t t_size = t_hi - t_lo;
-    thread_local Matrix<Cell> &trace = result.traceback;
+    Matrix<Cell> &trace = result.traceback;
     trace.resize(q_size+1, t_size+1);
 
     for (int i = 1; i < trace.rows(); ++i) {
@@ -297,8 +297,8 @@ nw_align(typename Polymer<M>::const_iterator q_lo,
   * be 4x4 with rows and columns corresponding to the values of Nt::index().
   *
   * @tparam M the type of monomer (Aa, Nt, etc.)
-  * @param query the amino acid "query" sequence
-  * @param templ the amino acid "template" sequence
+  * @param query the amino acid "query" sequence, a Polymer or a view of one
+  * @param templ the amino acid "template" sequence, a Polymer or a view of one
   * @param substitution_matrix the substituion scoring matrix (e.g. BLOSUM62 for M=Aa)
   * @param gapp the gap penalty
   * @param result stores the results of the alignment as a string
@@ -306,8 +306,8 @@ nw_align(typename Polymer<M>::const_iterator q_lo,
   */
 template<typename M>
 void
-nw_align(const Polymer<M> &q,
-         const Polymer<M> &t,
+nw_align(PolymerView<M> q,
+         PolymerView<M> t,
          const Matrix<int32_t> &match,
          int32_t gapp,
          Alignment &result,
@@ -318,7 +318,7 @@ nw_align(const Polymer<M> &q,
 /** Compute the Needleman-Wunsch score for aligning a sequence to itself. */
 template<typename M>
 int32_t
-nw_self_align_score(const Polymer<M> &query, const Matrix<int32_t> &matrix) {
+nw_self_align_score(PolymerView<M> query, const Matrix<int32_t> &matrix) {
     int32_t score = 0;
     for (const M &m : query) {
         int32_t index = static_cast<int32_t>(m.index());
@@ -386,6 +386,13 @@ struct Orf {
     bool contains_ptc() const;
 };
 
+/** A segment of an Orf cut out by split_orfs(), viewing the Orf's buffers. */
+struct OrfSegment {
+    const Orf *orf = nullptr; ///< the Orf cut, for umi_group_size and barcode
+    CdnsView cdns;
+    AasView  aas;
+};
+
 template<typename T>
 Matrix<T>::Matrix(size_t rows, size_t cols, const T& t)
     : rows_(rows)
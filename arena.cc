@@ -0,0 +1,147 @@
+/*
+Copyright 2024, The Broad Institute of MIT and Harvard
+
+Original Author: Charles C Bailey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "arena.h"
+#include "simdalloc.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <new>
+
+namespace bio {
+
+/** The header at the start of every block.
+  *
+  * refs starts at BIAS and the owning thread counts its buffers in a plain
+  * variable, subtracting BIAS less that count when it retires the block;
+  * every release subtracts 1. Carving a buffer thus needs no atomic, and
+  * refs reaches 0 only once the block is retired and all its buffers are
+  * released.
+  */
+class Arena::Block {
+public:
+    static constexpr size_t BIAS = std::numeric_limits<size_t>::max() / 2;
+
+    std::atomic<size_t> refs = BIAS;
+    detail::DsaTagTally *tally = nullptr; ///< charged for the block while allocations are tracked
+
+    /** Drop n references, freeing the block with the last. */
+    void unref(size_t n) {
+        if (refs.fetch_sub(n, std::memory_order_acq_rel) != n) return;
+        detail::DsaTagTally *charged = tally;
+        this->~Block();
+        detail::dsa_tally_free(charged, detail::DSA_SIMD_ALLOCATOR, this, 0);
+        std::free(this);
+        blocks_.fetch_sub(1, std::memory_order_relaxed);
+    }
+};
+
+std::atomic<size_t> Arena::blocks_ = 0;
+
+namespace {
+
+constexpr size_t ALN = ccb::REGISTER_SIZE;
+
+/** The calling thread's block, the part of it that is still free and the scopes it is in. */
+struct ThreadArena {
+    Arena::Block *block = nullptr;
+    char *cursor = nullptr, *end = nullptr;
+    size_t buffers = 0;
+    unsigned scopes = 0;
+
+    ~ThreadArena() { retire(); }
+
+    void retire() {
+        if (!block) return;
+        block->unref(Arena::Block::BIAS - buffers);
+        block = nullptr;
+        cursor = end = nullptr;
+        buffers = 0;
+    }
+
+    void renew() {
+        retire();
+        void *p = std::calloc(1, Arena::BLOCK_SIZE);
+        if (!p) throw std::bad_alloc();
+        detail::dsa_note_allocation(Arena::BLOCK_SIZE);
+        block = new (p) Arena::Block;
+        block->tally = detail::dsa_tally_allocation(detail::DSA_SIMD_ALLOCATOR, p, 0);
+        const uintptr_t first = (reinterpret_cast<uintptr_t>(p) + sizeof(Arena::Block) + ALN - 1) / ALN * ALN;
+        cursor = reinterpret_cast<char *>(first);
+        end = static_cast<char *>(p) + Arena::BLOCK_SIZE - ALN; //SIMD loads may run a register past a buffer
+    }
+};
+
+thread_local ThreadArena thread_arena;
+
+/** Bytes reserved for a buffer of n bytes, as by ccb::simd_allocator. */
+inline size_t
+reserved(size_t n) {
+    return (n + ALN - 1) / ALN * ALN + ALN;
+}
+
+}; //namespace
+
+Arena::Scope::Scope() {
+    ++thread_arena.scopes;
+}
+
+Arena::Scope::~Scope() {
+    if (--thread_arena.scopes == 0) thread_arena.retire();
+}
+
+char *
+Arena::allocate(size_t n, size_t &actual, Block *&block) {
+    ThreadArena &t = thread_arena;
+    if (!t.scopes || n == 0 || n > MAX_ALLOCATION) return nullptr;
+    const size_t r = reserved(n);
+    if (static_cast<size_t>(t.end - t.cursor) < r) {
+        t.renew();
+        blocks_.fetch_add(1, std::memory_order_relaxed);
+    }
+    char *p = t.cursor;
+    t.cursor += r;
+    ++t.buffers;
+    actual = r - 1;
+    block = t.block;
+    return p;
+}
+
+bool
+Arena::extend(char *p, size_t &actual, size_t n, const Block *block) {
+    ThreadArena &t = thread_arena;
+    if (block != t.block || p + actual + 1 != t.cursor || n > MAX_ALLOCATION) return false;
+    const size_t r = reserved(n);
+    if (static_cast<size_t>(t.end - p) < r) return false;
+    t.cursor = p + r;
+    actual = r - 1;
+    return true;
+}
+
+void
+Arena::release(Block *block) {
+    block->unref(1);
+}
+
+}; //namespace bio
\ No newline at end of file
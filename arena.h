@@ -0,0 +1,96 @@
+/*
+Copyright 2024, The Broad Institute of MIT and Harvard
+
+Original Author: Charles C Bailey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef BIO_ARENA_H_
+#define BIO_ARENA_H_
+
+#include <atomic>
+#include <cstddef>
+
+namespace bio {
+
+/** Per-thread bump allocation of short-lived Polymer buffers.
+  *
+  * While an Arena::Scope is alive on a thread, the Polymers created or
+  * grown on that thread take their buffers from the thread's current block
+  * instead of from ccb::simd_allocator. A buffer costs a pointer bump and
+  * the buffer that was carved last grows in place. Blocks come zeroed from
+  * calloc and no byte of a block is handed out twice, so the buffers meet
+  * the simd_allocator guarantees (32 byte alignment, a register of zeroed
+  * padding, a null terminator) without any memset.
+  *
+  * Buffers may be released on any thread. A block is freed when the scope
+  * that filled it has ended and every buffer carved from it has been
+  * released, so Polymers that outlive their stage should be moved to the
+  * heap with PolymerBase::detach() or they keep their whole block alive.
+  */
+class Arena {
+public:
+    class Block;
+
+    static constexpr size_t BLOCK_SIZE     = size_t(1) << 20;
+    static constexpr size_t MAX_ALLOCATION = BLOCK_SIZE / 16; ///< larger buffers come from the heap
+
+    /** Use the arena on the calling thread for the lifetime of this object.
+      *
+      * Scopes nest; when the outermost one ends the thread lets go of its
+      * current block, so that the next stage starts a block of its own.
+      */
+    class Scope {
+    public:
+        Scope();
+        ~Scope();
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+    };
+
+    /** Carve a buffer for n bytes from the calling thread's block.
+      *
+      * @param n bytes requested
+      * @param actual receives the usable size as for ccb::simd_allocator (1 less than reserved)
+      * @param block receives the block to release the buffer to
+      * @return the buffer, or nullptr if no Scope is active or n is 0 or larger than MAX_ALLOCATION
+      */
+    static char *allocate(size_t n, size_t &actual, Block *&block);
+
+    /** Grow the buffer p of usable size actual to hold n bytes in place.
+      *
+      * @return true (and the new usable size in actual) if p was the last
+      *         buffer carved from the calling thread's block and the block
+      *         has room, false otherwise
+      */
+    static bool extend(char *p, size_t &actual, size_t n, const Block *block);
+
+    /** Release a buffer carved from block. */
+    static void release(Block *block);
+
+    /** Blocks allocated and not yet freed by all threads. */
+    static size_t blocks() { return blocks_.load(std::memory_order_relaxed); }
+
+private:
+    static std::atomic<size_t> blocks_;
+};
+
+}; //namespace bio
+
+#endif
\ No newline at end of file
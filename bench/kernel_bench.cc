@@ -0,0 +1,373 @@
+/*
+Copyright 2024, The Broad Institute of MIT and Harvard
+
+Original Author: Charles C Bailey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/** Timings of the hot kernels of dsa over a range of input sizes.
+  *
+  * Each kernel is run until at least --min_time seconds have passed, in five
+  * rounds, and the fastest round is reported as nanoseconds per call, input
+  * bytes per second and, for the Needleman-Wunsch kernels, cells (query x
+  * template residues) per second. Inputs are random but seeded, so two builds
+  * or two machines time the same work. The results go to standard output as
+  * JSON; progress goes to standard error.
+  *
+  * usage: kernel_bench [--min_time=SECONDS (default 0.5)] [--filter=SUBSTRING]
+  */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../aa.h"
+#include "../abs.h"
+#include "../align.h"
+#include "../cdn.h"
+#include "../defines.h"
+#include "../dna.h"
+#include "../mainfunctions.h"
+#include "../umi.h"
+
+using namespace bio;
+
+struct Result {
+    std::string kernel;
+    size_t      size = 0;   ///< in units
+    const char *unit = "";
+    size_t      ops  = 0;   ///< calls timed in the fastest round
+    double      ns_per_op    = 0.0;
+    double      bytes_per_op = 0.0;
+    double      cells_per_op = 0.0; ///< dynamic programming cells, 0 for other kernels
+
+    double bytes_per_second() const { return ns_per_op > 0.0 ? bytes_per_op / ns_per_op * 1e9 : 0.0; }
+    double cells_per_second() const { return ns_per_op > 0.0 ? cells_per_op / ns_per_op * 1e9 : 0.0; }
+};
+
+static double min_seconds = 0.5;
+static std::string filter;
+static std::vector<Result> results;
+static volatile size_t sink = 0; //keeps results of the kernels alive
+
+/** Time op(i) for i in [0, batch) over and over. Kernels that consume or
+  * change their input get fresh inputs from prepare(batch) before each
+  * batch, outside the timed region.
+  */
+static void
+measure(Result result, size_t batch, const std::function<void(size_t)> &prepare, const std::function<size_t(size_t)> &op) {
+    if (result.kernel.find(filter) == std::string::npos) return;
+    using clock = std::chrono::steady_clock;
+
+    static constexpr int ROUNDS = 5;
+    double best = 1e30;
+    for (int round = 0; round < ROUNDS; ++round) {
+        double seconds = 0.0;
+        size_t ops = 0;
+        while (seconds < min_seconds / ROUNDS) {
+            prepare(batch);
+            size_t s = 0;
+            const auto start = clock::now();
+            for (size_t i = 0; i < batch; ++i) s += op(i);
+            seconds += std::chrono::duration<double>(clock::now() - start).count();
+            ops += batch;
+            sink = sink + s;
+        }
+        if (seconds / ops * 1e9 < best) {
+            best = seconds / ops * 1e9;
+            result.ops = ops;
+        }
+    }
+    result.ns_per_op = best;
+    std::cerr << std::left << std::setw(40) << result.kernel << std::right << std::setw(8) << result.size << ' ' << std::setw(9) << result.unit
+              << std::fixed << std::setprecision(1) << std::setw(14) << result.ns_per_op << " ns/op" << std::endl;
+    results.push_back(std::move(result));
+}
+
+static void
+measure(Result result, const std::function<size_t(size_t)> &op) {
+    measure(std::move(result), 1, [](size_t){}, op);
+}
+
+/** Padded, aligned memory for the kernels that work on raw buffers (see simd_allocator). */
+using Buffer = std::vector<char, ccb::simd_allocator<char, ccb::REGISTER>>;
+
+static std::mt19937_64 rng(42);
+
+static std::string
+str(const Nts &dna) {
+    return std::string(dna.as_string_view());
+}
+
+static Nts
+random_nts(size_t n) {
+    static const char ACGT[] = "ACGT";
+    std::string s(n, 'A');
+    for (char &c : s) c = ACGT[rng() % 4];
+    return Nts(s);
+}
+
+/** dna with about one position in rate changed to another base. */
+static Nts
+mutate(const Nts &dna, size_t rate) {
+    static const char ACGT[] = "ACGT";
+    std::string s = str(dna);
+    for (char &c : s) if (rng() % rate == 0) c = ACGT[(std::strchr(ACGT, c) - ACGT + 1 + rng() % 3) % 4];
+    return Nts(s);
+}
+
+/** A random open reading frame of n codons: random codons, stop codons replaced. */
+static Nts
+random_orf(size_t n) {
+    Nts dna = random_nts(3 * n);
+    const Cdns cdns(dna);
+    const Aas aas(cdns);
+    std::string s = str(dna);
+    for (size_t i = 0; i < n; ++i) if (aas[i] == Aa::STOP) s[3 * i] = 'C';
+    return Nts(s);
+}
+
+static void
+bench_find_overlap() {
+    for (size_t n : {64, 150, 250, 300}) {
+        const Nts fragment = random_nts(n + n * 2 / 3);
+        const Nts a = str(fragment).substr(0, n);
+        const Nts b = str(fragment).substr(fragment.size() - n);
+        measure({"find_overlapv_256", n, "nt", 0, 0.0, 2.0 * n}, [&](size_t) {
+            return find_overlapv_256(a.c_data(), a.size(), b.c_data(), b.size()).overlap;
+        });
+    }
+}
+
+static void
+bench_assemble() {
+    for (size_t n : {150, 250, 300}) {
+        const Nts fragment = random_nts(n + n * 2 / 3);
+        Read fw, rv;
+        fw.dna = Nts(str(fragment).substr(0, n));
+        rv.dna = Nts(str(fragment).substr(fragment.size() - n));
+        rv.dna.reverse_complement();
+        fw.qual = rv.qual = Qual(n, 'I');
+
+        static constexpr size_t BATCH = 256;
+        std::vector<Read> fws(BATCH), rvs(BATCH);
+        measure({"Read::assemble", n, "nt", 0, 0.0, 2.0 * n}, BATCH,
+            [&](size_t batch) { for (size_t i = 0; i < batch; ++i) { fws[i] = Read(fw); rvs[i] = Read(rv); } },
+            [&](size_t i) { return Read::assemble(std::move(fws[i]), std::move(rvs[i]), 9).size(); });
+    }
+}
+
+static void
+bench_normalize() {
+    for (size_t n : {300, 3000, 30000}) {
+        const std::string dna = str(random_nts(n));
+        std::string aas(n, 'A');
+        for (char &c : aas) c = Aa::valid_chars[rng() % Aa::valid_chars.size()];
+        Buffer out(n);
+        measure({"Nt::normalize", n, "nt", 0, 0.0, double(n)}, [&](size_t) {
+            return Nt::normalize(out.data(), dna.data(), dna.size());
+        });
+        measure({"Aa::normalize", n, "aa", 0, 0.0, double(n)}, [&](size_t) {
+            return Aa::normalize(out.data(), aas.data(), aas.size());
+        });
+        measure({"Nts(const std::string &)", n, "nt", 0, 0.0, double(n)}, [&](size_t) {
+            return Nts(dna).size();
+        });
+    }
+}
+
+static void
+bench_pack_cdns() {
+    for (size_t n : {300, 3000, 30000}) {
+        const Nts dna = random_nts(n);
+        Buffer cdns(n / 3);
+        measure({"mm256_pack_cdns", n, "nt", 0, 0.0, double(n)}, [&](size_t) {
+            mm256_pack_cdns(cdns.data(), dna.c_data(), dna.size());
+            return size_t(cdns[0]);
+        });
+    }
+}
+
+static void
+bench_translate_cdns() {
+    for (size_t n : {100, 1000, 10000}) {
+        const Cdns cdns(random_nts(3 * n));
+        Buffer aas(n);
+        measure({"mm256_translate_cdns", n, "codons", 0, 0.0, double(n)}, [&](size_t) {
+            mm256_translate_cdns(aas.data(), cdns.c_data(), cdns.size(), StandardTranslationTable.data());
+            return size_t(aas[0]);
+        });
+    }
+}
+
+static void
+bench_reverse_complement() {
+    for (size_t n : {150, 1500, 15000}) {
+        const Nts random = random_nts(n);
+        Buffer dna(random.c_data(), random.c_data() + n);
+        measure({"mm256_reverse_complement_dna", n, "nt", 0, 0.0, double(n)}, [&](size_t) {
+            mm256_reverse_complement_dna(dna.data(), dna.size());
+            return size_t(dna[0]);
+        });
+    }
+}
+
+static void
+bench_umi_extractor() {
+    const std::string ref = "TACnnnnnnAGTnnnnnnCGNNNNNNNNNNNGTCCTCTCT";
+    const UMIExtractor extractor(ref);
+    for (size_t n : {150, 250, 300}) {
+        std::string read = str(random_nts(n));
+        std::string planted = str(random_nts(ref.size()));
+        for (size_t i = 0; i < ref.size(); ++i) if (ref[i] != 'n' && ref[i] != 'N') planted[i] = ref[i];
+        read.replace(5, planted.size(), planted);
+        const Nts dna(read);
+        measure({"UMIExtractor::operator()", n, "nt", 0, 0.0, double(n)}, [&](size_t) {
+            return extractor(dna.cbegin(), dna.cend()).length;
+        });
+    }
+}
+
+static void
+bench_nw_align() {
+    for (size_t n : {50, 100, 200, 400}) {
+        const Nts tpl = random_orf(n);
+        const Cdns tcdns(tpl), qcdns(mutate(tpl, 30));
+        const Aas  taas(tcdns), qaas(qcdns);
+        Alignment aln;
+        measure({"nw_align<Aa>", n, "aa", 0, 2.0 * n, double(n) * n}, [&](size_t) {
+            nw_align<Aa>(qaas, taas, BLOSUM62, 4, aln);
+            return size_t(aln.score);
+        });
+        measure({"nw_align<Cdn>", n, "codons", 0, 2.0 * n, double(n) * n}, [&](size_t) {
+            nw_align<Cdn>(qcdns, tcdns, CDNSUBS, 4, aln);
+            return size_t(aln.score);
+        });
+    }
+}
+
+static void
+bench_consensus() {
+    help::Params params;
+    static constexpr size_t LENGTH = 300;
+    for (size_t k : {2, 8, 32}) {
+        const Nts consensus = random_nts(LENGTH);
+        std::vector<Read> group(k);
+        for (Read &rd : group) {
+            rd.dna  = mutate(consensus, 100);
+            rd.qual = Qual(LENGTH, 'I');
+        }
+
+        static constexpr size_t BATCH = 64;
+        std::vector<std::vector<Read>> groups(BATCH);
+        measure({"build_consensus_sequence", k, "reads", 0, double(k * LENGTH)}, BATCH,
+            [&](size_t batch) { for (size_t i = 0; i < batch; ++i) groups[i] = std::vector<Read>(group); },
+            [&](size_t i) { build_consensus_sequence(groups[i], params, false); return groups[i].front().size(); });
+    }
+}
+
+static void
+bench_query_and_align() {
+    static constexpr size_t LENGTH = 120; //codons, about a V region
+    for (size_t templates : {1, 10, 100}) {
+        std::shared_ptr<TemplateDatabase> db = TemplateDatabase::create_empty();
+        std::vector<Nts> dnas;
+        for (size_t t = 0; t < templates; ++t) {
+            dnas.push_back(random_orf(LENGTH));
+            const Cdns cdns(dnas.back());
+            db->add_entry("template " + std::to_string(t), cdns, Aas(cdns));
+        }
+        const Cdns query(mutate(dnas[templates / 2], 30));
+        const Aas  aas(query);
+        Alignment aln;
+        const double cells = double(LENGTH) * LENGTH * templates;
+        measure({"TemplateDatabase::query_and_align<Cdn>", templates, "templates", 0, double(LENGTH), cells}, [&](size_t) {
+            return db->query_and_align(query, aln);
+        });
+        measure({"TemplateDatabase::query_and_align<Aa>", templates, "templates", 0, double(LENGTH), cells}, [&](size_t) {
+            return db->query_and_align(aas, aln);
+        });
+    }
+}
+
+static void
+write_json(std::ostream &os) {
+    os << std::fixed << std::setprecision(3);
+    os << "{\n"
+       << "  \"program_version\": \"" << VERSION_STRING << "\",\n"
+#if defined(__clang__)
+       << "  \"compiler\": \"clang " << __clang_version__ << "\",\n"
+#elif defined(__GNUC__)
+       << "  \"compiler\": \"gcc " << __VERSION__ << "\",\n"
+#elif defined(_MSC_VER)
+       << "  \"compiler\": \"MSVC " << _MSC_VER << "\",\n"
+#endif
+       << "  \"min_seconds\": " << min_seconds << ",\n"
+       << "  \"results\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result &r = results[i];
+        os << (i ? ",\n" : "\n")
+           << "    {\"kernel\": \"" << r.kernel << "\", \"size\": " << r.size << ", \"unit\": \"" << r.unit << "\""
+           << ", \"ops\": " << r.ops
+           << ", \"ns_per_op\": " << r.ns_per_op
+           << ", \"bytes_per_second\": " << r.bytes_per_second();
+        if (r.cells_per_op > 0.0) os << ", \"cells_per_second\": " << r.cells_per_second() << ", \"gcups\": " << std::setprecision(6) << r.cells_per_second() * 1e-9 << std::setprecision(3);
+        else                      os << ", \"cells_per_second\": null, \"gcups\": null";
+        os << "}";
+    }
+    os << "\n  ]\n}" << std::endl;
+}
+
+int
+main(int argc, char **argv) {
+    for (int i = 1; i < argc; ++i) {
+        if (std::strncmp(argv[i], "--min_time=", 11) == 0) {
+            min_seconds = std::strtod(argv[i] + 11, nullptr);
+        } else if (std::strncmp(argv[i], "--filter=", 9) == 0) {
+            filter = argv[i] + 9;
+        } else {
+            min_seconds = 0.0;
+        }
+        if (min_seconds <= 0.0) {
+            std::cerr << "usage: " << argv[0] << " [--min_time=SECONDS] [--filter=SUBSTRING]" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    bench_find_overlap();
+    bench_assemble();
+    bench_normalize();
+    bench_pack_cdns();
+    bench_translate_cdns();
+    bench_reverse_complement();
+    bench_umi_extractor();
+    bench_nw_align();
+    bench_consensus();
+    bench_query_and_align();
+
+    write_json(std::cout);
+    return EXIT_SUCCESS;
+}
\ No newline at end of file
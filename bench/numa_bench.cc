@@ -0,0 +1,178 @@
+/*
+Copyright 2024, The Broad Institute of MIT and Harvard
+
+Original Author: Charles C Bailey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/** Local versus remote NUMA memory traffic.
+  *
+  * For every pair of (CPU node, memory node) a thread pinned to the first
+  * CPU of one node reads a buffer bound to the other, measuring streaming
+  * bandwidth and dependent-load (pointer chasing) latency. The diagonal of
+  * each matrix is local traffic; everything off it crosses sockets, which is
+  * what unpinned threads reading a single-node buffer pay about half the time.
+  *
+  * usage: numa_bench [megabytes (default 256)]
+  */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#ifdef DSA_TARGET_LINUX
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "../numa.h"
+
+using namespace bio;
+
+struct Cell {
+    double gb_per_s   = 0.0;
+    double ns_per_hop = 0.0;
+};
+
+/** bytes of anonymous memory whose pages are all placed on node. */
+static uint64_t *
+allocate_on(size_t bytes, size_t node) {
+#ifdef DSA_TARGET_LINUX
+    void *p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) return nullptr;
+    static constexpr int MPOL_BIND_MODE = 2; //MPOL_BIND from <linux/mempolicy.h>
+    unsigned long nodemask = 1ul << node;
+    syscall(SYS_mbind, p, bytes, MPOL_BIND_MODE, &nodemask, 8*sizeof(nodemask), 0);
+    return static_cast<uint64_t *>(p);
+#else
+    (void) node;
+    return static_cast<uint64_t *>(std::malloc(bytes));
+#endif
+}
+
+static void
+release(uint64_t *p, size_t bytes) {
+#ifdef DSA_TARGET_LINUX
+    munmap(p, bytes);
+#else
+    (void) bytes;
+    std::free(p);
+#endif
+}
+
+static Cell
+measure(size_t cpu_node, size_t mem_node, size_t bytes) {
+    const NumaTopology &topology = NumaTopology::instance();
+    pin_current_thread(topology.cpus(cpu_node).front());
+
+    const size_t n = bytes / sizeof(uint64_t);
+    uint64_t *data = allocate_on(bytes, mem_node);
+    if (!data) {
+        std::cerr << "could not allocate " << bytes << " bytes" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    //a single random cycle through one slot per cache line defeats the prefetchers
+    const size_t stride = 64 / sizeof(uint64_t);
+    const size_t slots  = n / stride;
+    std::vector<size_t> order(slots);
+    std::iota(order.begin(), order.end(), size_t(0));
+    std::shuffle(order.begin() + 1, order.end(), std::mt19937_64(42));
+    for (size_t i=0; i<n; ++i) data[i] = i;
+    for (size_t i=0; i<slots; ++i) data[order[i] * stride] = order[(i + 1) % slots] * stride;
+
+    using clock = std::chrono::steady_clock;
+    Cell cell;
+
+    //streaming: best of three passes
+    double best = 1e30;
+    volatile uint64_t sink = 0;
+    for (int pass=0; pass<3; ++pass) {
+        const auto start = clock::now();
+        uint64_t sum = 0;
+        for (size_t i=0; i<n; ++i) sum += data[i];
+        sink = sink + sum;
+        best = std::min(best, std::chrono::duration<double>(clock::now() - start).count());
+    }
+    cell.gb_per_s = bytes / best * 1e-9;
+
+    //latency: each load depends on the previous one
+    const size_t hops = std::min<size_t>(slots, 1 << 22);
+    const auto start = clock::now();
+    size_t at = 0;
+    for (size_t i=0; i<hops; ++i) at = data[at];
+    sink = sink + at;
+    cell.ns_per_hop = std::chrono::duration<double, std::nano>(clock::now() - start).count() / hops;
+
+    release(data, bytes);
+    return cell;
+}
+
+int
+main(int argc, char **argv) {
+    const size_t megabytes = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 256;
+    if (megabytes == 0) {
+        std::cerr << "usage: " << argv[0] << " [megabytes]" << std::endl;
+        return EXIT_FAILURE;
+    }
+    const size_t bytes = megabytes << 20;
+
+    const NumaTopology &topology = NumaTopology::instance();
+    std::vector<size_t> nodes;
+    for (size_t n=0; n<topology.nodes(); ++n) if (!topology.cpus(n).empty()) nodes.push_back(n);
+
+    std::cout << "NUMA nodes with CPUs: " << nodes.size() << ", buffer " << megabytes << " MiB\n";
+    if (nodes.size() < 2) std::cout << "(single node: every access is local)\n";
+
+    std::vector<std::vector<Cell>> cells(nodes.size(), std::vector<Cell>(nodes.size()));
+    for (size_t c=0; c<nodes.size(); ++c) {
+        for (size_t m=0; m<nodes.size(); ++m) cells[c][m] = measure(nodes[c], nodes[m], bytes);
+    }
+
+    auto table = [&](const char *title, auto value) {
+        std::cout << '\n' << title << " (rows: CPU node, columns: memory node)\n" << std::setw(8) << "";
+        for (size_t m : nodes) std::cout << std::setw(10) << m;
+        std::cout << '\n';
+        for (size_t c=0; c<nodes.size(); ++c) {
+            std::cout << std::setw(8) << nodes[c];
+            for (size_t m=0; m<nodes.size(); ++m) std::cout << std::setw(10) << std::fixed << std::setprecision(2) << value(cells[c][m]);
+            std::cout << '\n';
+        }
+    };
+    table("read bandwidth, GB/s", [](const Cell &cell) { return cell.gb_per_s; });
+    table("load latency, ns", [](const Cell &cell) { return cell.ns_per_hop; });
+
+    if (nodes.size() > 1) {
+        double local = 0.0, remote = 0.0;
+        for (size_t c=0; c<nodes.size(); ++c) {
+            for (size_t m=0; m<nodes.size(); ++m) (c == m ? local : remote) += cells[c][m].ns_per_hop;
+        }
+        local  /= nodes.size();
+        remote /= nodes.size() * (nodes.size() - 1);
+        std::cout << "\nremote/local latency: " << std::setprecision(2) << remote / local << '\n';
+    }
+    return EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,66 @@
+#!/bin/sh
+# End-to-end scaling benchmark: simulate libraries of increasing size with
+# dsa-simulate, run dsa over each with increasing thread counts and print
+# wall time, throughput and peak resident memory as a TSV table.
+#
+# usage: bench/scaling.sh [-d DSA] [-s DSA_SIMULATE] [-w WORKDIR] [-n "READ_PAIRS ..."] [-t "THREADS ..."]
+#
+# Libraries are cached in WORKDIR and reused by later runs with the same size.
+# The template and references are those of example/dsa-command-linux.sh.
+
+DSA=bin/dsa
+SIMULATE=bench/dsa-simulate
+WORKDIR=scaling
+SIZES="1000000 10000000 100000000"
+THREADS="1 2 4 8"
+
+while getopts "d:s:w:n:t:h" opt; do
+    case $opt in
+        d) DSA=$OPTARG ;;
+        s) SIMULATE=$OPTARG ;;
+        w) WORKDIR=$OPTARG ;;
+        n) SIZES=$OPTARG ;;
+        t) THREADS=$OPTARG ;;
+        *) sed -n '2,9s/^# \{0,1\}//p' "$0"; exit 1 ;;
+    esac
+done
+
+for exe in "$DSA" "$SIMULATE"; do
+    if [ ! -x "$exe" ]; then
+        echo "'$exe' not found; build it with 'make release bench'" >&2
+        exit 1
+    fi
+done
+
+FW_REF=TACnnnnnnAGTnnnnnnCGNNNNNNNNNNNGTCCTCTCT
+RV_REF=CCCnnnnnnnnnACGACAAN
+TEMPLATE=AAGAAAGTGGTGTTGGCCAAAAAAGGCGATACCGTGGAGCTGACCTGCACCGCAAGCCAGAAGAAGAACATCCAGTTCCACTGGAAGAACTCCAACCAGATCAAGATCCTGGGCAACCAGGGCAGCTTCTTGACCAAGGGACCTAGCAAGCTGAATGACAGAGTGGACTCTCGGAGGAGCCTGTGGGATCAAGGCAACTTCCCTCTGATCATAAAAAACCTGAAGATAGAGGATAGTGATACCTACATCTGTGAAGTGGAAGATCAGAAGGAGGAAGTGCAGCTGCTGGTGTTCGGGCTGACTGCTAACTCCGATACCCATCTGCTGCAGGGGCAGAGCCTAACACTGACACTGGAGAGCCCTCCTGGCAGCAGCCCAAGCCTGCAATGCCGCAGCCCTGGAGGCAAGAACATCCAAGGTGGCAAAACCCTTTCTGTCAGCCAGCTGGAACTGCAGGATTCTGGAACCTGGACATGTACAGTGCTGCAGGATCAGAAAACCTTGGAGTTCAAGATTGAT
+
+mkdir -p "$WORKDIR" || exit 1
+
+# one value of the profile json written by dsa --profile
+json_value() {
+    sed -n "s/^ *\"$2\": *\([0-9.]*\).*/\1/p" "$1" | head -n 1
+}
+
+printf 'read_pairs\tthreads\twall_seconds\tread_pairs_per_second\tpeak_rss_bytes\n'
+for n in $SIZES; do
+    lib="$WORKDIR/sim_$n"
+    if [ ! -f "$lib.truth.tsv" ]; then
+        "$SIMULATE" --template_dna="$TEMPLATE" -f "$FW_REF" -r "$RV_REF" -n "$n" -o "$lib" || exit 1
+    fi
+    for t in $THREADS; do
+        out="$WORKDIR/dsa_${n}_$t.csv"
+        start=$(date +%s.%N)
+        "$DSA" -g 2 -c horizontal -f "$FW_REF" -r "$RV_REF" --template_dna="$TEMPLATE" \
+            --threads="$t" --profile -o "$out" "${lib}_R1.fastq" "${lib}_R2.fastq" 2> "$out.log" || {
+            echo "dsa failed; see $out.log" >&2
+            exit 1
+        }
+        end=$(date +%s.%N)
+        pairs=$(json_value "$out.profile.json" read_pairs)
+        rss=$(json_value "$out.profile.json" peak_rss_bytes)
+        awk -v n="$pairs" -v t="$t" -v s="$start" -v e="$end" -v rss="$rss" \
+            'BEGIN { w = e - s; printf "%d\t%d\t%.3f\t%.0f\t%s\n", n, t, w, (w > 0 ? n / w : 0), rss }'
+    done
+done
@@ -0,0 +1,373 @@
+/*
+Copyright 2024, The Broad Institute of MIT and Harvard
+
+Original Author: Charles C Bailey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/** dsa-simulate: a synthetic amplicon library as paired fastq files, with
+  * the ground truth that dsa should recover from them.
+  *
+  * Each molecule of the library is one of --variants variants of the
+  * template (the first is the template itself, the others carry random
+  * substitutions and indels), flanked by the -f and -r references with
+  * their UMI (n) and wildcard (N) positions filled in at random. Every
+  * molecule is sequenced as a UMI family of read pairs whose size is drawn
+  * from --family_distribution. Read qualities fall linearly from
+  * --quality_start at the first cycle to --quality_end at the last, with
+  * some noise, and each base is miscalled with the probability its quality
+  * gives. Runs are reproducible: the same options and --seed give the same
+  * files.
+  *
+  * usage: dsa-simulate --template_dna=DNA -f FW_REF -r RV_REF [options]
+  */
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../aa.h"
+#include "../cdn.h"
+#include "../defines.h"
+#include "../dna.h"
+
+#ifdef DSA_TARGET_WIN64
+#include "../local-getopt.h"
+#elif defined(DSA_TARGET_LINUX)
+#include <getopt.h>
+#endif
+
+using namespace bio;
+
+struct Options {
+    std::string template_dna;
+    std::string fw_ref, rv_ref;
+    std::string output_prefix       = "simulated";
+    size_t      read_pairs          = 1000000;
+    size_t      read_length         = 300;
+    size_t      variants            = 1000;
+    double      substitution_rate   = 0.005; //per nucleotide of a variant
+    double      transition_fraction = 0.67;  //of substitutions; the rest are transversions
+    double      indel_rate          = 0.0;   //per nucleotide of a variant, 1-3 nt each
+    std::string family_distribution = "geometric";
+    double      family_mean         = 3.0;
+    int         quality_start       = 38;
+    int         quality_end         = 33;
+    int         quality_noise       = 2;
+    uint64_t    seed                = 1;
+};
+
+static void
+print_usage(std::ostream &os) {
+    const Options defaults;
+    os << "dsa-simulate " << VERSION_STRING << ": write a synthetic amplicon library as paired fastq files\n\n"
+       << "usage: dsa-simulate --template_dna=DNA -f FW_REF -r RV_REF [options]\n\n"
+       << "  -t, --template_dna         the in-frame coding sequence the variants are made from\n"
+       << "  -f, --fw_ref               forward reference as for dsa: ACGT literal, N wildcard, n UMI\n"
+       << "  -r, --rv_ref               reverse reference, likewise\n"
+       << "  -o, --output               prefix of PREFIX_R1.fastq, PREFIX_R2.fastq and PREFIX.truth.tsv (default=" << defaults.output_prefix << ")\n"
+       << "  -n, --read_pairs           read pairs to write (default=" << defaults.read_pairs << ")\n"
+       << "  -l, --read_length          cycles per read (default=" << defaults.read_length << ")\n"
+       << "      --variants             distinct variants in the library, the template included (default=" << defaults.variants << ")\n"
+       << "      --substitution_rate    substitutions per nucleotide of a variant (default=" << defaults.substitution_rate << ")\n"
+       << "      --transition_fraction  fraction of substitutions that are transitions (default=" << defaults.transition_fraction << ")\n"
+       << "      --indel_rate           insertions or deletions of 1-3 nt per nucleotide of a variant (default=" << defaults.indel_rate << ")\n"
+       << "      --family_distribution  UMI family sizes: geometric, poisson or fixed (default=" << defaults.family_distribution << ")\n"
+       << "      --family_mean          mean read pairs per UMI family, at least 1 (default=" << defaults.family_mean << ")\n"
+       << "      --quality_start        phred quality of the first cycle (default=" << defaults.quality_start << ")\n"
+       << "      --quality_end          phred quality of the last cycle (default=" << defaults.quality_end << ")\n"
+       << "      --quality_noise        qualities vary by up to this much either way (default=" << defaults.quality_noise << ")\n"
+       << "      --seed                 random seed (default=" << defaults.seed << ")\n\n"
+       << "PREFIX.truth.tsv lists every variant with the molecules (UMI families) and read pairs\n"
+       << "written for it, its translation and its DNA. Sequencing errors are not in the truth.\n"
+       << "Note that dsa trims 3' bases below --min_qual (default 'A', phred 32)." << std::endl;
+}
+
+static void
+fail(const std::string &message) {
+    std::cerr << message << std::endl;
+    exit (EXIT_FAILURE);
+}
+
+static Options
+parse_options(int argc, char **argv) {
+    Options o;
+    const char *opt_chars = "t:f:r:o:n:l:h";
+
+    static struct option long_options[] = {
+        {"template_dna",        required_argument, 0, 't'},
+        {"fw_ref",              required_argument, 0, 'f'},
+        {"rv_ref",              required_argument, 0, 'r'},
+        {"output",              required_argument, 0, 'o'},
+        {"read_pairs",          required_argument, 0, 'n'},
+        {"read_length",         required_argument, 0, 'l'},
+        {"variants",            required_argument, 0,  0 },
+        {"substitution_rate",   required_argument, 0,  0 },
+        {"transition_fraction", required_argument, 0,  0 },
+        {"indel_rate",          required_argument, 0,  0 },
+        {"family_distribution", required_argument, 0,  0 },
+        {"family_mean",         required_argument, 0,  0 },
+        {"quality_start",       required_argument, 0,  0 },
+        {"quality_end",         required_argument, 0,  0 },
+        {"quality_noise",       required_argument, 0,  0 },
+        {"seed",                required_argument, 0,  0 },
+        {"help",                no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    auto number = [](const char *name, const char *arg, double lo, double hi)->double {
+        char *end = nullptr;
+        const double x = std::strtod(arg, &end);
+        if (end == arg || *end || x < lo || x > hi) {
+            fail(std::string(name) + " must be a number in [" + std::to_string(lo) + ", " + std::to_string(hi) + "]");
+        }
+        return x;
+    };
+
+    for (;;) {
+        int option_index = 0;
+        int c = getopt_long(argc, argv, opt_chars, long_options, &option_index);
+        if (c == -1) break;
+        switch (c) {
+            case 0: {
+                const std::string name = long_options[option_index].name;
+                if      (name == "variants")            o.variants            = static_cast<size_t>(number("variants", optarg, 1, 1e9));
+                else if (name == "substitution_rate")   o.substitution_rate   = number("substitution_rate", optarg, 0, 1);
+                else if (name == "transition_fraction") o.transition_fraction = number("transition_fraction", optarg, 0, 1);
+                else if (name == "indel_rate")          o.indel_rate          = number("indel_rate", optarg, 0, 1);
+                else if (name == "family_distribution") o.family_distribution = optarg;
+                else if (name == "family_mean")         o.family_mean         = number("family_mean", optarg, 1, 1e6);
+                else if (name == "quality_start")       o.quality_start       = static_cast<int>(number("quality_start", optarg, 2, 41));
+                else if (name == "quality_end")         o.quality_end         = static_cast<int>(number("quality_end", optarg, 2, 41));
+                else if (name == "quality_noise")       o.quality_noise       = static_cast<int>(number("quality_noise", optarg, 0, 20));
+                else if (name == "seed")                o.seed                = static_cast<uint64_t>(number("seed", optarg, 0, 1e18));
+                break;
+            }
+            case 't': o.template_dna  = optarg; break;
+            case 'f': o.fw_ref        = optarg; break;
+            case 'r': o.rv_ref        = optarg; break;
+            case 'o': o.output_prefix = optarg; break;
+            case 'n': o.read_pairs    = static_cast<size_t>(number("read_pairs", optarg, 1, 1e12)); break;
+            case 'l': o.read_length   = static_cast<size_t>(number("read_length", optarg, 1, 100000)); break;
+            case 'h':
+                print_usage(std::cout);
+                exit (EXIT_SUCCESS);
+            default:
+                print_usage(std::cerr);
+                exit (EXIT_FAILURE);
+        }
+    }
+
+    if (o.template_dna.empty() || o.fw_ref.empty() || o.rv_ref.empty()) {
+        print_usage(std::cerr);
+        exit (EXIT_FAILURE);
+    }
+    for (char &c : o.template_dna) c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+    if (o.template_dna.find_first_not_of("ACGT") != std::string::npos) fail("template_dna must contain only A, C, G and T");
+    if (o.fw_ref.find_first_not_of("ACGTNn") != std::string::npos) fail("fw_ref must contain only A, C, G, T, N and n");
+    if (o.rv_ref.find_first_not_of("ACGTNn") != std::string::npos) fail("rv_ref must contain only A, C, G, T, N and n");
+    if (o.family_distribution != "geometric" && o.family_distribution != "poisson" && o.family_distribution != "fixed") {
+        fail("family_distribution must be one of 'geometric', 'poisson' or 'fixed'");
+    }
+    return o;
+}
+
+static const char ACGT[] = "ACGT";
+
+static char
+complement(char c) {
+    switch (c) {
+        case 'A': return 'T';
+        case 'C': return 'G';
+        case 'G': return 'C';
+        case 'T': return 'A';
+        default:  return 'N';
+    }
+}
+
+static std::string
+reverse_complement(const std::string &dna) {
+    std::string rc(dna.rbegin(), dna.rend());
+    for (char &c : rc) c = complement(c);
+    return rc;
+}
+
+/** The template with random substitutions and indels. */
+static std::string
+make_variant(const std::string &tpl, const Options &o, std::mt19937_64 &rng) {
+    std::uniform_real_distribution<double> uniform;
+    static const std::array<char, 4> TRANSITION = {'G', 'T', 'A', 'C'}; //of A, C, G, T
+    std::string variant;
+    variant.reserve(tpl.size() + 16);
+    for (size_t i = 0; i < tpl.size(); ++i) {
+        if (o.indel_rate > 0.0 && uniform(rng) < o.indel_rate) {
+            const size_t n = 1 + rng() % 3;
+            if (rng() % 2) {
+                i += n - 1; //deletion
+                continue;
+            }
+            for (size_t j = 0; j < n; ++j) variant += ACGT[rng() % 4]; //insertion
+        }
+        char c = tpl[i];
+        if (uniform(rng) < o.substitution_rate) {
+            const size_t k = std::strchr(ACGT, c) - ACGT;
+            if (uniform(rng) < o.transition_fraction) {
+                c = TRANSITION[k];
+            } else {
+                //the two transversions of c are the bases that are neither c nor its transition
+                char t;
+                do t = ACGT[rng() % 4]; while (t == c || t == TRANSITION[k]);
+                c = t;
+            }
+        }
+        variant += c;
+    }
+    return variant;
+}
+
+/** ref with its n and N positions filled in. */
+static std::string
+instantiate(const std::string &ref, std::mt19937_64 &rng) {
+    std::string s = ref;
+    for (char &c : s) if (c == 'n' || c == 'N') c = ACGT[rng() % 4];
+    return s;
+}
+
+/** Writes reads with per-cycle qualities and the sequencing errors they imply. */
+class Sequencer {
+public:
+    Sequencer(const Options &o) : o_(o), base_quality_(o.read_length) {
+        for (size_t i = 0; i < o.read_length; ++i) {
+            const double f = o.read_length > 1 ? double(i) / (o.read_length - 1) : 0.0;
+            base_quality_[i] = static_cast<int>(std::lround(o.quality_start + (o.quality_end - o.quality_start) * f));
+        }
+        for (int q = 0; q < 42; ++q) error_[q] = std::pow(10.0, -q / 10.0);
+    }
+
+    /** Append a fastq record for the first read_length bases of insert to out. */
+    void read(std::string &out, const std::string &name, const std::string &insert, std::mt19937_64 &rng) const {
+        const size_t n = std::min(o_.read_length, insert.size());
+        out += '@';
+        out += name;
+        out += '\n';
+        const size_t seq = out.size();
+        out.append(insert, 0, n);
+        out += "\n+\n";
+        const size_t qual = out.size();
+        out.append(n, '!');
+        out += '\n';
+
+        const uint64_t span = 2 * o_.quality_noise + 1;
+        for (size_t i = 0; i < n; ++i) {
+            //one draw per base: the low bits for the noise, the high 53 for the miscall
+            const uint64_t r = rng();
+            const int q = std::clamp(base_quality_[i] + static_cast<int>(r % span) - o_.quality_noise, 2, 41);
+            out[qual + i] = static_cast<char>('!' + q);
+            if ((r >> 11) * 0x1.0p-53 < error_[q]) {
+                const char c = out[seq + i];
+                char e;
+                do e = ACGT[rng() % 4]; while (e == c);
+                out[seq + i] = e;
+            }
+        }
+    }
+
+private:
+    const Options &o_;
+    std::vector<int> base_quality_;
+    double error_[42];
+};
+
+int
+main(int argc, char **argv) {
+    const Options o = parse_options(argc, argv);
+    std::mt19937_64 rng(o.seed);
+
+    std::vector<std::string> variants{o.template_dna};
+    for (size_t v = 1; v < o.variants; ++v) variants.push_back(make_variant(o.template_dna, o, rng));
+    std::vector<size_t> molecules(o.variants), read_pairs(o.variants);
+
+    std::geometric_distribution<size_t> geometric(1.0 / o.family_mean);
+    std::poisson_distribution<size_t>   poisson(o.family_mean - 1.0);
+    auto family_size = [&]()->size_t {
+        if (o.family_distribution == "geometric") return 1 + geometric(rng);
+        if (o.family_distribution == "poisson")   return 1 + (o.family_mean > 1.0 ? poisson(rng) : 0);
+        return static_cast<size_t>(std::lround(o.family_mean));
+    };
+
+    const std::string r1_filename = o.output_prefix + "_R1.fastq";
+    const std::string r2_filename = o.output_prefix + "_R2.fastq";
+    std::ofstream r1(r1_filename, std::ios::binary), r2(r2_filename, std::ios::binary);
+    if (!r1) fail("could not open '" + r1_filename + "' for writing");
+    if (!r2) fail("could not open '" + r2_filename + "' for writing");
+
+    const Sequencer sequencer(o);
+    std::string out1, out2;
+    size_t pairs = 0, molecule = 0;
+    while (pairs < o.read_pairs) {
+        const size_t v = rng() % o.variants;
+        const std::string insert = instantiate(o.fw_ref, rng) + variants[v] + reverse_complement(instantiate(o.rv_ref, rng));
+        const std::string rc_insert = reverse_complement(insert);
+        ++molecules[v];
+
+        const size_t family = family_size();
+        for (size_t k = 0; k < family && pairs < o.read_pairs; ++k, ++pairs) {
+            const std::string name = "sim:" + std::to_string(pairs) + ":" + std::to_string(molecule) + ":" + std::to_string(v);
+            sequencer.read(out1, name + " 1", insert, rng);
+            sequencer.read(out2, name + " 2", rc_insert, rng);
+            ++read_pairs[v];
+        }
+        ++molecule;
+
+        if (out1.size() > (1 << 20)) {
+            r1.write(out1.data(), out1.size());
+            r2.write(out2.data(), out2.size());
+            out1.clear();
+            out2.clear();
+        }
+    }
+    r1.write(out1.data(), out1.size());
+    r2.write(out2.data(), out2.size());
+    if (!r1.flush() || !r2.flush()) fail("could not write the fastq files");
+
+    const std::string truth_filename = o.output_prefix + ".truth.tsv";
+    std::ofstream truth(truth_filename);
+    if (!truth) fail("could not open '" + truth_filename + "' for writing");
+    truth << "#read pairs\t" << pairs << '\n'
+          << "#molecules\t" << molecule << '\n'
+          << "Variant\tMolecules\tRead Pairs\tAmino Acids\tDNA\n";
+    for (size_t v = 0; v < o.variants; ++v) {
+        const Aas aas(Cdns(Nts(variants[v])));
+        truth << v << '\t' << molecules[v] << '\t' << read_pairs[v] << '\t' << aas.as_string_view() << '\t' << variants[v] << '\n';
+    }
+    if (!truth.flush()) fail("could not write '" + truth_filename + "'");
+
+    std::cerr << "wrote " << pairs << " read pairs of " << molecule << " molecules to "
+              << r1_filename << " and " << r2_filename << std::endl;
+    return EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -93,6 +93,16 @@ const Cdn Cdn::GAA = Cdn('`');
 const Cdn Cdn::TCT = Cdn('V');
 
 const std::string Cdn::valid_chars = "0123456789:;<=>?@ABCDEFGHIJKLMNOPQRSTUVWXYZ[\\]^_`abcdefghijklmno";
+size_t
+Cdn::normalize(char *dst, const char *src, size_t n) {
+    //the codes run from AAA ('0') to GGG ('o'); signed compares reject bytes over 0x7F
+    const __m256i below = _mm256_set1_epi8(BIAS - 1), above = _mm256_set1_epi8(BIAS + 64);
+    return mm256_normalize(dst, src, n, [&](__m256i &v)->uint32_t {
+        const __m256i valid = _mm256_and_si256(_mm256_cmpgt_epi8(v, below), _mm256_cmpgt_epi8(above, v));
+        return static_cast<uint32_t>(_mm256_movemask_epi8(valid));
+    }, normalize_char);
+}
+
 const Cdns Cdns::all(Cdn::valid_chars);
 const Cdns Cdns::all_coding("0123456789:;<=>?@ABCDEFGHIJKLMNOQRTUVWXYZ[]^_`abcdefghijklmno");
 
@@ -204,48 +214,53 @@ mm256_pack_cdns(char *dst, const char *src, size_t len) {
     }
 }
 
-Cdns::Cdns(const Nts &dna) {
-    clear();
-    resize(dna.size()/3);
-    mm256_pack_cdns(data(), dna.c_data(), dna.size());
+namespace {
+
+/** Bytes mm256_pack_cdns() writes for len nucleotides. */
+size_t
+packed_size(size_t len) {
+    return (len + 29) / 30 * 10;
+}
+
+}; //namespace
+
+Cdns::Cdns(NtsView dna) {
+    *this = dna;
 }
 
 Cdns &
-Cdns::operator=(const Nts &dna) {
+Cdns::operator=(NtsView dna) {
     clear();
     resize(dna.size()/3);
     mm256_pack_cdns(data(), dna.c_data(), dna.size());
+    zero_tail(packed_size(dna.size()));
     return *this;
 }
 
 Cdns::Cdns(Nts &&dna) {
-    swap_buffers(dna);
-    mm256_pack_cdns(data(), c_data(), size());
-    resize(size()/3);
+    *this = std::move(dna);
 }
 
 Cdns &
 Cdns::operator=(Nts &&dna) {
     swap_buffers(dna);
-    mm256_pack_cdns(data(), c_data(), size());
-    resize(size()/3);
+    const size_t len = size();
+    mm256_pack_cdns(data(), c_data(), len);
+    resize(len/3);
+    zero_tail(std::max(len, packed_size(len)));
     return *this;
 }
 
 Cdns &
 Cdns::operator=(const char *s) {
-    clear();
-    for ( ; *s; ++s) {
-        char c = Cdn::normalize_char(*s);
-        if (c) push_back(c);
-    }
+    assign(s, std::strlen(s));
     return *this;
 }
 
 Cdns &
 Cdns::operator=(const std::string &s) {
-    reserve(s.size());
-    return *this = s.c_str();
+    assign(s.data(), s.size());
+    return *this;
 }
 
 Nts
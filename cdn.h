@@ -155,6 +155,9 @@ public:
     /** Returns c if c represents a valid codon or 0 otherwise */
     static char normalize_char(char c) { return (AAA.v <= c && c <= GGG.v) ? c : 0; }
 
+    /** Vectorized normalize_char() over n chars (see mm256_normalize()) @return the number of valid chars written to dst */
+    static size_t normalize(char *dst, const char *src, size_t n);
+
     static std::optional<Cdn> from_char(char c) {
         std::optional<Cdn> oc; 
         if (normalize_char(c)) oc = Cdn(c);
@@ -175,6 +178,13 @@ private:
     char v = 0x30;
 };
 
+/** Pack the len nucleotides at src into len/3 codons at dst, which may be
+  * src (see Cdns(const Nts &)). Reads and writes whole registers, so both
+  * need the padding of a Polymer's buffer.
+  */
+void
+mm256_pack_cdns(char *dst, const char *src, size_t len);
+
 class Cdns : public Polymer<Cdn> {
 public:
     static const Cdns all;
@@ -190,8 +200,11 @@ public:
 
     Cdns(Polymer &&p) : Polymer(std::move(p)) {}
 
-    Cdns(const Nts &dna);
-    Cdns &operator=(const Nts &dna);
+    Cdns(const Nts &dna) : Cdns(NtsView(dna)) {}
+    Cdns &operator=(const Nts &dna) { return *this = NtsView(dna); }
+
+    explicit Cdns(NtsView dna);
+    Cdns &operator=(NtsView dna);
 
     Cdns(Nts &&dna);
     Cdns &operator=(Nts &&dna);
@@ -205,6 +218,8 @@ public:
     Nts to_nts() const;
 };
 
+using CdnsView = PolymerView<Cdn>; ///< A view of a Cdns or of a slice of one.
+
 };
 
 template<>
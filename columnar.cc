@@ -0,0 +1,329 @@
+/*
+Copyright 2024, The Broad Institute of MIT and Harvard
+
+Original Author: Charles C Bailey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "columnar.h"
+
+#include <algorithm>
+#include <cctype>
+
+namespace bio {
+
+static constexpr char BARCODE_CHARS[] = "ACGTN";
+
+static void
+push_op(std::string &ops, AlignmentOp op, size_t run) {
+    while (run) {
+        const size_t n = std::min<size_t>(run, 64);
+        ops.push_back(static_cast<char>((static_cast<uint8_t>(op) << 6) | (n - 1)));
+        run -= n;
+    }
+}
+
+static AlignmentOp
+op_of(char c) {
+    if (c == '-')           return AlignmentOp::Deletion;
+    if (std::islower(c))    return AlignmentOp::Insertion;
+    return AlignmentOp::Match;
+}
+
+void
+encode_alignment(std::string_view alignment, std::string &ops, std::string &residues) {
+    size_t run = 0;
+    AlignmentOp cur = AlignmentOp::Match;
+    for (char c : alignment) {
+        AlignmentOp op = op_of(c);
+        if (op != cur) {
+            push_op(ops, cur, run);
+            cur = op;
+            run = 0;
+        }
+        ++run;
+        if (op != AlignmentOp::Deletion) residues.push_back(c);
+    }
+    push_op(ops, cur, run);
+}
+
+std::string
+decode_alignment(std::string_view ops, std::string_view residues) {
+    std::string out;
+    const char *r = residues.data(), *end = r + residues.size();
+    for (char c : ops) {
+        const uint8_t op = static_cast<uint8_t>(c);
+        const size_t n = (op & 0x3F) + 1;
+        if (static_cast<AlignmentOp>(op >> 6) == AlignmentOp::Deletion) {
+            out.append(n, '-');
+        } else {
+            const size_t m = std::min<size_t>(n, end - r);
+            out.append(r, m);
+            r += m;
+        }
+    }
+    return out;
+}
+
+std::string
+decode_codons(std::string_view ops, std::string_view codons) {
+    std::string out;
+    const char *r = codons.data(), *end = r + codons.size();
+    for (char c : ops) {
+        const uint8_t op = static_cast<uint8_t>(c);
+        const size_t n = (op & 0x3F) + 1;
+        if (static_cast<AlignmentOp>(op >> 6) == AlignmentOp::Deletion) {
+            out.append(n, ' ');
+        } else {
+            const size_t m = std::min<size_t>(n, end - r);
+            out.append(r, m);
+            r += m;
+        }
+    }
+    return out;
+}
+
+void
+pack_barcode(std::string_view barcode, std::string &out) {
+    //each base is stored as its index into ACGTN in one nibble, low nibble first
+    uint8_t byte = 0;
+    for (size_t i=0; i<barcode.size(); ++i) {
+        const char *p = std::strchr(BARCODE_CHARS, std::toupper(barcode[i]));
+        uint8_t code = (p && *p) ? static_cast<uint8_t>(p - BARCODE_CHARS) : 4;
+        if (i % 2 == 0) {
+            byte = code;
+        } else {
+            out.push_back(static_cast<char>(byte | (code << 4)));
+        }
+    }
+    if (barcode.size() % 2) out.push_back(static_cast<char>(byte));
+}
+
+std::string
+unpack_barcode(const uint8_t *packed, size_t first, size_t n) {
+    std::string out(n, 'N');
+    for (size_t i=0; i<n; ++i) {
+        const size_t j = first + i;
+        const uint8_t code = (packed[j / 2] >> (4 * (j % 2))) & 0x0F;
+        if (code < 5) out[i] = BARCODE_CHARS[code];
+    }
+    return out;
+}
+
+ColumnarWriter::ColumnarWriter(const fs::path &path)
+    : os_(path, std::ios::binary | std::ios::trunc) {
+    if (!os_) throw BadColumnarFile("could not open '" + path.string() + "' for writing");
+    const uint32_t header[2] = {ColumnarFormat::VERSION, 0};
+    os_.write(ColumnarFormat::HEADER_MAGIC, sizeof(ColumnarFormat::HEADER_MAGIC));
+    os_.write(reinterpret_cast<const char *>(header), sizeof(header));
+    pos_ = sizeof(ColumnarFormat::HEADER_MAGIC) + sizeof(header);
+}
+
+ColumnarWriter::~ColumnarWriter() {
+    if (os_.is_open()) {
+        try { close(); } catch (...) {}
+    }
+}
+
+void
+ColumnarWriter::pad() {
+    static const char zeros[8] = {};
+    const size_t n = (8 - pos_ % 8) % 8;
+    os_.write(zeros, n);
+    pos_ += n;
+}
+
+void
+ColumnarWriter::add(const std::string &name, ColumnType type,
+                    const void *data, size_t bytes, size_t rows, size_t cols) {
+    if (name.size() >= ColumnIndexEntry::NAME_SIZE) throw BadColumnarFile("column name too long: '" + name + "'");
+
+    pad();
+    ColumnIndexEntry e;
+    std::memcpy(e.name, name.data(), name.size());
+    e.type   = type;
+    e.offset = pos_;
+    e.bytes  = bytes;
+    e.rows   = rows;
+    e.cols   = cols;
+    index_.push_back(e);
+
+    os_.write(static_cast<const char *>(data), bytes);
+    pos_ += bytes;
+    if (!os_) throw BadColumnarFile("error writing column '" + name + "'");
+}
+
+void
+ColumnarWriter::add_strings(const std::string &name, const std::vector<std::string_view> &values) {
+    std::vector<uint64_t> offsets;
+    offsets.reserve(values.size() + 1);
+    offsets.push_back(0);
+    for (std::string_view v : values) offsets.push_back(offsets.back() + v.size());
+
+    add(name + ".offsets", offsets, offsets.size());
+
+    pad();
+    ColumnIndexEntry e;
+    std::memcpy(e.name, name.data(), std::min(name.size(), ColumnIndexEntry::NAME_SIZE - 1));
+    e.type   = ColumnType::Bytes;
+    e.offset = pos_;
+    e.bytes  = offsets.back();
+    e.rows   = values.size();
+    e.cols   = 1;
+    index_.push_back(e);
+
+    for (std::string_view v : values) os_.write(v.data(), v.size());
+    pos_ += offsets.back();
+    if (!os_) throw BadColumnarFile("error writing column '" + name + "'");
+}
+
+void
+ColumnarWriter::close() {
+    pad();
+    const uint64_t trailer[2] = {pos_, index_.size()};
+    os_.write(reinterpret_cast<const char *>(index_.data()), index_.size() * sizeof(ColumnIndexEntry));
+    os_.write(reinterpret_cast<const char *>(trailer), sizeof(trailer));
+    os_.write(ColumnarFormat::TRAILER_MAGIC, sizeof(ColumnarFormat::TRAILER_MAGIC));
+    os_.close();
+    if (os_.fail()) throw BadColumnarFile("error writing columnar index");
+}
+
+bool
+ColumnarFile::is_columnar(const char *data, size_t size) {
+    return size >= sizeof(ColumnarFormat::HEADER_MAGIC)
+        && std::memcmp(data, ColumnarFormat::HEADER_MAGIC, sizeof(ColumnarFormat::HEADER_MAGIC)) == 0;
+}
+
+ColumnarFile::ColumnarFile(ConstMapping &&map)
+    : map_(std::move(map)) {
+    const char  *data = map_.c_str();
+    const size_t size = map_.size();
+    const size_t trailer_size = 2 * sizeof(uint64_t) + sizeof(ColumnarFormat::TRAILER_MAGIC);
+
+    if (!is_columnar(data, size) || size < 16 + trailer_size) {
+        throw BadColumnarFile("not a dsa columnar file");
+    }
+
+    const char *trailer = data + size - trailer_size;
+    if (std::memcmp(trailer + 2 * sizeof(uint64_t), ColumnarFormat::TRAILER_MAGIC, sizeof(ColumnarFormat::TRAILER_MAGIC)) != 0) {
+        throw BadColumnarFile("columnar file is truncated (missing index)");
+    }
+
+    uint64_t index_offset = 0, count = 0;
+    std::memcpy(&index_offset, trailer, sizeof(uint64_t));
+    std::memcpy(&count, trailer + sizeof(uint64_t), sizeof(uint64_t));
+    if (index_offset % 8 != 0 || index_offset + count * sizeof(ColumnIndexEntry) != size - trailer_size) {
+        throw BadColumnarFile("columnar file index is corrupt");
+    }
+
+    index_ = std::span<const ColumnIndexEntry>(reinterpret_cast<const ColumnIndexEntry *>(data + index_offset), count);
+    for (const ColumnIndexEntry &e : index_) {
+        if (e.bytes > index_offset || e.offset > index_offset - e.bytes || e.name[ColumnIndexEntry::NAME_SIZE-1] != 0) {
+            throw BadColumnarFile("columnar file index is corrupt");
+        }
+    }
+
+    //look up the alignment columns and check their offsets here so that reading a row needs neither
+    if (!find("aln.template")) return;
+    aln_template_   = column<uint32_t>("aln.template");
+    aln_group_size_ = column<uint32_t>("aln.group_size");
+    const size_t n = aln_template_.size();
+    if (aln_group_size_.size() != n) throw BadColumnarFile("wrong number of rows in column 'aln.group_size'");
+    aln_barcode_         = column<uint8_t>("aln.barcode");
+    aln_barcode_offsets_ = offsets("aln.barcode", n, 2 * aln_barcode_.size()); //offsets count bases, two per byte
+    aln_ops_             = strings("aln.ops", n);
+    aln_residues_        = strings("aln.residues", n);
+    aln_codons_          = strings("aln.codons", n);
+}
+
+ColumnarFile
+ColumnarFile::open(const fs::path &path) {
+    return ColumnarFile(ConstMapping::map(path));
+}
+
+const ColumnIndexEntry *
+ColumnarFile::find(std::string_view name) const {
+    for (const ColumnIndexEntry &e : index_) {
+        if (name == e.name) return &e;
+    }
+    return nullptr;
+}
+
+const ColumnIndexEntry &
+ColumnarFile::require(std::string_view name, ColumnType type) const {
+    const ColumnIndexEntry *e = find(name);
+    if (!e)              throw BadColumnarFile("missing column '" + std::string(name) + "'");
+    if (e->type != type) throw BadColumnarFile("unexpected type for column '" + std::string(name) + "'");
+    return *e;
+}
+
+std::span<const uint64_t>
+ColumnarFile::offsets(std::string_view name, size_t rows, size_t limit) const {
+    std::span<const uint64_t> offsets = column<uint64_t>(std::string(name) + ".offsets");
+    if (offsets.size() != rows + 1) throw BadColumnarFile("wrong number of rows in column '" + std::string(name) + "'");
+    uint64_t last = 0;
+    for (uint64_t offset : offsets) {
+        if (offset < last || offset > limit) throw BadColumnarFile("corrupt offsets in column '" + std::string(name) + "'");
+        last = offset;
+    }
+    return offsets;
+}
+
+ColumnarFile::Strings
+ColumnarFile::strings(std::string_view name, size_t rows) const {
+    Strings s;
+    s.data    = column<char>(name);
+    s.offsets = offsets(name, rows, s.data.size());
+    return s;
+}
+
+size_t
+ColumnarFile::check_row(size_t i) const {
+    if (i >= aln_template_.size()) throw BadColumnarFile("alignment " + std::to_string(i) + " out of range");
+    return i;
+}
+
+std::string_view
+ColumnarFile::string(std::string_view name, size_t i) const {
+    std::span<const uint64_t> offsets = column<uint64_t>(std::string(name) + ".offsets");
+    std::span<const char>     data    = column<char>(name);
+    if (i + 1 >= offsets.size() || offsets[i] > offsets[i+1] || offsets[i+1] > data.size()) throw BadColumnarFile("row out of range in column '" + std::string(name) + "'");
+    return std::string_view(data.data() + offsets[i], offsets[i+1] - offsets[i]);
+}
+
+std::string
+ColumnarFile::barcode(size_t i) const {
+    check_row(i);
+    return unpack_barcode(aln_barcode_.data(), aln_barcode_offsets_[i], aln_barcode_offsets_[i+1] - aln_barcode_offsets_[i]);
+}
+
+std::string
+ColumnarFile::alignment(size_t i) const {
+    check_row(i);
+    return decode_alignment(aln_ops_[i], aln_residues_[i]);
+}
+
+std::string
+ColumnarFile::codons(size_t i) const {
+    check_row(i);
+    if (aln_codons_[i].empty()) return std::string(); //an alignment without codons has no gaps to put back
+    return decode_codons(aln_ops_[i], aln_codons_[i]);
+}
+
+}; //namespace bio
@@ -0,0 +1,232 @@
+/*
+Copyright 2024, The Broad Institute of MIT and Harvard
+
+Original Author: Charles C Bailey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef BIO_COLUMNAR_H_
+#define BIO_COLUMNAR_H_
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "io.h"
+
+namespace bio {
+
+/** Thrown when a columnar file cannot be written or does not parse. */
+class BadColumnarFile : public std::runtime_error {
+    using runtime_error::runtime_error;
+};
+
+/** Element type of a column block. */
+enum class ColumnType : uint32_t {
+    Bytes = 0, ///< Opaque bytes (e.g. text or packed sequence data)
+    U8    = 1,
+    U32   = 2,
+    U64   = 3,
+    F32   = 4
+};
+
+/** One entry of the footer index; describes a single column block.
+  *
+  * Columns are laid out as dense row-major arrays of rows*cols elements.
+  * Variable-length columns (sequences, labels) are stored as a pair of
+  * blocks: a U64 "<name>.offsets" block with rows+1 entries and a data
+  * block holding the concatenated values.
+  */
+struct ColumnIndexEntry {
+    static constexpr size_t NAME_SIZE = 48;
+
+    char       name[NAME_SIZE] = {}; ///< null-terminated block name
+    ColumnType type   = ColumnType::Bytes;
+    uint32_t   reserved = 0;
+    uint64_t   offset = 0;           ///< byte offset of the block from the start of the file
+    uint64_t   bytes  = 0;           ///< size of the block in bytes
+    uint64_t   rows   = 0;
+    uint64_t   cols   = 0;
+};
+
+/** Magic numbers and version of the columnar format.
+  *
+  * File layout (all integers little-endian, blocks 8-byte aligned):
+  *   header  : "DSACOL01" u32 version u32 reserved
+  *   blocks  : column data
+  *   index   : ColumnIndexEntry[n]
+  *   trailer : u64 index offset, u64 n, "DSACOLIX"
+  */
+struct ColumnarFormat {
+    static constexpr char     HEADER_MAGIC[8]  = {'D','S','A','C','O','L','0','1'};
+    static constexpr char     TRAILER_MAGIC[8] = {'D','S','A','C','O','L','I','X'};
+    static constexpr uint32_t VERSION = 1;
+    static constexpr uint32_t NO_TEMPLATE = 0xFFFFFFFF; ///< template id of untemplated alignments
+};
+
+/** Alignment string opcodes. Each op byte holds the op in its top 2 bits
+  * and (run length - 1) in its low 6 bits.
+  */
+enum class AlignmentOp : uint8_t {
+    Match     = 0, ///< residue aligned to the template (upper case)
+    Insertion = 1, ///< residue absent from the template (lower case)
+    Deletion  = 2  ///< template residue absent from the read ('-')
+};
+
+/** Split an alignment string (see #Alignments# in --help) into run-length
+  * encoded ops, appended to ops, and its ungapped residues, appended to residues.
+  */
+void
+encode_alignment(std::string_view alignment, std::string &ops, std::string &residues);
+
+/** Inverse of encode_alignment. */
+std::string
+decode_alignment(std::string_view ops, std::string_view residues);
+
+/** Re-insert the codon gaps (' ') at the deletion positions described by ops. */
+std::string
+decode_codons(std::string_view ops, std::string_view codons);
+
+/** Pack a nucleotide string two bases per byte, appending to out.
+  * Characters other than ACGTN are stored as N. Barcodes are packed as
+  * one concatenated string so that offsets into the column count bases.
+  */
+void
+pack_barcode(std::string_view barcode, std::string &out);
+
+/** Unpack n bases starting at nibble offset first of packed. */
+std::string
+unpack_barcode(const uint8_t *packed, size_t first, size_t n);
+
+/** Streams column blocks to a file and writes the footer index on close. */
+class ColumnarWriter {
+public:
+    explicit ColumnarWriter(const fs::path &path);
+    ColumnarWriter(const ColumnarWriter &) = delete;
+    ColumnarWriter &operator=(const ColumnarWriter &) = delete;
+    ~ColumnarWriter();
+
+    /** Write a raw block. bytes must equal rows*cols*sizeof(element). */
+    void add(const std::string &name, ColumnType type,
+             const void *data, size_t bytes, size_t rows, size_t cols=1);
+
+    template<typename T>
+    void add(const std::string &name, const std::vector<T> &v, size_t rows, size_t cols=1) {
+        add(name, type_of<T>(), v.data(), v.size() * sizeof(T), rows, cols);
+    }
+
+    /** Write a variable-length string column as "<name>.offsets" and "<name>". */
+    void add_strings(const std::string &name, const std::vector<std::string_view> &values);
+
+    /** Write the index and trailer. Called by the destructor if necessary. */
+    void close();
+
+    template<typename T> static constexpr ColumnType type_of();
+
+private:
+    void pad();
+
+    std::ofstream os_;
+    uint64_t pos_ = 0;
+    std::vector<ColumnIndexEntry> index_;
+};
+
+template<> constexpr ColumnType ColumnarWriter::type_of<uint8_t >() { return ColumnType::U8;  }
+template<> constexpr ColumnType ColumnarWriter::type_of<char    >() { return ColumnType::Bytes; }
+template<> constexpr ColumnType ColumnarWriter::type_of<uint32_t>() { return ColumnType::U32; }
+template<> constexpr ColumnType ColumnarWriter::type_of<uint64_t>() { return ColumnType::U64; }
+template<> constexpr ColumnType ColumnarWriter::type_of<float   >() { return ColumnType::F32; }
+
+/** Read-only, memory-mapped view of a columnar file.
+  * Column accessors return spans pointing directly into the mapping.
+  */
+class ColumnarFile {
+public:
+    /** Map path and validate its header, trailer and index. Throws BadColumnarFile. */
+    static ColumnarFile open(const fs::path &path);
+
+    /** True if the file starts with the columnar header magic. */
+    static bool is_columnar(const char *data, size_t size);
+
+    std::span<const ColumnIndexEntry> index() const { return index_; }
+
+    /** Find the index entry for name or nullptr if there is no such block. */
+    const ColumnIndexEntry *find(std::string_view name) const;
+
+    /** Get a block as an array of T. Throws BadColumnarFile if missing, mistyped or misaligned. */
+    template<typename T>
+    std::span<const T> column(std::string_view name) const {
+        const ColumnIndexEntry &e = require(name, ColumnarWriter::type_of<T>());
+        if (e.offset % alignof(T) != 0 || e.bytes % sizeof(T) != 0) throw BadColumnarFile("misaligned column '" + std::string(name) + "'");
+        return std::span<const T>(reinterpret_cast<const T *>(map_.c_str() + e.offset), e.bytes / sizeof(T));
+    }
+
+    /** Get row i of a variable-length string column. */
+    std::string_view string(std::string_view name, size_t i) const;
+
+    /** Number of rows in the alignment columns, 0 if the file has none. */
+    size_t alignment_count() const { return aln_template_.size(); }
+
+    /** Row i of the alignment columns, which are looked up and checked once
+      * when the file is opened. Throws BadColumnarFile if i is out of range.
+      */
+    uint32_t    template_id(size_t i) const { return aln_template_[check_row(i)]; }
+    uint32_t    group_size(size_t i)  const { return aln_group_size_[check_row(i)]; }
+    std::string barcode(size_t i)     const;
+    std::string alignment(size_t i)   const;
+    std::string codons(size_t i)      const;
+
+private:
+    /** A variable-length column whose offsets have been checked against its data. */
+    struct Strings {
+        std::span<const uint64_t> offsets;
+        std::span<const char>     data;
+
+        std::string_view operator[](size_t i) const { return std::string_view(data.data() + offsets[i], offsets[i+1] - offsets[i]); }
+    };
+
+    ColumnarFile(ConstMapping &&map);
+    const ColumnIndexEntry &require(std::string_view name, ColumnType type) const;
+
+    /** The "<name>.offsets" block of a column of rows values, checked to be
+      * ascending and to end within limit. Throws BadColumnarFile.
+      */
+    std::span<const uint64_t> offsets(std::string_view name, size_t rows, size_t limit) const;
+    Strings strings(std::string_view name, size_t rows) const;
+
+    /** i, if it is a row of the alignment columns. Throws BadColumnarFile. */
+    size_t check_row(size_t i) const;
+
+    ConstMapping map_;
+    std::span<const ColumnIndexEntry> index_;
+
+    std::span<const uint32_t> aln_template_, aln_group_size_;
+    std::span<const uint64_t> aln_barcode_offsets_;
+    std::span<const uint8_t>  aln_barcode_;
+    Strings aln_ops_, aln_residues_, aln_codons_;
+};
+
+}; //namespace bio
+
+#endif
@@ -0,0 +1,157 @@
+/*
+Copyright 2024, The Broad Institute of MIT and Harvard
+
+Original Author: Charles C Bailey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "compact.h"
+
+#include <cctype>
+#include <optional>
+
+#include "cdn.h"
+
+namespace bio {
+
+static void
+flush_matches(std::string &out, size_t &n) {
+    if (n == 0) return;
+    out.push_back('.');
+    if (n > 1) out += std::to_string(n);
+    n = 0;
+}
+
+/** Read the '.' token at s[i] and return its run length, advancing i past it. */
+static size_t
+read_matches(std::string_view s, size_t &i) {
+    size_t n = 0, j = ++i;
+    for (; i < s.size() && std::isdigit(static_cast<unsigned char>(s[i])); ++i) n = n * 10 + (s[i] - '0');
+    return i == j ? 1 : n;
+}
+
+static void
+append_nts(std::string &out, char c) {
+    std::optional<Cdn> oc = Cdn::from_char(c);
+    if (oc) {
+        out.push_back(oc->p1());
+        out.push_back(oc->p2());
+        out.push_back(oc->p3());
+    }
+}
+
+std::string
+compact_alignment(std::string_view alignment, std::string_view templ) {
+    std::string out;
+    size_t matches = 0;
+    for (size_t q=0, t=0; q<alignment.size(); ++q) {
+        const char c = alignment[q];
+        if (c == '-') {
+            flush_matches(out, matches);
+            out.push_back(c);
+            ++t;
+        } else if (std::islower(c)) {
+            flush_matches(out, matches);
+            out.push_back(c);
+        } else {
+            if (t < templ.size() && c == templ[t]) {
+                ++matches;
+            } else {
+                flush_matches(out, matches);
+                out.push_back(c);
+            }
+            ++t;
+        }
+    }
+    flush_matches(out, matches);
+    return out;
+}
+
+std::string
+expand_alignment(std::string_view compact, std::string_view templ) {
+    std::string out;
+    size_t t = 0;
+    for (size_t i=0; i<compact.size(); ) {
+        const char c = compact[i];
+        if (c == '.') {
+            const size_t n = read_matches(compact, i);
+            if (t + n > templ.size()) throw BadCompactAlignment("compact alignment is longer than its template");
+            out.append(templ.substr(t, n));
+            t += n;
+            continue;
+        }
+        out.push_back(c);
+        if (!std::islower(c)) ++t;
+        ++i;
+    }
+    return out;
+}
+
+std::string
+compact_codons(std::string_view alignment, std::string_view cdns, std::string_view tcdns) {
+    std::string out;
+    size_t matches = 0;
+    for (size_t q=0, t=0; q<alignment.size() && q<cdns.size(); ++q) {
+        const char c = alignment[q];
+        if (c == '-') {
+            ++t;
+        } else if (std::islower(c)) {
+            flush_matches(out, matches);
+            append_nts(out, cdns[q]);
+        } else {
+            if (t < tcdns.size() && cdns[q] == tcdns[t]) {
+                ++matches;
+            } else {
+                flush_matches(out, matches);
+                append_nts(out, cdns[q]);
+            }
+            ++t;
+        }
+    }
+    flush_matches(out, matches);
+    return out;
+}
+
+std::string
+expand_codons(std::string_view alignment, std::string_view compact, std::string_view tnts) {
+    std::string out;
+    size_t matches = 0, i = 0;
+    for (size_t q=0, t=0; q<alignment.size(); ++q) {
+        const char c = alignment[q];
+        if (c == '-') { ++t; continue; }
+
+        if (!std::islower(c) && matches == 0 && i < compact.size() && compact[i] == '.') {
+            matches = read_matches(compact, i);
+        }
+
+        if (!std::islower(c) && matches) {
+            if (3 * (t + 1) > tnts.size()) throw BadCompactAlignment("compact codons are longer than their template");
+            out.append(tnts.substr(3 * t, 3));
+            --matches;
+        } else {
+            if (i + 3 > compact.size()) throw BadCompactAlignment("compact codons are shorter than their alignment");
+            out.append(compact.substr(i, 3));
+            i += 3;
+        }
+        if (!std::islower(c)) ++t;
+    }
+    return out;
+}
+
+}; //namespace bio
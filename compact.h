@@ -0,0 +1,84 @@
+/*
+Copyright 2024, The Broad Institute of MIT and Harvard
+
+Original Author: Charles C Bailey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef BIO_COMPACT_H_
+#define BIO_COMPACT_H_
+
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace bio {
+
+/** Thrown when a compact alignment string cannot be expanded. */
+class BadCompactAlignment : public std::runtime_error {
+    using runtime_error::runtime_error;
+};
+
+/** Write an alignment string relative to its template (--compact_alignments).
+  *
+  * Residues identical to the aligned template residue are written as '.' and
+  * runs of n > 1 such residues as '.' followed by n in decimal (e.g. ".173").
+  * Substitutions, deletions ('-') and insertions (lower case) are written as in
+  * the full alignment string. Positions past the end of templ are written as is.
+  *
+  * @param alignment the gapped alignment string (see #Alignments# in --help)
+  * @param templ the amino acid template the alignment was made against
+  *
+  * @return the compact alignment string
+  */
+std::string
+compact_alignment(std::string_view alignment, std::string_view templ);
+
+/** Inverse of compact_alignment. Throws BadCompactAlignment. */
+std::string
+expand_alignment(std::string_view compact, std::string_view templ);
+
+/** Write the codons of an alignment relative to the template codons.
+  *
+  * Output is in the same form as -c horizontal (nucleotides, no gaps) except
+  * that codons identical to the aligned template codon are written as '.' with
+  * the same run-length compression as compact_alignment.
+  *
+  * @param alignment the full gapped alignment string
+  * @param cdns the gapped ASCII codons of the alignment
+  * @param tcdns the ASCII codons of the template (may be empty)
+  *
+  * @return the compact nucleotide string
+  */
+std::string
+compact_codons(std::string_view alignment, std::string_view cdns, std::string_view tcdns);
+
+/** Inverse of compact_codons; returns the -c horizontal nucleotide string.
+  * Throws BadCompactAlignment.
+  *
+  * @param alignment the full (expanded) gapped alignment string
+  * @param compact the compact nucleotide string
+  * @param tnts the template as nucleotides (3 per codon, may be empty)
+  */
+std::string
+expand_codons(std::string_view alignment, std::string_view compact, std::string_view tnts);
+
+}; //namespace bio
+
+#endif
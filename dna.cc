@@ -130,6 +130,20 @@ mm256_reverse_complement_dna(char *dna, size_t len) {
 const std::string
 Nt::valid_chars = "ACGTN";
 
+size_t
+Nt::normalize(char *dst, const char *src, size_t n) {
+    const __m256i upper = _mm256_set1_epi8(static_cast<char>(0xDF)); //clears the lowercase bit of letters only
+    const __m256i a = _mm256_set1_epi8('A'), c = _mm256_set1_epi8('C'), g = _mm256_set1_epi8('G'),
+                  t = _mm256_set1_epi8('T'), nn = _mm256_set1_epi8('N');
+    return mm256_normalize(dst, src, n, [&](__m256i &v)->uint32_t {
+        v = _mm256_and_si256(v, upper);
+        const __m256i valid = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, a), _mm256_cmpeq_epi8(v, c)),
+            _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, g), _mm256_cmpeq_epi8(v, t)), _mm256_cmpeq_epi8(v, nn)));
+        return static_cast<uint32_t>(_mm256_movemask_epi8(valid));
+    }, normalize_char);
+}
+
 Nts &
 Nts::complement() {
     mm256_complement_dna(data(), size());
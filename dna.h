@@ -70,6 +70,9 @@ public:
         };
     };
 
+    /** Vectorized normalize_char() over n chars (see mm256_normalize()) @return the number of valid chars written to dst */
+    static size_t normalize(char *dst, const char *src, size_t n);
+
     static const std::string valid_chars;
     static const char *clut; //complement lookup table: index using (v & 0b1111) to get complement
 
@@ -85,6 +88,10 @@ private:
 
 class Cdns;
 
+/** In-place reverse complement of the nucleotides in [dna, dna+len) (see Nts::reverse_complement()). */
+void
+mm256_reverse_complement_dna(char *dna, size_t len);
+
 class Nts : public Polymer<Nt> {
 public:
     Nts() = default;
@@ -108,6 +115,8 @@ public:
     Nts &reverse_complement();
 };
 
+using NtsView = PolymerView<Nt>; ///< A view of a Nts or of a slice of one.
+
 }; //namespace bio
 
 template<>
@@ -0,0 +1,552 @@
+/*
+Copyright 2024, The Broad Institute of MIT and Harvard
+
+Original Author: Charles C Bailey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "gzip.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+#include <vector>
+
+namespace bio {
+
+namespace {
+
+constexpr size_t WINDOW_SIZE  = 32768; //maximum match distance
+constexpr size_t MIN_MATCH    = 3;
+constexpr size_t MAX_MATCH    = 258;
+constexpr size_t NICE_MATCH   = 128;   //stop searching the hash chain once a match this long is found
+constexpr size_t MAX_CHAIN    = 64;    //maximum hash chain links followed per position
+constexpr unsigned HASH_BITS  = 15;
+constexpr size_t BLOCK_TOKENS = 32768; //tokens per DEFLATE block
+
+constexpr uint16_t LENGTH_BASE[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+constexpr uint8_t LENGTH_EXTRA[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+constexpr uint16_t DIST_BASE[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+constexpr uint8_t DIST_EXTRA[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+//order in which code length code lengths are transmitted
+constexpr uint8_t CL_ORDER[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+/** Map match lengths 3..258 to length codes 0..28 (symbols 257..285). */
+const std::array<uint8_t, MAX_MATCH+1> &
+length_codes() {
+    static const std::array<uint8_t, MAX_MATCH+1> lut = []{
+        std::array<uint8_t, MAX_MATCH+1> t{};
+        for (uint8_t c=0; c<29; ++c) {
+            const size_t hi = (c == 28) ? MAX_MATCH + 1 : LENGTH_BASE[c+1];
+            for (size_t len=LENGTH_BASE[c]; len<hi && len<=MAX_MATCH; ++len) t[len] = c;
+        }
+        return t;
+    }();
+    return lut;
+}
+
+inline unsigned
+dist_code(unsigned dist) {
+    const unsigned d = dist - 1;
+    if (d < 4) return d;
+    const unsigned hb = std::bit_width(d) - 1;
+    return 2 * hb + ((d >> (hb - 1)) & 1);
+}
+
+/** A literal (dist == 0) or a match of length len at distance dist. */
+struct Token {
+    uint16_t len;  ///< literal byte value or match length
+    uint16_t dist;
+};
+
+/** LSB-first bit packer. */
+struct BitWriter {
+    std::string &out;
+    uint64_t bits = 0;
+    unsigned n = 0;
+
+    explicit BitWriter(std::string &out) : out(out) {}
+
+    void put(uint32_t v, unsigned len) {
+        bits |= static_cast<uint64_t>(v) << n;
+        n += len;
+        while (n >= 8) {
+            out.push_back(static_cast<char>(bits & 0xFF));
+            bits >>= 8;
+            n -= 8;
+        }
+    }
+
+    void align() { if (n) put(0, 8 - n); }
+};
+
+uint32_t
+reverse_bits(uint32_t code, unsigned len) {
+    uint32_t r = 0;
+    for (unsigned i=0; i<len; ++i) { r = (r << 1) | (code & 1); code >>= 1; }
+    return r;
+}
+
+/** Length-limited Huffman code lengths for n symbols with frequencies freq.
+  * Tree built with the two-queue method; over-long codes are shortened by
+  * rebalancing the per-length counts (as in miniz) before reassignment.
+  */
+void
+huffman_lengths(const uint32_t *freq, size_t n, unsigned limit, uint8_t *lens) {
+    std::fill(lens, lens + n, 0);
+
+    std::vector<uint16_t> syms;
+    for (size_t i=0; i<n; ++i) if (freq[i]) syms.push_back(static_cast<uint16_t>(i));
+    if (syms.empty()) return;
+    if (syms.size() == 1) { lens[syms[0]] = 1; return; }
+
+    std::stable_sort(syms.begin(), syms.end(), [&](uint16_t a, uint16_t b){ return freq[a] < freq[b]; });
+
+    const size_t m = syms.size();
+    std::vector<uint64_t> weight(2*m - 1);
+    std::vector<uint32_t> parent(2*m - 1, 0);
+    for (size_t i=0; i<m; ++i) weight[i] = freq[syms[i]];
+
+    size_t leaf = 0, node = m;
+    for (size_t next=m; next<2*m-1; ++next) {
+        size_t pick[2];
+        for (size_t &k : pick) {
+            if (leaf < m && (node >= next || weight[leaf] <= weight[node])) k = leaf++;
+            else k = node++;
+        }
+        weight[next] = weight[pick[0]] + weight[pick[1]];
+        parent[pick[0]] = parent[pick[1]] = static_cast<uint32_t>(next);
+    }
+
+    std::vector<unsigned> depth(2*m - 1, 0);
+    for (size_t k=2*m-1; k-- > 0; ) depth[k] = (k == 2*m-2) ? 0 : depth[parent[k]] + 1;
+
+    std::vector<uint32_t> count(std::max<unsigned>(limit, 32) + 1, 0);
+    for (size_t i=0; i<m; ++i) count[std::min(depth[i], limit)] += 1;
+
+    uint64_t total = 0;
+    for (unsigned len=1; len<=limit; ++len) total += static_cast<uint64_t>(count[len]) << (limit - len);
+    while (total != (1ull << limit)) {
+        count[limit] -= 1;
+        for (unsigned len=limit-1; len>0; --len) {
+            if (count[len]) {
+                count[len] -= 1;
+                count[len+1] += 2;
+                break;
+            }
+        }
+        total -= 1;
+    }
+
+    //least frequent symbols get the longest codes
+    size_t i = 0;
+    for (unsigned len=limit; len>0; --len) {
+        for (uint32_t k=0; k<count[len]; ++k) lens[syms[i++]] = static_cast<uint8_t>(len);
+    }
+}
+
+/** Canonical Huffman codes (RFC 1951 3.2.2), bit-reversed for LSB-first output. */
+void
+canonical_codes(const uint8_t *lens, size_t n, uint16_t *codes) {
+    uint32_t bl_count[16] = {}, next_code[16] = {};
+    for (size_t i=0; i<n; ++i) bl_count[lens[i]] += 1;
+    bl_count[0] = 0;
+    uint32_t code = 0;
+    for (unsigned bits=1; bits<16; ++bits) {
+        code = (code + bl_count[bits-1]) << 1;
+        next_code[bits] = code;
+    }
+    for (size_t i=0; i<n; ++i) {
+        codes[i] = lens[i] ? static_cast<uint16_t>(reverse_bits(next_code[lens[i]]++, lens[i])) : 0;
+    }
+}
+
+/** Give at least two symbols a nonzero frequency so every code is complete. */
+void
+ensure_two_symbols(uint32_t *freq, size_t n) {
+    size_t used = 0;
+    for (size_t i=0; i<n; ++i) used += freq[i] != 0;
+    for (size_t i=0; i<n && used < 2; ++i) if (!freq[i]) { freq[i] = 1; ++used; }
+}
+
+void
+write_stored(BitWriter &bw, const char *data, size_t size, bool final) {
+    do {
+        const size_t len = std::min<size_t>(size, 65535);
+        size -= len;
+        bw.put((final && size == 0) ? 1 : 0, 1);
+        bw.put(0, 2);
+        bw.align();
+        bw.put(static_cast<uint32_t>(len), 16);
+        bw.put(static_cast<uint32_t>(~len & 0xFFFF), 16);
+        bw.out.append(data, len);
+        data += len;
+    } while (size);
+}
+
+/** Write tokens as one dynamic Huffman block or, if smaller, as stored blocks of the raw input. */
+void
+write_block(BitWriter &bw, const std::vector<Token> &tokens, const char *raw, size_t raw_size, bool final) {
+    const auto &lcodes = length_codes();
+
+    uint32_t lfreq[286] = {}, dfreq[30] = {};
+    for (const Token &t : tokens) {
+        if (t.dist == 0) {
+            lfreq[t.len] += 1;
+        } else {
+            lfreq[257 + lcodes[t.len]] += 1;
+            dfreq[dist_code(t.dist)] += 1;
+        }
+    }
+    lfreq[256] = 1;
+    ensure_two_symbols(lfreq, 286);
+    ensure_two_symbols(dfreq, 30);
+
+    uint8_t llens[286], dlens[30];
+    uint16_t lcode[286], dcode[30];
+    huffman_lengths(lfreq, 286, 15, llens);
+    huffman_lengths(dfreq, 30,  15, dlens);
+    canonical_codes(llens, 286, lcode);
+    canonical_codes(dlens, 30,  dcode);
+
+    size_t hlit = 286, hdist = 30;
+    while (hlit  > 257 && llens[hlit-1]  == 0) --hlit;
+    while (hdist > 1   && dlens[hdist-1] == 0) --hdist;
+
+    //run-length encode the concatenated code lengths with symbols 16, 17, 18
+    std::vector<uint8_t> all(llens, llens + hlit);
+    all.insert(all.end(), dlens, dlens + hdist);
+    std::vector<std::pair<uint8_t, uint8_t>> rle; //(symbol, extra bits value)
+    for (size_t i=0; i<all.size(); ) {
+        size_t run = 1;
+        while (i + run < all.size() && all[i+run] == all[i]) ++run;
+        if (all[i] == 0 && run >= 3) {
+            run = std::min<size_t>(run, 138);
+            if (run >= 11) rle.push_back({18, static_cast<uint8_t>(run - 11)});
+            else           rle.push_back({17, static_cast<uint8_t>(run - 3)});
+        } else if (all[i] != 0 && run >= 4) {
+            run = std::min<size_t>(run, 7);
+            rle.push_back({all[i], 0});
+            rle.push_back({16, static_cast<uint8_t>(run - 4)});
+        } else {
+            run = 1;
+            rle.push_back({all[i], 0});
+        }
+        i += run;
+    }
+
+    uint32_t cfreq[19] = {};
+    for (const auto &[sym, _] : rle) cfreq[sym] += 1;
+    ensure_two_symbols(cfreq, 19);
+    uint8_t clens[19];
+    uint16_t ccode[19];
+    huffman_lengths(cfreq, 19, 7, clens);
+    canonical_codes(clens, 19, ccode);
+
+    size_t hclen = 19;
+    while (hclen > 4 && clens[CL_ORDER[hclen-1]] == 0) --hclen;
+
+    static constexpr uint8_t CL_EXTRA[19] = {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,2,3,7};
+
+    //compare the exact size of the dynamic block with stored blocks
+    uint64_t bits = 3 + 5 + 5 + 4 + 3 * hclen;
+    for (const auto &[sym, _] : rle) bits += clens[sym] + CL_EXTRA[sym];
+    for (size_t i=0; i<286; ++i) bits += static_cast<uint64_t>(lfreq[i]) * (llens[i] + (i > 256 ? LENGTH_EXTRA[i-257] : 0));
+    for (size_t i=0; i<30;  ++i) bits += static_cast<uint64_t>(dfreq[i]) * (dlens[i] + DIST_EXTRA[i]);
+    const uint64_t stored_bits = (raw_size / 65535 + 1) * 40 + 8 * static_cast<uint64_t>(raw_size) + 7;
+    if (stored_bits < bits) {
+        write_stored(bw, raw, raw_size, final);
+        return;
+    }
+
+    bw.put(final ? 1 : 0, 1);
+    bw.put(2, 2);
+    bw.put(static_cast<uint32_t>(hlit - 257), 5);
+    bw.put(static_cast<uint32_t>(hdist - 1), 5);
+    bw.put(static_cast<uint32_t>(hclen - 4), 4);
+    for (size_t i=0; i<hclen; ++i) bw.put(clens[CL_ORDER[i]], 3);
+    for (const auto &[sym, extra] : rle) {
+        bw.put(ccode[sym], clens[sym]);
+        if (CL_EXTRA[sym]) bw.put(extra, CL_EXTRA[sym]);
+    }
+
+    for (const Token &t : tokens) {
+        if (t.dist == 0) {
+            bw.put(lcode[t.len], llens[t.len]);
+        } else {
+            const unsigned lc = lcodes[t.len];
+            bw.put(lcode[257 + lc], llens[257 + lc]);
+            if (LENGTH_EXTRA[lc]) bw.put(t.len - LENGTH_BASE[lc], LENGTH_EXTRA[lc]);
+            const unsigned dc = dist_code(t.dist);
+            bw.put(dcode[dc], dlens[dc]);
+            if (DIST_EXTRA[dc]) bw.put(t.dist - DIST_BASE[dc], DIST_EXTRA[dc]);
+        }
+    }
+    bw.put(lcode[256], llens[256]);
+}
+
+/** LZ77 match finder over hash chains of 3-byte prefixes. */
+struct MatchFinder {
+    const uint8_t *p;
+    size_t n;
+    std::vector<int32_t> head;
+    std::vector<int32_t> prev;
+
+    MatchFinder(const char *data, size_t size)
+        : p(reinterpret_cast<const uint8_t *>(data))
+        , n(size)
+        , head(size_t(1) << HASH_BITS, -1)
+        , prev(size, -1) {}
+
+    uint32_t hash(size_t i) const {
+        const uint32_t v = (uint32_t(p[i]) << 16) | (uint32_t(p[i+1]) << 8) | p[i+2];
+        return (v * 2654435761u) >> (32 - HASH_BITS);
+    }
+
+    void insert(size_t i) {
+        if (i + MIN_MATCH > n) return;
+        const uint32_t h = hash(i);
+        prev[i] = head[h];
+        head[h] = static_cast<int32_t>(i);
+    }
+
+    /** Find the longest match for position i (then insert i). Returns (length, distance). */
+    std::pair<size_t, size_t> find_and_insert(size_t i) {
+        if (i + MIN_MATCH > n) return {0, 0};
+        const size_t max_len = std::min(MAX_MATCH, n - i);
+        size_t best_len = 0, best_dist = 0;
+
+        const uint32_t h = hash(i);
+        int32_t j = head[h];
+        for (size_t chain=0; j >= 0 && chain < MAX_CHAIN; ++chain, j = prev[j]) {
+            const size_t dist = i - j;
+            if (dist > WINDOW_SIZE) break;
+            if (p[j + best_len] != p[i + best_len]) continue;
+            size_t len = 0;
+            while (len < max_len && p[j + len] == p[i + len]) ++len;
+            if (len > best_len) {
+                best_len = len;
+                best_dist = dist;
+                if (len >= NICE_MATCH || len == max_len) break;
+            }
+        }
+
+        prev[i] = head[h];
+        head[h] = static_cast<int32_t>(i);
+
+        if (best_len < MIN_MATCH) return {0, 0};
+        return {best_len, best_dist};
+    }
+};
+
+}; //namespace
+
+uint32_t
+crc32(const void *data, size_t size, uint32_t crc) {
+    static const std::array<uint32_t, 256> table = []{
+        std::array<uint32_t, 256> t{};
+        for (uint32_t i=0; i<256; ++i) {
+            uint32_t c = i;
+            for (int k=0; k<8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[i] = c;
+        }
+        return t;
+    }();
+
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    crc = ~crc;
+    for (size_t i=0; i<size; ++i) crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+std::string
+deflate(const char *data, size_t size) {
+    std::string out;
+    out.reserve(size / 3 + 64);
+    BitWriter bw(out);
+    MatchFinder mf(data, size);
+
+    std::vector<Token> tokens;
+    tokens.reserve(BLOCK_TOKENS + 2);
+    size_t block_start = 0;
+
+    //greedy matching with one step of lazy evaluation
+    size_t prev_len = 0, prev_dist = 0;
+    bool have_prev = false;
+    size_t i = 0;
+    while (i < size) {
+        if (!have_prev && tokens.size() >= BLOCK_TOKENS) {
+            write_block(bw, tokens, data + block_start, i - block_start, false);
+            tokens.clear();
+            block_start = i;
+        }
+
+        auto [len, dist] = mf.find_and_insert(i);
+
+        if (have_prev) {
+            if (len > prev_len) {
+                tokens.push_back({static_cast<uint8_t>(data[i-1]), 0});
+                prev_len = len; prev_dist = dist;
+                ++i;
+            } else {
+                tokens.push_back({static_cast<uint16_t>(prev_len), static_cast<uint16_t>(prev_dist)});
+                const size_t end = i - 1 + prev_len;
+                for (size_t k=i+1; k<end; ++k) mf.insert(k);
+                i = end;
+                have_prev = false;
+            }
+        } else if (len >= NICE_MATCH) {
+            tokens.push_back({static_cast<uint16_t>(len), static_cast<uint16_t>(dist)});
+            for (size_t k=i+1; k<i+len; ++k) mf.insert(k);
+            i += len;
+        } else if (len) {
+            have_prev = true;
+            prev_len = len; prev_dist = dist;
+            ++i;
+        } else {
+            tokens.push_back({static_cast<uint8_t>(data[i]), 0});
+            ++i;
+        }
+    }
+    if (have_prev) tokens.push_back({static_cast<uint16_t>(prev_len), static_cast<uint16_t>(prev_dist)});
+
+    write_block(bw, tokens, data + block_start, size - block_start, true);
+    bw.align();
+    return out;
+}
+
+std::string
+gzip_compress(const char *data, size_t size) {
+    static const char header[10] = {
+        '\x1f', '\x8b', //magic
+        8,              //CM = deflate
+        0,              //FLG
+        0, 0, 0, 0,     //MTIME (not set)
+        0,              //XFL
+        '\xff'          //OS = unknown
+    };
+
+    std::string out(header, sizeof(header));
+    out += deflate(data, size);
+
+    const uint32_t trailer[2] = {crc32(data, size), static_cast<uint32_t>(size)};
+    for (uint32_t v : trailer) {
+        for (int k=0; k<4; ++k) out.push_back(static_cast<char>((v >> (8 * k)) & 0xFF));
+    }
+    return out;
+}
+
+GzipStreambuf::GzipStreambuf(std::streambuf *sink, size_t threads)
+    : sink_(sink)
+    , max_pending_(threads ? threads : ThreadPool::current().size()) {
+    buf_.resize(BLOCK_SIZE);
+    setp(buf_.data(), buf_.data() + buf_.size());
+}
+
+GzipStreambuf::~GzipStreambuf() {
+    finish();
+}
+
+GzipStreambuf::int_type
+GzipStreambuf::overflow(int_type c) {
+    submit();
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+    }
+    return ok_ ? traits_type::not_eof(c) : traits_type::eof();
+}
+
+void
+GzipStreambuf::submit() {
+    if (pptr() == pbase()) return;
+    drain(max_pending_ - 1);
+
+    auto block = std::make_unique<Block>();
+    block->input.assign(pbase(), pptr() - pbase());
+    Block *b = block.get();
+    b->task.run([b]{ b->output = gzip_compress(b->input.data(), b->input.size()); b->input.clear(); });
+    pending_.push_back(std::move(block));
+    empty_ = false;
+
+    setp(buf_.data(), buf_.data() + buf_.size());
+}
+
+void
+GzipStreambuf::drain(size_t max_pending) {
+    while (pending_.size() > max_pending) {
+        Block &b = *pending_.front();
+        b.task.wait();
+        const std::streamsize n = static_cast<std::streamsize>(b.output.size());
+        if (sink_->sputn(b.output.data(), n) != n) ok_ = false;
+        pending_.pop_front();
+    }
+}
+
+bool
+GzipStreambuf::finish() {
+    submit();
+    drain(0);
+    if (empty_) {
+        const std::string member = gzip_compress(nullptr, 0);
+        const std::streamsize n = static_cast<std::streamsize>(member.size());
+        if (sink_->sputn(member.data(), n) != n) ok_ = false;
+        empty_ = false;
+    }
+    if (sink_->pubsync() != 0) ok_ = false;
+    return ok_;
+}
+
+GzipOfstream::GzipOfstream(const fs::path &path, size_t threads)
+    : std::ostream(nullptr) {
+    if (!file_.open(path, std::ios::out | std::ios::binary | std::ios::trunc)) {
+        setstate(std::ios::failbit);
+        return;
+    }
+    gz_ = std::make_unique<GzipStreambuf>(&file_, threads);
+    rdbuf(gz_.get());
+}
+
+GzipOfstream::~GzipOfstream() {
+    close();
+}
+
+void
+GzipOfstream::close() {
+    if (gz_) {
+        if (!gz_->finish()) setstate(std::ios::failbit);
+        gz_.reset();
+    }
+    if (file_.is_open() && !file_.close()) setstate(std::ios::failbit);
+}
+
+}; //namespace bio
@@ -0,0 +1,124 @@
+/*
+Copyright 2024, The Broad Institute of MIT and Harvard
+
+Original Author: Charles C Bailey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef BIO_GZIP_H_
+#define BIO_GZIP_H_
+
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+#include <string>
+
+#include "threadpool.h"
+
+namespace bio {
+
+namespace fs = std::filesystem;
+
+/** CRC-32 (ISO-HDLC, as used by gzip) of size bytes at data, continuing from crc. */
+uint32_t
+crc32(const void *data, size_t size, uint32_t crc=0);
+
+/** Compress size bytes at data to a raw DEFLATE stream (RFC 1951).
+  *
+  * Uses LZ77 with hash chains over a 32 KiB window and dynamic Huffman
+  * blocks, falling back to stored blocks for incompressible input.
+  */
+std::string
+deflate(const char *data, size_t size);
+
+/** Compress size bytes at data as one complete gzip member (RFC 1952). */
+std::string
+gzip_compress(const char *data, size_t size);
+
+/** A std::streambuf that gzips everything written to it.
+  *
+  * Output is cut into BLOCK_SIZE blocks that are compressed concurrently on
+  * the current ThreadPool, each as an independent gzip member, and
+  * written to the sink in order.
+  * Concatenated members are a valid gzip file (gzip -d, zcat, Python's gzip
+  * and zlib with automatic header detection all accept them).
+  * Flushing the stream does not end a block so std::endl is harmless.
+  */
+class GzipStreambuf : public std::streambuf {
+public:
+    static constexpr size_t BLOCK_SIZE = 1 << 20;
+
+    /** @param sink where the compressed data are written
+      * @param threads maximum blocks compressed at once (0 for the thread pool size)
+      */
+    explicit GzipStreambuf(std::streambuf *sink, size_t threads=0);
+    GzipStreambuf(const GzipStreambuf &) = delete;
+    GzipStreambuf &operator=(const GzipStreambuf &) = delete;
+    ~GzipStreambuf();
+
+    /** Compress any buffered data and write all pending members to the sink.
+      * An empty member is written if nothing was ever output.
+      * Returns false if the sink reported an error.
+      */
+    bool finish();
+
+protected:
+    int_type overflow(int_type c) override;
+
+private:
+    struct Block {
+        std::string input;
+        std::string output;
+        TaskGroup   task;
+    };
+
+    void submit();
+    void drain(size_t max_pending);
+
+    std::streambuf *sink_;
+    size_t max_pending_;
+    bool ok_ = true;
+    bool empty_ = true;
+    std::string buf_;
+    std::deque<std::unique_ptr<Block>> pending_;
+};
+
+/** An output file stream that writes gzip-compressed data. */
+class GzipOfstream : public std::ostream {
+public:
+    explicit GzipOfstream(const fs::path &path, size_t threads=0);
+    ~GzipOfstream();
+
+    bool is_open() const { return file_.is_open(); }
+
+    /** Finish compression and close the file. Sets failbit on error. */
+    void close();
+
+private:
+    std::filebuf file_;
+    std::unique_ptr<GzipStreambuf> gz_;
+};
+
+}; //namespace bio
+
+#endif
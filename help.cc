@@ -59,6 +59,28 @@ print_help() {
         {'a', "min_aln",        "reads where (alignment score / max possible alignment score) < min_aln will be discarded (default=0.8)"},
         {'n', "number_from",    "number template amino acids starting from 'n' in the #Substitutions# section (default=1)"},
         {'c', "show_codons",    "output format for codons; can be ascii, horizontal, vertical, or none (none by default)"},
+        {'o', "output",         "write program output to a file rather than the standard output stream"},
+        { 0 , "output_format",  "text (default) or columnar; columnar writes a binary file for dsa-util and requires --output"},
+        { 0 , "compact_alignments", "write alignments relative to the template, '.' marking identical residues/codons (see OUTPUT)"},
+        { 0 , "threads",        "number of threads to use (default: available CPUs, respecting affinity and cgroup CPU quota)"},
+        { 0 , "pin_threads",    "bind each worker thread to one CPU, spreading them evenly over the NUMA nodes"},
+        { 0 , "profile",        "report the time, throughput and memory of each stage in a #Profile# section and as JSON (see OUTPUT; not with dsa serve or --batch_jobs > 1)"},
+        { 0 , "perf_counters",  "add the cycles, instructions, cache and branch misses of each stage to --profile (Linux perf_event_open)"},
+        { 0 , "track_allocations", "add an #Allocations# section to --profile: calls and bytes allocated, live and peak by stage, for Polymer buffers and operator new"},
+        { 0 , "trace",          "write a timeline of every thread's tasks, chunks and batches to a Chrome trace (.json) file for chrome://tracing or ui.perfetto.dev (not with dsa serve)"},
+        { 0 , "progress",       "print the reads parsed, passed QC and assembled, UMI groups collapsed and ORFs aligned so far, and the current stage's rate, to stderr every --progress_interval seconds"},
+        { 0 , "metrics_file",   "keep the same counters in a file in the Prometheus text format, rewritten every --progress_interval seconds"},
+        { 0 , "progress_interval", "seconds between --progress lines and --metrics_file updates (default=10)"},
+        { 0 , "thread_stats",   "print the busy time of each thread for every processing stage, and queue occupancy, to stderr (not with dsa serve or --batch_jobs > 1)"},
+        { 0 , "qc_threads",     "threads that parse and QC batches of reads (default: half of --threads); see --staged_front_end"},
+        { 0 , "assembly_threads", "threads that assemble batches of read pairs (default: half of --threads); see --staged_front_end"},
+        { 0 , "staged_front_end", "parse/QC and assembly of a batch on separate threads instead of together on qc_threads + assembly_threads"},
+        { 0 , "queue_depth",    "batches of reads that may wait between two stages of parsing, QC and assembly (default: 2 x stage threads)"},
+        { 0 , "batch",          "process every sample in a tab-delimited manifest instead of one pair of fastq files (see BATCH)"},
+        { 0 , "batch_jobs",     "samples of a --batch that are processed at the same time (default=2)"},
+        { 0 , "socket",         "Unix socket that dsa serve listens on and dsa submit sends jobs to (see SERVE)"},
+        { 0 , "serve_jobs",     "jobs that dsa serve runs at the same time; later ones wait (default=2)"},
+        { 0 , "shutdown",       "with dsa submit, ask the server to finish its running jobs and exit"},
         { 0 , "split",          "regular expression to split translated ORFs into multiple pieces for alignment to separate templates (see --help templates)"},
         { 0 , "template_db",    ".fasta file containing a list of possible nucleotide templates for split sequences (see --help templates)"},
         { 0 , "trim"            "trim the N- and/or C-terminal ends of a template or template database to match the deep-sequenced region (default=0,0)"}
@@ -66,7 +88,12 @@ print_help() {
 
     std::cout << "Deep Sequencing Analysis version " << VERSION_STRING << "\n\n"
                  "Program usage: dsa [options] [-f forward_reference] [-r reverse_reference]\n"
-                 "  [-t template] forward_reads.fastq reverse_reads.fastq > output.csv\n" << std::endl;
+                 "  [-t template] forward_reads.fastq reverse_reads.fastq > output.csv\n"
+                 "   or: dsa [options] [-f forward_reference] [-r reverse_reference]\n"
+                 "  [-t template] --batch manifest.tsv\n"
+                 "   or: dsa serve --socket path [options] [-f forward_reference] [-r reverse_reference]\n"
+                 "  [-t template]\n"
+                 "   or: dsa submit --socket path [-o output] forward_reads.fastq reverse_reads.fastq\n" << std::endl;
     std::cout << "Aligns paired reads in fastq files forward_reads.fastq and reverse_reads.fastq,\n"
                  "  extracts UMI barcodes, translates, and aligns the translated sequence to the\n"
                  "  supplied amino acid or dna template seuqnece(s)." << std::endl;
@@ -83,9 +110,35 @@ print_help() {
                  "  Barcode:         GA  AG\n"
                  "  ORF:                      CTGCAGCCG...\n"
                  "                            LeuGlnPro..." << std::endl;
+    std::cout << "\nBATCH:\n"
+              << "With --batch, dsa analyzes many samples with the same options in one run. The\n"
+              << "  templates are loaded once and --batch_jobs samples are processed at a time on the\n"
+              << "  shared threads, so that one sample's serial steps overlap another's parallel work.\n"
+              << "Each line of the manifest lists one sample as three tab-separated columns:\n"
+              << "  forward_reads.fastq  reverse_reads.fastq  output_file\n"
+              << "  Blank lines and lines starting with # are ignored. -o may not be used with --batch.\n"
+              << "A line per sample and a throughput summary are printed to the standard error stream.\n"
+              << "  A sample that fails is reported and skipped; dsa then exits with an error status." << std::endl;
+    std::cout << "\nSERVE:\n"
+              << "dsa serve loads the templates once and then analyzes samples sent to it over a\n"
+              << "  Unix socket, so that short jobs do not pay for starting dsa and loading templates.\n"
+              << "  All analysis options are given to dsa serve; a job names only its fastq files and\n"
+              << "  output. --serve_jobs jobs run at a time and the rest wait. dsa serve runs until\n"
+              << "  it is interrupted or sent --shutdown, and logs a line per job to standard error.\n"
+              << "dsa submit sends one job and waits for it. Without -o the results are streamed back\n"
+              << "  and printed to the standard output stream; with -o the server writes the file.\n"
+              << "  Relative paths are resolved in dsa submit's working directory.\n"
+              << "Example:\n"
+              << "  $dsa serve --socket=/tmp/dsa.sock -f ... -r ... --template_dna=... &\n"
+              << "  $dsa submit --socket=/tmp/dsa.sock fw_reads.fastq rv_reads.fastq > output.csv\n"
+              << "  $dsa submit --socket=/tmp/dsa.sock --shutdown" << std::endl;
     std::cout << "\nOUTPUT:\n"
               << "Output is printed as tab-delimited text to the terminal stanard output stream.\n"
-              << "To write to a file, use output redirection (e.g. \"dsa ... > output.csv\").\n"
+              << "To write to a file, use output redirection (e.g. \"dsa ... > output.csv\") or -o.\n"
+              << "If the -o file name ends in .gz the text output is gzip compressed on the fly\n"
+              << "  using several threads (e.g. \"-o output.tsv.gz\").\n"
+              << "With --output_format=columnar the same data are written to the -o file as binary\n"
+              << "  column blocks which dsa-util can read directly (see dsa-util --help).\n"
               << "Program output is divided into several sections:\n"
               << "\n#Settings# lists the values of the input parameters.\n"
               << "\n#Parse# shows the numbers of sequences that were removed by quality control.\n"
@@ -123,7 +176,16 @@ print_help() {
               << "    Should be interpreted as:\n"
               << "       Template --MATIH-KA\n"
               << "                  |: :| ||\n"
-              << "      Alignment ASML-VHQKA" << std::endl;
+              << "      Alignment ASML-VHQKA\n"
+              << "  With --compact_alignments, residues identical to the template are written as '.'\n"
+              << "    and runs of n identical residues as '.n' (e.g. '.173'); only differing residues\n"
+              << "    are written out. The same applies to codons with --show_codons=horizontal, where\n"
+              << "    differing codons are written as nucleotides. The #Templates# section gains a 4th\n"
+              << "    column with the template nucleotides. Use 'dsa-util expand' to restore full strings.\n"
+              << "    Example:\n"
+              << "       Template   MATIHKA\n"
+              << "      Alignment   asML-VHqKA\n"
+              << "        Compact   as.L-V.q.2" << std::endl;
     std::cout << "\n#Substitutions# contains a grid of amino acid mutation frequencies relative to the template.\n"
               << "  Column headers show the numbered residues of the template (see --number_from).\n"
               << "  Row headers show the different possible mutations.\n"
@@ -145,6 +207,30 @@ print_help() {
               << "  Column 1 contains the number of UMI groups encoding this sequence\n"
               << "  Column 2 contains the number of PCR reads encoding this sequence\n"
               << "  Column 3 contains the amino unique acid sequence" << std::endl;
+    std::cout << "\n#Profile# is written last with --profile and lists, for each stage of the analysis,\n"
+              << "the wall and CPU seconds, the items (reads, ORFs, alignments) it was given and handed\n"
+              << "on, items per second, bytes allocated and the peak resident memory of the process\n"
+              << "since it started.\n"
+              << "  CPU time and allocations are counted for the whole process, so stages that would\n"
+              << "  overlap are not told apart: with -x, the forward and reverse branches, which run at\n"
+              << "  the same time, are one stage, and --profile (like --perf_counters and\n"
+              << "  --track_allocations) cannot be used with dsa serve or with --batch_jobs > 1.\n"
+              << "  The same numbers, plus the time to write the output, are written as JSON to the\n"
+              << "  output file name with .profile.json appended, or to the standard error stream\n"
+              << "  when there is no output file.\n"
+              << "With --perf_counters the section also lists the threads counted, their CPU time\n"
+              << "  (task clock) and their cycles, instructions, instructions per cycle, cache misses and\n"
+              << "  branch misses. These are read with Linux perf_event_open and need no extra tools;\n"
+              << "  where the hardware events are unavailable (no PMU, perf_event_paranoid > 2) they\n"
+              << "  are NA.\n"
+              << "With --track_allocations an #Allocations# section follows, with one line per stage\n"
+              << "  and allocator (simd_allocator for Polymer buffers, operator new for the rest): calls,\n"
+              << "  bytes allocated, bytes live and the peak of bytes live. A free counts against the\n"
+              << "  stage that allocated the block, whichever thread makes it, so bytes live is what\n"
+              << "  that stage allocated and is still in use. Like CPU time these are for the whole\n"
+              << "  process, but only since the sample started: with --batch, each sample lists its\n"
+              << "  own, and bytes live and the peak are counted from what was live when it started.\n"
+              << "  The JSON lists them too." << std::endl;
     std::cout << "\nOPTIONS:" << std::endl;
     print_opthelp(options);
 }
@@ -280,6 +366,15 @@ parse_argv(int argc, char **argv) {
         //flags
         {"no_header",      no_argument, &p.no_header_flag,      1},
         {"skip_assembly",  no_argument, &p.skip_assembly_flag,  1},
+        {"compact_alignments", no_argument, &p.compact_alignments_flag, 1},
+        {"thread_stats",   no_argument, &p.thread_stats_flag,   1},
+        {"staged_front_end", no_argument, &p.staged_front_end_flag, 1},
+        {"pin_threads",    no_argument, &p.pin_threads_flag,    1},
+        {"shutdown",       no_argument, &p.shutdown_flag,       1},
+        {"profile",        no_argument, &p.profile_flag,        1},
+        {"perf_counters",  no_argument, &p.perf_counters_flag,  1},
+        {"track_allocations", no_argument, &p.track_allocations_flag, 1},
+        {"progress",       no_argument, &p.progress_flag,       1},
         //options  
         {"min_aln",        required_argument, 0, 'a'}, //minimum alignment score (fraction of max)
         {"fw_ref",         required_argument, 0, 'f'}, //forward UMI/reference DNA sequence
@@ -292,6 +387,19 @@ parse_argv(int argc, char **argv) {
         {"min_overlap",    required_argument, 0, 'v'}, //mimimum overlap in nucleotide for paired ends
         {"number_from",    optional_argument, 0, 'n'}, //number template residues in subs matrix starting from n
         {"show_codons",    required_argument, 0, 'c'}, //how to output codons
+        {"output",         required_argument, 0, 'o'}, //output filename
+        {"output_format",  required_argument, 0,  0 }, //text or columnar
+        {"threads",        required_argument, 0,  0 }, //worker thread count
+        {"qc_threads",     required_argument, 0,  0 }, //threads in the parse/QC stage
+        {"assembly_threads", required_argument, 0,  0 }, //threads in the assembly stage
+        {"queue_depth",    required_argument, 0,  0 }, //capacity of the queues between stages
+        {"batch",          required_argument, 0,  0 }, //manifest of samples
+        {"batch_jobs",     required_argument, 0,  0 }, //samples in flight at once
+        {"socket",         required_argument, 0,  0 }, //Unix socket of dsa serve/submit
+        {"serve_jobs",     required_argument, 0,  0 }, //jobs dsa serve runs at once
+        {"trace",          required_argument, 0,  0 }, //Chrome trace output file
+        {"metrics_file",   required_argument, 0,  0 }, //Prometheus textfile of progress counters
+        {"progress_interval", required_argument, 0,  0 }, //seconds between progress reports
         {"split",          required_argument, 0,  0 }, //for a split template, e.g. V region CDR3, J/CH
         {"template_db",    required_argument, 0,  0 }, //file containing multiple templates
         {"trim",           required_argument, 0,  0 },
@@ -302,12 +410,22 @@ parse_argv(int argc, char **argv) {
         {nullptr,        0,                        0,  0 }  //end-of-list sentinel
     };
 
-    const char *opt_chars = "f:g:r:t:d:a:b:u:q:v:m:n:c:svx";
+    const char *opt_chars = "f:g:r:t:d:a:b:u:q:v:m:n:c:o:svx";
 
     std::regex trim_regex(R"-(([0-9]+),([0-9]+))-");
     std::smatch match;
     std::string optstring;
     std::optional<CodonOutput> co;
+    std::optional<OutputFormat> of;
+
+    //dsa serve and dsa submit are commands; the options follow them
+    if (argc > 1 && std::strcmp(argv[1], "serve") == 0) {
+        p.command = Command::Serve;
+        optind = 2;
+    } else if (argc > 1 && std::strcmp(argv[1], "submit") == 0) {
+        p.command = Command::Submit;
+        optind = 2;
+    }
 
     for (;;) {
         int option_index = 0;
@@ -356,6 +474,63 @@ parse_argv(int argc, char **argv) {
                         exit (EXIT_FAILURE);
                     }
                     p.trims.push_back({std::stol(match.str(1)), std::stol(match.str(2))});
+                } else if (std::strcmp(long_options[option_index].name, "output_format") == 0) {
+                    of = output_format_from_string(optarg);
+                    if (!of) {
+                        std::cerr << "output_format must be one of 'text' or 'columnar'" << std::endl;
+                        exit (EXIT_FAILURE);
+                    }
+                    p.output_format = *of;
+                } else if (std::strcmp(long_options[option_index].name, "threads") == 0) {
+                    p.threads = std::strtol(optarg, nullptr, 10);
+                    if (errno != 0 || p.threads < 1) {
+                        std::cerr << "threads must be an integer >= 1" << std::endl;
+                        exit (EXIT_FAILURE);
+                    }
+                } else if (std::strcmp(long_options[option_index].name, "qc_threads") == 0) {
+                    p.qc_threads = std::strtol(optarg, nullptr, 10);
+                    if (errno != 0 || p.qc_threads < 1) {
+                        std::cerr << "qc_threads must be an integer >= 1" << std::endl;
+                        exit (EXIT_FAILURE);
+                    }
+                } else if (std::strcmp(long_options[option_index].name, "assembly_threads") == 0) {
+                    p.assembly_threads = std::strtol(optarg, nullptr, 10);
+                    if (errno != 0 || p.assembly_threads < 1) {
+                        std::cerr << "assembly_threads must be an integer >= 1" << std::endl;
+                        exit (EXIT_FAILURE);
+                    }
+                } else if (std::strcmp(long_options[option_index].name, "queue_depth") == 0) {
+                    p.queue_depth = std::strtol(optarg, nullptr, 10);
+                    if (errno != 0 || p.queue_depth < 1) {
+                        std::cerr << "queue_depth must be an integer >= 1" << std::endl;
+                        exit (EXIT_FAILURE);
+                    }
+                } else if (std::strcmp(long_options[option_index].name, "batch") == 0) {
+                    p.batch_filename = optarg;
+                } else if (std::strcmp(long_options[option_index].name, "batch_jobs") == 0) {
+                    p.batch_jobs = std::strtol(optarg, nullptr, 10);
+                    if (errno != 0 || p.batch_jobs < 1) {
+                        std::cerr << "batch_jobs must be an integer >= 1" << std::endl;
+                        exit (EXIT_FAILURE);
+                    }
+                } else if (std::strcmp(long_options[option_index].name, "trace") == 0) {
+                    p.trace_filename = optarg;
+                } else if (std::strcmp(long_options[option_index].name, "metrics_file") == 0) {
+                    p.metrics_filename = optarg;
+                } else if (std::strcmp(long_options[option_index].name, "progress_interval") == 0) {
+                    p.progress_interval = std::strtol(optarg, nullptr, 10);
+                    if (errno != 0 || p.progress_interval < 1) {
+                        std::cerr << "progress_interval must be an integer >= 1" << std::endl;
+                        exit (EXIT_FAILURE);
+                    }
+                } else if (std::strcmp(long_options[option_index].name, "socket") == 0) {
+                    p.socket_filename = optarg;
+                } else if (std::strcmp(long_options[option_index].name, "serve_jobs") == 0) {
+                    p.serve_jobs = std::strtol(optarg, nullptr, 10);
+                    if (errno != 0 || p.serve_jobs < 1) {
+                        std::cerr << "serve_jobs must be an integer >= 1" << std::endl;
+                        exit (EXIT_FAILURE);
+                    }
                 }
                 break;
             case 'a':
@@ -399,6 +574,9 @@ parse_argv(int argc, char **argv) {
                     exit (EXIT_FAILURE);
                 }
                 break;
+            case 'o':
+                p.output_filename = optarg;
+                break;
             case 'n':
                 p.number_from = std::strtol(optarg, nullptr, 10);
                 if (errno != 0 || p.number_from < 0) {
@@ -443,17 +621,87 @@ parse_argv(int argc, char **argv) {
         }
     }
 
-    if (optind ==  argc) {
-        std::cerr << "missing positional argument: forward_reads.fastq" << std::endl;
+    if (p.perf_counters_flag || p.track_allocations_flag) p.profile_flag = 1;
+
+    if (p.command != Command::Analyze && p.socket_filename.empty()) {
+        std::cerr << "dsa serve and dsa submit require a socket (--socket)" << std::endl;
         exit (EXIT_FAILURE);
     }
-    p.fw_filename = argv[optind++];
-
-    if (optind == argc) {
-        std::cerr << "missing positional argument: reverse_reads.fastq" << std::endl;
+    if (p.command == Command::Analyze && !p.socket_filename.empty()) {
+        std::cerr << "--socket can only be used with dsa serve or dsa submit" << std::endl;
+        exit (EXIT_FAILURE);
+    }
+    if (p.command != Command::Submit && p.shutdown_flag) {
+        std::cerr << "--shutdown can only be used with dsa submit" << std::endl;
         exit (EXIT_FAILURE);
-    } 
-    p.rv_filename = argv[optind++];
+    }
+
+    //a dsa submit job is only file names; the server has the analysis options
+    if (p.command == Command::Submit) {
+        if (!p.shutdown_flag) {
+            if (argc - optind != 2) {
+                std::cerr << "dsa submit requires forward_reads.fastq and reverse_reads.fastq" << std::endl;
+                exit (EXIT_FAILURE);
+            }
+            p.fw_filename = argv[optind++];
+            p.rv_filename = argv[optind++];
+        }
+        if (optind != argc) {
+            std::cerr << "unexpected positional argument: '" << argv[optind] << "'" << std::endl;
+            exit (EXIT_FAILURE);
+        }
+        return p;
+    }
+
+    //a stage's profile reads counters of the whole process, so it is only right while no other run overlaps it
+    const char *profile_option = p.track_allocations_flag ? "--track_allocations"
+                               : p.perf_counters_flag     ? "--perf_counters" : "--profile";
+
+    //dsa serve takes the fastq files and outputs from its jobs
+    if (p.command == Command::Serve) {
+        if (!p.output_filename.empty() || !p.batch_filename.empty()) {
+            std::cerr << "dsa serve takes input and output file names from its jobs and cannot be used with -o or --batch" << std::endl;
+            exit (EXIT_FAILURE);
+        }
+        if (p.thread_stats_flag) {
+            std::cerr << "--thread_stats cannot be used with dsa serve: jobs running at the same time share the thread pool" << std::endl;
+            exit (EXIT_FAILURE);
+        }
+        if (p.profile_flag) {
+            std::cerr << profile_option << " cannot be used with dsa serve: jobs running at the same time share the process" << std::endl;
+            exit (EXIT_FAILURE);
+        }
+        if (!p.trace_filename.empty()) {
+            std::cerr << "--trace cannot be used with dsa serve: the trace of every job would be kept until the server exits" << std::endl;
+            exit (EXIT_FAILURE);
+        }
+    //with --batch the fastq files and outputs come from the manifest
+    } else if (!p.batch_filename.empty()) {
+        if (!p.output_filename.empty()) {
+            std::cerr << "--batch takes output file names from the manifest and cannot be used with -o, --output" << std::endl;
+            exit (EXIT_FAILURE);
+        }
+        if (p.thread_stats_flag && p.batch_jobs > 1) {
+            std::cerr << "--thread_stats requires --batch_jobs=1: samples running at the same time share the thread pool" << std::endl;
+            exit (EXIT_FAILURE);
+        }
+        if (p.profile_flag && p.batch_jobs > 1) {
+            std::cerr << profile_option << " requires --batch_jobs=1: samples running at the same time share the process" << std::endl;
+            exit (EXIT_FAILURE);
+        }
+    } else {
+        if (optind ==  argc) {
+            std::cerr << "missing positional argument: forward_reads.fastq" << std::endl;
+            exit (EXIT_FAILURE);
+        }
+        p.fw_filename = argv[optind++];
+
+        if (optind == argc) {
+            std::cerr << "missing positional argument: reverse_reads.fastq" << std::endl;
+            exit (EXIT_FAILURE);
+        } 
+        p.rv_filename = argv[optind++];
+    }
 
     if (optind != argc) {
         std::cerr << "unexpected positional argument: '" << argv[optind] << "'" << std::endl;
@@ -477,6 +725,18 @@ parse_argv(int argc, char **argv) {
     }
     */
 
+    if (p.compact_alignments_flag &&
+        (p.codon_output == CodonOutput::Ascii || p.codon_output == CodonOutput::Vertical)) {
+        std::cerr << "--compact_alignments supports only horizontal or no codon output (-c, --show_codons)" << std::endl;
+        exit (EXIT_FAILURE);
+    }
+
+    if (p.output_format == OutputFormat::Columnar && p.output_filename.empty() && p.batch_filename.empty() &&
+        p.command != Command::Serve) {
+        std::cerr << "--output_format=columnar requires an output file (-o, --output)" << std::endl;
+        exit (EXIT_FAILURE);
+    }
+
     if (p.trims.empty()) {
         for (const auto &src : p.template_sources) p.trims.push_back({0,0});
     }
@@ -203,7 +203,7 @@ size_t ConstMapping::size() const { return impl_->size(); }
 const char* ConstMapping::begin() const { return impl_->c_str(); }
 const char* ConstMapping::end()   const { return begin() ? begin() + size() : begin(); }
 
-void ConstMapping::unmap() { impl_->unmap(); }
+void ConstMapping::unmap() { if (impl_) impl_->unmap(); }
 
 const char *
 next_lines(const char *cur, size_t n, const char *end) {
@@ -24,14 +24,21 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "mainfunctions.h"
 
 #include <algorithm>
+#include <chrono>
+#include <iomanip>
 #include <numeric>
 #include <thread>
 #include <unordered_map>
 
 #include "abs.h"
 #include "align.h"
+#include "columnar.h"
 #include "io.h"
+#include "mpmc.h"
+#include "numa.h"
 #include "parallelism.h"
+#include "progress.h"
+#include "trace.h"
 #include "umi.h"
 
 #undef min
@@ -78,251 +85,457 @@ AlignmentTemplate::label(const std::string &delim) const {
     return s;
 }
 
+/** Parse the fastq record at begin into rd, which is left empty if the record has
+  * non-ATGC bases or mismatched quality length. Returns the start of the next record.
+  */
+static const char *
+parse_fastq_record(const char *begin, const char *end, Read &rd) {
+    size_t stripped = 0;
+    begin = bio::skipline(begin, end, '\n');            //skip header
+    begin = bio::getline(begin, end, rd.dna, stripped); //copy dna
+    begin = bio::skipline(begin, end, '\n');            //skip '+'
+    begin = bio::getline(begin, end, rd.qual);          //copy quality
+
+    if (stripped != 0 || rd.dna.size() != rd.qual.size()) rd = Read();
+    return begin;
+}
 
-std::vector<Read>
-extract_read_data(const ConstMapping &mapping) {
-    const unsigned int thread_count = std::thread::hardware_concurrency();
+/** Parse the fastq records in [begin, end), which must start at a record. */
+static void
+parse_fastq_records(const char *begin, const char *end, std::vector<Read> &result) {
+    result.clear();
+    Read rd;
+    while (begin != end) {
+        begin = parse_fastq_record(begin, end, rd);
+        result.push_back(rd);
+    }
+}
 
-    //divide the memory up into evenly sized chunks
-    size_t chunk = mapping.size() / thread_count;
-    std::vector<const char *> breakpoints(thread_count+1, nullptr);
-    for (size_t i=0; i<thread_count; ++i) breakpoints[i] = mapping.begin() + i * chunk;
-    breakpoints.back() = mapping.end();
+/** QC one read pair (see qc_reads()); on success the UMI barcode is in fw. */
+static bool
+qc_read_pair(Read &fw,
+             Read &rv,
+             const std::vector<UMIExtractor> &fwexs,
+             const std::vector<UMIExtractor> &rvexs,
+             const Params &params,
+             ParseLog &log) {
+    if (fw.empty()) {
+        ++log.filter_invalid_chars;
+        return false;
+    }
 
-    //move each chunk pointer to the beginning of the next record
-    for (size_t i=1; i<breakpoints.size()-1; ++i) {
-        breakpoints[i] = seek_next(breakpoints[i], mapping.begin(), breakpoints.back());
+    if (rv.empty()) {
+        ++log.filter_invalid_chars;
+        return false;
     }
 
-    auto process_fastq = [](const char *begin,
-                            const char *end,
-                            std::vector<Read> &result)->void {
-        result.clear();
-        Read rd;
-        size_t stripped = 0;
-        while (begin != end) {
-            begin = bio::skipline(begin, end, '\n');            //skip header
-            begin = bio::getline(begin, end, rd.dna, stripped); //copy dna
-            begin = bio::skipline(begin, end, '\n');            //skip '+'
-            begin = bio::getline(begin, end, rd.qual);          //copy quality
-
-            if (stripped != 0 || rd.dna.size() != rd.qual.size()) {
-                result.push_back(Read());
-            } else {
-                result.push_back(rd);
-            }
-        }
-    };
+    while (!fw.empty() && fw.qual.back() < params.tp_qual_min) fw.pop_back();
+    while (!rv.empty() && rv.qual.back() < params.tp_qual_min) rv.pop_back();
 
-    //spawn threads to perform the extraction
-    std::vector<std::thread> threads(thread_count-1);
-    vecvec<Read>             partial_results(thread_count);
-
-    size_t i=0;
-    for (; i<threads.size(); ++i) {
-        const char *begin = breakpoints[i  ];
-        const char *end   = breakpoints[i+1];
-        threads[i] = std::thread(process_fastq,
-                                 begin,
-                                 end,
-                                 std::ref(partial_results[i]));
+    ExtractedUMI fwumi;
+    for (const UMIExtractor &fwex : fwexs) {
+        fwumi = fwex(fw.dna.begin(), fw.dna.end());
+        if (fwumi.valid()) break;
+    }
+    if (fwumi.invalid()) {
+        ++log.filter_no_fw_umi;
+        return false;
     }
-    process_fastq(breakpoints[i], breakpoints[i+1], partial_results[i]);
-
-    for (auto &th : threads) th.join();
 
-    //concat partial results from each thread in a linked list
-    std::vector<Read> result;
-    size_t total_size = 0;
-    for (const auto &pr : partial_results) total_size += pr.size();
-    result.reserve(total_size);
-
-    for (auto &pr : partial_results) {
-        result.insert(
-            result.cend(),
-            std::make_move_iterator(pr.begin()),
-            std::make_move_iterator(pr.end()  ));
+    ExtractedUMI rvumi;
+    for (const UMIExtractor &rvex : rvexs) {
+        rvumi = rvex(rv.dna.begin(), rv.dna.end());
+        if (rvumi.valid()) break;
+    }
+    if (rvumi.invalid()) {
+        ++log.filter_no_rv_umi;
+        return false;
     }
 
-    return result;
-}
+    fw.dna.exo(fwumi.from + fwumi.length, 0);
+    fw.qual = fw.qual.substr(fwumi.from + fwumi.length);
 
-std::vector<ReadPair>
-qc_reads(
-    std::vector<Read> &&fw,
-    std::vector<Read> &&rv,
-    const std::vector<UMIExtractor> &fwexs,
-    const std::vector<UMIExtractor> &rvexs,
-    const Params &params,
-    ParseLog &log)
-{
-    assert(fw.size() == rv.size());
-    std::vector<ReadPair> result;
+    rv.dna.exo(rvumi.from + rvumi.length, 0);
+    rv.qual = rv.qual.substr(rvumi.from + rvumi.length);
 
-    const unsigned int thread_count = std::thread::hardware_concurrency();
-    const size_t chunk = fw.size() / thread_count;
+    fw.barcode.reserve(fwumi.barcode.size() + rvumi.barcode.size());
+    fw.barcode += fwumi.barcode;
+    fw.barcode += rvumi.barcode;
 
-    std::vector<std::thread> threads(thread_count-1);
-    vecvec<ReadPair>         partial_results(thread_count);
-    std::vector<ParseLog>    partial_logs(thread_count);
+    return true;
+}
 
-    typedef std::vector<Read>::iterator IterT;
+/** QC n read pairs starting at ff and rr (see qc_reads()); output receives the pairs that pass. */
+template<typename IterT>
+static void
+qc_read_pairs(IterT ff,
+              IterT rr,
+              size_t n,
+              const std::vector<UMIExtractor> &fwexs,
+              const std::vector<UMIExtractor> &rvexs,
+              const Params &params,
+              std::vector<ReadPair> &output,
+              ParseLog &log) {
+    output.clear();
+    for (const IterT last = ff + n; ff != last; ++ff, ++rr) {
+        if (!qc_read_pair(*ff, *rr, fwexs, rvexs, params, log)) continue;
+
+        ReadPair rd;
+        rd.fw = std::move(*ff);
+        rd.rv = std::move(*rr);
+
+        output.push_back(std::move(rd));
+    }
+}
 
-    auto perform_qc = [&](IterT ff, 
-                        IterT rr,
-                        size_t n,
-                        std::vector<ReadPair> &output,
-                        ParseLog &log)->void {
-        output.clear();
-        for (const IterT last = ff + n; ff != last; ++ff, ++rr) {
-            if (ff->empty()) {
-                ++log.filter_invalid_chars;
-                continue;
-            }
+/** Assemble one pair (see assemble_reads()); the assembled read is appended to output. */
+static void
+assemble_read_pair(Read &&fw, Read &&rv, const Params &params, std::vector<Read> &output, ParseLog &log) {
+    Read rd = Read::assemble(
+        std::move(fw),
+        std::move(rv),
+        params.min_overlap,
+        params.max_mismatches);
+    
+    if (rd.empty()) {
+        ++log.filter_could_not_assemble;
+        return;
+    }
 
-            if (rr->empty()) {
-                ++log.filter_invalid_chars;
-                continue;
-            }
+    rd.dna.detach(); //outlives the front end's arena
+    output.push_back(std::move(rd));
+}
 
-            while (!ff->empty() && ff->qual.back() < params.tp_qual_min) ff->pop_back();
-            while (!rr->empty() && rr->qual.back() < params.tp_qual_min) rr->pop_back();
+/** Assemble each pair (see assemble_reads()); assembled reads are appended to output. */
+static void
+assemble_read_pairs(std::vector<ReadPair> &pairs, const Params &params, std::vector<Read> &output, ParseLog &log) {
+    output.reserve(output.size() + pairs.size());
+    for (ReadPair &pair : pairs) assemble_read_pair(std::move(pair.fw), std::move(pair.rv), params, output, log);
+}
 
-            ExtractedUMI fwumi;
-            for (const UMIExtractor &fwex : fwexs) {
-                fwumi = fwex(ff->dna.begin(), ff->dna.end());
-                if (fwumi.valid()) break;
-            }
-            if (fwumi.invalid()) {
-                ++log.filter_no_fw_umi;
-                continue;
-            }
+/** Parse, QC and assemble the record pairs in [ff, fend) and [rr, rend) one pair
+  * at a time, so that each read stays in cache from parsing to assembly. With
+  * --skip_assembly the fw and rv reads go to reads and rv_reads instead.
+  */
+static void
+process_record_pairs(const char *ff,
+                     const char *fend,
+                     const char *rr,
+                     const char *rend,
+                     const std::vector<UMIExtractor> &fwexs,
+                     const std::vector<UMIExtractor> &rvexs,
+                     const Params &params,
+                     std::vector<Read> &reads,
+                     std::vector<Read> &rv_reads,
+                     ParseLog &log) {
+    const size_t assembled = reads.size();
+    size_t parsed = 0, passed = 0;
+    while (ff != fend) {
+        Read fw, rv;
+        ff = parse_fastq_record(ff, fend, fw);
+        rr = parse_fastq_record(rr, rend, rv);
+        ++parsed;
+
+        if (!qc_read_pair(fw, rv, fwexs, rvexs, params, log)) continue;
+        ++passed;
+
+        if (params.skip_assembly_flag) {
+            rv.barcode = fw.barcode;
+            fw.dna.detach();
+            rv.dna.detach();
+            reads.push_back(std::move(fw));
+            rv_reads.push_back(std::move(rv));
+        } else {
+            assemble_read_pair(std::move(fw), std::move(rv), params, reads, log);
+        }
+    }
 
-            ExtractedUMI rvumi;
-            for (const UMIExtractor &rvex : rvexs) {
-                rvumi = rvex(rr->dna.begin(), rr->dna.end());
-                if (rvumi.valid()) break;
-            }
-            if (rvumi.invalid()) {
-                ++log.filter_no_rv_umi;
-                continue;
-            }
+    Progress &progress = Progress::instance();
+    progress.add(Progress::ReadsParsed, parsed);
+    progress.add(Progress::ReadsPassedQc, passed);
+    if (!params.skip_assembly_flag) progress.add(Progress::ReadsAssembled, reads.size() - assembled);
+}
 
-            ff->dna.exo(fwumi.from + fwumi.length, 0);
-            ff->qual = ff->qual.substr(fwumi.from + fwumi.length);
+SegmentedVector<Read>
+extract_read_data(const ConstMapping &mapping) {
+    const size_t chunks = chunk_count(mapping.size());
 
-            rr->dna.exo(rvumi.from + rvumi.length, 0);
-            rr->qual = rr->qual.substr(rvumi.from + rvumi.length);
+    //divide the memory up into evenly sized chunks
+    size_t chunk = mapping.size() / chunks;
+    std::vector<const char *> breakpoints(chunks+1, nullptr);
+    for (size_t i=0; i<chunks; ++i) breakpoints[i] = mapping.begin() + i * chunk;
+    breakpoints.back() = mapping.end();
 
-            ff->barcode.reserve(fwumi.barcode.size() + rvumi.barcode.size());
-            ff->barcode += fwumi.barcode;
-            ff->barcode += rvumi.barcode;
+    //move each chunk pointer to the beginning of the next record
+    for (size_t i=1; i<breakpoints.size()-1; ++i) {
+        breakpoints[i] = seek_next(breakpoints[i], mapping.begin(), breakpoints.back());
+    }
 
-            ReadPair rd;
-            rd.fw = std::move(*ff);
-            rd.rv = std::move(*rr);
+    //run one task per chunk to perform the extraction
+    vecvec<Read> partial_results(chunks);
+    parallel_for(chunks, [&](size_t i) {
+        parse_fastq_records(breakpoints[i], breakpoints[i+1], partial_results[i]);
+    });
 
-            output.push_back(std::move(rd));
-        }
-    };
+    return SegmentedVector<Read>(std::move(partial_results));
+}
 
-    size_t i=0;
-    auto ff=fw.begin(), rr=rv.begin();
-    for (; i<thread_count-1; ++i, ff += chunk, rr += chunk) {
-        threads[i] = std::thread(
-            perform_qc, ff, rr, chunk, std::ref(partial_results[i]), std::ref(partial_logs[i])
-        );
-    }
-    perform_qc(ff, rr, fw.end()-ff, partial_results[i], partial_logs[i]);
+SegmentedVector<ReadPair>
+qc_reads(
+    SegmentedVector<Read> &&fw,
+    SegmentedVector<Read> &&rv,
+    const std::vector<UMIExtractor> &fwexs,
+    const std::vector<UMIExtractor> &rvexs,
+    const Params &params,
+    ParseLog &log)
+{
+    assert(fw.size() == rv.size());
+    std::vector<ReadPair> result;
 
-    for (auto &th : threads) th.join();
+    const size_t chunks = chunk_count(fw.size());
 
-    size_t result_size = 0;
-    for (const auto &pr : partial_results) result_size += pr.size();
-    result.reserve(result_size);
+    vecvec<ReadPair>      partial_results(chunks);
+    std::vector<ParseLog> partial_logs(chunks);
 
-    for (auto &pr : partial_results) {
-        result.insert(
-            result.cend(),
-            std::make_move_iterator(pr.begin()),
-            std::make_move_iterator(pr.end()  )
-        );
-    }
+    parallel_for(chunks, [&](size_t i) {
+        const size_t lo = fw.size() * i / chunks, hi = fw.size() * (i + 1) / chunks;
+        qc_read_pairs(fw.begin() + lo, rv.begin() + lo, hi - lo, fwexs, rvexs, params, partial_results[i], partial_logs[i]);
+    });
 
     log = std::accumulate(partial_logs.begin(), partial_logs.end(), log);
 
-    fw.clear(); fw.shrink_to_fit();
-    rv.clear(); rv.shrink_to_fit();
+    fw.clear();
+    rv.clear();
 
-    return result;
+    return SegmentedVector<ReadPair>(std::move(partial_results));
 }
 
-std::vector<Read>
+SegmentedVector<Read>
 assemble_reads(
-    std::vector<ReadPair> &&pairs,
+    SegmentedVector<ReadPair> &&pairs,
     const Params &params,
     ParseLog &log) {
-    std::vector<Read> result;
+    SegmentedVector<Read> result;
+
+    //assembly runs serially; each input segment becomes one output segment
+    //and is released as soon as it has been assembled
+    for (size_t i=0; i<pairs.segment_count(); ++i) {
+        std::vector<ReadPair> &segment = pairs.segment(i);
+        std::vector<Read> output;
+        assemble_read_pairs(segment, params, output, log);
+
+        segment.clear();
+        segment.shrink_to_fit();
+        result.append_segment(std::move(output));
+    }
 
-    const unsigned int thread_count = 1; //std::thread::hardware_concurrency();
-    const size_t chunk = pairs.size() / thread_count;
-
-    std::vector<std::thread> threads(thread_count-1);
-    vecvec<Read>             partial_results(thread_count);
-    std::vector<ParseLog>    partial_logs(thread_count);
-
-    typedef std::vector<ReadPair>::iterator IterT;
-
-    auto perform_assembly = [&](IterT ii, 
-                        size_t n,
-                        std::vector<Read> &output,
-                        ParseLog &log)->void {
-
-        output.clear();
-        for (const IterT last = ii + n; ii != last; ++ii) {
-            Read rd = Read::assemble(
-                std::move(ii->fw),
-                std::move(ii->rv),
-                params.min_overlap,
-                params.max_mismatches);
-            
-            if (rd.empty()) {
-                ++log.filter_could_not_assemble;
-                continue;
-            }
+    pairs.clear();
 
-            output.push_back(std::move(rd));
-        }
+    return result;
+}
+
+FrontEnd
+stream_front_end(
+    const ConstMapping &fwmap,
+    const ConstMapping &rvmap,
+    const std::vector<UMIExtractor> &fwexs,
+    const std::vector<UMIExtractor> &rvexs,
+    const Params &params,
+    ParseLog &log)
+{
+    //raw fastq bytes (fw + rv) per batch: small enough for a batch to stay in
+    //a core's L2 cache while it is parsed, QC'd and assembled
+    static constexpr size_t BATCH_BYTES = 256 << 10;
+
+    Progress::instance().stage("front end", Progress::ReadsParsed);
+
+    //a batch of raw fastq records, matching in number between the two files
+    struct RawBatch {
+        size_t index = 0;
+        const char *fw_begin = nullptr, *fw_end = nullptr;
+        const char *rv_begin = nullptr, *rv_end = nullptr;
     };
 
-    size_t i=0;
-    auto ii=pairs.begin();
-    for (; i<thread_count-1; ++i, ii += chunk) {
-        threads[i] = std::thread(
-            perform_assembly, ii, chunk, std::ref(partial_results[i]), std::ref(partial_logs[i])
-        );
-    }
-    perform_assembly(ii, pairs.end()-ii, partial_results[i], partial_logs[i]);
+    struct PairBatch {
+        size_t index = 0;
+        std::vector<ReadPair> pairs;
+    };
 
-    for (auto &th : threads) th.join();
+    struct ReadBatch {
+        size_t index = 0;
+        std::vector<Read> reads, rv_reads;
+    };
 
-    size_t result_size = 0;
-    for (const auto &pr : partial_results) result_size += pr.size();
-    result.reserve(result_size);
+    const size_t threads    = ThreadPool::current().size();
+    const size_t qc_threads = params.qc_threads ? params.qc_threads : std::max<size_t>(1, (threads + 1) / 2);
+    const size_t as_threads = params.assembly_threads ? params.assembly_threads : std::max<size_t>(1, threads / 2);
+    const size_t depth      = params.queue_depth ? params.queue_depth : 2 * (qc_threads + as_threads);
+
+    MpmcQueue<RawBatch>  raw(depth);
+    MpmcQueue<PairBatch> qcd(depth);
+    MpmcQueue<ReadBatch> done(depth);
+
+    FrontEnd result;
+    std::vector<ParseLog> logs(qc_threads + as_threads); //one per worker thread
+    std::exception_ptr error;
+
+    //for --thread_stats: slot 0 is the splitter, the workers follow in order
+    result.thread_stats.resize(1 + qc_threads + as_threads);
+    struct BusyTimer {
+        ThreadStats &stats;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        ~BusyTimer() {
+            stats.busy_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            stats.tasks += 1;
+        }
+    };
 
-    for (auto &pr : partial_results) {
-        result.insert(
-            result.cend(),
-            std::make_move_iterator(pr.begin()),
-            std::make_move_iterator(pr.end()  )
-        );
+    //splitter: cut both files into batches of about BATCH_BYTES; this is
+    //only a scan for line ends, the records are parsed by the next stage
+    std::thread splitter([&] {
+        trace::name_thread("front end splitter");
+        trace::Label trace_label("split fastq into batches");
+        try {
+            const char *ff = fwmap.begin(), *fend = fwmap.end();
+            const char *rr = rvmap.begin(), *rend = rvmap.end();
+            for (size_t index=0; ff != fend || rr != rend; ++index) {
+                RawBatch batch{index, ff, ff, rr, rr};
+                {
+                    BusyTimer busy{result.thread_stats[0]};
+                    trace::Span span("front end");
+                    const size_t first_read = result.total_reads;
+                    while (static_cast<size_t>((ff - batch.fw_begin) + (rr - batch.rv_begin)) < BATCH_BYTES && ff != fend && rr != rend) {
+                        ff = next_lines(ff, 3, fend); //past the 4th newline: next_lines(cur, n) returns
+                        rr = next_lines(rr, 3, rend); //the character after newline n+1
+                        ++result.total_reads;
+                    }
+                    span.items(result.total_reads - first_read);
+                }
+                if ((ff == fend) != (rr == rend)) throw ReadCountError("read count disagreement");
+                batch.fw_end = ff;
+                batch.rv_end = rr;
+                raw.push(std::move(batch));
+            }
+        } catch (...) {
+            error = std::current_exception();
+        }
+        raw.close();
+    });
+
+    //with --pin_threads, spread the workers over the NUMA nodes; each one
+    //allocates, and so first touches, its output batches on its own node
+    std::vector<int> cpus;
+    if (params.pin_threads_flag) cpus = NumaTopology::instance().spread(qc_threads + as_threads);
+    auto pin = [&](size_t t) { if (!cpus.empty()) pin_current_thread(cpus[t]); };
+
+    std::vector<std::thread> qc_workers, as_workers;
+
+    //fused: each worker runs parse, qc and assembly on a batch, one read pair at a time
+    if (!params.staged_front_end_flag) for (size_t t=0; t<qc_threads+as_threads; ++t) qc_workers.emplace_back([&, t] {
+        pin(t);
+        trace::name_thread("front end " + std::to_string(t));
+        trace::Label trace_label(params.skip_assembly_flag ? "parse, qc" : "parse, qc, assemble");
+        Arena::Scope arena; //the parsed reads die with their batch; the reads handed on are detached
+        RawBatch batch;
+        while (raw.pop(batch)) {
+            ReadBatch output{batch.index, {}, {}};
+            {
+                BusyTimer busy{result.thread_stats[1 + t]};
+                trace::Span span("front end");
+                process_record_pairs(batch.fw_begin, batch.fw_end, batch.rv_begin, batch.rv_end,
+                                     fwexs, rvexs, params, output.reads, output.rv_reads, logs[t]);
+                span.items(output.reads.size() + output.rv_reads.size());
+            }
+            done.push(std::move(output));
+        }
+    });
+
+    //staged, qc: parse both halves of a batch and pair up the reads that pass qc
+    if (params.staged_front_end_flag) for (size_t t=0; t<qc_threads; ++t) qc_workers.emplace_back([&, t] {
+        pin(t);
+        trace::name_thread("front end qc " + std::to_string(t));
+        trace::Label trace_label("parse, qc");
+        Arena::Scope arena; //the reads are released once the assembly workers are done with them
+        RawBatch batch;
+        std::vector<Read> fw, rv;
+        while (raw.pop(batch)) {
+            PairBatch output{batch.index, {}};
+            {
+                BusyTimer busy{result.thread_stats[1 + t]};
+                trace::Span span("front end");
+                parse_fastq_records(batch.fw_begin, batch.fw_end, fw);
+                parse_fastq_records(batch.rv_begin, batch.rv_end, rv);
+                qc_read_pairs(fw.begin(), rv.begin(), fw.size(), fwexs, rvexs, params, output.pairs, logs[t]);
+                span.items(output.pairs.size());
+                Progress::instance().add(Progress::ReadsParsed, fw.size());
+                Progress::instance().add(Progress::ReadsPassedQc, output.pairs.size());
+            }
+            qcd.push(std::move(output));
+        }
+    });
+
+    //staged, assembly: assemble the pairs or, with --skip_assembly, split them into fw and rv reads
+    if (params.staged_front_end_flag) for (size_t t=0; t<as_threads; ++t) as_workers.emplace_back([&, t] {
+        pin(qc_threads + t);
+        trace::name_thread("front end assembly " + std::to_string(t));
+        trace::Label trace_label(params.skip_assembly_flag ? "split read pairs" : "assemble");
+        Arena::Scope arena;
+        PairBatch batch;
+        while (qcd.pop(batch)) {
+            ReadBatch output{batch.index, {}, {}};
+            {
+                BusyTimer busy{result.thread_stats[1 + qc_threads + t]};
+                trace::Span span("front end", batch.pairs.size());
+                if (params.skip_assembly_flag) {
+                    output.reads.reserve(batch.pairs.size());
+                    output.rv_reads.reserve(batch.pairs.size());
+                    for (ReadPair &rp : batch.pairs) {
+                        rp.rv.barcode = rp.fw.barcode;
+                        rp.fw.dna.detach();
+                        rp.rv.dna.detach();
+                        output.reads.push_back(std::move(rp.fw));
+                        output.rv_reads.push_back(std::move(rp.rv));
+                    }
+                } else {
+                    assemble_read_pairs(batch.pairs, params, output.reads, logs[qc_threads + t]);
+                    Progress::instance().add(Progress::ReadsAssembled, output.reads.size());
+                }
+            }
+            done.push(std::move(output));
+        }
+    });
+
+    //the stages close the queue that follows them once all their threads are done
+    std::thread closer([&] {
+        for (std::thread &t : qc_workers) t.join();
+        qcd.close();
+        for (std::thread &t : as_workers) t.join();
+        done.close();
+    });
+
+    //batches finish out of order; put them back in input order
+    vecvec<Read> reads, rv_reads;
+    ReadBatch batch;
+    while (done.pop(batch)) {
+        if (reads.size() <= batch.index) {
+            reads.resize(batch.index + 1);
+            rv_reads.resize(batch.index + 1);
+        }
+        reads[batch.index]    = std::move(batch.reads);
+        rv_reads[batch.index] = std::move(batch.rv_reads);
     }
 
-    log = std::accumulate(partial_logs.begin(), partial_logs.end(), log);
+    splitter.join();
+    closer.join();
+    if (error) std::rethrow_exception(error);
 
-    pairs.clear();
-    pairs.shrink_to_fit();
+    log = std::accumulate(logs.begin(), logs.end(), log);
 
+    result.reads    = SegmentedVector<Read>(std::move(reads));
+    result.rv_reads = SegmentedVector<Read>(std::move(rv_reads));
+    result.queue_stats.emplace_back("raw batches", raw.stats());
+    if (params.staged_front_end_flag) result.queue_stats.emplace_back("qc batches", qcd.stats());
+    result.queue_stats.emplace_back("read batches", done.stats());
     return result;
 }
 
@@ -419,98 +632,87 @@ build_consensus_sequence(std::vector<Read> &reads, const Params &params, bool ra
     reads.resize(1);
 }
 
-std::vector<Read>
+SegmentedVector<Read>
 umi_collapse(
-    std::vector<Read> &&reads,
+    SegmentedVector<Read> &&reads,
     const Params &params,
     ParseLog &log,
     bool ragged_ends) {
+    trace::Label trace_label("umi collapse");
+    Progress::instance().stage("umi collapse", Progress::GroupsCollapsed);
     std::vector<Read> result;
 
-    //gather up reads by umi into a hash table
-    std::unordered_map<std::string, std::vector<Read>> groups;
-    for (Read &rd : reads) groups[rd.barcode].push_back(std::move(rd));
+    //gather up reads by umi
+    vecvec<Read> groups = parallel_group_by(reads.begin(), reads.end(),
+        [](const Read &rd)->const std::string & { return rd.barcode; });
     reads.clear();
 
-    const unsigned int thread_count = std::thread::hardware_concurrency();
-    const size_t chunk = groups.size() / thread_count;
-
-    std::vector<std::thread> threads(thread_count-1);
-    vecvec<Read>             partial_results(thread_count);
-    std::vector<ParseLog>    partial_logs(thread_count);
-
-    typedef decltype(groups.begin()) IterT;
- 
-    auto build_consensus = [&](IterT from, IterT to, std::vector<Read> &output, ParseLog &log)->void {
-        output.clear();
-        for (; from != to; ++from) {
-            std::vector<Read> &group = from->second;
-            size_t pre_consensus_group_size = group.size();
+    //group sizes range from one read to thousands so groups are handed out
+    //dynamically rather than in equal shares; each group is replaced by its
+    //consensus, or by a Read with umi_group_size 0 if the group is discarded
+    std::vector<Read>     consensus(groups.size());
+    std::vector<ParseLog> partial_logs(worker_count());
 
-            if (group.size() < params.min_umi_group_size) {
-                log.filter_umi_group_size_too_small += pre_consensus_group_size;
-                continue;
-            }
+    auto build_consensus = [&](std::vector<Read> &group, Read &output, ParseLog &log)->void {
+        output.umi_group_size = 0;
+        size_t pre_consensus_group_size = group.size();
 
-            if (group.size() > 1) {
-                build_consensus_sequence(group, params, ragged_ends);
-            }
-
-            if (group.front().umi_group_size < params.min_umi_group_size) {
-                log.filter_umi_group_size_too_small += pre_consensus_group_size;
-                continue;
-            }
-            
-            if (std::find(group.front().dna.begin(), group.front().dna.end(), Nt::N) != group.front().dna.end()) {
-                ++log.filter_invalid_chars;
-                continue;
-            }
-
-            log.filter_duplicate_umi += pre_consensus_group_size - group.size();
-            output.push_back(std::move(group.front()));
+        if (group.size() < params.min_umi_group_size) {
+            log.filter_umi_group_size_too_small += pre_consensus_group_size;
+            return;
         }
-    };
 
-    size_t i=0;
-    auto from=groups.begin(), to=from;
-    for (; i<thread_count-1; ++i) {
-        std::advance(to, chunk);
-        threads[i] = std::thread(
-            build_consensus, 
-            from, 
-            to,
-            std::ref(partial_results[i]),
-            std::ref(partial_logs[i]));
-        from = to;
-    }
-    build_consensus(from, groups.end(), partial_results[i], partial_logs[i]);
+        if (group.size() > 1) {
+            build_consensus_sequence(group, params, ragged_ends);
+        }
 
-    for (auto &th : threads) th.join();
+        if (group.front().umi_group_size < params.min_umi_group_size) {
+            log.filter_umi_group_size_too_small += pre_consensus_group_size;
+            return;
+        }
+        
+        if (std::find(group.front().dna.begin(), group.front().dna.end(), Nt::N) != group.front().dna.end()) {
+            ++log.filter_invalid_chars;
+            return;
+        }
 
-    size_t result_size = 0;
-    for (const auto &pr : partial_results) result_size += pr.size();
-    result.reserve(result_size);
+        log.filter_duplicate_umi += pre_consensus_group_size - group.size();
+        output = std::move(group.front());
+        group.clear();
+        group.shrink_to_fit();
+    };
 
-    for (auto &pr : partial_results) {
-        result.insert(
-            result.cend(),
-            std::make_move_iterator(pr.begin()),
-            std::make_move_iterator(pr.end()  ));
-    }
+    parallel_guided(groups.size(), [&](size_t worker, size_t lo, size_t hi) {
+        for (size_t i=lo; i<hi; ++i) build_consensus(groups[i], consensus[i], partial_logs[worker]);
+        Progress::instance().add(Progress::GroupsCollapsed, hi - lo);
+    });
+    groups.clear(); groups.shrink_to_fit();
+
+    //keep the surviving consensus sequences, in order
+    result.resize(consensus.size());
+    auto result_end = parallel_compact(
+        std::make_move_iterator(consensus.begin()),
+        std::make_move_iterator(consensus.end()),
+        result.begin(),
+        [](const Read &rd)->bool { return rd.umi_group_size != 0; });
+    result.erase(result_end, result.end());
 
     log = std::accumulate(partial_logs.begin(), partial_logs.end(), log);
 
-    reads.clear(); reads.shrink_to_fit();
+    reads.clear();
 
-    return result;
+    return SegmentedVector<Read>(std::move(result));
 }
 
-std::vector<Orf>
-translate_and_filter_ptcs(std::vector<Read> &&preads, 
+SegmentedVector<Orf>
+translate_and_filter_ptcs(SegmentedVector<Read> &&preads, 
                           const help::Params &p,
                           ParseLog &log,
                           bool reverse_complement)
 {
+    trace::Label trace_label("translate");
+    Progress::instance().stage("translate");
+
     //translate and discard all reads with PTCs
     auto translate_and_filter_ptcs = [&p, &reverse_complement](Read &&rd, ParseLog &log)->std::optional<Orf> {
         std::optional<Orf> opt_orf;
@@ -529,8 +731,7 @@ translate_and_filter_ptcs(std::vector<Read> &&preads,
         return opt_orf;
     };
 
-    std::vector<Orf> orfs;
-    orfs.reserve(preads.size());
+    SegmentedVector<Orf> orfs;
 
     parallel_transform_filter(
         std::make_move_iterator(preads.begin()),
@@ -540,17 +741,19 @@ translate_and_filter_ptcs(std::vector<Read> &&preads,
         log
     );
 
-    preads.clear(); preads.shrink_to_fit();
+    preads.clear();
 
     return orfs;
 };
 
 std::vector<GroupAlignment>
-align_to_multiple_templates(vecvec<Orf> &&orfs,
+align_to_multiple_templates(SplitOrfs &&orfs,
                    const std::vector<std::shared_ptr<const TemplateDatabase>> &dbs,
                    const help::Params &params,
                    ParseLog &log,
                    bool ragged_ends) {
+    trace::Label trace_label("align");
+    Progress::instance().stage("align", Progress::OrfsAligned);
     assert (!dbs.empty());
     std::vector<GroupAlignment> alignments;
     if (orfs.empty()) {
@@ -563,7 +766,7 @@ align_to_multiple_templates(vecvec<Orf> &&orfs,
     };
 
     auto align_to_multiple_templates_worker = [&](
-        std::vector<Orf> &&orfs,
+        std::vector<OrfSegment> &&orfs,
         ParseLog &log)->std::optional<WorkerOutput> {
         assert (orfs.size() == dbs.size());
 
@@ -576,8 +779,8 @@ align_to_multiple_templates(vecvec<Orf> &&orfs,
         for (size_t i=0; i<orfs.size(); ++i) {
             if (dbs[i] == nullptr) {
                 template_ids.push_back(0);
-                alignment.alignment += orfs[i].aas.c_str();
-                alignment.cdns += orfs[i].cdns.c_str();
+                alignment.alignment += orfs[i].aas.as_string_view();
+                alignment.cdns += orfs[i].cdns.as_string_view();
                 continue;
             }
 
@@ -618,20 +821,20 @@ align_to_multiple_templates(vecvec<Orf> &&orfs,
         }
 
         if (template_ids.size() == orfs.size()) {
-            alignment.umi_group_size = orfs.front().umi_group_size;
-            alignment.barcode        = orfs.front().barcode;
+            alignment.umi_group_size = orfs.front().orf->umi_group_size;
+            alignment.barcode        = orfs.front().orf->barcode;
             output = WorkerOutput{std::move(alignment), std::move(template_ids)};
         }
 
+        Progress::instance().add(Progress::OrfsAligned, 1);
         return output;
     };
 
-    std::vector<WorkerOutput> worker_outputs;
-    worker_outputs.reserve(orfs.size());
+    SegmentedVector<WorkerOutput> worker_outputs;
 
     parallel_transform_filter(
-        std::make_move_iterator(orfs.begin()),
-        std::make_move_iterator(orfs.end()  ),
+        std::make_move_iterator(orfs.segments.begin()),
+        std::make_move_iterator(orfs.segments.end()  ),
         std::back_inserter(worker_outputs),
         align_to_multiple_templates_worker,
         log
@@ -689,35 +892,33 @@ align_to_multiple_templates(vecvec<Orf> &&orfs,
     return alignments;
 }
 
-vecvec<Orf>
-split_orfs(std::vector<Orf> &&orfs,
+SplitOrfs
+split_orfs(SegmentedVector<Orf> &&orfs,
            const help::Params &params,
            ParseLog &log) {
-    vecvec<Orf> result;
-    result.reserve(orfs.size());
+    trace::Label trace_label("split");
+    Progress::instance().stage("split");
+    SplitOrfs result;
+    result.orfs = std::move(orfs);
+    result.segments.reserve(result.orfs.size());
 
     //if there's nothing to split we just return a matrix of shape (orfs.size(), 1)
     if (params.split_template_regex.mark_count() == 0) {
-        result.resize(orfs.size());
-        for (size_t i=0; i<orfs.size(); ++i) result[i].push_back(std::move(orfs[i]));
+        for (const Orf &orf : result.orfs) result.segments.push_back({OrfSegment{&orf, orf.cdns, orf.aas}});
         return result;
     }
 
     //otherwise the matrix shape is (orfs.size() - unsplittable, params.split_template_regex.mark_count())
     std::cmatch match;
-    for (Orf &orf : orfs) {
-        std::vector<Orf> splits;
-        splits.resize(params.split_template_regex.mark_count());
-        if (std::regex_match(orf.aas.c_str(), match, params.split_template_regex)) {
+    for (const Orf &orf : result.orfs) {
+        const char *aas = orf.aas.data();
+        if (std::regex_match(aas, aas + orf.aas.size(), match, params.split_template_regex)) {
+            std::vector<OrfSegment> &splits = result.segments.emplace_back();
+            splits.reserve(match.size() - 1);
             for (size_t i=1; i<match.size(); ++i) {
-                Orf &sub = splits[i-1];
-                sub.umi_group_size = orf.umi_group_size;
-                sub.template_id    = orf.template_id;
-                sub.barcode        = orf.barcode;
-                sub.aas            = orf.aas .subclone(match.position(i), match.length(i));
-                sub.cdns           = orf.cdns.subclone(match.position(i), match.length(i));
+                splits.push_back({&orf, orf.cdns.view(match.position(i), match.length(i)),
+                                        orf.aas .view(match.position(i), match.length(i))});
             }
-            result.push_back(std::move(splits));
         } else {
             ++log.filter_split_failed;
         }
@@ -726,4 +927,159 @@ split_orfs(std::vector<Orf> &&orfs,
     return result;
 }
 
+std::vector<Counter<std::string>>
+template_usage(const std::vector<GroupAlignment> &alignments, size_t splits) {
+    std::vector<Counter<std::string>> counters(splits);
+    for (const GroupAlignment& aln : alignments) {
+        const AlignmentTemplate& tpl = *aln.templ;
+        for (size_t i = 0; i < tpl.labels.size(); ++i) counters[i].push_back(tpl.labels[i]);
+    }
+    return counters;
+}
+
+void
+write_columnar(const fs::path &path,
+               const std::string &settings,
+               const help::Params &params,
+               const std::vector<Counter<std::string>> &usage,
+               const std::vector<std::shared_ptr<AlignmentTemplate>> &templates,
+               const std::vector<GroupAlignment> &alignments,
+               const std::vector<Matrix<float>> &substitution_matrices,
+               const std::vector<MutationCount> &mutation_counts) {
+    ColumnarWriter w(path);
+
+    w.add("settings", ColumnType::Bytes, settings.data(), settings.size(), settings.size());
+
+    //the options that shape the text output; number_from is stored as its two's complement
+    w.add("text.codon_output",       std::vector<uint32_t>{static_cast<uint32_t>(params.codon_output)}, 1);
+    w.add("text.number_from",        std::vector<uint64_t>{static_cast<uint64_t>(params.number_from)}, 1);
+    w.add("text.compact_alignments", std::vector<uint8_t>{static_cast<uint8_t>(params.compact_alignments_flag)}, 1);
+    w.add("text.no_header",          std::vector<uint8_t>{static_cast<uint8_t>(params.no_header_flag)}, 1);
+    w.add("text.unique_sequences",   std::vector<uint8_t>{static_cast<uint8_t>(!params.skip_assembly_flag)}, 1);
+
+    //template table
+    std::vector<uint32_t> ids;
+    std::vector<std::string> labels;
+    std::vector<std::string_view> label_views, aas_views, cdns_views;
+    for (const auto &tpl : templates) {
+        ids.push_back(static_cast<uint32_t>(tpl->id));
+        labels.push_back(tpl->label());
+        aas_views.push_back(tpl->aas.as_string_view());
+        cdns_views.push_back(tpl->cdns.as_string_view());
+    }
+    for (const std::string &label : labels) label_views.push_back(label);
+    w.add("templates.id", ids, ids.size());
+    w.add_strings("templates.label", label_views);
+    w.add_strings("templates.aas",   aas_views);
+    w.add_strings("templates.cdns",  cdns_views);
+
+    //template usage, in the order of the text section
+    if (!usage.empty()) {
+        std::vector<uint32_t> splits;
+        std::vector<std::string_view> usage_labels;
+        std::vector<uint64_t> counts;
+        for (size_t i=0; i<usage.size(); ++i) {
+            for (const auto &[label, count] : usage[i]) {
+                splits.push_back(static_cast<uint32_t>(i));
+                usage_labels.push_back(label);
+                counts.push_back(count);
+            }
+        }
+        w.add("usage.split", splits, splits.size());
+        w.add_strings("usage.label", usage_labels);
+        w.add("usage.count", counts, counts.size());
+    }
+
+    //alignment columns
+    const size_t n = alignments.size();
+    std::vector<uint32_t> template_ids(n), group_sizes(n);
+    std::vector<uint64_t> barcode_offsets(1, 0), ops_offsets(1, 0), residue_offsets(1, 0), codon_offsets(1, 0);
+    std::string barcodes, packed, ops, residues, codons;
+    for (size_t i=0; i<n; ++i) {
+        const GroupAlignment &al = alignments[i];
+        template_ids[i] = al.templ ? static_cast<uint32_t>(al.templ->id) : ColumnarFormat::NO_TEMPLATE;
+        group_sizes[i]  = static_cast<uint32_t>(al.umi_group_size);
+
+        barcodes += al.barcode;
+        barcode_offsets.push_back(barcodes.size());
+
+        encode_alignment(al.alignment, ops, residues);
+        ops_offsets.push_back(ops.size());
+        residue_offsets.push_back(residues.size());
+
+        for (char c : al.cdns) if (c != ' ') codons.push_back(c);
+        codon_offsets.push_back(codons.size());
+    }
+    pack_barcode(barcodes, packed);
+
+    w.add("aln.template",           template_ids,    n);
+    w.add("aln.group_size",         group_sizes,     n);
+    w.add("aln.barcode.offsets",    barcode_offsets, barcode_offsets.size());
+    w.add("aln.barcode",            ColumnType::U8, packed.data(), packed.size(), packed.size());
+    w.add("aln.ops.offsets",        ops_offsets,     ops_offsets.size());
+    w.add("aln.ops",                ColumnType::Bytes, ops.data(), ops.size(), n);
+    w.add("aln.residues.offsets",   residue_offsets, residue_offsets.size());
+    w.add("aln.residues",           ColumnType::Bytes, residues.data(), residues.size(), n);
+    w.add("aln.codons.offsets",     codon_offsets,   codon_offsets.size());
+    w.add("aln.codons",             ColumnType::Bytes, codons.data(), codons.size(), n);
+
+    //per-template statistics as dense row-major matrices
+    for (size_t i=0; i<substitution_matrices.size(); ++i) {
+        const Matrix<float> &subs = substitution_matrices[i];
+        std::vector<float> dense(subs.rows() * subs.cols());
+        for (size_t r=0; r<subs.rows(); ++r)
+        for (size_t c=0; c<subs.cols(); ++c) dense[r * subs.cols() + c] = subs.elem(r, c);
+        w.add("subs." + std::to_string(i), dense, subs.rows(), subs.cols());
+
+        if (i >= mutation_counts.size() || mutation_counts[i].total.empty()) continue;
+        const MutationCount &mc = mutation_counts[i];
+        const size_t cols = mc.total.size();
+        std::vector<uint32_t> counts;
+        counts.reserve(3 * cols);
+        for (const auto *row : {&mc.total, &mc.synonymous, &mc.nonsynonymous}) counts.insert(counts.end(), row->begin(), row->end());
+        w.add("mutations." + std::to_string(i), counts, 3, cols);
+    }
+
+    w.close();
+}
+
+void
+report_thread_stats(std::ostream &os, const std::string &stage, double wall_seconds) {
+    ThreadPool &pool = ThreadPool::current();
+    const std::vector<ThreadStats> stats = pool.stats();
+    pool.reset_stats();
+    report_thread_stats(os, stage, wall_seconds, stats);
+}
+
+void
+report_thread_stats(std::ostream &os, const std::string &stage, double wall_seconds, const std::vector<ThreadStats> &stats) {
+    double total = 0.0, busiest = 0.0;
+    for (const ThreadStats &ts : stats) {
+        total  += ts.busy_seconds;
+        busiest = std::max(busiest, ts.busy_seconds);
+    }
+    const double mean = total / stats.size();
+
+    const std::ios_base::fmtflags flags = os.flags();
+    os << std::fixed << std::setprecision(3);
+    os << "#thread stats\t" << stage << "\twall " << wall_seconds << "s\tbusy";
+    for (const ThreadStats &ts : stats) os << ' ' << ts.busy_seconds;
+    os << "\timbalance " << std::setprecision(2) << (mean > 0.0 ? busiest / mean : 1.0) << std::endl;
+    os.flags(flags);
+}
+
+void
+report_queue_stats(std::ostream &os, const std::string &queue, const QueueStats &stats) {
+    const std::ios_base::fmtflags flags = os.flags();
+    os << std::fixed << std::setprecision(2);
+    os << "#queue stats\t" << queue
+       << "\tcapacity " << stats.capacity
+       << "\tbatches " << stats.pushes
+       << "\tmean occupancy " << stats.mean_size
+       << "\tmax occupancy " << stats.max_size
+       << "\tfull waits " << stats.full_waits
+       << "\tempty waits " << stats.empty_waits << std::endl;
+    os.flags(flags);
+}
+
 }; //namespace bio
\ No newline at end of file
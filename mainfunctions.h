@@ -24,13 +24,17 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #ifndef BIO_MAINFUNCTIONS_H_
 #define BIO_MAINFUNCTIONS_H_
 #include <ostream>
+#include <stdexcept>
 #include <unordered_map>
 
 #include "align.h"
 #include "defines.h"
 #include "help.h"
 #include "io.h"
+#include "mpmc.h"
 #include "params.h"
+#include "segmented.h"
+#include "threadpool.h"
 #include "umi.h"
 
 namespace bio {
@@ -140,9 +144,9 @@ struct MutationCount {
   * quality length.
   *
   * @params mapping a memory mapped fastq file
-  * @return the unpaired reads and quality data
+  * @return the unpaired reads and quality data, one segment per parsing task
   */
-std::vector<Read>
+SegmentedVector<Read>
 extract_read_data(const ConstMapping &mapping);
 
 /**
@@ -161,10 +165,10 @@ extract_read_data(const ConstMapping &mapping);
   *
   * @return pairs of reads (not yet assembled) for which both fw and rv passed QC
   */
-std::vector<ReadPair>
+SegmentedVector<ReadPair>
 qc_reads(
-    std::vector<Read> &&fw,
-    std::vector<Read> &&rv,
+    SegmentedVector<Read> &&fw,
+    SegmentedVector<Read> &&rv,
     const std::vector<UMIExtractor> &fwexs,
     const std::vector<UMIExtractor> &rvexs,
     const help::Params &params,
@@ -184,9 +188,61 @@ qc_reads(
   *
   * @return pairs of reads (not yet assembled) for which assembly was successful
   */
-std::vector<Read>
+SegmentedVector<Read>
 assemble_reads(
-    std::vector<ReadPair> &&pairs,
+    SegmentedVector<ReadPair> &&pairs,
+    const help::Params &params,
+    ParseLog &log);
+
+/** Thrown when the two fastq files hold different numbers of reads. */
+class ReadCountError : public std::runtime_error {
+    using runtime_error::runtime_error;
+};
+
+/** Output of split_orfs(). */
+struct SplitOrfs {
+    SegmentedVector<Orf> orfs;   ///< the Orfs split, which the segments view; never moved after the split
+    vecvec<OrfSegment> segments; ///< the segments of each Orf that could be split, in order
+
+    bool   empty() const { return segments.empty(); }
+    size_t size()  const { return segments.size(); }
+    void   clear()       { segments.clear(); orfs.clear(); }
+};
+
+/** Output of stream_front_end(). */
+struct FrontEnd {
+    size_t total_reads = 0;         ///< read pairs parsed
+    SegmentedVector<Read> reads;    ///< assembled reads, or the fw reads with --skip_assembly
+    SegmentedVector<Read> rv_reads; ///< the rv reads with --skip_assembly, otherwise empty
+    std::vector<std::pair<std::string, QueueStats>> queue_stats; ///< occupancy of each queue
+    std::vector<ThreadStats> thread_stats; ///< time each thread spent on batches: the splitter, then the workers
+};
+
+/**
+  * Parse, QC and assemble the reads of two fastq files as a streaming pipeline.
+  *
+  * Does the work of extract_read_data(), qc_reads() and assemble_reads() (or,
+  * with --skip_assembly, the split of pairs into fw and rv reads) on cache-sized
+  * batches of reads. One thread cuts the files into batches, which are passed
+  * between threads through bounded MpmcQueues so that a slow stage holds back
+  * the ones before it instead of letting batches pile up.
+  *
+  * By default the batches go to params.qc_threads + params.assembly_threads
+  * workers that each run the whole chain on a batch one read pair at a time,
+  * so a read is still in cache when it is QC'd and assembled. With
+  * params.staged_front_end_flag, parsing and QC run on params.qc_threads and
+  * assembly on params.assembly_threads, with a queue in between.
+  *
+  * The output is in input order and does not depend on the numbers of threads.
+  *
+  * @throws ReadCountError if the files hold different numbers of reads
+  */
+FrontEnd
+stream_front_end(
+    const ConstMapping &fwmap,
+    const ConstMapping &rvmap,
+    const std::vector<UMIExtractor> &fwexs,
+    const std::vector<UMIExtractor> &rvexs,
     const help::Params &params,
     ParseLog &log);
 
@@ -219,13 +275,20 @@ assemble_reads(
   *
   * @return the consensus sequences for each UMI group
   */
-std::vector<Read>
+SegmentedVector<Read>
 umi_collapse(
-    std::vector<Read> &&reads,
+    SegmentedVector<Read> &&reads,
     const help::Params &params,
     ParseLog &log,
     bool ragged_ends);
 
+/** Replace the reads of one UMI group, at least params.min_umi_group_size of
+  * them, by their consensus (see umi_collapse()). On return reads.front() is
+  * the consensus, its umi_group_size the number of reads it was built from.
+  */
+void
+build_consensus_sequence(std::vector<Read> &reads, const help::Params &params, bool ragged_ends);
+
 /**
   * Translate ORFs from nucleotide data.
   *
@@ -241,8 +304,8 @@ umi_collapse(
   *
   * @return ORFs without stop codons
   */
-std::vector<Orf>
-translate_and_filter_ptcs(std::vector<Read> &&reads, 
+SegmentedVector<Orf>
+translate_and_filter_ptcs(SegmentedVector<Read> &&reads, 
                           const help::Params &params,
                           ParseLog &log,
                           bool reverse_complement);
@@ -274,7 +337,7 @@ enum class AlignmentMethod {
 };
 
 std::vector<GroupAlignment>
-align_to_multiple_templates(vecvec<Orf> &&orfs,
+align_to_multiple_templates(SplitOrfs &&orfs,
                    const std::vector<std::shared_ptr<const TemplateDatabase>> &dbs,
                    const help::Params &params,
                    ParseLog &log,
@@ -283,14 +346,17 @@ align_to_multiple_templates(vecvec<Orf> &&orfs,
 /**
   * Split ORFs according to params.split_template_regex.
   *
+  * The segments are views of the orfs, which are kept in the result, so
+  * splitting copies no sequence.
+  *
   * @param orfs the orfs to split
   * @param params run options from command line arguments
   * @param log ParseLog to store counts of ORFs that could not be split
   *
-  * @return a vector of vector of Orf where each element of the inner vectors is one of the split orfs
+  * @return the orfs and, for each one that could be split, a vector of its segments
   */
-vecvec<Orf>
-split_orfs(std::vector<Orf> &&orfs,
+SplitOrfs
+split_orfs(SegmentedVector<Orf> &&orfs,
            const help::Params &params,
            ParseLog &log);
 
@@ -314,6 +380,65 @@ assign_templates(std::vector<std::vector<Orf>> &&orfs,
                  const help::Params &params,
                  ParseLog &log);
 
+/** For each of splits template databases, how many alignments used each of its templates (#Template Usage#). */
+std::vector<Counter<std::string>>
+template_usage(const std::vector<GroupAlignment> &alignments, size_t splits);
+
+/**
+  * Write the results of an analysis as a binary columnar file (--output_format=columnar).
+  *
+  * See columnar.h for the file layout. Alignment columns are "aln.template",
+  * "aln.group_size", "aln.barcode", "aln.ops", "aln.residues" and "aln.codons";
+  * the template table is "templates.id", "templates.label", "templates.aas" and
+  * "templates.cdns"; the i-th template's statistics are "subs.i" (rows ordered as
+  * Aa::valid_chars) and "mutations.i" (rows total, synonymous, nonsynonymous).
+  * #Template Usage# is "usage.split", "usage.label" and "usage.count", one row
+  * per line of the section. The "text.*" blocks keep the options that shape
+  * the text output (-c, --number_from, --compact_alignments, --no_header and
+  * whether the #Unique# sections are written) so that dsa-util dump can
+  * reproduce it.
+  *
+  * @param path the output file
+  * @param settings the #Settings# and #Parse# text, stored verbatim in the "settings" block
+  * @param params the options of the run
+  * @param usage the template usage of each split (see template_usage()), empty if there are no templates
+  * @param templates the templates, in the order of substitution_matrices
+  * @param alignments the alignments, sorted by template id
+  * @param substitution_matrices one frequency matrix per template
+  * @param mutation_counts one MutationCount per template (empty if the template has no codons)
+  */
+void
+write_columnar(const fs::path &path,
+               const std::string &settings,
+               const help::Params &params,
+               const std::vector<Counter<std::string>> &usage,
+               const std::vector<std::shared_ptr<AlignmentTemplate>> &templates,
+               const std::vector<GroupAlignment> &alignments,
+               const std::vector<Matrix<float>> &substitution_matrices,
+               const std::vector<MutationCount> &mutation_counts);
+
+/**
+  * Print how busy each thread of the current ThreadPool was during a stage.
+  *
+  * Writes one line, "#thread stats" followed by the stage name, its wall time, the
+  * busy seconds of each worker (and of waiting threads, last) and the imbalance,
+  * the ratio of the busiest thread's time to the mean. Resets the pool statistics.
+  *
+  * @param os the destination stream (the report is not part of the program output)
+  * @param stage a name for the stage
+  * @param wall_seconds elapsed time of the stage
+  */
+void
+report_thread_stats(std::ostream &os, const std::string &stage, double wall_seconds);
+
+/** As above, for a stage that ran on threads of its own (e.g. FrontEnd::thread_stats). */
+void
+report_thread_stats(std::ostream &os, const std::string &stage, double wall_seconds, const std::vector<ThreadStats> &stats);
+
+/** Print the occupancy of a queue of stream_front_end() (see --thread_stats). */
+void
+report_queue_stats(std::ostream &os, const std::string &queue, const QueueStats &stats);
+
 }; //namespace bio
 
 #endif
\ No newline at end of file
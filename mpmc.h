@@ -0,0 +1,214 @@
+/*
+Copyright 2024, The Broad Institute of MIT and Harvard
+
+Original Author: Charles C Bailey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef BIO_MPMC_H_
+#define BIO_MPMC_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <utility>
+
+namespace bio {
+
+/** Occupancy of a MpmcQueue, sampled at every push. */
+struct QueueStats {
+    size_t capacity    = 0;
+    size_t pushes      = 0;   ///< number of items pushed
+    size_t max_size    = 0;   ///< highest number of items queued at once
+    double mean_size   = 0.0; ///< average number of items queued, seen by a push
+    size_t full_waits  = 0;   ///< pushes that had to wait for room (back-pressure)
+    size_t empty_waits = 0;   ///< pops that had to wait for an item (starvation)
+};
+
+/** A bounded multi-producer multi-consumer queue.
+  *
+  * try_push() and try_pop() are lock-free (D. Vyukov's bounded MPMC queue:
+  * each cell carries a sequence number that says whether it is ready to be
+  * written or read in the current lap). push() and pop() block, spinning
+  * briefly and then sleeping on an atomic wait, while the queue is full or
+  * empty. After close() pushes are not allowed and pop() returns false once
+  * the queue has been drained, which is how consumers learn that the stream
+  * has ended.
+  */
+template<typename T>
+class MpmcQueue {
+public:
+    /** @param capacity maximum number of queued items, rounded up to a power of two */
+    explicit MpmcQueue(size_t capacity) {
+        size_t n = 2;
+        while (n < capacity) n *= 2;
+        mask_  = n - 1;
+        cells_ = std::make_unique<Cell[]>(n);
+        for (size_t i=0; i<n; ++i) cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    MpmcQueue(const MpmcQueue &) = delete;
+    MpmcQueue &operator=(const MpmcQueue &) = delete;
+
+    size_t capacity() const { return mask_ + 1; }
+
+    bool
+    try_push(T &value) {
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell &cell = cells_[pos & mask_];
+            const size_t seq = cell.sequence.load(std::memory_order_acquire);
+            const intptr_t dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (dif == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value = std::move(value);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    record_push(pos + 1);
+                    return true;
+                }
+            } else if (dif < 0) {
+                return false; //full
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool
+    try_pop(T &value) {
+        size_t pos = head_.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell &cell = cells_[pos & mask_];
+            const size_t seq = cell.sequence.load(std::memory_order_acquire);
+            const intptr_t dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (dif == 0) {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    value = std::move(cell.value);
+                    cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+                    popped_.fetch_add(1, std::memory_order_release);
+                    popped_.notify_all();
+                    return true;
+                }
+            } else if (dif < 0) {
+                return false; //empty
+            } else {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /** Push value, waiting while the queue is full. */
+    void
+    push(T value) {
+        bool waited = false;
+        for (unsigned spins=0; ; ++spins) {
+            const uint32_t seen = popped_.load(std::memory_order_acquire);
+            if (try_push(value)) break;
+            waited = true;
+            if (spins < SPINS) std::this_thread::yield();
+            else               popped_.wait(seen, std::memory_order_acquire);
+        }
+        if (waited) full_waits_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /** Pop into value, waiting while the queue is empty.
+      * @return false if the queue is empty and has been closed
+      */
+    bool
+    pop(T &value) {
+        bool waited = false;
+        for (unsigned spins=0; ; ++spins) {
+            const uint32_t seen = pushed_.load(std::memory_order_acquire);
+            if (try_pop(value)) break;
+            if (closed_.load(std::memory_order_acquire)) {
+                //everything pushed before close() is visible now
+                if (try_pop(value)) break;
+                return false;
+            }
+            waited = true;
+            if (spins < SPINS) std::this_thread::yield();
+            else               pushed_.wait(seen, std::memory_order_acquire);
+        }
+        if (waited) empty_waits_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    /** End the stream; consumers drain what is left and then see pop() return false. */
+    void
+    close() {
+        closed_.store(true, std::memory_order_release);
+        pushed_.fetch_add(1, std::memory_order_release);
+        pushed_.notify_all();
+    }
+
+    QueueStats
+    stats() const {
+        QueueStats s;
+        s.capacity    = capacity();
+        s.pushes      = pushes_.load(std::memory_order_relaxed);
+        s.max_size    = max_size_.load(std::memory_order_relaxed);
+        s.mean_size   = s.pushes ? static_cast<double>(size_sum_.load(std::memory_order_relaxed)) / s.pushes : 0.0;
+        s.full_waits  = full_waits_.load(std::memory_order_relaxed);
+        s.empty_waits = empty_waits_.load(std::memory_order_relaxed);
+        return s;
+    }
+
+private:
+    static constexpr unsigned SPINS = 64;
+
+    struct alignas(64) Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    void
+    record_push(size_t tail) {
+        pushed_.fetch_add(1, std::memory_order_release);
+        pushed_.notify_all();
+
+        //approximate: head may move while we look at it
+        const size_t head = head_.load(std::memory_order_relaxed);
+        const size_t size = tail > head ? tail - head : 0;
+        pushes_.fetch_add(1, std::memory_order_relaxed);
+        size_sum_.fetch_add(size, std::memory_order_relaxed);
+        size_t max = max_size_.load(std::memory_order_relaxed);
+        while (size > max && !max_size_.compare_exchange_weak(max, size, std::memory_order_relaxed)) {}
+    }
+
+    std::unique_ptr<Cell[]> cells_;
+    size_t mask_ = 0;
+
+    alignas(64) std::atomic<size_t>   tail_   = 0;
+    alignas(64) std::atomic<size_t>   head_   = 0;
+    alignas(64) std::atomic<uint32_t> pushed_ = 0; //bumped after every push, waited on by pop()
+    alignas(64) std::atomic<uint32_t> popped_ = 0; //bumped after every pop, waited on by push()
+    std::atomic<bool> closed_ = false;
+
+    std::atomic<size_t> pushes_      = 0;
+    std::atomic<size_t> size_sum_    = 0;
+    std::atomic<size_t> max_size_    = 0;
+    std::atomic<size_t> full_waits_  = 0;
+    std::atomic<size_t> empty_waits_ = 0;
+};
+
+}; //namespace bio
+
+#endif
\ No newline at end of file
@@ -0,0 +1,200 @@
+/*
+Copyright 2024, The Broad Institute of MIT and Harvard
+
+Original Author: Charles C Bailey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "numa.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <thread>
+
+#ifdef DSA_TARGET_LINUX
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace bio {
+
+#ifdef DSA_TARGET_LINUX
+static constexpr int MPOL_INTERLEAVE_MODE = 3; //MPOL_INTERLEAVE from <linux/mempolicy.h>
+#endif
+
+/** cpulist of each node under /sys/devices/system/node indexed by node id, or
+  * nothing if sysfs is unavailable. Memory-only nodes (e.g. CXL or HBM) and
+  * gaps in the numbering get an empty list.
+  */
+static std::vector<std::string>
+read_node_cpulists() {
+    std::vector<std::string> lists;
+#ifdef DSA_TARGET_LINUX
+    std::ifstream online("/sys/devices/system/node/online");
+    std::string nodes;
+    if (!std::getline(online, nodes)) return lists;
+    try {
+        for (int n : parse_cpu_list(nodes)) {
+            std::ifstream cpulist("/sys/devices/system/node/node" + std::to_string(n) + "/cpulist");
+            if (lists.size() <= static_cast<size_t>(n)) lists.resize(n + 1);
+            std::getline(cpulist, lists[n]);
+        }
+    } catch (const std::invalid_argument &) {
+        lists.clear();
+    }
+#endif
+    return lists;
+}
+
+std::vector<int>
+parse_cpu_list(const std::string &list) {
+    std::vector<int> cpus;
+    size_t pos = 0;
+    auto number = [&]() {
+        const size_t start = pos;
+        while (pos < list.size() && list[pos] >= '0' && list[pos] <= '9') ++pos;
+        if (pos == start) throw std::invalid_argument("malformed cpu list '" + list + "'");
+        return std::stoi(list.substr(start, pos - start));
+    };
+
+    while (pos < list.size() && list[pos] != '\n') {
+        const int lo = number();
+        int hi = lo;
+        if (pos < list.size() && list[pos] == '-') {
+            ++pos;
+            hi = number();
+        }
+        if (hi < lo) throw std::invalid_argument("malformed cpu list '" + list + "'");
+        for (int c=lo; c<=hi; ++c) cpus.push_back(c);
+        if (pos < list.size() && list[pos] == ',') ++pos;
+    }
+    return cpus;
+}
+
+std::vector<int>
+allowed_cpus() {
+    std::vector<int> cpus;
+#ifdef DSA_TARGET_LINUX
+    cpu_set_t mask;
+    if (sched_getaffinity(0, sizeof(mask), &mask) == 0) {
+        for (int c=0; c<CPU_SETSIZE; ++c) if (CPU_ISSET(c, &mask)) cpus.push_back(c);
+    }
+#endif
+    if (cpus.empty()) {
+        for (int c=0; c<static_cast<int>(std::max(1u, std::thread::hardware_concurrency())); ++c) cpus.push_back(c);
+    }
+    return cpus;
+}
+
+bool
+pin_current_thread(int cpu) {
+#ifdef DSA_TARGET_LINUX
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    CPU_SET(cpu, &mask);
+    return sched_setaffinity(0, sizeof(mask), &mask) == 0;
+#else
+    (void) cpu;
+    return false;
+#endif
+}
+
+void
+numa_interleave(void *p, size_t bytes) {
+#ifdef DSA_TARGET_LINUX
+    //interleave over the nodes that have CPUs, leaving memory-only nodes alone
+    const NumaTopology &topology = NumaTopology::instance();
+    unsigned long nodemask = 0;
+    size_t nodes = 0;
+    for (size_t n=0; n<topology.nodes() && n<8*sizeof(nodemask); ++n) {
+        if (topology.cpus(n).empty()) continue;
+        nodemask |= 1ul << n;
+        ++nodes;
+    }
+    if (nodes < 2 || bytes == 0) return;
+
+    const uintptr_t page  = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    const uintptr_t begin = (reinterpret_cast<uintptr_t>(p) + page - 1) & ~(page - 1);
+    const uintptr_t end   = (reinterpret_cast<uintptr_t>(p) + bytes) & ~(page - 1);
+    if (end <= begin) return;
+
+    //failure just leaves the default first-touch placement
+    syscall(SYS_mbind, begin, end - begin, MPOL_INTERLEAVE_MODE, &nodemask, 8*sizeof(nodemask), 0);
+#else
+    (void) p;
+    (void) bytes;
+#endif
+}
+
+const NumaTopology &
+NumaTopology::instance() {
+    static const NumaTopology topology(read_node_cpulists());
+    return topology;
+}
+
+NumaTopology::NumaTopology(const std::vector<std::string> &cpulists) {
+    for (const std::string &list : cpulists) node_cpus_.push_back(list.empty() ? std::vector<int>() : parse_cpu_list(list));
+    if (node_cpus_.empty()) node_cpus_.push_back(allowed_cpus());
+    for (std::vector<int> &cpus : node_cpus_) std::sort(cpus.begin(), cpus.end());
+}
+
+size_t
+NumaTopology::node_of_cpu(int cpu) const {
+    for (size_t n=0; n<node_cpus_.size(); ++n) {
+        if (std::binary_search(node_cpus_[n].begin(), node_cpus_[n].end(), cpu)) return n;
+    }
+    return 0;
+}
+
+std::vector<int>
+NumaTopology::spread(size_t count) const {
+    std::vector<int> allowed = allowed_cpus();
+    std::sort(allowed.begin(), allowed.end());
+
+    std::vector<std::vector<int>> usable(node_cpus_.size());
+    for (size_t n=0; n<node_cpus_.size(); ++n) {
+        std::set_intersection(node_cpus_[n].begin(), node_cpus_[n].end(), allowed.begin(), allowed.end(), std::back_inserter(usable[n]));
+    }
+
+    std::vector<int> order;
+    for (size_t i=0; order.size() < allowed.size(); ++i) {
+        bool any = false;
+        for (const std::vector<int> &cpus : usable) {
+            if (i < cpus.size()) {
+                order.push_back(cpus[i]);
+                any = true;
+            }
+        }
+        //CPUs in the mask but on no listed node go last
+        if (!any) {
+            for (int c : allowed) if (std::find(order.begin(), order.end(), c) == order.end()) order.push_back(c);
+            break;
+        }
+    }
+
+    std::vector<int> result(count);
+    for (size_t i=0; i<count; ++i) result[i] = order[i % order.size()];
+    return result;
+}
+
+}; //namespace bio
\ No newline at end of file
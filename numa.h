@@ -0,0 +1,93 @@
+/*
+Copyright 2024, The Broad Institute of MIT and Harvard
+
+Original Author: Charles C Bailey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef BIO_NUMA_H_
+#define BIO_NUMA_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace bio {
+
+/** The NUMA nodes of the machine and the CPUs on each.
+  *
+  * On Linux this is read from /sys/devices/system/node so no libnuma is
+  * needed. Elsewhere, or when sysfs is unavailable, the machine is reported
+  * as a single node holding every CPU.
+  */
+class NumaTopology {
+public:
+    /** The topology of this machine, discovered on first use. */
+    static const NumaTopology &instance();
+
+    /** Build a topology from the cpulist of each node (e.g. "0-3,8-11"),
+      * indexed by node id. Nodes without CPUs have an empty cpulist.
+      */
+    explicit NumaTopology(const std::vector<std::string> &cpulists);
+
+    /** Number of node ids, including any memory-only nodes. */
+    size_t nodes() const { return node_cpus_.size(); }
+
+    /** CPUs on node n, ascending. */
+    const std::vector<int> &cpus(size_t n) const { return node_cpus_[n]; }
+
+    /** Node holding cpu, or 0 if it is unknown. */
+    size_t node_of_cpu(int cpu) const;
+
+    /** CPUs for count threads, dealt round-robin across the nodes so that
+      * threads (and the memory they first touch) are spread evenly over the
+      * sockets. Only CPUs in the process affinity mask are used; the list
+      * repeats if count exceeds them.
+      */
+    std::vector<int> spread(size_t count) const;
+
+private:
+    std::vector<std::vector<int>> node_cpus_;
+};
+
+/** Parse a Linux cpulist such as "0-3,8,10-11". Throws std::invalid_argument if malformed. */
+std::vector<int>
+parse_cpu_list(const std::string &list);
+
+/** CPUs the calling process may run on. */
+std::vector<int>
+allowed_cpus();
+
+/** Bind the calling thread to cpu. Returns false if that is not possible. */
+bool
+pin_current_thread(int cpu);
+
+/** Ask for the untouched pages of [p, p+bytes) to be interleaved across all
+  * nodes, so that a buffer shared by every thread does not end up on the
+  * socket of whichever thread first touched it. A no-op on a single node.
+  *
+  * Only whole pages inside the range are affected and pages already touched
+  * stay where they are, so call this between reserving and filling a buffer.
+  */
+void
+numa_interleave(void *p, size_t bytes);
+
+}; //namespace bio
+
+#endif
\ No newline at end of file
@@ -26,20 +26,45 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cstddef>
+#include <iterator>
 #include <iostream>
+#include <functional>
 #include <numeric>
+#include <type_traits>
 #include <unordered_map>
 #include <thread>
 #include <vector>
 
+#include "defines.h"
+#include "numa.h"
+#include "segmented.h"
+#include "threadpool.h"
+
 /** 
   * Multithreaded implementations of some algorithms.
+  * All of them run as tasks on the current work-stealing ThreadPool (see
+  * ThreadPool::current()); items are handed out with guided self-scheduling.
   */
 namespace bio {
 
 namespace impl {
 
+/** A vector of n value-initialized elements with its pages interleaved across
+  * the NUMA nodes: buffers that every thread reads and writes would otherwise
+  * all land on the socket of the thread that allocated them.
+  */
+template<typename T>
+std::vector<T>
+interleaved_vector(size_t n) {
+    std::vector<T> v;
+    v.reserve(n);
+    numa_interleave(v.data(), n * sizeof(T));
+    v.resize(n);
+    return v;
+}
+
 template<typename InputIt, typename UnaryFunction>
 void
 for_each(InputIt first, InputIt last, UnaryFunction f) {
@@ -117,76 +142,297 @@ modal_element(InputIt first, InputIt last)->InputIt {
 }
 
 
-template<typename InputIt, typename UnaryFunction>
-void
-parallel_for_each(InputIt first, InputIt last, UnaryFunction f) {
-    const typename std::iterator_traits<InputIt>::difference_type n = std::distance(first, last);
-    const unsigned int thread_count = std::thread::hardware_concurrency();
-    const size_t batch = n / thread_count;
+/**
+  * Multithreaded exclusive prefix sum of [first, last) into d_first (which may equal first).
+  * The input is split into chunks whose totals are summed in a first pass; the
+  * second pass scans each chunk starting from the sum of the chunks before it.
+  * @return the one-past-the-end output iterator
+  */
+template<typename InputIt, typename OutputIt, typename T>
+OutputIt
+parallel_exclusive_scan(InputIt first, InputIt last, OutputIt d_first, T init) {
+    const size_t n = std::distance(first, last);
+    const size_t chunks = chunk_count(n);
+
+    std::vector<T> offsets(chunks, T());
+    parallel_for(chunks, [&](size_t i) {
+        offsets[i] = std::accumulate(first + n * i / chunks, first + n * (i + 1) / chunks, T());
+    });
+    std::exclusive_scan(offsets.begin(), offsets.end(), offsets.begin(), init);
+
+    parallel_for(chunks, [&](size_t i) {
+        std::exclusive_scan(first + n * i / chunks, first + n * (i + 1) / chunks, d_first + n * i / chunks, offsets[i]);
+    });
+    return d_first + n;
+}
+
+/**
+  * Multithreaded stable std::copy_if into preallocated output.
+  * Each chunk counts its matching elements, an exclusive scan of the counts gives
+  * every chunk its output offset, and the chunks then copy concurrently.
+  * Pass std::move_iterators to move rather than copy.
+  * @param d_first the start of an output range with room for every element that may match
+  * @return the one-past-the-end output iterator
+  */
+template<typename InputIt, typename OutputIt, typename Predicate>
+OutputIt
+parallel_compact(InputIt first, InputIt last, OutputIt d_first, Predicate pred) {
+    const size_t n = std::distance(first, last);
+    const size_t chunks = chunk_count(n);
+
+    std::vector<size_t> offsets(chunks + 1, 0);
+    parallel_for(chunks, [&](size_t i) {
+        offsets[i] = std::count_if(first + n * i / chunks, first + n * (i + 1) / chunks, pred);
+    });
+    std::exclusive_scan(offsets.begin(), offsets.end(), offsets.begin(), size_t(0));
+
+    parallel_for(chunks, [&](size_t i) {
+        std::copy_if(first + n * i / chunks, first + n * (i + 1) / chunks, d_first + offsets[i], pred);
+    });
+    return d_first + offsets.back();
+}
 
-    if (batch == 0) return impl::for_each(first, last, f);
+/**
+  * Move the contents of parts, in order, into one vector.
+  * Output offsets come from an exclusive scan of the part sizes and the parts
+  * are moved concurrently.
+  */
+template<typename T>
+std::vector<T>
+parallel_concatenate(vecvec<T> &&parts) {
+    std::vector<size_t> offsets(parts.size() + 1, 0);
+    for (size_t i=0; i<parts.size(); ++i) offsets[i] = parts[i].size();
+    std::exclusive_scan(offsets.begin(), offsets.end(), offsets.begin(), size_t(0));
+
+    std::vector<T> result = impl::interleaved_vector<T>(offsets.back());
+    parallel_for(parts.size(), [&](size_t i) {
+        std::move(parts[i].begin(), parts[i].end(), result.begin() + offsets[i]);
+        parts[i].clear();
+        parts[i].shrink_to_fit();
+    });
+    return result;
+}
 
-    std::vector<std::thread> threads(thread_count-1);
+namespace impl {
 
-    InputIt lo = first, hi = lo;
-    size_t i = 0;
-    for (; i != thread_count-1; ++i) {
-        std::advance(hi, batch);
-        threads[i] = std::thread(impl::for_each<InputIt, UnaryFunction>, lo, hi, f);
-        std::advance(lo, batch);
-        hi = lo;
+/** Split [first, last) into chunk_count() ranges; returns the chunk boundaries. */
+template<typename InputIt>
+std::vector<InputIt>
+chunk_bounds(InputIt first, InputIt last) {
+    const size_t n = std::distance(first, last);
+    const size_t chunks = chunk_count(n);
+    std::vector<InputIt> bounds;
+    bounds.reserve(chunks + 1);
+    bounds.push_back(first);
+    for (size_t i=1; i<chunks; ++i) {
+        std::advance(first, n * i / chunks - n * (i - 1) / chunks);
+        bounds.push_back(first);
     }
-    impl::for_each(lo, last, f);
-
-    for (auto &th : threads) th.join();
+    bounds.push_back(last);
+    return bounds;
 }
 
-template<typename InputIt, typename OutputIt, typename UnaryOperation>
-void
-parallel_transform(InputIt first, InputIt last, OutputIt out, UnaryOperation unary_op) {
-    typedef typename std::iterator_traits<InputIt>::value_type InputT;
-    typedef decltype(unary_op(*first)) OutputT;
+/** Guided self-scheduling of the indices [0, n).
+  *
+  * Workers claim contiguous ranges from a shared atomic counter. Each range
+  * is a fixed fraction of the indices still unclaimed (but at least min_grain)
+  * so ranges start large and shrink towards the end, letting threads that
+  * drew cheap items pick up the slack from threads that drew expensive ones.
+  */
+class GuidedRanges {
+public:
+    GuidedRanges(size_t n, size_t workers, size_t min_grain)
+        : n_(n), divisor_(2 * std::max<size_t>(workers, 1)), min_grain_(std::max<size_t>(min_grain, 1)) {}
+
+    /** Claim the next range [lo, hi). Returns false once every index has been claimed. */
+    bool claim(size_t &lo, size_t &hi) {
+        size_t cur = next_.load(std::memory_order_relaxed);
+        for (;;) {
+            if (cur >= n_) return false;
+            const size_t end = std::min(n_, cur + std::max(min_grain_, (n_ - cur) / divisor_));
+            if (next_.compare_exchange_weak(cur, end, std::memory_order_relaxed)) {
+                lo = cur;
+                hi = end;
+                return true;
+            }
+        }
+    }
 
-    const size_t n = std::distance(first, last);
-    const unsigned int thread_count = std::thread::hardware_concurrency();
-    const size_t batch = n / thread_count;
+private:
+    const size_t n_, divisor_, min_grain_;
+    std::atomic<size_t> next_ = 0;
+};
 
-    if (batch == 0) {
-        std::transform(first, last, out, unary_op);
-        return;
+/** Random access to the elements of [first, last) by index. Non-random-access
+  * iterators are indexed through a table of iterators built up front.
+  */
+template<typename InputIt>
+class IndexedRange {
+public:
+    IndexedRange(InputIt first, InputIt last) : first_(first), size_(std::distance(first, last)) {
+        if constexpr (!std::random_access_iterator<InputIt>) {
+            its_.reserve(size_ + 1);
+            for (; first != last; ++first) its_.push_back(first);
+            its_.push_back(last);
+        }
     }
 
-    std::vector<std::thread> threads(thread_count-1);
-    std::vector<std::vector<OutputT>> fragments(thread_count);
+    size_t size() const { return size_; }
 
-    InputIt lo = first, hi = lo;
+    InputIt at(size_t i) const {
+        if constexpr (std::random_access_iterator<InputIt>) return first_ + i;
+        else return its_[i];
+    }
 
-    size_t i = 0;
-    for (; i != thread_count-1; ++i) {
-        std::advance(hi, batch);
-        threads[i] = std::thread(impl::transform<InputIt, OutputT, UnaryOperation>, 
-            lo, hi, std::ref(fragments[i]), unary_op);
-        std::advance(lo, batch);
-        hi = lo;
+private:
+    InputIt first_;
+    size_t size_;
+    std::vector<InputIt> its_;
+};
+
+/** Output of the range of inputs starting at index first. */
+template<typename T>
+struct Fragment {
+    size_t first;
+    T      value;
+};
+
+/** Collect the fragments produced by all workers, sorted by input position. */
+template<typename T>
+std::vector<Fragment<T>>
+in_order(vecvec<Fragment<T>> &per_worker) {
+    std::vector<Fragment<T>> all;
+    for (auto &frags : per_worker) {
+        all.insert(all.end(), std::make_move_iterator(frags.begin()), std::make_move_iterator(frags.end()));
+        frags.clear();
     }
-    impl::transform(lo, last, fragments[i], unary_op);
-
-    for (auto &th : threads) th.join();
-    for (auto &frag : fragments) {
-        out = std::copy(
-            std::make_move_iterator(frag.begin()),
-            std::make_move_iterator(frag.end()),
-            out);
+    std::sort(all.begin(), all.end(), [](const Fragment<T> &a, const Fragment<T> &b) { return a.first < b.first; });
+    return all;
+}
+
+template<typename OutputIt>
+struct is_vector_back_inserter : std::false_type {};
+
+template<typename T, typename Allocator>
+struct is_vector_back_inserter<std::back_insert_iterator<std::vector<T, Allocator>>> : std::true_type {};
+
+template<typename OutputIt>
+struct is_segmented_back_inserter : std::false_type {};
+
+template<typename T>
+struct is_segmented_back_inserter<std::back_insert_iterator<SegmentedVector<T>>> : std::true_type {};
+
+/** The container a std::back_insert_iterator appends to. */
+template<typename Container>
+Container &
+container_of(std::back_insert_iterator<Container> it) {
+    struct Access : std::back_insert_iterator<Container> {
+        Access(std::back_insert_iterator<Container> it) : std::back_insert_iterator<Container>(it) {}
+        Container &get() const { return *this->container; }
+    };
+    return Access(it).get();
+}
+
+/** Move the contents of each fragment, in input order, to out.
+  * Fragments appended to a SegmentedVector become its segments without
+  * moving any elements; appending to a std::vector is done concurrently
+  * (see parallel_concatenate).
+  */
+template<typename OutputIt, typename OutputT>
+OutputIt
+concatenate(vecvec<Fragment<std::vector<OutputT>>> &per_worker, OutputIt out) {
+    std::vector<Fragment<std::vector<OutputT>>> ordered = in_order(per_worker);
+
+    if constexpr (is_segmented_back_inserter<OutputIt>::value) {
+        auto &container = container_of(out);
+        for (auto &frag : ordered) container.append_segment(std::move(frag.value));
+        return out;
+    } else if constexpr (is_vector_back_inserter<OutputIt>::value) {
+        vecvec<OutputT> parts;
+        parts.reserve(ordered.size());
+        for (auto &frag : ordered) parts.push_back(std::move(frag.value));
+        std::vector<OutputT> joined = parallel_concatenate(std::move(parts));
+
+        auto &container = container_of(out);
+        if (container.empty()) {
+            container = std::move(joined);
+        } else {
+            container.insert(container.end(), std::make_move_iterator(joined.begin()), std::make_move_iterator(joined.end()));
+        }
+        return out;
+    } else {
+        for (auto &frag : ordered) {
+            out = std::copy(
+                std::make_move_iterator(frag.value.begin()),
+                std::make_move_iterator(frag.value.end()),
+                out);
+        }
+        return out;
     }
 }
 
+}; //namespace impl
+
+/** Number of workers parallel_guided() runs; callers size per-worker state with this. */
+inline size_t
+worker_count() {
+    return ThreadPool::current().size();
+}
+
+/**
+  * Call f(worker, lo, hi) for dynamically claimed ranges [lo, hi) covering [0, n).
+  * worker is in [0, worker_count()) and no two calls with the same worker run
+  * concurrently, so f can use it to index per-worker state without locking.
+  * @param min_grain the smallest range handed out (except possibly the last)
+  */
+template<typename Function>
+void
+parallel_guided(size_t n, Function f, size_t min_grain=1) {
+    const size_t workers = worker_count();
+    impl::GuidedRanges ranges(n, workers, min_grain);
+    parallel_for(std::max<size_t>(1, std::min(n, workers)), [&](size_t worker) {
+        size_t lo, hi;
+        while (ranges.claim(lo, hi)) {
+            trace::Span span("parallel_guided", hi - lo);
+            f(worker, lo, hi);
+        }
+    });
+}
+
+template<typename InputIt, typename UnaryFunction>
+void
+parallel_for_each(InputIt first, InputIt last, UnaryFunction f) {
+    const impl::IndexedRange<InputIt> range(first, last);
+    parallel_guided(range.size(), [&](size_t, size_t lo, size_t hi) {
+        impl::for_each(range.at(lo), range.at(hi), f);
+    });
+}
+
+template<typename InputIt, typename OutputIt, typename UnaryOperation>
+void
+parallel_transform(InputIt first, InputIt last, OutputIt out, UnaryOperation unary_op) {
+    typedef decltype(unary_op(*first)) OutputT;
+
+    const impl::IndexedRange<InputIt> range(first, last);
+    vecvec<impl::Fragment<std::vector<OutputT>>> fragments(worker_count());
+
+    parallel_guided(range.size(), [&](size_t worker, size_t lo, size_t hi) {
+        fragments[worker].push_back({lo, {}});
+        impl::transform(range.at(lo), range.at(hi), fragments[worker].back().value, unary_op);
+    });
+
+    impl::concatenate(fragments, out);
+}
+
 /**
   * Multithreaded transform over [first, last) using binary functor TransformFilter
   * TransformFilter should return std::optional<T> where T is the desired output type
   * std::nullopt outputs from TransformFilter are discarded
+  * Items are handed out with parallel_guided() so that costly items do not hold
+  * up a whole thread's share; results are reassembled in input order.
   * 
   * @tparam InputIt the input iterator type
-  * @tparam OutputIt the output iterator type (threads std::copy their results here)
+  * @tparam OutputIt the output iterator type (results are std::copy'd here in input order)
   * @tparam TransformFilter a functor that takes InputIt::value_type and Log and returns std::optional<OutputIt::value_type>
   * @tparam Log a structure to capture error information, must define operator + for use in std::accumulate
   * @param first the first iterator in the range
@@ -198,36 +444,18 @@ parallel_transform(InputIt first, InputIt last, OutputIt out, UnaryOperation una
 template<typename InputIt, typename OutputIt, typename TransformFilter, typename Log>
 OutputIt
 parallel_transform_filter(InputIt first, InputIt last, OutputIt out, TransformFilter tf, Log &log) {
-    typedef typename std::iterator_traits<InputIt>::value_type InputT;
     typedef typename decltype(tf(*first, log))::value_type OutputT;
 
-    const size_t n = std::distance(first, last);
-    const unsigned int thread_count = std::thread::hardware_concurrency();
-    const size_t batch = n / thread_count;
-
-    std::vector<std::thread> threads(thread_count-1);
-    std::vector<std::vector<OutputT>> fragments(thread_count);
-    std::vector<Log> logs(thread_count);
-
-    InputIt batch_last = first;
-
-    size_t i = 0;
-    for (; i != thread_count-1; ++i) {
-        std::advance(batch_last, batch);
-        threads[i] = std::thread(impl::transform_filter<InputIt, OutputT, TransformFilter, Log>, 
-            first, batch_last, std::ref(fragments[i]), tf, std::ref(logs[i]));
-        std::advance(first, batch);
-        batch_last = first;
-    }
-    impl::transform_filter(first, last, fragments[i], tf, logs[i]);
-
-    for (auto &th : threads) th.join();
-    for (auto &frag : fragments) {
-        out = std::copy(
-            std::make_move_iterator(frag.begin()),
-            std::make_move_iterator(frag.end()),
-            out);
-    }
+    const impl::IndexedRange<InputIt> range(first, last);
+    vecvec<impl::Fragment<std::vector<OutputT>>> fragments(worker_count());
+    std::vector<Log> logs(worker_count());
+
+    parallel_guided(range.size(), [&](size_t worker, size_t lo, size_t hi) {
+        fragments[worker].push_back({lo, {}});
+        impl::transform_filter(range.at(lo), range.at(hi), fragments[worker].back().value, tf, logs[worker]);
+    });
+
+    out = impl::concatenate(fragments, out);
     log = std::accumulate(logs.begin(), logs.end(), log);
 
     return out;
@@ -236,36 +464,18 @@ parallel_transform_filter(InputIt first, InputIt last, OutputIt out, TransformFi
 template<typename InputIt, typename OutputIt, typename TransformFilterLog>
 OutputIt
 parallel_transform_filter(InputIt first, InputIt last, OutputIt out, TransformFilterLog &tfl) {
-    typedef typename std::iterator_traits<InputIt>::value_type InputT;
     typedef typename decltype(tfl(*first))::value_type OutputT;
 
-    const size_t n = std::distance(first, last);
-    const unsigned int thread_count = std::thread::hardware_concurrency();
-    const size_t batch = n / thread_count;
-
-    std::vector<std::thread> threads(thread_count-1);
-    std::vector<std::vector<OutputT>> fragments(thread_count);
-    std::vector<TransformFilterLog> logs(thread_count);
-
-    InputIt batch_last = first;
-
-    size_t i = 0;
-    for (; i != thread_count-1; ++i) {
-        std::advance(batch_last, batch);
-        threads[i] = std::thread(impl::transform_filter<InputIt, OutputT, TransformFilterLog>, 
-            first, batch_last, std::ref(fragments[i]), std::ref(logs[i]));
-        std::advance(first, batch);
-        batch_last = first;
-    }
-    impl::transform_filter(first, last, fragments[i], logs[i]);
-
-    for (auto &th : threads) th.join();
-    for (auto &frag : fragments) {
-        out = std::copy(
-            std::make_move_iterator(frag.begin()),
-            std::make_move_iterator(frag.end()),
-            out);
-    }
+    const impl::IndexedRange<InputIt> range(first, last);
+    vecvec<impl::Fragment<std::vector<OutputT>>> fragments(worker_count());
+    std::vector<TransformFilterLog> logs(worker_count());
+
+    parallel_guided(range.size(), [&](size_t worker, size_t lo, size_t hi) {
+        fragments[worker].push_back({lo, {}});
+        impl::transform_filter(range.at(lo), range.at(hi), fragments[worker].back().value, logs[worker]);
+    });
+
+    out = impl::concatenate(fragments, out);
     tfl = std::accumulate(logs.begin(), logs.end(), tfl);
 
     return out;
@@ -273,6 +483,7 @@ parallel_transform_filter(InputIt first, InputIt last, OutputIt out, TransformFi
 
 /**
   * Multithreaded reduction over [first, last) using binary function Reduces
+  * Partial results are combined in input order.
   * @tparam InputIt the input iterator type
   * @tparam Reduce a binary function that operates on two <em>iterators</em> representing a range of values
   * @param first the first iterator in the range
@@ -285,29 +496,184 @@ auto
 parallel_reduce(InputIt first, InputIt last, Reduce f)->decltype(f(first, last)) {
     using OutputT = decltype(f(first, last));
 
-    const size_t n = std::distance(first, last);
-    const unsigned int thread_count = std::thread::hardware_concurrency();
-    const size_t batch = n / thread_count;
+    const impl::IndexedRange<InputIt> range(first, last);
+    if (range.size() == 0) return f(first, last);
+
+    vecvec<impl::Fragment<OutputT>> fragments(worker_count());
+
+    parallel_guided(range.size(), [&](size_t worker, size_t lo, size_t hi) {
+        OutputT partial;
+        impl::reduce(range.at(lo), range.at(hi), f, partial);
+        fragments[worker].push_back({lo, std::move(partial)});
+    });
 
-    std::vector<std::thread> threads(thread_count-1);
-    std::vector<OutputT>     fragments(thread_count);
+    std::vector<impl::Fragment<OutputT>> ordered = impl::in_order(fragments);
+    OutputT result = std::move(ordered.front().value);
+    for (size_t i=1; i<ordered.size(); ++i) result = result + ordered[i].value;
+    return result;
+}
 
-    InputIt batch_last = first;
+namespace impl {
 
-    size_t i = 0;
-    for (; i != thread_count-1; ++i) {
-        std::advance(batch_last, batch);
-        threads[i] = std::thread(impl::reduce<InputIt, Reduce, OutputT>, 
-            first, batch_last, f, std::ref(fragments[i]));
-        std::advance(first, batch);
-        batch_last = first;
+/** Index of the element of a (size m) that ends the first k elements of the
+  * stable merge of a and b (size n); b[k - result] starts the rest.
+  */
+template<typename RandomItA, typename RandomItB, typename Compare>
+size_t
+co_rank(size_t k, RandomItA a, size_t m, RandomItB b, size_t n, Compare comp) {
+    size_t lo = k > n ? k - n : 0, hi = std::min(k, m);
+    while (lo < hi) {
+        const size_t i = lo + (hi - lo) / 2, j = k - i;
+        //a[i] <= b[j-1] means a[i] belongs in the first k (ties go to a)
+        if (i < m && j > 0 && !comp(b[j-1], a[i])) lo = i + 1;
+        else hi = i;
     }
-    impl::reduce(first, last, f, fragments[i]);
+    return lo;
+}
+
+/** Merge adjacent sorted runs of width `width` chunks from src into dst. Each
+  * merge is split into `pieces` independent parts at co-rank boundaries.
+  */
+template<typename SrcIt, typename DstIt, typename Compare>
+void
+merge_round(SrcIt src, DstIt dst, const std::vector<size_t> &bounds, size_t width, Compare comp) {
+    const size_t chunks = bounds.size() - 1;
+    const size_t pairs = chunks / (2 * width);
+    const size_t pieces = std::max<size_t>(1, worker_count() / pairs);
+
+    auto run_bounds = [&](size_t pair, size_t &lo, size_t &mid, size_t &hi) {
+        lo  = bounds[2 * pair * width];
+        mid = bounds[2 * pair * width + width];
+        hi  = bounds[2 * pair * width + 2 * width];
+    };
 
-    for (auto &th : threads) th.join();
-    return (fragments.size() == 1)
-        ? fragments.front()
-        : std::accumulate(fragments.begin()+1, fragments.end(), fragments.front());
+    //all co-ranks are found before anything is moved: the search for a piece's
+    //boundaries reads elements that the neighbouring pieces move from
+    std::vector<size_t> splits(pairs * (pieces + 1));
+    parallel_for(splits.size(), [&](size_t t) {
+        const size_t pair = t / (pieces + 1), piece = t % (pieces + 1);
+        size_t lo, mid, hi;
+        run_bounds(pair, lo, mid, hi);
+        const size_t m = mid - lo, n = hi - mid;
+        splits[t] = co_rank((m + n) * piece / pieces, src + lo, m, src + mid, n, comp);
+    });
+
+    parallel_for(pairs * pieces, [&](size_t t) {
+        const size_t pair = t / pieces, piece = t % pieces;
+        size_t lo, mid, hi;
+        run_bounds(pair, lo, mid, hi);
+        const size_t m = mid - lo, n = hi - mid;
+
+        const size_t k0 = (m + n) * piece / pieces, k1 = (m + n) * (piece + 1) / pieces;
+        const size_t i0 = splits[pair * (pieces + 1) + piece];
+        const size_t i1 = splits[pair * (pieces + 1) + piece + 1];
+
+        std::merge(std::make_move_iterator(src + lo + i0),        std::make_move_iterator(src + lo + i1),
+                   std::make_move_iterator(src + mid + (k0 - i0)), std::make_move_iterator(src + mid + (k1 - i1)),
+                   dst + lo + k0, comp);
+    });
+}
+
+}; //namespace impl
+
+/**
+  * Multithreaded stable sort of [first, last).
+  *
+  * Chunks are std::stable_sort'ed concurrently and then merged pairwise, each
+  * merge split across threads at co-rank (merge path) boundaries, ping-ponging
+  * between the input and a buffer. The result is identical to std::stable_sort
+  * regardless of the number of threads.
+  * Requires a default-constructible value type (for the merge buffer).
+  */
+template<typename RandomIt, typename Compare=std::less<>>
+void
+parallel_sort(RandomIt first, RandomIt last, Compare comp=Compare()) {
+    using T = typename std::iterator_traits<RandomIt>::value_type;
+    static constexpr size_t SERIAL_CUTOFF = 1 << 13;
+
+    const size_t n = last - first;
+    if (n < SERIAL_CUTOFF || worker_count() == 1) {
+        std::stable_sort(first, last, comp);
+        return;
+    }
+
+    size_t chunks = 1;
+    while (chunks < worker_count()) chunks *= 2;
+    std::vector<size_t> bounds(chunks + 1);
+    for (size_t i=0; i<=chunks; ++i) bounds[i] = n * i / chunks;
+
+    parallel_for(chunks, [&](size_t i) {
+        std::stable_sort(first + bounds[i], first + bounds[i+1], comp);
+    });
+
+    std::vector<T> buffer = impl::interleaved_vector<T>(n);
+    bool in_buffer = false;
+    for (size_t width=1; width<chunks; width*=2) {
+        if (in_buffer) impl::merge_round(buffer.begin(), first, bounds, width, comp);
+        else           impl::merge_round(first, buffer.begin(), bounds, width, comp);
+        in_buffer = !in_buffer;
+    }
+
+    if (in_buffer) {
+        parallel_for(chunks, [&](size_t i) {
+            std::move(buffer.begin() + bounds[i], buffer.begin() + bounds[i+1], first + bounds[i]);
+        });
+    }
+}
+
+/**
+  * Multithreaded grouping of the elements of [first, last) by key.
+  *
+  * Elements are moved out of the input range and scattered into a fixed number
+  * of partitions by the hash of key(element); the partitions are then grouped
+  * concurrently. Groups are ordered by partition and, within a partition, by
+  * first appearance in the input, and members keep their input order, so the
+  * result does not depend on the number of threads.
+  *
+  * @param key callable returning a hashable, equality-comparable key for an element
+  * @return one vector per distinct key
+  */
+template<typename InputIt, typename KeyFunction>
+auto
+parallel_group_by(InputIt first, InputIt last, KeyFunction key)
+    ->vecvec<typename std::iterator_traits<InputIt>::value_type> {
+    using T   = typename std::iterator_traits<InputIt>::value_type;
+    using Key = std::decay_t<decltype(key(*first))>;
+    static constexpr size_t PARTITIONS = 64;
+
+    //scatter into partitions by key hash
+    const impl::IndexedRange<InputIt> range(first, last);
+    vecvec<impl::Fragment<vecvec<T>>> scattered(worker_count());
+    parallel_guided(range.size(), [&](size_t worker, size_t lo, size_t hi) {
+        scattered[worker].push_back({lo, vecvec<T>(PARTITIONS)});
+        vecvec<T> &parts = scattered[worker].back().value;
+        for (InputIt it=range.at(lo), end=range.at(hi); it != end; ++it) {
+            parts[std::hash<Key>()(key(*it)) % PARTITIONS].push_back(std::move(*it));
+        }
+    });
+    std::vector<impl::Fragment<vecvec<T>>> ordered = impl::in_order(scattered);
+
+    //group each partition, visiting the fragments in input order
+    std::array<vecvec<T>, PARTITIONS> grouped;
+    parallel_for(PARTITIONS, [&](size_t p) {
+        std::unordered_map<Key, size_t> index;
+        for (auto &frag : ordered) {
+            for (T &item : frag.value[p]) {
+                auto [it, inserted] = index.try_emplace(key(item), grouped[p].size());
+                if (inserted) grouped[p].emplace_back();
+                grouped[p][it->second].push_back(std::move(item));
+            }
+            frag.value[p].clear();
+            frag.value[p].shrink_to_fit();
+        }
+    });
+
+    vecvec<T> result;
+    size_t total = 0;
+    for (const auto &g : grouped) total += g.size();
+    result.reserve(total);
+    for (auto &g : grouped) result.insert(result.end(), std::make_move_iterator(g.begin()), std::make_move_iterator(g.end()));
+    return result;
 }
 
 }; //namespace bio
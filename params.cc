@@ -43,4 +43,18 @@ codon_output_from_string(const char *s) {
     return co;
 }
 
+std::optional<OutputFormat>
+output_format_from_string(const char *s) {
+    static const std::unordered_map<std::string, OutputFormat> lookup = {
+        {"text",     OutputFormat::Text},
+        {"columnar", OutputFormat::Columnar}
+    };
+
+    std::optional<OutputFormat> of;
+    std::string lc; for (; *s; ++s) lc.push_back(std::tolower(*s));
+    auto ii = lookup.find(lc);
+    if (ii != lookup.end()) of = ii->second;
+    return of;
+}
+
 };
\ No newline at end of file
@@ -52,6 +52,23 @@ enum class CodonOutput {
 std::optional<CodonOutput>
 codon_output_from_string(const char *s);
 
+/** Supported formats for the program output. */
+enum class OutputFormat {
+    Text,       //< Tab-delimited text sections (#Settings#, #Alignments#, etc.)
+    Columnar    //< Binary column blocks with a footer index (see columnar.h)
+};
+
+/** Maybe get an OutputFormat enum value from a string. */
+std::optional<OutputFormat>
+output_format_from_string(const char *s);
+
+/** What a dsa invocation does (the first command line argument). */
+enum class Command {
+    Analyze,    //< Analyze one sample or a --batch of them (no command)
+    Serve,      //< dsa serve: keep the templates loaded and run jobs sent to a --socket
+    Submit      //< dsa submit: send one job to a dsa serve --socket and print its result
+};
+
 /** Alignment templates can be dna sequences (packed as Cdns),
 * amino acid sequences (Aas), or special files containing lists
 * of sequences (std::path to a .fasta file)
@@ -66,6 +83,11 @@ struct Params {
 
     std::string fw_filename;
     std::string rv_filename; 
+    std::string output_filename;
+    std::string batch_filename; //manifest of samples for --batch
+    std::string socket_filename; //Unix socket of dsa serve and dsa submit
+    std::string trace_filename;  //Chrome trace of the threads' activity (--trace)
+    std::string metrics_filename; //Prometheus textfile of the progress counters (--metrics_file)
     std::vector<std::string> fw_refs;
     std::vector<std::string> rv_refs;
 
@@ -81,6 +103,15 @@ struct Params {
     int skip_assembly_flag = 0;
     int allow_ptcs_flag    = 0;
     int separate_cdr3_flag = 0;
+    int compact_alignments_flag = 0;
+    int thread_stats_flag       = 0;
+    int staged_front_end_flag   = 0;
+    int pin_threads_flag        = 0;
+    int shutdown_flag           = 0; //dsa submit --shutdown
+    int profile_flag            = 0;
+    int perf_counters_flag      = 0; //implies profile_flag
+    int track_allocations_flag  = 0; //implies profile_flag
+    int progress_flag           = 0;
 
     float min_alignment_score = 0.8f;
     char  tp_qual_min         = 'A';
@@ -88,8 +119,17 @@ struct Params {
     long  min_overlap         = 9;
     long  max_mismatches      = 0;
     long  number_from         = 1;
-
-    CodonOutput codon_output = CodonOutput::None;
+    long  threads             = 0; //0 for default_thread_count()
+    long  qc_threads          = 0; //0 for about half of the threads
+    long  assembly_threads    = 0; //0 for about half of the threads
+    long  queue_depth         = 0; //batches; 0 for twice the qc and assembly threads
+    long  batch_jobs          = 2; //samples of a --batch processed at once
+    long  serve_jobs          = 2; //jobs dsa serve runs at once; more wait their turn
+    long  progress_interval   = 10; //seconds between --progress lines and --metrics_file updates
+
+    CodonOutput  codon_output  = CodonOutput::None;
+    OutputFormat output_format = OutputFormat::Text;
+    Command      command       = Command::Analyze;
 };
 
 }; //namespace help
@@ -0,0 +1,159 @@
+/*
+Copyright 2024, The Broad Institute of MIT and Harvard
+
+Original Author: Charles C Bailey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "perfcount.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <iterator>
+
+#ifdef DSA_TARGET_LINUX
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace bio {
+
+#ifdef DSA_TARGET_LINUX
+
+/** Open a counter of (type, config) on thread tid in the group of leader (-1 to lead one). */
+static int
+open_counter(uint32_t type, uint64_t config, pid_t tid, int leader) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size           = sizeof(attr);
+    attr.type           = type;
+    attr.config         = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+    attr.inherit        = 1;
+    attr.read_format    = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, tid, -1, leader, 0));
+}
+
+/** The value of counter fd, scaled up for the time it was multiplexed out. */
+static uint64_t
+read_counter(int fd) {
+    if (fd < 0) return 0;
+    uint64_t values[3] = {0, 0, 0}; //value, time enabled, time running
+    if (::read(fd, values, sizeof(values)) != sizeof(values) || values[2] == 0) return 0;
+    if (values[2] >= values[1]) return values[0];
+    return static_cast<uint64_t>(static_cast<double>(values[0]) * values[1] / values[2]);
+}
+
+static const uint64_t HARDWARE_EVENTS[4] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES
+};
+
+PerfCounterSet::PerfCounterSet() {
+    std::error_code ec;
+    for (const auto &entry : std::filesystem::directory_iterator("/proc/self/task", ec)) {
+        const pid_t tid = static_cast<pid_t>(std::stol(entry.path().filename().string()));
+        ThreadCounters t;
+        t.task_clock = open_counter(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK, tid, -1);
+        if (t.task_clock < 0) continue; //the thread has exited, or perf events are off limits
+
+        t.hardware[0] = open_counter(PERF_TYPE_HARDWARE, HARDWARE_EVENTS[0], tid, -1);
+        for (int i = 1; i < 4 && t.hardware[0] >= 0; ++i) {
+            t.hardware[i] = open_counter(PERF_TYPE_HARDWARE, HARDWARE_EVENTS[i], tid, t.hardware[0]);
+        }
+        threads_.push_back(t);
+    }
+}
+
+PerfCounterSet::~PerfCounterSet() {
+    for (const ThreadCounters &t : threads_) {
+        for (int fd : t.hardware) if (fd >= 0) ::close(fd);
+        ::close(t.task_clock);
+    }
+}
+
+PerfCounters
+PerfCounterSet::read() const {
+    PerfCounters counters;
+    counters.threads  = threads_.size();
+    counters.hardware = !threads_.empty();
+    for (const ThreadCounters &t : threads_) {
+        //all four or none: a partial group would mix counts from different runs of the code
+        if (std::find(std::begin(t.hardware), std::end(t.hardware), -1) != std::end(t.hardware)) {
+            counters.hardware = false;
+        }
+        counters.task_seconds += read_counter(t.task_clock) * 1e-9;
+    }
+    if (counters.hardware) {
+        for (const ThreadCounters &t : threads_) {
+            counters.cycles        += read_counter(t.hardware[0]);
+            counters.instructions  += read_counter(t.hardware[1]);
+            counters.cache_misses  += read_counter(t.hardware[2]);
+            counters.branch_misses += read_counter(t.hardware[3]);
+        }
+    }
+    return counters;
+}
+
+bool
+PerfCounterSet::hardware_available(std::string *reason) {
+    const int fd = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, 0, -1);
+    if (fd >= 0) {
+        ::close(fd);
+        return true;
+    }
+    if (reason) {
+        switch (errno) {
+            case ENOENT:
+            case EOPNOTSUPP: *reason = "the CPU has no usable performance monitoring unit (e.g. in a virtual machine)"; break;
+            case EACCES:
+            case EPERM:      *reason = "not permitted; see /proc/sys/kernel/perf_event_paranoid"; break;
+            case ENOSYS:     *reason = "perf_event_open is not available (e.g. blocked by seccomp)"; break;
+            default:         *reason = std::strerror(errno);
+        }
+    }
+    return false;
+}
+
+#else //#ifdef DSA_TARGET_LINUX
+
+PerfCounterSet::PerfCounterSet() {}
+
+PerfCounterSet::~PerfCounterSet() {}
+
+PerfCounters
+PerfCounterSet::read() const {
+    return PerfCounters();
+}
+
+bool
+PerfCounterSet::hardware_available(std::string *reason) {
+    if (reason) *reason = "hardware counters are only read on Linux";
+    return false;
+}
+
+#endif //#ifdef DSA_TARGET_LINUX
+
+}; //namespace bio
\ No newline at end of file
@@ -0,0 +1,87 @@
+/*
+Copyright 2024, The Broad Institute of MIT and Harvard
+
+Original Author: Charles C Bailey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef BIO_PERFCOUNT_H_
+#define BIO_PERFCOUNT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace bio {
+
+/** Events counted by a PerfCounterSet, summed over the threads it counted. */
+struct PerfCounters {
+    bool     hardware      = false; ///< whether the hardware events below were counted
+    uint64_t cycles        = 0;
+    uint64_t instructions  = 0;
+    uint64_t cache_misses  = 0;     ///< last level cache misses
+    uint64_t branch_misses = 0;
+    double   task_seconds  = 0.0;   ///< CPU time of the counted threads (software task clock)
+    size_t   threads       = 0;     ///< threads that were counted
+
+    double instructions_per_cycle() const { return cycles ? static_cast<double>(instructions) / cycles : 0.0; }
+};
+
+/** Counts cycles, instructions, cache misses and branch misses, plus the
+  * task clock, with Linux perf_event_open from construction until read().
+  *
+  * One group of counters is opened for each thread of the process, in user
+  * space only, so that no privileges beyond perf_event_paranoid <= 2 are
+  * needed. The counters are inherited, so threads started afterwards (e.g.
+  * the front end's) count towards the thread that started them once they
+  * have exited. Counts are scaled up if the kernel had to multiplex them.
+  *
+  * Where counters cannot be opened (other platforms, virtual machines
+  * without a PMU, seccomp) the set counts nothing and read() says so.
+  */
+class PerfCounterSet {
+public:
+    PerfCounterSet();
+    ~PerfCounterSet();
+    PerfCounterSet(const PerfCounterSet &) = delete;
+    PerfCounterSet &operator=(const PerfCounterSet &) = delete;
+    PerfCounterSet(PerfCounterSet &&other) noexcept : threads_(std::move(other.threads_)) { other.threads_.clear(); }
+
+    /** Takes other's counters; other closes ours. */
+    PerfCounterSet &operator=(PerfCounterSet &&other) noexcept { std::swap(threads_, other.threads_); return *this; }
+
+    /** The counts so far. */
+    PerfCounters read() const;
+
+    /** Whether hardware events can be counted here; if not, why not in *reason. */
+    static bool hardware_available(std::string *reason=nullptr);
+
+private:
+    struct ThreadCounters {
+        int hardware[4] = {-1, -1, -1, -1}; //cycles (the group leader), instructions, cache misses, branch misses
+        int task_clock  = -1;
+    };
+    std::vector<ThreadCounters> threads_;
+};
+
+}; //namespace bio
+
+#endif
\ No newline at end of file
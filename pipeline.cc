@@ -0,0 +1,867 @@
+/*
+Copyright 2024, The Broad Institute of MIT and Harvard
+
+Original Author: Charles C Bailey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "pipeline.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+
+#include "cdn.h"
+#include "columnar.h"
+#include "compact.h"
+#include "defines.h"
+#include "gzip.h"
+#include "io.h"
+#include "parallelism.h"
+#include "sections.h"
+#include "taskgraph.h"
+#include "threadpool.h"
+#include "trace.h"
+
+namespace bio {
+
+using help::Params;
+typedef std::vector<GroupAlignment>::const_iterator SubsIt;
+
+/** Load template source i of params and trim it, or nullptr for an empty amino acid template. */
+static std::shared_ptr<TemplateDatabase>
+load_template_db(const Params &p, size_t i) {
+    const help::TemplateSource &source = p.template_sources[i];
+    std::shared_ptr<TemplateDatabase> db;
+    if (std::holds_alternative<fs::path>(source)) {
+        const fs::path &filename = std::get<fs::path>(source);
+        try {
+            db = TemplateDatabase::from_imgt_fasta(filename);
+        } catch (const BadTemplateDatabaseParse &ex) {
+            std::ostringstream msg;
+            msg << "could not parse '" << filename.string() << "' as a template database: " << std::endl
+                << "Error: " << ex.what() << std::endl
+                << "databases should be .fasta files of in-frame nucleotides with IGMT-style headers (see --help_split)";
+            throw PipelineError(msg.str());
+        }
+    } else if (std::holds_alternative<Cdns>(source)) {
+        db = TemplateDatabase::create_empty();
+        db->add_entry("user_defined_cdns", std::get<Cdns>(source), Aas(std::get<Cdns>(source)));
+    } else if (std::holds_alternative<Aas>(source)) {
+        Aas aas = std::get<Aas>(source);
+        if (aas.empty()) {
+            db = nullptr;
+        } else {
+            db = TemplateDatabase::create_empty();
+            db->add_entry("user_defined_aas", Cdns(), std::get<Aas>(source));
+        }
+    } else {
+        throw PipelineError("Unkown template source.");
+    }
+
+    try {
+        if (db) db->trim(p.trims[i]);
+    } catch (ExcessiveTrimmingError &ex) {
+        throw PipelineError(ex.what());
+    }
+    return db;
+}
+
+/** Ignore indels and count substitutions at each position in the template.
+  * The output is a matrix whose columns correspond to the amino acid positions
+  * in the template and whose rows correspond to the amino acids found at those
+  * positions.
+  */
+static Matrix<float>
+substitution_frequencies(const Aas &templ, SubsIt lo, SubsIt hi) {
+    auto count_substitutions = [&templ](SubsIt first, SubsIt last)->Matrix<float> {
+        const size_t tpl_size = templ.size();
+        Matrix<float> out(Aa::valid_chars.size(), tpl_size);
+        for (; first != last; ++first) {
+            const std::string &query = first->alignment;
+            assert(tpl_size <= query.size());
+            for (size_t q=0, t=0; t != tpl_size; ++q) {       //q and t are indices into query and template respectively
+                const char c = query[q];
+                if (c == '-')        { ++t; continue; }       //skip insertions
+                if (std::islower(c)) {      continue; }       //skip deletions
+                out.elem(Aa::from_char(c)->index(), t) += 1.; //increment the count in out[residues, position]
+                ++t;
+            }
+        }
+        return out;
+    };
+
+    //accumulate mutation counts
+    Matrix<float> substitutions = parallel_reduce(
+        lo,
+        hi,
+        count_substitutions
+    );
+
+    //calculate the column totals
+    std::vector<float> column_totals(substitutions.cols(), 0.);
+    for (size_t r=0; r<substitutions.rows(); ++r)
+    for (size_t c=0; c<substitutions.cols(); ++c) {
+        column_totals[c] += substitutions.elem(r, c);
+    }
+
+    //convert counts to frequencies
+    for (size_t c=0; c<substitutions.cols(); ++c) {
+        if (column_totals[c] == 0.) continue; //treat 0/0 as 0
+        for (size_t r=0; r<substitutions.rows(); ++r) substitutions.elem(r, c) /= column_totals[c];
+    }
+
+    //zero out the wild type frequencies
+    for (size_t c=0; c<substitutions.cols(); ++c) {
+        substitutions.elem(templ[c].index(), c) = 0.;
+    }
+
+    return substitutions;
+}
+
+/** Count coding and non-coding mutations for a template with codon data. */
+static MutationCount
+count_mutations(const Aas &aa_template, const Cdns &cdn_template, SubsIt lo, SubsIt hi) {
+    //compare an alignment string/codons with an amino acid template/codons
+    //and count the coding vs noncoding mutations
+    auto categorize_mutations = [&aa_template, &cdn_template](SubsIt first, SubsIt last)->MutationCount {
+        MutationCount out(cdn_template.size());
+        assert(aa_template.size() == cdn_template.size());
+        const char* ta = aa_template.c_str();
+        const char* tc = cdn_template.c_str();
+        const size_t t_size = aa_template.size();
+
+        for (; first != last; ++first) {
+            assert(first->alignment.size() == first->cdns.size());
+            assert(aa_template.size() <= first->alignment.size());
+            const char* qa = first->alignment.c_str();
+            const char* qc = first->cdns.c_str();
+
+            for (size_t q = 0, t = 0; t != t_size; ++q) {       //q and t are indices into query and template
+                if (qa[q] == '-') { ++t; continue; } //skip deletions
+                if (std::islower(qa[q])) { continue; } //skip insertions
+                out.total[t] += 1;
+                if (qc[q] != tc[t]) {                       //codon mismatch means a mutation
+                    if (qa[q] == ta[t]) {                   //mutation is synonymous if residues match
+                        out.synonymous[t] += 1;
+                    }
+                    else {
+                        out.nonsynonymous[t] += 1;
+                    }
+                }
+                ++t;
+            }
+        }
+        return out;
+    };
+
+    return parallel_reduce(lo, hi, categorize_mutations);
+}
+
+/** Collate the alignments of unpaired reads such that the fw alignment of a
+  * read pair always preceeds the rv alignment. Some pairs might only have one
+  * viable alignment (for example, one Orf is fine but the other has a PTC) so
+  * those are listed at the end.
+  */
+static std::vector<GroupAlignment>
+collate_alignments(std::vector<GroupAlignment> &&fwaln, std::vector<GroupAlignment> &&rvaln) {
+    std::vector<GroupAlignment> alignments;
+    alignments.reserve(fwaln.size() + rvaln.size());
+
+    //We do this by sorting fw and rv alignments by barcode then interleaving them into the alignments
+    //vector while storing the unpaired alignments in the unpaired vector.
+    std::vector<GroupAlignment> unpaired; //to store the unpaired alignments
+
+    //reverse-sort by barcode
+    struct by_barcode { 
+        bool operator()(const GroupAlignment &a, const GroupAlignment &b) const {
+            return a.barcode > b.barcode;
+        }
+    };
+    parallel_sort(fwaln.begin(), fwaln.end(), by_barcode());
+    parallel_sort(rvaln.begin(), rvaln.end(), by_barcode());
+
+    //collate
+    while (!fwaln.empty() && !rvaln.empty()) {
+        const int cmp = fwaln.back().barcode.compare(rvaln.back().barcode);
+        if (cmp == 0) {
+            alignments.push_back(std::move(fwaln.back()));
+            fwaln.pop_back();
+            alignments.push_back(std::move(rvaln.back()));
+            rvaln.pop_back();
+        } else if (cmp < 0) {
+            unpaired.push_back(std::move(fwaln.back()));
+            fwaln.pop_back();
+        } else {
+            unpaired.push_back(std::move(rvaln.back()));
+            rvaln.pop_back();
+        }
+    }
+
+    //combine with unpaired and left-over alignments
+    alignments.insert(alignments.cend(),
+                      std::make_move_iterator(unpaired.begin()),
+                      std::make_move_iterator(unpaired.end()));
+
+    alignments.insert(alignments.cend(),
+                      std::make_move_iterator(fwaln.rbegin()),
+                      std::make_move_iterator(fwaln.rend()));
+
+    alignments.insert(alignments.cend(),
+                      std::make_move_iterator(rvaln.rbegin()),
+                      std::make_move_iterator(rvaln.rend()));
+    return alignments;
+}
+
+Pipeline::Pipeline(const Params &params) : params_(params) {
+    const Params &p = params_;
+
+    //check the arguments for bad values and mutually exclusive options
+    if (p.min_overlap < p.max_mismatches) {
+        throw PipelineError("max_mismatches must be less than min_overlap");
+    }
+
+    if (p.skip_assembly_flag && p.template_sources.size() > 1) {
+        throw PipelineError("skipping assembly (i.e. -x, --skip_assembly) is incompatible with "
+                            "split templates and multiple template alignment");
+    }
+
+    if (p.split_template_regex.mark_count() != 0 &&
+        p.split_template_regex.mark_count() != p.template_sources.size()) {
+        throw PipelineError("when splitting reads for multi-template alignment (--split), "
+                            "a template source (--template, --template_dna, --template_db) must be provided for each capturing "
+                            "subgroup of the regular expression (see --help_split)");
+    }
+
+    for (size_t i=0; i<p.template_sources.size(); ++i) template_dbs_.push_back(load_template_db(p, i));
+
+    if (p.skip_assembly_flag && (template_dbs_.size() * template_dbs_.front()->size() > 1)) {
+        throw PipelineError("skipping assembly (i.e. -x, --skip_assembly) is incompatible with "
+                            "split templates and multiple template alignment");
+    }
+
+    for (const std::string &ref : p.fw_refs) {
+        try {
+            fwexs_.push_back(UMIExtractor(ref));
+        } catch (std::exception &) {
+            throw PipelineError("fw_ref '" + ref + "' is not a valid reference sequence (see --help)");
+        }
+    }
+
+    for (const std::string &ref : p.rv_refs) {
+        try {
+            rvexs_.push_back(UMIExtractor(ref));
+        } catch (std::exception &) {
+            throw PipelineError("rv_ref '" + ref + "' is not a valid reference sequence (see --help)");
+        }
+    }
+
+    //tracing starts before the pool is built so that its workers are named
+    if (!p.trace_filename.empty()) {
+        trace::start();
+        trace::name_thread("main");
+    }
+    pool_ = std::make_unique<ThreadPool>(p.threads > 0 ? static_cast<size_t>(p.threads) : default_thread_count(), p.pin_threads_flag);
+    if (p.profile_flag) count_allocations(true);
+    if (p.track_allocations_flag) track_allocations(true);
+    if (p.perf_counters_flag) {
+        count_perf_events(true);
+        std::string reason;
+        if (!PerfCounterSet::hardware_available(&reason)) {
+            std::cerr << "--perf_counters: hardware events are unavailable (" << reason << "); only the task clock is counted" << std::endl;
+        }
+    }
+    if (p.progress_flag || !p.metrics_filename.empty()) {
+        progress_ = std::make_unique<ProgressReporter>(p.progress_flag ? &std::cerr : nullptr,
+                                                       p.metrics_filename,
+                                                       std::chrono::seconds(p.progress_interval));
+    }
+}
+
+SampleResult
+Pipeline::run(const std::string &fw_filename, const std::string &rv_filename) const {
+    const Params &p = params_;
+    ThreadPool::Use use_pool(*pool_);
+
+    SampleResult result;
+    result.fw_filename = fw_filename;
+    result.rv_filename = rv_filename;
+    if (p.track_allocations_flag) result.allocations_at_start = restart_allocation_tallies();
+
+    //Filling out 'alignments' is the ultimate goal of our program.
+    //These GroupAlignments represent the Needleman-Wunsch alignments
+    //of translated paired or unpaired read data to the user-supplied
+    //template(s)
+    //If no templates are given, dsa will just return UMI-grouped
+    //lists of sequences found between the references
+    std::vector<GroupAlignment> &alignments = result.alignments;
+    ParseLog &log = result.log;
+
+    auto clock_start = std::chrono::high_resolution_clock::now();
+
+    //with --thread_stats, report how evenly each stage kept the threads busy
+    auto stage_start = std::chrono::steady_clock::now();
+    if (p.thread_stats_flag) pool_->reset_stats();
+    auto stage_done = [&](const char *stage, const std::vector<ThreadStats> *stats=nullptr) {
+        if (!p.thread_stats_flag) return;
+        const auto now = std::chrono::steady_clock::now();
+        const double seconds = std::chrono::duration<double>(now - stage_start).count();
+        if (stats) {
+            report_thread_stats(std::cerr, stage, seconds, *stats);
+            pool_->reset_stats();
+        } else {
+            report_thread_stats(std::cerr, stage, seconds);
+        }
+        stage_start = now;
+    };
+
+    //with --profile, time each stage and count the items it takes and hands on
+    auto stage_timer = [&](std::string stage, size_t items_in) {
+        std::optional<StageTimer> timer;
+        if (p.profile_flag) timer.emplace(std::move(stage), items_in);
+        return timer;
+    };
+
+    //map the fastq files; they are read in place by the front end
+    auto map_fastq = [](const std::string &filename)->ConstMapping {
+        try {
+            return ConstMapping::map(filename);
+        } catch (std::exception &) {
+            throw PipelineError("error parsing '" + filename + "'");
+        }
+    };
+    ConstMapping fwmap = map_fastq(fw_filename);
+    ConstMapping rvmap = map_fastq(rv_filename);
+
+    //Parse the reads, perform qc and assemble the read pairs as a pipeline
+    //of batches (see stream_front_end()).
+    //QC includes locating the primers, extracting the UMI,
+    //and trimming low-quality bases from the 3' ends of the reads.
+    //Sometimes data are low enough quality that the 3' ends are too hard to
+    //align or the PCR template may be too long to sequence. In these cases,
+    //we can skip assembling the read pairs (-x) and process them anyway;
+    //the front end then hands back the fw and rv reads separately.
+    std::optional<StageTimer> timer = stage_timer(p.skip_assembly_flag ? "parse, qc" : "parse, qc, assemble", 0);
+    FrontEnd front;
+    try {
+        front = stream_front_end(fwmap, rvmap, fwexs_, rvexs_, p, log);
+    } catch (ReadCountError &) {
+        //make sure we got the same number of forward and reverse reads
+        throw PipelineError("read count disagreement between " + fw_filename + " and " + rv_filename);
+    }
+    fwmap.unmap();
+    rvmap.unmap();
+
+    result.total_reads = front.total_reads;
+    result.queue_stats = std::move(front.queue_stats);
+    if (timer) {
+        //the front end counts the read pairs as it goes
+        result.profile.push_back(timer->stop(front.reads.size() + front.rv_reads.size()));
+        result.profile.back().items_in = front.total_reads;
+    }
+    if (p.thread_stats_flag) {
+        for (const auto &[queue, stats] : result.queue_stats) report_queue_stats(std::cerr, queue, stats);
+    }
+    //the front end runs on threads of its own rather than on the pool
+    stage_done(p.skip_assembly_flag ? "parse, qc" : "parse, qc, assembly", &front.thread_stats);
+
+    if (p.skip_assembly_flag) {
+        //at first we hold the reads from the two fastq files separately
+        SegmentedVector<Read> fwreads = std::move(front.reads);
+        SegmentedVector<Read> rvreads = std::move(front.rv_reads);
+
+        //From here on the fw and rv reads are processed independently, so
+        //the two branches (UMI collapse -> translate -> split -> align) run
+        //concurrently. Each branch keeps its own ParseLog.
+        std::vector<GroupAlignment> fwaln, rvaln;
+        ParseLog fwlog, rvlog;
+
+        auto add_branch = [&](TaskGraph &graph,
+                              SegmentedVector<Read> &reads,
+                              std::vector<GroupAlignment> &aln,
+                              ParseLog &branch_log,
+                              bool reverse) {
+            auto splits = std::make_shared<SplitOrfs>(); //handed from translate to align
+
+            //UMI collapse gives us consensus sequences for the UMI groups
+            TaskGraph::Node collapse = graph.add([&]{
+                reads = umi_collapse(std::move(reads), p, branch_log, true);
+            });
+
+            //translate; we don't support splitting unpaired reads so split_orfs just
+            //reorganizes the data structures so they can be passed to the template
+            //alignment functions
+            TaskGraph::Node translate = graph.add([&, splits, reverse]{
+                SegmentedVector<Orf> orfs = translate_and_filter_ptcs(std::move(reads), p, branch_log, reverse);
+                reads.clear(); reads.shrink_to_fit();
+                *splits = split_orfs(std::move(orfs), p, branch_log);
+            }, {collapse});
+
+            //Align our reads to the template; 5' and 3' are aligned separately
+            graph.add([&, splits]{
+                aln = align_to_multiple_templates(
+                    std::move(*splits),
+                    template_dbs_,
+                    p,
+                    branch_log,
+                    true);
+            }, {translate});
+        };
+
+        //the stages of the two branches overlap, and a StageTimer measures
+        //the whole process, so the branches are profiled as one stage
+        timer = stage_timer("umi collapse, translate, align", fwreads.size() + rvreads.size());
+        TaskGraph branches;
+        add_branch(branches, fwreads, fwaln, fwlog, false);
+        add_branch(branches, rvreads, rvaln, rvlog, true);
+        branches.run();
+        log = log + fwlog + rvlog;
+        if (timer) result.profile.push_back(timer->stop(fwaln.size() + rvaln.size()));
+        stage_done("umi collapse, translate, align");
+
+        alignments = collate_alignments(std::move(fwaln), std::move(rvaln));
+    } else { //assembling the read ends makes life much easier
+        SegmentedVector<Read> reads = std::move(front.reads);
+        timer = stage_timer("umi collapse", reads.size());
+        reads = umi_collapse(std::move(reads), p, log, false);
+        if (timer) result.profile.push_back(timer->stop(reads.size()));
+        stage_done("umi collapse");
+        timer = stage_timer("translate", reads.size());
+        SegmentedVector<Orf>  orfs  = translate_and_filter_ptcs(std::move(reads), p, log, false);
+        if (timer) result.profile.push_back(timer->stop(orfs.size()));
+
+        //Note that the split/multitemplate code path and the sigle template code
+        //path are the same. If there is no regex for splitting, split_orfs just turns
+        //the 1D orfs vector, shape=(orfs.size(), ) into a 2D vector of shape=(orfs.size(), 1)
+        timer = stage_timer("split", orfs.size());
+        SplitOrfs splits = split_orfs(
+            std::move(orfs),
+            p,
+            log
+        );
+        orfs.clear(); orfs.shrink_to_fit();
+        if (timer) result.profile.push_back(timer->stop(splits.size()));
+        stage_done("translate");
+
+        //Again, the single- and multi-template code paths are the same.
+        //Single templates are just folded into single-entry template
+        //databases.
+        timer = stage_timer("align", splits.size());
+        alignments = align_to_multiple_templates(
+            std::move(splits),
+            template_dbs_,
+            p,
+            log
+        );
+        if (timer) result.profile.push_back(timer->stop(alignments.size()));
+        stage_done("align");
+    }
+
+    std::vector<std::shared_ptr<AlignmentTemplate>> &templates = result.templates;
+    timer = stage_timer("statistics", alignments.size());
+    trace::Label trace_label("statistics");
+    Progress::instance().stage("statistics");
+
+    //If we have more than one template, we sort the alignments by template id
+    //so that the output has similar sequences adjacent to one another
+    parallel_sort(alignments.begin(), 
+        alignments.end(), 
+        [](const GroupAlignment &a, const GroupAlignment &b)->bool{
+            if ( a.templ ==  b.templ) return false;
+            if (!a.templ &&  b.templ) return true;
+            if ( a.templ && !b.templ) return false;
+            return a.templ->id < b.templ->id;
+        }
+    );
+
+    //Alignments are sorted by tempate_id where template_id is the index into templates
+    //we now find the range of alignments with each template_id; the range for
+    //templates[i] is stored in template_ranges[i] as [lo, hi)
+    std::vector<std::pair<SubsIt, SubsIt>> template_ranges;
+    for (SubsIt lo=alignments.cbegin(), hi=alignments.cbegin(); hi != alignments.cend(); ) {
+        lo = hi;
+
+        //substitutions only make sense in the context of a template
+        //so we skip untemplated stuff.
+        if (lo->templ == nullptr) {
+            ++hi;
+            continue;
+        }
+
+        const size_t i = lo->templ->id;
+        templates.push_back(lo->templ);
+
+        hi = std::find_if_not(lo, alignments.cend(),
+            [=](const GroupAlignment &g)->bool{ return i == g.templ->id; }
+        );
+        template_ranges.emplace_back(lo, hi);
+    }
+
+    //the statistics of different templates are independent of one another
+    //so each is a separate task
+    result.substitution_matrices.resize(templates.size());
+    result.mutation_counts.resize(templates.size());
+    TaskGraph statistics;
+    for (size_t i = 0; i < templates.size(); ++i) {
+        const AlignmentTemplate &tpl = *templates[i];
+        auto [lo, hi] = template_ranges[i];
+        statistics.add([&, i, lo, hi]{ result.substitution_matrices[i] = substitution_frequencies(tpl.aas, lo, hi); });
+        if (!tpl.cdns.empty()) {
+            statistics.add([&, i, lo, hi]{ result.mutation_counts[i] = count_mutations(tpl.aas, tpl.cdns, lo, hi); });
+        }
+    }
+    statistics.run();
+    if (timer) result.profile.push_back(timer->stop(templates.size()));
+    stage_done("statistics");
+
+    auto clock_stop = std::chrono::high_resolution_clock::now();
+    result.milliseconds = std::chrono::duration<double, std::milli>(clock_stop-clock_start).count();
+    result.completed    = std::time(nullptr);
+    Progress::instance().add(Progress::SamplesCompleted, 1);
+    return result;
+}
+
+std::string
+Pipeline::settings(const SampleResult &result) const {
+    const Params &p = params_;
+    const ParseLog &log = result.log;
+
+    double ms = result.milliseconds;
+    size_t ss = static_cast<size_t>(ms / 1000);
+    size_t mm = ss / 60;
+    size_t hh = mm / 60;
+    ms -= ss * 1000;
+    ss -= mm * 60;
+    mm -= hh * 60;
+
+    //std::localtime() shares one buffer between threads; samples of a batch are written concurrently
+    std::tm end_tm;
+#ifdef DSA_TARGET_WIN64
+    localtime_s(&end_tm, &result.completed);
+#else
+    localtime_r(&result.completed, &end_tm);
+#endif
+
+    //the settings and parse statistics are kept as text; they become the header
+    //of the text output or a metadata block of the columnar output
+    std::ostringstream settings;
+    settings << "#Settings#" << std::endl;
+    settings << "#program version\t" << VERSION_STRING << std::endl;
+    settings << "#run complete\t" << std::put_time(&end_tm, "%Y-%m-%d %H:%M:%S") << std::endl;
+    settings << "#wall clock time\t" << std::setw(2) << std::setfill('0') << hh << ":"
+                                     << std::setw(2) << std::setfill('0') << mm << ":"
+                                     << std::setw(2) << std::setfill('0') << ss << "."
+                                     << std::setw(3) << std::setfill('0') << static_cast<int>(ms) << std::endl; 
+    settings << "#forward reads fastq file\t" << result.fw_filename << std::endl;
+    settings << "#reverse reads fastq file\t" << result.rv_filename << std::endl;
+    for (const UMIExtractor &fwex : fwexs_) settings << "#forward nucleotide reference sequence (-f, --fw_ref)\t" << fwex.sequence() << std::endl;
+    for (const UMIExtractor &rvex : rvexs_) settings << "#reverse nucleotide reference sequence (-r, --rv_ref)\t" << rvex.sequence() << std::endl;
+    if (!p.split_template_string.empty()) {
+        settings << "#split template regular expression (--split)\t" << p.split_template_string << std::endl;
+    }
+    for (const help::TemplateSource &source : p.template_sources) {
+        if  (std::holds_alternative<Aas>(source)) {
+            settings << "#amino acid template sequence (-t, --template)\t" << std::get<Aas>(source) << std::endl;
+        } else if (std::holds_alternative<Cdns>(source)) {
+            settings << "#dna template sequence (-d, --template_dna)\t" << std::get<Cdns>(source).to_nts() << std::endl;
+        } else if (std::holds_alternative<fs::path>(source)) {
+            settings << "#template database (--template_db)\t" << std::get<fs::path>(source) << std::endl;
+        }
+    }
+    settings << "#minimum 3 prime quality (-q, --min_qual)\t" << p.tp_qual_min << std::endl;
+    settings << "#minimum umi group size (-g, --min_umi_grp)\t" << p.min_umi_group_size << std::endl;
+    settings << "#reads aligned to template separately (-x, --skip_assembly)\t" << p.skip_assembly_flag << std::endl;
+    settings << "#minimum nucleotide alignment overlap (-v, --min_overlap)\t" << p.min_overlap << std::endl;
+    settings << "#maximum nucleotide mismatches allowed (-m, --max_mismatch)\t" << p.max_mismatches << std::endl;
+    settings << "#minimum template alignment score (-a, --min_aln)\t" << p.min_alignment_score << std::endl;
+    if (p.compact_alignments_flag) {
+        settings << "#compact alignments (--compact_alignments)\t" << p.compact_alignments_flag << std::endl;
+    }
+    settings << "#Parse#" << std::endl; 
+    settings << "#paired end reads parsed\t" << result.total_reads << std::endl;
+    settings << "#reads filtered because of non-ATGC characters\t" << log.filter_invalid_chars << std::endl;
+    settings << "#reads filtered because reference could not be identified in forward sequence\t" << log.filter_no_fw_umi << std::endl;
+    settings << "#reads filtered because reference could not be identified in reverse sequence\t" << log.filter_no_rv_umi << std::endl;
+    settings << "#reads filtered because they could not be assembled\t" << log.filter_could_not_assemble << std::endl;
+    settings << "#reads filtered because of small umi group size\t" << log.filter_umi_group_size_too_small << std::endl;
+    settings << "#reads merged during umi collapse\t" << log.filter_duplicate_umi << std::endl;
+    settings << "#reads filtered because of premature stop codons\t" << log.filter_premature_stop_codon << std::endl;
+    settings << "#reads filtered because no matching template was identified\t" << log.filter_no_matching_template << std::endl;
+    settings << "#reads filtered because of poor alignment to template\t" << log.filter_bad_alignment << std::endl;
+    settings << "#alignments calculated after qc and umi collapse\t" << result.alignments.size() << std::endl;
+    return settings.str();
+}
+
+void
+Pipeline::write(const SampleResult &result, const std::string &output_filename) const {
+    trace::Label trace_label("output");
+    ThreadPool::Use use_pool(*pool_);
+    std::optional<StageTimer> timer;
+    if (params_.profile_flag) timer.emplace("output", result.alignments.size());
+
+    if (params_.output_format == help::OutputFormat::Columnar) {
+        try {
+            std::vector<Counter<std::string>> usage;
+            if (template_dbs_.size()) usage = template_usage(result.alignments, template_dbs_.size());
+            write_columnar(output_filename, settings(result), params_, usage, result.templates, result.alignments,
+                           result.substitution_matrices, result.mutation_counts);
+        } catch (const BadColumnarFile &ex) {
+            throw PipelineError(ex.what());
+        }
+    } else {
+        std::unique_ptr<std::ostream> ofs;
+        if (!output_filename.empty()) {
+            if (fs::path(output_filename).extension() == ".gz") ofs = std::make_unique<GzipOfstream>(output_filename);
+            else ofs = std::make_unique<std::ofstream>(output_filename);
+            if (!*ofs) throw PipelineError("could not open '" + output_filename + "' for writing");
+        }
+        write_text(ofs ? *ofs : std::cout, result);
+    }
+
+    //unlike the #Profile# section, the JSON can include closing the file
+    if (timer) {
+        std::vector<StageProfile> stages = result.profile;
+        stages.push_back(timer->stop(result.alignments.size()));
+        std::vector<AllocationTally> allocations;
+        if (params_.track_allocations_flag) allocations = allocation_tallies(result.allocations_at_start);
+        if (output_filename.empty()) {
+            write_profile_json(std::cerr, result.fw_filename, result.rv_filename, result.total_reads, stages, allocations);
+        } else {
+            std::ofstream json(output_filename + ".profile.json");
+            write_profile_json(json, result.fw_filename, result.rv_filename, result.total_reads, stages, allocations);
+            if (!json) throw PipelineError("could not write '" + output_filename + ".profile.json'");
+        }
+    }
+}
+
+void
+Pipeline::write_text(std::ostream &os, const SampleResult &result) const {
+    const Params &p = params_;
+    ThreadPool::Use use_pool(*pool_);
+    const std::vector<GroupAlignment> &alignments = result.alignments;
+    const std::vector<std::shared_ptr<AlignmentTemplate>> &templates = result.templates;
+
+    std::optional<StageTimer> timer;
+    if (p.profile_flag) timer.emplace("output", alignments.size());
+
+    if (!p.no_header_flag) os << settings(result);
+
+    if (template_dbs_.size()) {
+        os << "#Templates#" << std::endl;
+        os << "Template Id\tTemplate Name\tSequence" << (p.compact_alignments_flag ? "\tNucleotides" : "") << std::endl;
+        for (const auto& tpl : templates) {
+            os << tpl->id << '\t'
+                << tpl->label() << '\t'
+                << tpl->aas;
+            if (p.compact_alignments_flag) os << '\t' << tpl->cdns.to_nts();
+            os << std::endl;
+        }
+
+        //get frequency of template usage
+        const std::vector<Counter<std::string>> template_counters = template_usage(alignments, template_dbs_.size());
+
+        os << "#Template Usage#" << std::endl;
+        os << "Split\tTemplate\tCount\tFrequency" << std::endl;
+        for (size_t i = 0; i < template_counters.size(); ++i) {
+            for (const auto& [label, count] : template_counters[i]) {
+                os << (i + 1) << '\t'
+                    << label << '\t'
+                    << count << '\t'
+                    << count / static_cast<double>(template_counters[i].total()) << std::endl;
+            }
+        }
+    }
+
+    os << "#Alignments#" << std::endl;
+    os << "Template\tUMI Group Size\tBarcode\tSequence" << std::endl;
+    for (const GroupAlignment &al : alignments) {
+        if (p.compact_alignments_flag) {
+            //write only the differences from the template; see --help
+            const std::string_view taas  = al.templ ? al.templ->aas.as_string_view()  : std::string_view();
+            const std::string_view tcdns = al.templ ? al.templ->cdns.as_string_view() : std::string_view();
+            os << (al.templ ? std::to_string(al.templ->id) : std::string()) << '\t'
+               << al.umi_group_size << '\t'
+               << al.barcode << '\t'
+               << compact_alignment(al.alignment, taas) << std::endl;
+            if (p.codon_output == help::CodonOutput::Horizontal) {
+                os << "\t\t\t" << compact_codons(al.alignment, al.cdns, tcdns) << std::endl;
+            }
+            continue;
+        }
+
+        os << (al.templ ? std::to_string(al.templ->id) : std::string()) << '\t'
+           << al.umi_group_size << '\t'
+           << al.barcode << '\t'
+           << al.alignment << std::endl;
+        write_codons(os, al.cdns, p.codon_output);
+    }
+
+    if (template_dbs_.size()) {
+        for (size_t i = 0; i < result.substitution_matrices.size(); ++i) {
+            const Matrix<float>& substitutions = result.substitution_matrices[i];
+
+            os << "#Substitutions (" << templates[i]->label() << ")#" << std::endl;
+            //print the matrix
+            for (size_t c = 0; c < substitutions.cols(); ++c) os << '\t' << templates[i]->aas[c] << (c + p.number_from);
+            os << std::endl;
+            for (size_t r = 0; r < substitutions.rows(); ++r) {
+                os << Aa::valid_chars[r];
+                for (size_t c = 0; c < substitutions.cols(); ++c) os << '\t' << substitutions.elem(r, c);
+                os << std::endl;
+            }
+
+            if (!templates[i]->cdns.empty()) {
+                const Aas& aa_template = templates[i]->aas;
+                const MutationCount &mutation_count = result.mutation_counts[i];
+
+                os << "#Mutation Counts (" << templates[i]->label() << ")#" << std::endl;
+                for (size_t c = 0; c < aa_template.size(); ++c) os << '\t' << aa_template[c] << (c + p.number_from);
+                os << std::endl;
+
+                os << "Total";
+                for (size_t c = 0; c < aa_template.size(); ++c) os << '\t' << mutation_count.total[c];
+                os << std::endl;
+
+                os << "Non-Coding";
+                for (size_t c = 0; c < aa_template.size(); ++c) os << '\t' << mutation_count.synonymous[c];
+                os << std::endl;
+
+                os << "Coding";
+                for (size_t c = 0; c < aa_template.size(); ++c) os << '\t' << mutation_count.nonsynonymous[c];
+                os << std::endl;
+            }
+        }
+    }
+
+    //output lists of unique amino acid and codon sequences
+    if (!p.skip_assembly_flag) {
+        UniqueSequences unique;
+        for (const GroupAlignment &aln : alignments) unique.add(aln.alignment, aln.cdns, aln.umi_group_size);
+        unique.write(os);
+    }
+
+    if (timer) {
+        std::vector<StageProfile> stages = result.profile;
+        stages.push_back(timer->stop(alignments.size()));
+        write_profile_section(os, stages);
+        if (p.track_allocations_flag) write_allocation_section(os, allocation_tallies(result.allocations_at_start));
+    }
+}
+
+std::vector<BatchSample>
+parse_manifest(std::istream &is, const std::string &name) {
+    std::vector<BatchSample> samples;
+    size_t lineno = 0;
+    for (std::string line; std::getline(is, line); ) {
+        ++lineno;
+        if (!line.empty() && line.back() == '\r') line.pop_back(); //manifests written on Windows
+        if (line.empty() || line[0] == '#') continue;
+
+        std::vector<std::string> columns;
+        for (size_t start=0, tab; ; start=tab+1) {
+            tab = line.find('\t', start);
+            columns.push_back(line.substr(start, tab == std::string::npos ? std::string::npos : tab - start));
+            if (tab == std::string::npos) break;
+        }
+
+        const bool empty_column = std::any_of(columns.begin(), columns.end(), [](const std::string &c){ return c.empty(); });
+        if (columns.size() != 3 || empty_column) {
+            throw PipelineError(name + ":" + std::to_string(lineno) + ": expected forward fastq, reverse fastq "
+                                "and output file separated by tabs");
+        }
+        samples.push_back({columns[0], columns[1], columns[2]});
+    }
+    return samples;
+}
+
+std::vector<BatchSample>
+read_manifest(const std::string &path) {
+    std::ifstream ifs(path);
+    if (!ifs) throw PipelineError("could not open batch manifest '" + path + "'");
+    return parse_manifest(ifs, path);
+}
+
+BatchSummary
+run_batch(const Pipeline &pipeline, const std::vector<BatchSample> &samples, size_t jobs, std::ostream &report) {
+    BatchSummary summary;
+    summary.samples = samples.size();
+
+    std::mutex report_mutex;
+    std::atomic<size_t> next = 0;
+    const auto batch_start = std::chrono::steady_clock::now();
+
+    //each job takes the next sample when it is done with the last one
+    auto job = [&]{
+        for (size_t i; (i = next++) < samples.size(); ) {
+            const BatchSample &sample = samples[i];
+            const auto start = std::chrono::steady_clock::now();
+            size_t reads = 0;
+            std::string error;
+            try {
+                const SampleResult result = pipeline.run(sample.fw_filename, sample.rv_filename);
+                pipeline.write(result, sample.output_filename);
+                reads = result.total_reads;
+            } catch (const std::exception &ex) {
+                error = ex.what();
+            }
+            const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            std::lock_guard<std::mutex> lock(report_mutex);
+            summary.sample_seconds += seconds;
+            if (error.empty()) summary.total_reads += reads;
+            else               summary.failed      += 1;
+
+            const std::ios_base::fmtflags flags = report.flags();
+            report << std::fixed << std::setprecision(3)
+                   << (error.empty() ? "#batch sample\t" : "#batch failed\t") << (i + 1) << '/' << samples.size()
+                   << '\t' << sample.fw_filename << '\t' << sample.rv_filename << '\t' << sample.output_filename
+                   << '\t' << reads << " read pairs\t" << seconds << 's';
+            if (!error.empty()) report << '\t' << error;
+            report << std::endl;
+            report.flags(flags);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t j=1; j<std::min(std::max<size_t>(jobs, 1), samples.size()); ++j) threads.emplace_back(job);
+    job();
+    for (std::thread &t : threads) t.join();
+
+    summary.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - batch_start).count();
+
+    const std::ios_base::fmtflags flags = report.flags();
+    report << std::fixed << std::setprecision(3)
+           << "#batch total\t" << summary.samples << " samples (" << summary.failed << " failed)"
+           << '\t' << summary.total_reads << " read pairs"
+           << "\twall " << summary.seconds << 's'
+           << '\t' << std::setprecision(0) << (summary.seconds > 0.0 ? summary.total_reads / summary.seconds : 0.0) << " read pairs/s"
+           << '\t' << std::setprecision(2) << (summary.seconds > 0.0 ? summary.samples * 3600.0 / summary.seconds : 0.0) << " samples/h"
+           << "\tconcurrency " << (summary.seconds > 0.0 ? summary.sample_seconds / summary.seconds : 0.0) << std::endl;
+    report.flags(flags);
+    return summary;
+}
+
+}; //namespace bio
\ No newline at end of file
@@ -0,0 +1,199 @@
+/*
+Copyright 2024, The Broad Institute of MIT and Harvard
+
+Original Author: Charles C Bailey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef BIO_PIPELINE_H_
+#define BIO_PIPELINE_H_
+
+#include <ctime>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "abs.h"
+#include "align.h"
+#include "mainfunctions.h"
+#include "mpmc.h"
+#include "params.h"
+#include "profile.h"
+#include "progress.h"
+#include "threadpool.h"
+#include "umi.h"
+
+namespace bio {
+
+/** Thrown for options that cannot work together, templates that cannot be
+  * loaded, and samples whose input cannot be read or whose output cannot be
+  * written. what() is a message fit for the user.
+  */
+class PipelineError : public std::runtime_error {
+    using runtime_error::runtime_error;
+};
+
+/** Everything dsa computes for one sample. */
+struct SampleResult {
+    std::string fw_filename;
+    std::string rv_filename;
+    size_t      total_reads = 0;  ///< read pairs in the fastq files
+    ParseLog    log;              ///< reads filtered at each stage
+
+    /** The alignments, sorted by template id (untemplated ones first). */
+    std::vector<GroupAlignment> alignments;
+
+    /** The templates that alignments were made to, in order of id, and for
+      * each one its substitution frequencies and (if it has codons) its
+      * mutation counts.
+      */
+    std::vector<std::shared_ptr<AlignmentTemplate>> templates;
+    std::vector<Matrix<float>> substitution_matrices;
+    std::vector<MutationCount> mutation_counts;
+
+    /** Occupancy of the queues of the streaming front end. */
+    std::vector<std::pair<std::string, QueueStats>> queue_stats;
+
+    /** With --profile, each stage of run() (see StageProfile). */
+    std::vector<StageProfile> profile;
+
+    /** With --track_allocations, the tallies when run() started, so that
+      * only this sample's allocations are reported (see allocation_tallies()).
+      */
+    std::vector<AllocationTally> allocations_at_start;
+
+    double      milliseconds = 0.0; ///< wall time from parsing to statistics
+    std::time_t completed    = 0;   ///< when the statistics were done
+};
+
+/** The dsa analysis as a reusable object.
+  *
+  * A Pipeline is built once from a set of Params: it checks them, loads and
+  * trims the template databases, builds the UMI extractors and starts a
+  * ThreadPool of its own. run() can then be called for any number of
+  * samples, concurrently if need be, without paying for any of that again.
+  * The fastq and output file names in the Params are only defaults for
+  * run() and write().
+  *
+  * run() and write() bind the Pipeline's pool to the calling thread (see
+  * ThreadPool::Use), so several Pipelines can live and run side by side
+  * without touching the process-wide pool. With --progress or
+  * --metrics_file it reports the process-wide Progress for as long as it
+  * lives.
+  */
+class Pipeline {
+public:
+    /** @throws PipelineError if the options are inconsistent or a template cannot be loaded */
+    explicit Pipeline(const help::Params &params);
+
+    const help::Params &params() const { return params_; }
+    const std::vector<std::shared_ptr<const TemplateDatabase>> &template_dbs() const { return template_dbs_; }
+    const std::vector<UMIExtractor> &fw_extractors() const { return fwexs_; }
+    const std::vector<UMIExtractor> &rv_extractors() const { return rvexs_; }
+    ThreadPool &pool() const { return *pool_; }
+
+    /** Analyze one sample. Safe to call from several threads at once, except
+      * with --thread_stats, whose counters belong to the whole pool, and
+      * --profile, whose stage profiles measure the whole process.
+      *
+      * @throws PipelineError if a fastq file cannot be read or the two hold
+      * different numbers of reads
+      */
+    SampleResult run(const std::string &fw_filename, const std::string &rv_filename) const;
+
+    /** Analyze the sample named by params().fw_filename and params().rv_filename. */
+    SampleResult run() const { return run(params_.fw_filename, params_.rv_filename); }
+
+    /** The #Settings# and #Parse# header for result. */
+    std::string settings(const SampleResult &result) const;
+
+    /** Write result as text (all sections, see --help) to os. With --profile
+      * the #Profile# section comes last and includes the time taken to write
+      * the sections before it.
+      */
+    void write_text(std::ostream &os, const SampleResult &result) const;
+
+    /** Write result in the format chosen by params() to output_filename:
+      * columnar, gzipped text for a .gz name, text otherwise, or text to
+      * standard output for an empty name. With --profile, the profile is then
+      * written as JSON to output_filename + ".profile.json", or to standard
+      * error for an empty name.
+      *
+      * @throws PipelineError if the file cannot be written
+      */
+    void write(const SampleResult &result, const std::string &output_filename) const;
+
+    /** Write result to params().output_filename (see above). */
+    void write(const SampleResult &result) const { write(result, params_.output_filename); }
+
+private:
+    help::Params params_;
+    std::unique_ptr<ThreadPool> pool_;
+    std::vector<std::shared_ptr<const TemplateDatabase>> template_dbs_;
+    std::vector<UMIExtractor> fwexs_, rvexs_;
+    std::unique_ptr<ProgressReporter> progress_;
+};
+
+/** One sample of a --batch manifest. */
+struct BatchSample {
+    std::string fw_filename;
+    std::string rv_filename;
+    std::string output_filename;
+};
+
+/** Parse a --batch manifest: one sample per line as three tab-separated
+  * columns (forward fastq, reverse fastq, output file). Blank lines and lines
+  * starting with # are skipped.
+  *
+  * @param name the manifest's name, for error messages
+  * @throws PipelineError for a line without exactly three non-empty columns
+  */
+std::vector<BatchSample>
+parse_manifest(std::istream &is, const std::string &name);
+
+/** Read and parse the manifest at path. @throws PipelineError */
+std::vector<BatchSample>
+read_manifest(const std::string &path);
+
+/** Totals over the samples of run_batch(). */
+struct BatchSummary {
+    size_t samples        = 0;
+    size_t failed         = 0;
+    size_t total_reads    = 0;   ///< read pairs of the samples that succeeded
+    double seconds        = 0.0; ///< wall time of the whole batch
+    double sample_seconds = 0.0; ///< sum of the wall times of the samples
+};
+
+/** Run and write every sample, up to jobs of them at a time.
+  *
+  * The samples share the pipeline's templates and its ThreadPool, so while one sample is in a serial step (mapping the files,
+  * collating, writing) another keeps the pool busy. A sample that fails is
+  * reported and the rest carry on. One line per sample and a summary with
+  * the aggregate throughput are written to report.
+  */
+BatchSummary
+run_batch(const Pipeline &pipeline, const std::vector<BatchSample> &samples, size_t jobs, std::ostream &report);
+
+}; //namespace bio
+
+#endif
\ No newline at end of file
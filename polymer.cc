@@ -21,6 +21,7 @@ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
 CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
+#include <algorithm>
 #include <cassert>
 #include <ostream>
 
@@ -28,13 +29,42 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 namespace bio {
 
+/** A buffer for n bytes from the calling thread's arena, or from the heap. */
+char *
+PolymerBase::allocate(size_t n, size_t &capacity, Arena::Block *&block) {
+    block = nullptr;
+    char *buf = Arena::allocate(n, capacity, block);
+    return buf ? buf : alloc().allocate(n, capacity);
+}
+
+void
+PolymerBase::deallocate(char *buf, size_t capacity, Arena::Block *block) {
+    if (block) {
+        Arena::release(block);
+    } else {
+        alloc().deallocate(buf, capacity);
+    }
+}
+
+/** Point buf_ at a buffer for n bytes, the local one if it is big enough. */
+void
+PolymerBase::init_buffer(size_t n) {
+    if (n + ccb::REGISTER_SIZE > LOCAL_SIZE) buf_ = allocate(n, capacity_, block_);
+}
+
+/** Free buf_ unless it is the local buffer. */
+void
+PolymerBase::free_buffer() {
+    if (!is_local()) deallocate(buf_, capacity_, block_);
+}
+
 PolymerBase::PolymerBase(size_t capacity) {
-    buf_ = alloc().allocate(capacity, capacity_);
+    init_buffer(capacity);
 }
 
 PolymerBase::PolymerBase(const PolymerBase &p) {
     assert (&p != this);
-    buf_ = alloc().allocate(p.size(), capacity_);
+    init_buffer(p.size());
     memcpy(buf_, p.buf_+p.lo_, p.size());
     lo_ = 0;
     hi_ = p.size();
@@ -42,12 +72,21 @@ PolymerBase::PolymerBase(const PolymerBase &p) {
 
 PolymerBase::PolymerBase(const char *begin, const char *end) {
     hi_ = end - begin;
-    buf_ = alloc().allocate(hi_, capacity_);
+    init_buffer(hi_);
     memcpy(buf_, begin, hi_);
 }
 
 PolymerBase::~PolymerBase() {
-    alloc().deallocate(buf_, capacity_);
+    free_buffer();
+}
+
+PolymerBase &
+PolymerBase::operator=(const PolymerBase &p) {
+    if (this != &p) {
+        PolymerBase tmp(p);
+        swap_buffers(tmp);
+    }
+    return *this;
 }
 
 void
@@ -65,27 +104,41 @@ PolymerBase::resize(size_t n, char c) {
 void
 PolymerBase::reserve(size_t n) {
     if (n <= capacity_) return;
+    if (block_ && Arena::extend(buf_, capacity_, n, block_)) return;
     size_t allocd = 0;
-    char *tmp = alloc().allocate(n, allocd);
+    Arena::Block *block = nullptr;
+    char *tmp = allocate(n, allocd, block);
     memcpy(tmp, buf_+lo_, size());
-    alloc().deallocate(buf_, 0);
+    free_buffer();
     capacity_ = allocd;
     buf_ = tmp;
+    block_ = block;
     hi_ -= lo_;
     lo_ = 0;
 }
 
+size_t
+PolymerBase::assign(const char *s, size_t n, size_t (*normalize)(char *, const char *, size_t)) {
+    const size_t dirty = hi_; //bytes past the new contents that may not be zero
+    lo_ = hi_ = 0;
+    reserve(n);
+    hi_ = normalize(buf_, s, n);
+    zero_tail(std::max(dirty, n));
+    return hi_;
+}
+
 void
 PolymerBase::shrink_to_fit() {
     if (empty()) {
-        alloc().deallocate(buf_, capacity_);
-        buf_ = nullptr;
-        lo_ = hi_ = capacity_ = 0;
+        free_buffer();
+        memset(local_, 0, LOCAL_SIZE);
+        buf_ = local_;
+        block_ = nullptr;
+        lo_ = hi_ = 0;
+        capacity_ = LOCAL_SIZE - 1;
     } else {
-        char *tmp = alloc().allocate(size(), capacity_);
-        std::memcpy(tmp, buf_, size());
-        alloc().deallocate(buf_, capacity_);
-        buf_ = tmp;
+        PolymerBase tmp(*this);
+        swap_buffers(tmp);
     }
 }
 
@@ -103,6 +156,16 @@ PolymerBase::pack() {
     swap_buffers(tmp);
 }
 
+void
+PolymerBase::detach() {
+    if (!block_) return;
+    PolymerBase tmp;
+    if (size() + ccb::REGISTER_SIZE > LOCAL_SIZE) tmp.buf_ = alloc().allocate(size(), tmp.capacity_);
+    memcpy(tmp.buf_, buf_+lo_, size());
+    tmp.hi_ = size();
+    swap_buffers(tmp);
+}
+
 std::string_view 
 PolymerBase::as_string_view() const { 
     return std::string_view(c_data(), size()); 
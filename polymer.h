@@ -24,9 +24,15 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #ifndef BIO_POLYMER_H_
 #define BIO_POLYMER_H_
 
+#include "arena.h"
 #include "simdalloc.h"
 
+#include <array>
+#include <bit>
 #include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <immintrin.h>
 #include <iostream>
 #include <istream>
 #include <iterator>
@@ -35,15 +41,78 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 namespace bio {
 
+/** pshufb indexes that left-pack 8 bytes: byte k of entry m is the position of the k-th set bit of m. */
+inline constexpr std::array<uint64_t, 256> LEFT_PACK_SHUFFLES = [] {
+    std::array<uint64_t, 256> shuffles{};
+    for (unsigned m = 0; m < 256; ++m) {
+        for (unsigned b = 0, k = 0; b < 8; ++b) if (m & (1u << b)) shuffles[m] |= uint64_t(b) << (8 * k++);
+    }
+    return shuffles;
+}();
+
+/** Store the bytes of v whose bits are set in mask to dst, in order.
+  *
+  * Writes anywhere in [dst, dst+32).
+  * @return the number of bytes stored
+  */
+inline size_t
+mm256_left_pack(char *dst, __m256i v, uint32_t mask) {
+    if (mask == 0xFFFFFFFFu) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), v);
+        return 32;
+    }
+    const __m128i lanes[2] = {_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)};
+    size_t n = 0;
+    for (int i = 0; i < 4; ++i, mask >>= 8) {
+        const __m128i bytes   = (i & 1) ? _mm_srli_si128(lanes[i >> 1], 8) : lanes[i >> 1];
+        const __m128i shuffle = _mm_cvtsi64_si128(static_cast<long long>(LEFT_PACK_SHUFFLES[mask & 0xFF]));
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(dst + n), _mm_shuffle_epi8(bytes, shuffle));
+        n += std::popcount(mask & 0xFF);
+    }
+    return n;
+}
+
+/** Copy the valid chars among the n at src to dst, normalized and in order.
+  *
+  * The driver of the Monomer::normalize() kernels: classify(v) normalizes the
+  * 32 chars in v in place and returns a mask of the valid ones, which are
+  * then left-packed; the last n % 32 chars go through normalize_char().
+  * Writes anywhere in [dst, dst+n).
+  *
+  * @return the number of chars written
+  */
+template<typename Classify>
+inline size_t
+mm256_normalize(char *dst, const char *src, size_t n, Classify classify, char (*normalize_char)(char)) {
+    size_t i = 0, count = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+        const uint32_t mask = classify(v);
+        count += mm256_left_pack(dst + count, v, mask);
+    }
+    for (; i < n; ++i) {
+        const char c = normalize_char(src[i]);
+        if (c) dst[count++] = c;
+    }
+    return count;
+}
+
 /**
   * Base class for all polymers (dna, codons, protein)
   *
-  * "Polymers" are dynamic arrays of types punnable with char.
+  * "Polymers" are dynamic arrays of types punnable with char. Short ones
+  * (primers, UMIs, split segments) live in a buffer inside the object; longer
+  * ones take theirs from the calling thread's Arena while an Arena::Scope is
+  * active and from ccb::simd_allocator otherwise. The guarantees are the same
+  * wherever the buffer is.
   */
-class PolymerBase {
+class alignas(ccb::REGISTER_SIZE) PolymerBase {
     using alloc = ccb::simd_allocator<char, ccb::Register::YMM>;
 
 public:
+    /** Bytes of the buffer inside the object; requests of up to LOCAL_SIZE - REGISTER_SIZE bytes are held there. */
+    static constexpr size_t LOCAL_SIZE = 2 * ccb::REGISTER_SIZE;
+
     PolymerBase() noexcept = default;
     /** Connstruct PolymerBase with 0 size and count capacity.
       *
@@ -51,7 +120,7 @@ public:
       */
     explicit PolymerBase(size_t count);
     PolymerBase(const PolymerBase &);
-    PolymerBase &operator=(const PolymerBase &)=default;
+    PolymerBase &operator=(const PolymerBase &);
 
     ~PolymerBase();
 
@@ -90,6 +159,12 @@ public:
     void exo(size_t left, size_t right);
     void pack();
 
+    /** Move the monomers out of an Arena block into a heap buffer of their
+      * own, so that they do not keep the block alive after their stage.
+      * Does nothing if the buffer is already on the heap.
+      */
+    void detach();
+
     std::string_view as_string_view() const;
 
     friend std::ostream &operator<<(std::ostream &, const PolymerBase &);
@@ -107,18 +182,41 @@ protected:
 
     void resize(size_t n, char c);
 
+    /** Exchange contents with p, which costs a copy of the local buffers if either is in use. */
     void swap_buffers(PolymerBase &p) noexcept {
+        const bool local = is_local(), p_local = p.is_local();
+        if (local || p_local) {
+            char tmp[LOCAL_SIZE];
+            std::memcpy(tmp, local_, LOCAL_SIZE);
+            std::memcpy(local_, p.local_, LOCAL_SIZE);
+            std::memcpy(p.local_, tmp, LOCAL_SIZE);
+        }
         std::swap(      lo_, p.lo_);
         std::swap(      hi_, p.hi_);
         std::swap(capacity_, p.capacity_);
         std::swap(     buf_, p.buf_);
+        std::swap(   block_, p.block_);
+        if (p_local) buf_ = local_;
+        if (local) p.buf_ = p.local_;
     }
 
+    bool is_local() const noexcept { return buf_ == local_; }
+
     inline void push_back(char c) {
-        if (hi_ == capacity_) reserve(capacity_+32);
+        if (hi_ == capacity_) reserve(2*capacity_);
         buf_[hi_++] = c;
     }
 
+    /** Replace the contents with the chars in [s, s+n) that normalize (a Monomer::normalize()) keeps.
+      * @return the number of chars kept
+      */
+    size_t assign(const char *s, size_t n, size_t (*normalize)(char *, const char *, size_t));
+
+    /** Zero the bytes a kernel wrote past the end, up to written bytes from data(), restoring the null terminator. */
+    void zero_tail(size_t written) {
+        if (written > size()) std::memset(buf_ + hi_, 0, written - size());
+    }
+
     inline char pop_back() {
         char c = buf_[--hi_];
         buf_[hi_] = 0;
@@ -129,10 +227,20 @@ protected:
 
     PolymerBase(const char *begin, const char *end);
 
-    size_t lo_ = 0, hi_ = 0, capacity_ = 0;
-    char  *buf_ = nullptr;
+    alignas(ccb::REGISTER_SIZE) char local_[LOCAL_SIZE] = {}; ///< first, so that SIMD loads past its end stay inside the object
+    size_t lo_ = 0, hi_ = 0, capacity_ = LOCAL_SIZE - 1;
+    char  *buf_ = local_;
+    Arena::Block *block_ = nullptr; ///< the block buf_ was carved from, or nullptr if it is local or on the heap
+
+private:
+    void init_buffer(size_t n);
+    void free_buffer();
+    static char *allocate(size_t n, size_t &capacity, Arena::Block *&block);
+    static void deallocate(char *buf, size_t capacity, Arena::Block *block);
 };
 
+template<typename Monomer> class PolymerView;
+
 /**
   * Polymer is a dynamic array of type Monomer
   *
@@ -144,7 +252,9 @@ protected:
   *         Every class Monomer must have a static method with signature
   *         <pre>static char Monomer::normalize_char(char c);</pre>
   *         that returns a normalized representation of c (e.g. capital ATGC for nucleotides) or 0 for
-  *         an invalid/non-convertable character.
+  *         an invalid/non-convertable character, and its vectorized counterpart
+  *         <pre>static size_t Monomer::normalize(char *dst, const char *src, size_t n);</pre>
+  *         that writes the normalized valid chars among the n at src to dst (see mm256_normalize()).
   */
 template<typename Monomer>
 class Polymer : public PolymerBase {
@@ -164,6 +274,11 @@ public:
 
     explicit Polymer(size_t capacity) : PolymerBase(capacity) {}
 
+    /** Replace the contents with the valid monomers among the n chars at s.
+      * @return the number of chars kept; the others were invalid
+      */
+    size_t assign(const char *s, size_t n) { return PolymerBase::assign(s, n, Monomer::normalize); }
+
     void resize(size_t n, const Monomer &m=Monomer());
 
     /** Append c if c can be converted to a valid Monomer @return true if c was valid, false otherwise */
@@ -182,7 +297,10 @@ public:
 
     Polymer &operator+=(const Polymer &);
 
-    Polymer subclone(size_t pos, size_t len=std::string::npos);
+    Polymer subclone(size_t pos, size_t len=std::string::npos) const;
+
+    /** A view of len monomers from pos that shares this Polymer's buffer (see PolymerView). */
+    PolymerView<Monomer> view(size_t pos=0, size_t len=std::string::npos) const;
 
     template<typename T, typename difference_type>
     struct Forward {
@@ -203,6 +321,7 @@ public:
     template<bool is_mut, bool forward=true>
     class iter {
         friend class Polymer;
+        friend class PolymerView<Monomer>;
     public:
         using iterator_category = std::contiguous_iterator_tag;
         using difference_type   = std::ptrdiff_t;
@@ -282,21 +401,12 @@ private:
 
 template<typename Monomer>
 Polymer<Monomer>::Polymer(const char *s) {
-    clear();
-    for (; *s; ++s) {
-        char c = Monomer::normalize_char(*s);
-        if (c) PolymerBase::push_back(c);
-    }
+    assign(s, std::strlen(s));
 }
 
 template<typename Monomer>
 Polymer<Monomer>::Polymer(const std::string &s) {
-    clear();
-    reserve(s.size());
-    for (char c : s) {
-        c = Monomer::normalize_char(c);
-        if(c) PolymerBase::push_back(c);
-    }
+    assign(s.data(), s.size());
 }
 
 template<typename Monomer>
@@ -333,7 +443,7 @@ Polymer<Monomer>::operator+=(const Polymer<Monomer> &p) {
 
 template<typename Monomer>
 Polymer<Monomer>
-Polymer<Monomer>::subclone(size_t pos, size_t len) {
+Polymer<Monomer>::subclone(size_t pos, size_t len) const {
     assert (pos <= size());
     Polymer p;
     len = std::min(len, size() - pos);
@@ -342,6 +452,86 @@ Polymer<Monomer>::subclone(size_t pos, size_t len) {
     return p;
 }
 
+template<typename Monomer>
+PolymerView<Monomer>
+Polymer<Monomer>::view(size_t pos, size_t len) const {
+    return PolymerView<Monomer>(*this).subview(pos, len);
+}
+
+/**
+  * A non-owning view of a run of monomers, such as a slice of a Polymer.
+  *
+  * PolymerView has the const interface of Polymer and uses its iterators, so
+  * functions that only read monomers (alignment, template queries,
+  * translation) take views and accept whole Polymers and slices of them
+  * alike, without copies. The monomers belong to the Polymer viewed, which
+  * must outlive the view and not change while it is in use; note that a
+  * Polymer short enough to be held inside the object must not move either.
+  *
+  * A view is not null terminated, but a slice of a Polymer's buffer is always
+  * followed by a register's worth of readable bytes, so the SIMD kernels that
+  * read whole registers work on views too.
+  */
+template<typename Monomer>
+class PolymerView {
+public:
+    using const_iterator         = typename Polymer<Monomer>::const_iterator;
+    using const_reverse_iterator = typename Polymer<Monomer>::const_reverse_iterator;
+    using iterator               = const_iterator;
+    using reverse_iterator       = const_reverse_iterator;
+
+    PolymerView() noexcept = default;
+    PolymerView(const Polymer<Monomer> &p) noexcept : lo_(p.data()), hi_(p.data() + p.size()) {}
+    PolymerView(const_iterator lo, const_iterator hi) noexcept
+        : lo_(reinterpret_cast<const char *>(lo.p)), hi_(reinterpret_cast<const char *>(hi.p)) {}
+
+    size_t size()  const noexcept { return hi_ - lo_; }
+    bool   empty() const noexcept { return hi_ == lo_; }
+
+    const char *  data() const { return lo_; } ///< Const access to the monomers; not null terminated.
+    const char *c_data() const { return lo_; } ///< Const access to the monomers; not null terminated.
+
+    const Monomer &operator[](size_t i) const { return reinterpret_cast<const Monomer &>(lo_[i]); }
+
+    const Monomer &front() const { return reinterpret_cast<const Monomer &>(*lo_); }
+    const Monomer &back () const { return reinterpret_cast<const Monomer &>(*(hi_ - 1)); }
+
+    bool operator==(const PolymerView &rhs) const noexcept { return as_string_view() == rhs.as_string_view(); }
+
+    /** The view of len monomers from pos, or of those up to the end if there are fewer. */
+    PolymerView subview(size_t pos, size_t len=std::string::npos) const {
+        assert (pos <= size());
+        len = std::min(len, size() - pos);
+        return PolymerView(lo_ + pos, lo_ + pos + len);
+    }
+
+    /** Trim monomers from the left and right of the view, as PolymerBase::exo() does for Polymers. */
+    void exo(size_t left, size_t right) {
+        assert (left + right <= size());
+        lo_ += left;
+        hi_ -= right;
+    }
+
+    std::string_view as_string_view() const { return std::string_view(lo_, size()); }
+
+    const_iterator  begin() const { return const_iterator(lo_); }
+    const_iterator  end  () const { return const_iterator(hi_); }
+    const_iterator cbegin() const { return const_iterator(lo_); }
+    const_iterator cend  () const { return const_iterator(hi_); }
+
+    const_reverse_iterator  rbegin() const { return const_reverse_iterator(hi_); }
+    const_reverse_iterator  rend  () const { return const_reverse_iterator(lo_); }
+    const_reverse_iterator crbegin() const { return const_reverse_iterator(hi_); }
+    const_reverse_iterator crend  () const { return const_reverse_iterator(lo_); }
+
+    friend std::ostream &operator<<(std::ostream &os, const PolymerView &v) { return os << v.as_string_view(); }
+
+private:
+    PolymerView(const char *lo, const char *hi) noexcept : lo_(lo), hi_(hi) {}
+
+    const char *lo_ = nullptr, *hi_ = nullptr;
+};
+
 /** Implement getline for polymer types that handles \n, \r, and \r\n newlines.
   * Thanks to Stackoverflow queston #6089231!
   */
@@ -376,15 +566,10 @@ getline(const char *begin, const char *end, std::string &s);
 template<typename Monomer>
 const char *
 getline(const char *begin, const char *end, Polymer<Monomer> &p, size_t &stripped) {
-    p.clear();
-    stripped=0;
-
-    for (; begin != end; ++begin) {
-        const char c = *begin;
-        if (c == '\n') return begin + 1;
-        stripped += !p.push_back(static_cast<char>(c));
-    }
-    return end;
+    const char *eol = static_cast<const char *>(std::memchr(begin, '\n', end - begin));
+    const char *last = eol ? eol : end;
+    stripped = (last - begin) - p.assign(begin, last - begin);
+    return eol ? eol + 1 : end;
 }
 
 const char *
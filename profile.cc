@@ -0,0 +1,293 @@
+/*
+Copyright 2024, The Broad Institute of MIT and Harvard
+
+Original Author: Charles C Bailey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "profile.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <new>
+#include <sstream>
+
+#include "defines.h"
+#include "simdalloc.h"
+
+#ifdef DSA_TARGET_WIN64
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#undef min //undefine infuriating min and max macros from windows.h
+#undef max //undefine infuriating min and max macros from windows.h
+#elif defined(DSA_TARGET_LINUX)
+#include <sys/resource.h>
+#endif
+
+namespace bio {
+
+static std::atomic<bool> perf_events_on = false;
+
+StageTimer::StageTimer(std::string stage, size_t items_in)
+:   stage_(std::move(stage)),
+    items_in_(items_in),
+    start_(std::chrono::steady_clock::now()),
+    cpu_start_(process_cpu_seconds()),
+    allocated_start_(allocated_bytes())
+{
+    if (perf_events_on) counters_.emplace();
+}
+
+StageTimer::~StageTimer() = default;
+
+StageProfile
+StageTimer::stop(size_t items_out) const {
+    StageProfile profile;
+    profile.stage           = stage_;
+    profile.wall_seconds    = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+    profile.cpu_seconds     = process_cpu_seconds() - cpu_start_;
+    profile.items_in        = items_in_;
+    profile.items_out       = items_out;
+    profile.bytes_allocated = allocated_bytes() - allocated_start_;
+    profile.peak_rss        = peak_rss_bytes();
+    if (counters_) profile.counters = counters_->read();
+    return profile;
+}
+
+double
+process_cpu_seconds() {
+#ifdef DSA_TARGET_WIN64
+    FILETIME creation, exit, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) return 0.0;
+    auto seconds = [](const FILETIME &ft) {
+        return ((static_cast<uint64_t>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime) * 1e-7; //100ns ticks
+    };
+    return seconds(kernel) + seconds(user);
+#elif defined(DSA_TARGET_LINUX)
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0.0;
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+#else
+    return 0.0;
+#endif
+}
+
+size_t
+peak_rss_bytes() {
+#ifdef DSA_TARGET_WIN64
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+    return counters.PeakWorkingSetSize;
+#elif defined(DSA_TARGET_LINUX)
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+    return static_cast<size_t>(usage.ru_maxrss) * 1024; //kilobytes on Linux
+#else
+    return 0;
+#endif
+}
+
+void
+count_allocations(bool on) {
+    detail::dsa_count_allocations = on;
+}
+
+size_t
+allocated_bytes() {
+    return detail::dsa_allocated_bytes();
+}
+
+void
+count_perf_events(bool on) {
+    perf_events_on = on;
+}
+
+void
+track_allocations(bool on) {
+    detail::dsa_track_allocations = on;
+}
+
+static const char *const ALLOCATORS[detail::DSA_ALLOCATORS] = {"simd_allocator", "operator new"};
+
+std::vector<AllocationTally>
+restart_allocation_tallies() {
+    for (detail::DsaTagTally &t : detail::dsa_tag_tallies) {
+        for (int a = 0; a < detail::DSA_ALLOCATORS; ++a) t.peak[a].store(t.live[a].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+    return allocation_tallies();
+}
+
+std::vector<AllocationTally>
+allocation_tallies(const std::vector<AllocationTally> &start) {
+    std::vector<AllocationTally> tallies;
+    for (const detail::DsaTagTally &t : detail::dsa_tag_tallies) {
+        const char *tag = t.tag.load();
+        for (int a = 0; a < detail::DSA_ALLOCATORS; ++a) {
+            AllocationTally tally{tag ? tag : "", ALLOCATORS[a],
+                                  t.calls[a].load(std::memory_order_relaxed), t.bytes[a].load(std::memory_order_relaxed),
+                                  t.live[a].load(std::memory_order_relaxed), t.peak[a].load(std::memory_order_relaxed)};
+            auto before = std::find_if(start.begin(), start.end(), [&](const AllocationTally &s) {
+                return s.stage == tally.stage && s.allocator == tally.allocator;
+            });
+            if (before != start.end()) {
+                tally.calls -= before->calls;
+                tally.bytes -= before->bytes;
+                tally.live  -= before->live;
+                tally.peak  -= before->live;
+            }
+            if (tally.calls || tally.live) tallies.push_back(std::move(tally));
+        }
+    }
+    return tallies;
+}
+
+void
+write_profile_section(std::ostream &os, const std::vector<StageProfile> &stages) {
+    const bool counted = std::any_of(stages.begin(), stages.end(), [](const StageProfile &s){ return s.counters.threads > 0; });
+
+    const std::ios_base::fmtflags flags = os.flags();
+    os << "#Profile#" << std::endl;
+    os << "Stage\tWall Seconds\tCPU Seconds\tItems In\tItems Out\tItems Per Second\tBytes Allocated\tProcess Peak RSS";
+    if (counted) os << "\tThreads Counted\tTask Seconds\tCycles\tInstructions\tIPC\tCache Misses\tBranch Misses";
+    os << std::endl;
+    for (const StageProfile &s : stages) {
+        os << std::fixed << std::setprecision(3)
+           << s.stage << '\t' << s.wall_seconds << '\t' << s.cpu_seconds << '\t'
+           << s.items_in << '\t' << s.items_out << '\t'
+           << std::setprecision(0) << s.items_per_second() << '\t'
+           << s.bytes_allocated << '\t' << s.peak_rss;
+        if (counted) {
+            const PerfCounters &c = s.counters;
+            os << '\t' << c.threads << '\t' << std::setprecision(3) << c.task_seconds;
+            //hardware events that could not be counted are NA rather than 0
+            if (c.hardware) os << '\t' << c.cycles << '\t' << c.instructions << '\t' << std::setprecision(2) << c.instructions_per_cycle()
+                               << '\t' << c.cache_misses << '\t' << c.branch_misses;
+            else            os << "\tNA\tNA\tNA\tNA\tNA";
+        }
+        os << std::endl;
+    }
+    os.flags(flags);
+}
+
+void
+write_allocation_section(std::ostream &os, const std::vector<AllocationTally> &tallies) {
+    os << "#Allocations#" << std::endl;
+    os << "Stage\tAllocator\tCalls\tBytes Allocated\tBytes Live\tPeak Bytes Live" << std::endl;
+    for (const AllocationTally &t : tallies) {
+        os << (t.stage.empty() ? "other" : t.stage) << '\t' << t.allocator << '\t'
+           << t.calls << '\t' << t.bytes << '\t' << t.live << '\t' << t.peak << std::endl;
+    }
+}
+
+/** s as a quoted JSON string. */
+static std::string
+json_string(const std::string &s) {
+    std::string q = "\"";
+    for (char c : s) {
+        switch (c) {
+            case '"':  q += "\\\""; break;
+            case '\\': q += "\\\\"; break;
+            case '\n': q += "\\n";  break;
+            case '\t': q += "\\t";  break;
+            case '\r': q += "\\r";  break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char buf[8];
+                    std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    q += buf;
+                } else {
+                    q += c;
+                }
+        }
+    }
+    return q + '"';
+}
+
+void
+write_profile_json(std::ostream &os, const std::string &fw_filename, const std::string &rv_filename,
+                   size_t read_pairs, const std::vector<StageProfile> &stages,
+                   const std::vector<AllocationTally> &allocations) {
+    double wall = 0.0, cpu = 0.0;
+    for (const StageProfile &s : stages) {
+        wall += s.wall_seconds;
+        cpu  += s.cpu_seconds;
+    }
+
+    const std::ios_base::fmtflags flags = os.flags();
+    os << std::fixed << std::setprecision(6);
+    os << "{\n"
+       << "  \"program_version\": " << json_string(VERSION_STRING) << ",\n"
+       << "  \"forward_reads\": " << json_string(fw_filename) << ",\n"
+       << "  \"reverse_reads\": " << json_string(rv_filename) << ",\n"
+       << "  \"read_pairs\": " << read_pairs << ",\n"
+       << "  \"wall_seconds\": " << wall << ",\n"
+       << "  \"cpu_seconds\": " << cpu << ",\n"
+       << "  \"process_peak_rss_bytes\": " << peak_rss_bytes() << ",\n"
+       << "  \"stages\": [";
+    for (size_t i = 0; i < stages.size(); ++i) {
+        const StageProfile &s = stages[i];
+        os << (i ? ",\n" : "\n")
+           << "    {\"stage\": " << json_string(s.stage)
+           << ", \"wall_seconds\": " << s.wall_seconds
+           << ", \"cpu_seconds\": " << s.cpu_seconds
+           << ", \"items_in\": " << s.items_in
+           << ", \"items_out\": " << s.items_out
+           << ", \"items_per_second\": " << s.items_per_second()
+           << ", \"bytes_allocated\": " << s.bytes_allocated
+           << ", \"process_peak_rss_bytes\": " << s.peak_rss;
+        if (s.counters.threads) {
+            const PerfCounters &c = s.counters;
+            os << ", \"perf\": {\"threads\": " << c.threads << ", \"task_seconds\": " << c.task_seconds;
+            if (c.hardware) {
+                os << ", \"cycles\": " << c.cycles << ", \"instructions\": " << c.instructions
+                   << ", \"instructions_per_cycle\": " << c.instructions_per_cycle()
+                   << ", \"cache_misses\": " << c.cache_misses << ", \"branch_misses\": " << c.branch_misses;
+            } else {
+                os << ", \"cycles\": null, \"instructions\": null, \"instructions_per_cycle\": null"
+                   << ", \"cache_misses\": null, \"branch_misses\": null";
+            }
+            os << "}";
+        }
+        os << "}";
+    }
+    os << "\n  ]";
+    if (!allocations.empty()) {
+        os << ",\n  \"allocations\": [";
+        for (size_t i = 0; i < allocations.size(); ++i) {
+            const AllocationTally &t = allocations[i];
+            os << (i ? ",\n" : "\n")
+               << "    {\"stage\": " << json_string(t.stage.empty() ? "other" : t.stage)
+               << ", \"allocator\": " << json_string(t.allocator)
+               << ", \"calls\": " << t.calls
+               << ", \"bytes_allocated\": " << t.bytes
+               << ", \"bytes_live\": " << t.live
+               << ", \"peak_bytes_live\": " << t.peak << "}";
+        }
+        os << "\n  ]";
+    }
+    os << "\n}" << std::endl;
+    os.flags(flags);
+}
+
+}; //namespace bio
\ No newline at end of file
@@ -0,0 +1,161 @@
+/*
+Copyright 2024, The Broad Institute of MIT and Harvard
+
+Original Author: Charles C Bailey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef BIO_PROFILE_H_
+#define BIO_PROFILE_H_
+
+#include <chrono>
+#include <cstddef>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "perfcount.h"
+
+namespace bio {
+
+/** Time and resources spent in one stage of the analysis (see --profile).
+  *
+  * CPU time, allocations and peak RSS are process-wide: they include every
+  * thread, and would include any other work that overlapped the stage,
+  * which is why the branches of -x are profiled as one stage and --profile
+  * is refused with dsa serve and --batch_jobs > 1. Peak RSS is the most
+  * the process has held since it started, not what the stage added.
+  */
+struct StageProfile {
+    std::string stage;
+    double wall_seconds    = 0.0;
+    double cpu_seconds     = 0.0; ///< user + system time of all threads
+    size_t items_in        = 0;   ///< reads, ORFs or alignments the stage was given
+    size_t items_out       = 0;   ///< and what it handed on
+    size_t bytes_allocated = 0;   ///< by operator new and simd_allocator
+    size_t peak_rss        = 0;   ///< peak resident set size of the process since it started, in bytes, when the stage ended
+    PerfCounters counters;        ///< with --perf_counters; counters.threads is 0 otherwise
+
+    double items_per_second() const { return wall_seconds > 0.0 ? items_in / wall_seconds : 0.0; }
+};
+
+/** Measures one stage from construction until stop(). */
+class StageTimer {
+public:
+    StageTimer(std::string stage, size_t items_in);
+    StageTimer(StageTimer &&) = default;
+    StageTimer &operator=(StageTimer &&) = default;
+    ~StageTimer();
+
+    /** The stage's profile up to now. */
+    StageProfile stop(size_t items_out) const;
+
+private:
+    std::string stage_;
+    size_t items_in_;
+    std::chrono::steady_clock::time_point start_;
+    double cpu_start_;
+    size_t allocated_start_;
+    std::optional<PerfCounterSet> counters_;
+};
+
+/** User + system CPU time of the process so far. */
+double
+process_cpu_seconds();
+
+/** Peak resident set size of the process in bytes, or 0 if unknown. */
+size_t
+peak_rss_bytes();
+
+/** Start or stop counting the bytes allocated by operator new and
+  * simd_allocator. Counting costs a relaxed atomic add per allocation, so it
+  * is off unless --profile is given. operator new is only counted in the dsa
+  * executable, which replaces it; programs linking libdsa count simd_allocator.
+  */
+void
+count_allocations(bool on);
+
+/** Bytes allocated while counting was on. */
+size_t
+allocated_bytes();
+
+/** Allocations of one allocator in one stage while they were tracked (see
+  * track_allocations()). A free counts against the stage that allocated the
+  * block, whichever thread makes it, so live is what the stage allocated
+  * that is still in use and peak is its highest value.
+  * Sizes are those of the blocks malloc() handed out.
+  */
+struct AllocationTally {
+    std::string stage;     ///< the trace::Label of the allocating thread, "" for none
+    std::string allocator; ///< "simd_allocator" (Polymer buffers) or "operator new"
+    size_t    calls = 0;
+    size_t    bytes = 0;
+    long long live  = 0;
+    long long peak  = 0;
+};
+
+/** Start or stop tallying allocations by stage and allocator. Tallying costs
+  * a few atomic adds on counters shared by the threads of a stage, and a
+  * locked table insert per allocation and lookup per free to remember which
+  * stage each block belongs to, so it is off unless --track_allocations is given.
+  */
+void
+track_allocations(bool on);
+
+/** The tallies of every stage so far, for the whole process, after
+  * restarting each peak from the bytes now live, so that they can be handed
+  * to allocation_tallies() at the end of a run to get the tallies of that run.
+  */
+std::vector<AllocationTally>
+restart_allocation_tallies();
+
+/** The tallies of every stage since start, what restart_allocation_tallies()
+  * returned (for the whole process if empty): calls and bytes made since,
+  * the change in bytes live, and the peak above what was live at start.
+  */
+std::vector<AllocationTally>
+allocation_tallies(const std::vector<AllocationTally> &start = {});
+
+/** Start or stop counting hardware events in each StageTimer (see
+  * PerfCounterSet). Opening the counters costs a few system calls per
+  * thread and stage, so this is off unless --perf_counters is given.
+  */
+void
+count_perf_events(bool on);
+
+/** Write stages as a #Profile# section: a header line and one tab-delimited
+  * line per stage, with columns for the hardware counters if they were on.
+  */
+void
+write_profile_section(std::ostream &os, const std::vector<StageProfile> &stages);
+
+/** Write tallies as an #Allocations# section, one tab-delimited line each. */
+void
+write_allocation_section(std::ostream &os, const std::vector<AllocationTally> &tallies);
+
+/** Write stages, and any allocation tallies, as a JSON object along with the sample they belong to. */
+void
+write_profile_json(std::ostream &os, const std::string &fw_filename, const std::string &rv_filename,
+                   size_t read_pairs, const std::vector<StageProfile> &stages,
+                   const std::vector<AllocationTally> &allocations = {});
+
+}; //namespace bio
+
+#endif
\ No newline at end of file
@@ -0,0 +1,145 @@
+/*
+Copyright 2024, The Broad Institute of MIT and Harvard
+
+Original Author: Charles C Bailey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "progress.h"
+
+#include <algorithm>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace bio {
+
+Progress &
+Progress::instance() {
+    static Progress progress;
+    return progress;
+}
+
+const char *
+Progress::metric_name(Counter counter) {
+    switch (counter) {
+        case ReadsParsed:      return "dsa_reads_parsed_total";
+        case ReadsPassedQc:    return "dsa_reads_passed_qc_total";
+        case ReadsAssembled:   return "dsa_reads_assembled_total";
+        case GroupsCollapsed:  return "dsa_umi_groups_collapsed_total";
+        case OrfsAligned:      return "dsa_orfs_aligned_total";
+        case SamplesCompleted: return "dsa_samples_completed_total";
+        default:               return "";
+    }
+}
+
+ProgressReporter::ProgressReporter(std::ostream *log, std::string metrics_filename, std::chrono::seconds interval)
+:   log_(log),
+    metrics_filename_(std::move(metrics_filename)),
+    interval_(std::max(interval, std::chrono::seconds(1))),
+    start_(std::chrono::steady_clock::now()),
+    last_time_(start_)
+{
+    thread_ = std::thread([this]{
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!cv_.wait_for(lock, interval_, [this]{ return stop_; })) report();
+        report();
+    });
+}
+
+ProgressReporter::~ProgressReporter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+}
+
+std::string
+ProgressReporter::metrics(double elapsed_seconds, double stage_rate) {
+    const Progress &progress = Progress::instance();
+    std::ostringstream os;
+    os << std::fixed << std::setprecision(3);
+    for (int c = 0; c < Progress::COUNTERS; ++c) {
+        const char *name = Progress::metric_name(static_cast<Progress::Counter>(c));
+        os << "# TYPE " << name << " counter\n"
+           << name << ' ' << progress.get(static_cast<Progress::Counter>(c)) << '\n';
+    }
+    os << "# HELP dsa_stage_info The stage dsa is in.\n"
+       << "# TYPE dsa_stage_info gauge\n"
+       << "dsa_stage_info{stage=\"" << progress.stage() << "\"} 1\n"
+       << "# HELP dsa_stage_items_per_second Throughput of the current stage since the last update.\n"
+       << "# TYPE dsa_stage_items_per_second gauge\n"
+       << "dsa_stage_items_per_second " << stage_rate << '\n'
+       << "# TYPE dsa_elapsed_seconds gauge\n"
+       << "dsa_elapsed_seconds " << elapsed_seconds << '\n'
+       << "# HELP dsa_last_update_timestamp_seconds When these metrics were written; a stale value means dsa is gone.\n"
+       << "# TYPE dsa_last_update_timestamp_seconds gauge\n"
+       << "dsa_last_update_timestamp_seconds " << std::time(nullptr) << '\n';
+    return os.str();
+}
+
+void
+ProgressReporter::report() {
+    const Progress &progress = Progress::instance();
+    const auto now = std::chrono::steady_clock::now();
+    const double elapsed = std::chrono::duration<double>(now - start_).count();
+
+    //the rate of the stage's own counter over the last interval
+    const Progress::Counter counter = progress.stage_counter();
+    const double seconds = std::chrono::duration<double>(now - last_time_).count();
+    double rate = 0.0;
+    if (counter != Progress::COUNTERS && seconds > 0.0) rate = (progress.get(counter) - last_counts_[counter]) / seconds;
+    for (int c = 0; c < Progress::COUNTERS; ++c) last_counts_[c] = progress.get(static_cast<Progress::Counter>(c));
+    last_time_ = now;
+
+    if (log_) {
+        const std::ios_base::fmtflags flags = log_->flags();
+        *log_ << std::fixed << std::setprecision(1)
+              << "#progress\t" << elapsed << "s\t" << progress.stage()
+              << '\t' << progress.get(Progress::ReadsParsed)      << " reads parsed"
+              << '\t' << progress.get(Progress::ReadsPassedQc)    << " passed qc"
+              << '\t' << progress.get(Progress::ReadsAssembled)   << " assembled"
+              << '\t' << progress.get(Progress::GroupsCollapsed)  << " umi groups collapsed"
+              << '\t' << progress.get(Progress::OrfsAligned)      << " orfs aligned"
+              << '\t' << progress.get(Progress::SamplesCompleted) << " samples done"
+              << '\t' << std::setprecision(0) << rate << " items/s" << std::endl;
+        log_->flags(flags);
+    }
+
+    if (!metrics_filename_.empty()) {
+        const std::string tmp = metrics_filename_ + ".tmp";
+        {
+            std::ofstream ofs(tmp);
+            ofs << metrics(elapsed, rate);
+        }
+        std::error_code ec;
+        std::filesystem::rename(tmp, metrics_filename_, ec); //replaces an existing file, also on Windows
+        if (ec && !metrics_failed_) {
+            metrics_failed_ = true; //say so once rather than every interval
+            std::cerr << "could not write metrics file '" << metrics_filename_ << "': " << ec.message() << std::endl;
+        }
+    }
+}
+
+}; //namespace bio
\ No newline at end of file
@@ -0,0 +1,116 @@
+/*
+Copyright 2024, The Broad Institute of MIT and Harvard
+
+Original Author: Charles C Bailey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef BIO_PROGRESS_H_
+#define BIO_PROGRESS_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+
+namespace bio {
+
+/** Counters of the work done so far by the process, so that a long run can
+  * be watched (see --progress and --metrics_file).
+  *
+  * Workers add to them with relaxed atomics once per batch, chunk or
+  * alignment, which costs next to nothing; nothing else reads them but a
+  * ProgressReporter.
+  */
+class Progress {
+public:
+    enum Counter {
+        ReadsParsed,
+        ReadsPassedQc,
+        ReadsAssembled,
+        GroupsCollapsed,
+        OrfsAligned,
+        SamplesCompleted,
+        COUNTERS, ///< the number of counters, also "none"
+    };
+
+    /** The process-wide counters. */
+    static Progress &instance();
+
+    void add(Counter counter, uint64_t n) { counters_[counter].fetch_add(n, std::memory_order_relaxed); }
+    uint64_t get(Counter counter) const { return counters_[counter].load(std::memory_order_relaxed); }
+
+    /** Enter a stage, named by a string literal, whose throughput is the rate of counter. */
+    void stage(const char *name, Counter counter=COUNTERS) {
+        stage_counter_.store(counter, std::memory_order_relaxed);
+        stage_.store(name, std::memory_order_relaxed);
+    }
+    const char *stage() const { return stage_.load(std::memory_order_relaxed); }
+    Counter stage_counter() const { return stage_counter_.load(std::memory_order_relaxed); }
+
+    /** Name of counter as a Prometheus metric. */
+    static const char *metric_name(Counter counter);
+
+private:
+    std::atomic<uint64_t>    counters_[COUNTERS] = {};
+    std::atomic<const char *> stage_ = "starting";
+    std::atomic<Counter>     stage_counter_ = COUNTERS;
+};
+
+/** Writes the Progress counters every interval on a thread of its own,
+  * until it is destroyed, when they are written one last time.
+  *
+  * Progress lines go to log, if there is one. The metrics file, if named, is
+  * rewritten each time in the Prometheus text format, through a temporary
+  * file and a rename so that a collector (e.g. node_exporter's textfile
+  * collector) never reads half of it.
+  */
+class ProgressReporter {
+public:
+    ProgressReporter(std::ostream *log, std::string metrics_filename, std::chrono::seconds interval);
+    ~ProgressReporter();
+    ProgressReporter(const ProgressReporter &) = delete;
+    ProgressReporter &operator=(const ProgressReporter &) = delete;
+
+    /** The counters in the Prometheus text format. */
+    static std::string metrics(double elapsed_seconds, double stage_rate);
+
+private:
+    void report();
+
+    std::ostream *log_;
+    std::string metrics_filename_;
+    std::chrono::seconds interval_;
+    std::chrono::steady_clock::time_point start_, last_time_;
+    uint64_t last_counts_[Progress::COUNTERS] = {};
+    bool metrics_failed_ = false;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stop_ = false;
+    std::thread thread_;
+};
+
+}; //namespace bio
+
+#endif
\ No newline at end of file
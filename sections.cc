@@ -0,0 +1,105 @@
+/*
+Copyright 2024, The Broad Institute of MIT and Harvard
+
+Original Author: Charles C Bailey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "sections.h"
+
+#include <algorithm>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "cdn.h"
+
+namespace bio {
+
+void
+write_codons(std::ostream &os, std::string_view cdns, help::CodonOutput format) {
+    std::vector<std::optional<Cdn>> ocdns;
+    switch (format) {
+    case help::CodonOutput::Ascii:
+        os << "\t\t\t" << cdns << std::endl;
+        break;
+    case help::CodonOutput::Horizontal:
+        for (char c : cdns) ocdns.push_back(Cdn::from_char(c));
+        os << "\t\t\t";
+        for (const auto &oc : ocdns) {
+            if (oc) os << oc->p1() << oc->p2() << oc->p3();
+        }
+        os << std::endl;
+        break;
+    case help::CodonOutput::Vertical:
+        for (char c : cdns) ocdns.push_back(Cdn::from_char(c));
+        for (size_t i=0; i<3; ++i) {
+            os << "\t\t\t";
+            for (size_t j=0; j<ocdns.size(); ++j) {
+                os << (ocdns[j] ? static_cast<char>(ocdns[j]->at(i)) : ' ');
+            }
+            os << std::endl;
+        }
+        break;
+    case help::CodonOutput::None:
+        break;
+    };
+}
+
+void
+UniqueSequences::add(std::string_view alignment, std::string_view cdns, size_t umi_group_size) {
+    std::string aa_seq(alignment), cdn_seq(cdns);
+    std::erase(aa_seq, '-'); //remove gaps from alignment string before calculating uniqueness
+    std::erase(cdn_seq, ' '); //remove gaps from codons
+
+    Counts &aa_counts = aas_[std::move(aa_seq)];
+    aa_counts.groups += 1;
+    aa_counts.reads  += static_cast<unsigned int>(umi_group_size);
+
+    Counts &cdn_counts = cdns_[std::move(cdn_seq)];
+    cdn_counts.groups += 1;
+    cdn_counts.reads  += static_cast<unsigned int>(umi_group_size);
+}
+
+void
+UniqueSequences::write(std::ostream &os) const {
+    write(os, "#Unique Amino Acids ()#", aas_);
+    write(os, "#Unique Codons ()#", cdns_);
+}
+
+void
+UniqueSequences::write(std::ostream &os, const char *section, const std::unordered_map<std::string, Counts> &uniq) {
+    os << section << std::endl;
+    os << "Num UMI Groups\tNum PCR Reads\tSequence" << std::endl;
+    std::vector<std::pair<const std::string *, Counts>> flat;
+    flat.reserve(uniq.size());
+    for (const auto &[seq, counts] : uniq) flat.emplace_back(&seq, counts);
+    std::sort(flat.begin(),
+        flat.end(),
+        [](const auto &a, const auto &b)->bool { return a.second.groups > b.second.groups; }
+    );
+
+    for (const auto &[seq, c] : flat) {
+        os << c.groups << '\t'
+            << c.reads << '\t'
+            << *seq << std::endl;
+    }
+}
+
+}; //namespace bio
@@ -0,0 +1,72 @@
+/*
+Copyright 2024, The Broad Institute of MIT and Harvard
+
+Original Author: Charles C Bailey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef BIO_SECTIONS_H_
+#define BIO_SECTIONS_H_
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "params.h"
+
+namespace bio {
+
+/** Write the codons of an alignment as chosen by -c (see #Alignments# in
+  * --help): a line of codon characters (ascii), of nucleotides (horizontal)
+  * or three lines of nucleotides under the residues (vertical), each after
+  * three tabs. Writes nothing for help::CodonOutput::None.
+  *
+  * @param cdns the gapped ASCII codons of the alignment (' ' for a deletion)
+  */
+void
+write_codons(std::ostream &os, std::string_view cdns, help::CodonOutput format);
+
+/** The distinct sequences of the #Unique Amino Acids# and #Unique Codons#
+  * sections, each with the number of UMI groups and of reads that had it.
+  * Used by dsa and by dsa-util dump so that the two write the same sections.
+  */
+class UniqueSequences {
+public:
+    /** Count one alignment from its gapped alignment string and codons. */
+    void add(std::string_view alignment, std::string_view cdns, size_t umi_group_size);
+
+    /** Write both sections, the sequences of the most UMI groups first. */
+    void write(std::ostream &os) const;
+
+private:
+    struct Counts {
+        unsigned groups = 0;
+        unsigned reads  = 0;
+    };
+
+    static void write(std::ostream &os, const char *section, const std::unordered_map<std::string, Counts> &uniq);
+
+    std::unordered_map<std::string, Counts> aas_, cdns_;
+};
+
+}; //namespace bio
+
+#endif
@@ -0,0 +1,221 @@
+/*
+Copyright 2024, The Broad Institute of MIT and Harvard
+
+Original Author: Charles C Bailey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef BIO_SEGMENTED_H_
+#define BIO_SEGMENTED_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+#include <vector>
+
+#include "defines.h"
+
+namespace bio {
+
+/** A sequence stored as a list of std::vector segments.
+  *
+  * Parallel stages produce one output vector per task. Rather than moving
+  * every element again into one big vector (and briefly holding two copies
+  * of the data) a stage can hand its task outputs to the next stage as the
+  * segments of a SegmentedVector. Segments are owned by the container and
+  * never reallocated by it except through push_back on the last segment.
+  * Iteration and indexing are flat; iterators are random access, with
+  * jumps resolved by binary search over the segment offsets.
+  */
+template<typename T>
+class SegmentedVector {
+public:
+    using value_type      = T;
+    using size_type       = size_t;
+    using difference_type = std::ptrdiff_t;
+    using reference       = T &;
+    using const_reference = const T &;
+
+    template<bool Const>
+    class Iterator {
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using iterator_concept  = std::random_access_iterator_tag;
+        using value_type        = T;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = std::conditional_t<Const, const T *, T *>;
+        using reference         = std::conditional_t<Const, const T &, T &>;
+        using container_type    = std::conditional_t<Const, const SegmentedVector, SegmentedVector>;
+
+        Iterator() = default;
+        Iterator(container_type *sv, size_t seg, size_t off) : sv_(sv), seg_(seg), off_(off) {}
+        template<bool C=Const, typename=std::enable_if_t<C>>
+        Iterator(const Iterator<false> &it) : sv_(it.sv_), seg_(it.seg_), off_(it.off_) {}
+
+        reference operator*() const { return sv_->segments_[seg_][off_]; }
+        pointer operator->() const { return &sv_->segments_[seg_][off_]; }
+        reference operator[](difference_type n) const { return *(*this + n); }
+
+        Iterator &operator++() {
+            if (++off_ == sv_->segments_[seg_].size()) { ++seg_; off_ = 0; }
+            return *this;
+        }
+        Iterator operator++(int) { Iterator it = *this; ++*this; return it; }
+
+        Iterator &operator--() {
+            if (off_ == 0) { --seg_; off_ = sv_->segments_[seg_].size(); }
+            --off_;
+            return *this;
+        }
+        Iterator operator--(int) { Iterator it = *this; --*this; return it; }
+
+        Iterator &operator+=(difference_type n) {
+            const size_t i = index() + n;
+            seg_ = sv_->segment_of(i);
+            off_ = i - sv_->offsets_[seg_];
+            return *this;
+        }
+        Iterator &operator-=(difference_type n) { return *this += -n; }
+
+        friend Iterator operator+(Iterator it, difference_type n) { return it += n; }
+        friend Iterator operator+(difference_type n, Iterator it) { return it += n; }
+        friend Iterator operator-(Iterator it, difference_type n) { return it -= n; }
+        friend difference_type operator-(const Iterator &a, const Iterator &b) {
+            return static_cast<difference_type>(a.index()) - static_cast<difference_type>(b.index());
+        }
+
+        friend bool operator==(const Iterator &a, const Iterator &b) { return a.seg_ == b.seg_ && a.off_ == b.off_; }
+        friend auto operator<=>(const Iterator &a, const Iterator &b) { return a.index() <=> b.index(); }
+
+    private:
+        friend class SegmentedVector;
+        friend class Iterator<!Const>;
+
+        size_t index() const { return sv_->offsets_[seg_] + off_; }
+
+        container_type *sv_ = nullptr;
+        size_t seg_ = 0; //index of a nonempty segment, or segments_.size() at the end
+        size_t off_ = 0;
+    };
+
+    using iterator       = Iterator<false>;
+    using const_iterator = Iterator<true>;
+
+    SegmentedVector() = default;
+    SegmentedVector(const SegmentedVector &) = default;
+    SegmentedVector &operator=(const SegmentedVector &) = default;
+
+    /** Moves leave other empty and usable (the defaulted ones would leave it without offsets). */
+    SegmentedVector(SegmentedVector &&other) { swap(other); }
+    SegmentedVector &operator=(SegmentedVector &&other) {
+        if (this != &other) {
+            SegmentedVector tmp(std::move(other));
+            swap(tmp);
+        }
+        return *this;
+    }
+
+    void swap(SegmentedVector &other) noexcept {
+        segments_.swap(other.segments_);
+        offsets_.swap(other.offsets_);
+    }
+
+    /** Take ownership of segments (empty ones are dropped). */
+    explicit SegmentedVector(vecvec<T> &&segments) {
+        for (std::vector<T> &seg : segments) append_segment(std::move(seg));
+        segments.clear();
+    }
+
+    /** A SegmentedVector with the single segment v. */
+    explicit SegmentedVector(std::vector<T> &&v) { append_segment(std::move(v)); }
+
+    /** Append segment to the end of the sequence, without copying its elements. */
+    void append_segment(std::vector<T> &&segment) {
+        if (segment.empty()) return;
+        offsets_.back() += segment.size();
+        offsets_.insert(offsets_.end() - 1, offsets_.back() - segment.size());
+        segments_.push_back(std::move(segment));
+    }
+
+    /** Append all of other's segments. */
+    void append(SegmentedVector &&other) {
+        for (std::vector<T> &seg : other.segments_) append_segment(std::move(seg));
+        other.clear();
+    }
+
+    void push_back(const T &value) { last_segment().push_back(value); offsets_.back() += 1; }
+    void push_back(T &&value) { last_segment().push_back(std::move(value)); offsets_.back() += 1; }
+
+    size_t size() const { return offsets_.back(); }
+    bool empty() const { return size() == 0; }
+
+    T &operator[](size_t i) { const size_t s = segment_of(i); return segments_[s][i - offsets_[s]]; }
+    const T &operator[](size_t i) const { const size_t s = segment_of(i); return segments_[s][i - offsets_[s]]; }
+
+    T &front() { return segments_.front().front(); }
+    const T &front() const { return segments_.front().front(); }
+    T &back() { return segments_.back().back(); }
+    const T &back() const { return segments_.back().back(); }
+
+    iterator begin() { return iterator(this, 0, 0); }
+    iterator end() { return iterator(this, segments_.size(), 0); }
+    const_iterator begin() const { return const_iterator(this, 0, 0); }
+    const_iterator end() const { return const_iterator(this, segments_.size(), 0); }
+    const_iterator cbegin() const { return begin(); }
+    const_iterator cend() const { return end(); }
+
+    size_t segment_count() const { return segments_.size(); }
+    std::vector<T> &segment(size_t i) { return segments_[i]; }
+    const std::vector<T> &segment(size_t i) const { return segments_[i]; }
+
+    /** Release all segments and their memory. */
+    void clear() {
+        segments_.clear();
+        segments_.shrink_to_fit();
+        offsets_.assign(1, 0);
+    }
+
+    void shrink_to_fit() {
+        for (std::vector<T> &seg : segments_) seg.shrink_to_fit();
+        segments_.shrink_to_fit();
+    }
+
+private:
+    /** Index of the segment holding element i (segments_.size() for i == size()). */
+    size_t segment_of(size_t i) const {
+        if (i >= size()) return segments_.size();
+        return std::upper_bound(offsets_.begin(), offsets_.end() - 1, i) - offsets_.begin() - 1;
+    }
+
+    std::vector<T> &last_segment() {
+        if (segments_.empty()) {
+            segments_.emplace_back();
+            offsets_.insert(offsets_.begin(), 0);
+        }
+        return segments_.back();
+    }
+
+    vecvec<T> segments_;
+    std::vector<size_t> offsets_ = {0}; //offsets_[i] is the index of the first element of segment i; back() is size()
+};
+
+}; //namespace bio
+
+#endif
\ No newline at end of file
@@ -0,0 +1,388 @@
+/*
+Copyright 2024, The Broad Institute of MIT and Harvard
+
+Original Author: Charles C Bailey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "server.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <filesystem>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <streambuf>
+#include <thread>
+#include <vector>
+
+#ifdef DSA_TARGET_LINUX
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace bio {
+
+#ifdef DSA_TARGET_LINUX
+
+/** Set by SIGINT and SIGTERM while serve() is running. */
+static volatile std::sig_atomic_t stop_signal = 0;
+
+/** Connections that may wait for a job slot, each in a thread of its own;
+  * as many again wait in the listen backlog to be accepted.
+  */
+static constexpr size_t MAX_WAITING = 64;
+
+static void
+on_stop_signal(int) {
+    stop_signal = 1;
+}
+
+static sockaddr_un
+socket_address(const std::string &path) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+        throw ServerError("socket path '" + path + "' must be 1 to " + std::to_string(sizeof(addr.sun_path) - 1) + " characters long");
+    }
+    std::copy(path.begin(), path.end(), addr.sun_path);
+    return addr;
+}
+
+/** A socket connected to the server at path, or -1 if nothing is listening there. */
+static int
+connect_to(const std::string &path) {
+    const sockaddr_un addr = socket_address(path);
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (::connect(fd, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool
+send_all(int fd, const char *data, size_t size) {
+    while (size) {
+        const ssize_t n = ::send(fd, data, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+/** Read up to the first newline (not included) into line. Requests are a
+  * single short line so reading a byte at a time costs nothing.
+  */
+static bool
+read_line(int fd, std::string &line) {
+    line.clear();
+    for (char c; ; ) {
+        const ssize_t n = ::recv(fd, &c, 1, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return !line.empty();
+        if (c == '\n') return true;
+        if (line.size() > 64 * 1024) return false;
+        line.push_back(c);
+    }
+}
+
+/** An output buffer that sends to a socket, so that results can be written
+  * with Pipeline::write_text() as they are formatted. The stream goes bad
+  * if the client hangs up.
+  */
+class SocketStreambuf : public std::streambuf {
+public:
+    explicit SocketStreambuf(int fd) : fd_(fd), buffer_(64 * 1024) {
+        setp(buffer_.data(), buffer_.data() + buffer_.size());
+    }
+
+    ~SocketStreambuf() override { sync(); }
+
+protected:
+    int_type
+    overflow(int_type ch) override {
+        if (sync() != 0) return traits_type::eof();
+        if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    int
+    sync() override {
+        const size_t size = pptr() - pbase();
+        setp(buffer_.data(), buffer_.data() + buffer_.size());
+        return size == 0 || send_all(fd_, buffer_.data(), size) ? 0 : -1;
+    }
+
+private:
+    int fd_;
+    std::vector<char> buffer_;
+};
+
+ServeSummary
+serve(const Pipeline &pipeline, const std::string &socket_path, size_t jobs, std::ostream &log) {
+    const sockaddr_un addr = socket_address(socket_path);
+
+    //a socket left behind by a server that died is reused, a live one is not
+    if (const int fd = connect_to(socket_path); fd >= 0) {
+        ::close(fd);
+        throw ServerError("a server is already listening on '" + socket_path + "'");
+    }
+    struct stat st;
+    if (::lstat(socket_path.c_str(), &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) throw ServerError("'" + socket_path + "' exists and is not a socket");
+        ::unlink(socket_path.c_str());
+    }
+
+    //jobs read and write files as this user, so only this user may submit them;
+    //the socket is made under a umask that leaves nobody else a moment to connect
+    const int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) throw ServerError("could not create a socket");
+    const mode_t previous_umask = ::umask(S_IRWXG | S_IRWXO);
+    const bool bound = ::bind(listener, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) == 0;
+    ::umask(previous_umask);
+    if (!bound) {
+        ::close(listener);
+        throw ServerError("could not create the socket '" + socket_path + "'");
+    }
+    if (::chmod(socket_path.c_str(), S_IRUSR | S_IWUSR) != 0 || ::listen(listener, MAX_WAITING) != 0) {
+        ::close(listener);
+        ::unlink(socket_path.c_str());
+        throw ServerError("could not listen on '" + socket_path + "'");
+    }
+
+    jobs = std::max<size_t>(jobs, 1);
+    const size_t max_connections = jobs + MAX_WAITING;
+    ServeSummary summary;
+    std::mutex mutex;
+    std::condition_variable cv;
+    size_t running = 0, connections = 0, next_id = 0;
+    std::atomic<bool> stop = false;
+
+    log << "#serve listening\t" << socket_path << '\t' << jobs << " jobs at a time" << std::endl;
+
+    //one thread per connection; it waits for a job slot and answers the request
+    auto handle = [&](int fd, size_t id) {
+        timeval timeout{10, 0}; //a client has 10s to send its request
+        ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        std::string request, status;
+        if (!read_line(fd, request)) {
+            status = "#serve failed\tno request received";
+        } else if (request == "shutdown") {
+            stop = true;
+            status = "#serve ok\tshutting down";
+        } else {
+            BatchSample job;
+            std::string error;
+            size_t reads = 0;
+            double seconds = 0.0;
+            try {
+                std::istringstream is(request);
+                const std::vector<BatchSample> samples = parse_manifest(is, "request");
+                if (samples.size() != 1) throw PipelineError("request: expected one job");
+                job = samples.front();
+            } catch (const std::exception &ex) {
+                error = ex.what();
+            }
+
+            if (error.empty()) {
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    cv.wait(lock, [&]{ return running < jobs; });
+                    ++running;
+                }
+                const auto start = std::chrono::steady_clock::now();
+                try {
+                    const SampleResult result = pipeline.run(job.fw_filename, job.rv_filename);
+                    if (job.output_filename == "-") {
+                        if (pipeline.params().output_format == help::OutputFormat::Columnar) {
+                            throw PipelineError("columnar output cannot be streamed; give the job an output file");
+                        }
+                        SocketStreambuf buf(fd);
+                        std::ostream os(&buf);
+                        pipeline.write_text(os, result);
+                        os.flush();
+                    } else {
+                        pipeline.write(result, job.output_filename);
+                    }
+                    reads = result.total_reads;
+                } catch (const std::exception &ex) {
+                    error = ex.what();
+                }
+                seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    --running;
+                }
+                cv.notify_all();
+            }
+
+            std::ostringstream line;
+            line << std::fixed << std::setprecision(3);
+            if (error.empty()) line << "#serve ok\t" << reads << " read pairs\t" << seconds << 's';
+            else               line << "#serve failed\t" << error;
+            status = line.str();
+
+            std::lock_guard<std::mutex> lock(mutex);
+            summary.jobs += 1;
+            if (error.empty()) summary.total_reads += reads;
+            else               summary.failed      += 1;
+            const std::ios_base::fmtflags flags = log.flags();
+            log << std::fixed << std::setprecision(3)
+                << (error.empty() ? "#serve job\t" : "#serve failed\t") << id
+                << '\t' << job.fw_filename << '\t' << job.rv_filename << '\t' << job.output_filename
+                << '\t' << reads << " read pairs\t" << seconds << 's';
+            if (!error.empty()) log << '\t' << error;
+            log << std::endl;
+            log.flags(flags);
+        }
+
+        status.push_back('\n');
+        send_all(fd, status.data(), status.size());
+        ::close(fd);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        --connections;
+        cv.notify_all();
+    };
+
+    stop_signal = 0;
+    void (*previous_int)(int)  = std::signal(SIGINT,  on_stop_signal);
+    void (*previous_term)(int) = std::signal(SIGTERM, on_stop_signal);
+
+    while (!stop && !stop_signal) {
+        {
+            //past the bound, clients wait in the listen backlog rather than in threads of their own
+            std::unique_lock<std::mutex> lock(mutex);
+            if (!cv.wait_for(lock, std::chrono::milliseconds(200), [&]{ return connections < max_connections; })) continue;
+        }
+        pollfd pfd{listener, POLLIN, 0};
+        if (::poll(&pfd, 1, 200) <= 0) continue; //wake up now and then to check for a stop
+        const int fd = ::accept(listener, nullptr, nullptr);
+        if (fd < 0) continue;
+        std::lock_guard<std::mutex> lock(mutex);
+        ++connections;
+        std::thread(handle, fd, ++next_id).detach();
+    }
+
+    ::close(listener);
+    ::unlink(socket_path.c_str());
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&]{ return connections == 0; });
+    }
+    std::signal(SIGINT,  previous_int);
+    std::signal(SIGTERM, previous_term);
+
+    log << "#serve total\t" << summary.jobs << " jobs (" << summary.failed << " failed)\t"
+        << summary.total_reads << " read pairs" << std::endl;
+    return summary;
+}
+
+/** Send request and return the answer's status line; everything before it
+  * goes to results as it arrives.
+  */
+static std::string
+send_request(const std::string &socket_path, const std::string &request, std::ostream &results) {
+    const int fd = connect_to(socket_path);
+    if (fd < 0) throw ServerError("no dsa server is listening on '" + socket_path + "'");
+    if (!send_all(fd, request.data(), request.size())) {
+        ::close(fd);
+        throw ServerError("could not send the request to '" + socket_path + "'");
+    }
+
+    //the status is the last line, so the last complete line is held back
+    std::string pending;
+    std::vector<char> buffer(64 * 1024);
+    for (;;) {
+        const ssize_t n = ::recv(fd, buffer.data(), buffer.size(), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        pending.append(buffer.data(), n);
+        const size_t last = pending.size() > 1 ? pending.rfind('\n', pending.size() - 2) : std::string::npos;
+        if (last != std::string::npos) {
+            results.write(pending.data(), last + 1);
+            pending.erase(0, last + 1);
+        }
+    }
+    ::close(fd);
+
+    if (!pending.empty() && pending.back() == '\n') pending.pop_back();
+    if (pending.rfind("#serve ", 0) != 0) {
+        results << pending;
+        return "#serve failed\tthe server closed the connection";
+    }
+    return pending;
+}
+
+bool
+submit(const std::string &socket_path, const BatchSample &job, std::ostream &results, std::ostream &status) {
+    auto absolute = [](const std::string &filename) { return fs::absolute(filename).string(); };
+    const std::string output = job.output_filename.empty() ? std::string("-") : absolute(job.output_filename);
+    const std::string request = absolute(job.fw_filename) + '\t' + absolute(job.rv_filename) + '\t' + output + '\n';
+
+    const std::string line = send_request(socket_path, request, results);
+    results.flush();
+    status << line << std::endl;
+    return line.rfind("#serve ok", 0) == 0;
+}
+
+void
+request_shutdown(const std::string &socket_path) {
+    std::ostringstream ignored;
+    send_request(socket_path, "shutdown\n", ignored);
+}
+
+#else //#ifdef DSA_TARGET_LINUX
+
+ServeSummary
+serve(const Pipeline &, const std::string &, size_t, std::ostream &) {
+    throw ServerError("dsa serve needs Unix sockets and is only available on Linux");
+}
+
+bool
+submit(const std::string &, const BatchSample &, std::ostream &, std::ostream &) {
+    throw ServerError("dsa submit needs Unix sockets and is only available on Linux");
+}
+
+void
+request_shutdown(const std::string &) {
+    throw ServerError("dsa submit needs Unix sockets and is only available on Linux");
+}
+
+#endif //#ifdef DSA_TARGET_LINUX
+
+}; //namespace bio
\ No newline at end of file
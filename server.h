@@ -0,0 +1,92 @@
+/*
+Copyright 2024, The Broad Institute of MIT and Harvard
+
+Original Author: Charles C Bailey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef BIO_SERVER_H_
+#define BIO_SERVER_H_
+
+#include <cstddef>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+
+#include "pipeline.h"
+
+namespace bio {
+
+/** Thrown when the socket of dsa serve cannot be created, or dsa submit
+  * cannot reach a server. what() is a message fit for the user.
+  */
+class ServerError : public std::runtime_error {
+    using runtime_error::runtime_error;
+};
+
+/** Totals over the jobs of serve(). */
+struct ServeSummary {
+    size_t jobs        = 0;
+    size_t failed      = 0;
+    size_t total_reads = 0; ///< read pairs of the jobs that succeeded
+};
+
+/** Run the jobs sent to a Unix socket at socket_path until a shutdown
+  * request, SIGINT or SIGTERM arrives.
+  *
+  * Each connection carries one request line and gets one answer. A request
+  * is either "shutdown" or a job in the format of a --batch manifest line
+  * (forward fastq, reverse fastq and output file, tab-separated). The job's
+  * results are written to the output file, or streamed back as text if the
+  * output is "-". The answer ends with a status line, either
+  * "#serve ok\t<n> read pairs\t<s>s" or "#serve failed\t<message>".
+  *
+  * Up to jobs jobs run at a time on the pipeline's templates and its
+  * ThreadPool; the rest wait for a slot, at most 64 of them at once, and
+  * further clients wait to be accepted. Only the user running the server
+  * can connect to the socket. A line per job goes to log. Running
+  * jobs are finished before serve() returns, and the socket is removed.
+  *
+  * @throws ServerError if the socket cannot be created, e.g. because
+  * another server is listening on it
+  */
+ServeSummary
+serve(const Pipeline &pipeline, const std::string &socket_path, size_t jobs, std::ostream &log);
+
+/** Send a job to the server at socket_path and wait for it to finish.
+  *
+  * Relative file names are made absolute first, since the server may run
+  * elsewhere. An empty output_filename has the results streamed back to
+  * results. The server's status line is written to status.
+  *
+  * @returns true if the server reports that the job succeeded
+  * @throws ServerError if no server answers at socket_path
+  */
+bool
+submit(const std::string &socket_path, const BatchSample &job, std::ostream &results, std::ostream &status);
+
+/** Ask the server at socket_path to finish its running jobs and exit.
+  * @throws ServerError if no server answers at socket_path
+  */
+void
+request_shutdown(const std::string &socket_path);
+
+}; //namespace bio
+
+#endif
\ No newline at end of file
@@ -25,11 +25,18 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define CCB_SIMDALLOC_H_
 
 #include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
 #include <cstring>
 #include <string>
 #include <cstddef>
 #include <iostream>
+#include <mutex>
+#include <new>
 #include <type_traits>
+#include <unordered_map>
+#include <utility>
 
 #ifdef DSA_TARGET_WIN64
 #include <malloc.h>
@@ -45,9 +52,16 @@ dsa_aligned_free(void* p) {
     return _aligned_free(p);
 }
 
+/** Size of the block at p, from malloc() if alignment is 0 and dsa_aligned_alloc() otherwise. */
+inline size_t
+dsa_usable_size(void *p, size_t alignment) {
+    return alignment ? _aligned_msize(p, alignment, 0) : _msize(p);
+}
+
 }; // namespace detail
 #elif defined(DSA_TARGET_LINUX)
 #include <cstdlib>
+#include <malloc.h>
 namespace detail {
 inline void* dsa_aligned_alloc(size_t alignment, size_t n) {
     return std::aligned_alloc(alignment, n);
@@ -55,9 +69,196 @@ inline void* dsa_aligned_alloc(size_t alignment, size_t n) {
 inline void dsa_aligned_free(void* p) {
     return std::free(p);
 }
+inline size_t dsa_usable_size(void *p, size_t) {
+    return malloc_usable_size(p);
+}
 }; //namespace detail
 #endif
 
+namespace detail {
+
+/** Allocations are counted (see dsa --profile) only while this is set. */
+inline std::atomic<bool> dsa_count_allocations = false;
+
+/** Bytes allocated while counting, spread over cache line sized shards so
+  * that threads allocating at the same time do not share one counter.
+  */
+struct alignas(64) DsaAllocationShard {
+    std::atomic<size_t> bytes = 0;
+};
+inline constexpr size_t DSA_ALLOCATION_SHARDS = 16;
+inline DsaAllocationShard dsa_allocation_shards[DSA_ALLOCATION_SHARDS];
+inline std::atomic<size_t> dsa_next_allocation_shard = 0;
+
+/** Count n bytes allocated by the calling thread. */
+inline void
+dsa_note_allocation(size_t n) {
+    if (!dsa_count_allocations.load(std::memory_order_relaxed)) return;
+    thread_local const size_t shard = dsa_next_allocation_shard++ % DSA_ALLOCATION_SHARDS;
+    dsa_allocation_shards[shard].bytes.fetch_add(n, std::memory_order_relaxed);
+}
+
+/** Bytes counted so far by all threads. */
+inline size_t
+dsa_allocated_bytes() {
+    size_t total = 0;
+    for (const DsaAllocationShard &shard : dsa_allocation_shards) total += shard.bytes.load(std::memory_order_relaxed);
+    return total;
+}
+
+/** Allocations are also tallied by tag (see dsa --track_allocations) only
+  * while this is set. A tag is the allocator and the stage of the calling
+  * thread, so that e.g. Polymer buffers made during assembly are told apart
+  * from the strings and hash map nodes of the same stage.
+  */
+inline std::atomic<bool> dsa_track_allocations = false;
+
+/** The stage the calling thread is working on, a string literal or "" (set by bio::trace::Label). */
+inline thread_local const char *dsa_allocation_tag = "";
+
+enum DsaAllocator { DSA_SIMD_ALLOCATOR, DSA_OPERATOR_NEW, DSA_ALLOCATORS };
+
+/** The tallies of one stage. A free counts against the stage that allocated
+  * the block, whichever thread makes it, so live is what the stage allocated
+  * that is still in use and peak the most it ever reached.
+  */
+struct alignas(64) DsaTagTally {
+    std::atomic<const char *>  tag = nullptr;
+    std::atomic<size_t>        calls[DSA_ALLOCATORS] = {};
+    std::atomic<size_t>        bytes[DSA_ALLOCATORS] = {};
+    std::atomic<long long>     live[DSA_ALLOCATORS]  = {};
+    std::atomic<long long>     peak[DSA_ALLOCATORS]  = {};
+};
+inline constexpr size_t DSA_TAG_TALLIES = 32;
+inline DsaTagTally dsa_tag_tallies[DSA_TAG_TALLIES]; //the first is for "" and for tags that do not fit
+
+/** The tally of the calling thread's tag, claiming a free one for a new tag. */
+inline DsaTagTally &
+dsa_tag_tally() {
+    thread_local const char *cached_tag = nullptr;
+    thread_local DsaTagTally *cached = nullptr;
+    const char *tag = dsa_allocation_tag;
+    if (tag == cached_tag) return *cached;
+
+    DsaTagTally *tally = &dsa_tag_tallies[0];
+    if (*tag) for (size_t i = 1; i < DSA_TAG_TALLIES; ++i) {
+        const char *claimed = dsa_tag_tallies[i].tag.load();
+        if (!claimed && dsa_tag_tallies[i].tag.compare_exchange_strong(claimed, tag)) claimed = tag;
+        if (claimed == tag || std::strcmp(claimed, tag) == 0) {
+            tally = &dsa_tag_tallies[i];
+            break;
+        }
+    }
+    cached_tag = tag;
+    cached = tally;
+    return *tally;
+}
+
+/** Tally the block p from allocator; alignment as for dsa_usable_size().
+  * Returns the tally charged, to be kept with the block and handed to
+  * dsa_tally_free(), or nullptr while allocations are not tracked.
+  */
+inline DsaTagTally *
+dsa_tally_allocation(DsaAllocator allocator, void *p, size_t alignment) {
+    if (!dsa_track_allocations.load(std::memory_order_relaxed)) return nullptr;
+    const size_t n = dsa_usable_size(p, alignment);
+    DsaTagTally &tally = dsa_tag_tally();
+    tally.calls[allocator].fetch_add(1, std::memory_order_relaxed);
+    tally.bytes[allocator].fetch_add(n, std::memory_order_relaxed);
+    const long long live = tally.live[allocator].fetch_add(n, std::memory_order_relaxed) + n;
+    long long peak = tally.peak[allocator].load(std::memory_order_relaxed);
+    while (live > peak && !tally.peak[allocator].compare_exchange_weak(peak, live, std::memory_order_relaxed)) {}
+    return &tally;
+}
+
+/** Tally the freeing of the block p from allocator against tally, what
+  * dsa_tally_allocation() returned for it; call before freeing it. Blocks
+  * allocated while tracking was off have no tally and are not counted.
+  */
+inline void
+dsa_tally_free(DsaTagTally *tally, DsaAllocator allocator, void *p, size_t alignment) {
+    if (!tally) return;
+    tally->live[allocator].fetch_sub(dsa_usable_size(p, alignment), std::memory_order_relaxed);
+}
+
+/** An allocator that takes its memory from malloc(), for the tables of the
+  * tracking itself, which cannot go through operator new.
+  */
+template<typename T>
+struct DsaMallocAllocator {
+    using value_type = T;
+
+    DsaMallocAllocator() = default;
+    template<typename U> DsaMallocAllocator(const DsaMallocAllocator<U> &) {}
+
+    T *allocate(size_t n) {
+        if (void *p = std::malloc(n * sizeof(T))) return static_cast<T *>(p);
+        throw std::bad_alloc();
+    }
+    void deallocate(T *p, size_t) { std::free(p); }
+
+    template<typename U> bool operator==(const DsaMallocAllocator<U> &) const { return true; }
+};
+
+/** Blocks allocated while tracking, by address, with the tally each was
+  * charged to, so that a free is charged to the stage that allocated the
+  * block whichever thread makes it. Kept out of the blocks themselves so
+  * that nothing is spent on them while tracking is off.
+  */
+struct alignas(64) DsaTrackedBlocks {
+    std::mutex mutex;
+    std::unordered_map<const void *, DsaTagTally *, std::hash<const void *>, std::equal_to<const void *>,
+                       DsaMallocAllocator<std::pair<const void *const, DsaTagTally *>>> tallies;
+};
+
+/** Blocks in the tables; frees look nothing up while there are none. */
+inline std::atomic<size_t> dsa_tracked_block_count = 0;
+
+/** The table for the block p. The tables are made on first use and never
+  * destroyed, since blocks are freed until the very end of the process.
+  */
+inline DsaTrackedBlocks &
+dsa_tracked_blocks(const void *p) {
+    static DsaTrackedBlocks *const shards = [] {
+        void *storage = dsa_aligned_alloc(alignof(DsaTrackedBlocks), DSA_ALLOCATION_SHARDS * sizeof(DsaTrackedBlocks));
+        if (!storage) throw std::bad_alloc();
+        DsaTrackedBlocks *tables = static_cast<DsaTrackedBlocks *>(storage);
+        for (size_t i = 0; i < DSA_ALLOCATION_SHARDS; ++i) new (tables + i) DsaTrackedBlocks;
+        return tables;
+    }();
+    return shards[(reinterpret_cast<uintptr_t>(p) >> 4) % DSA_ALLOCATION_SHARDS];
+}
+
+/** Tally the block p from allocator and remember the tally for dsa_track_free(). */
+inline void
+dsa_track_allocation(DsaAllocator allocator, void *p, size_t alignment) {
+    DsaTagTally *tally = dsa_tally_allocation(allocator, p, alignment);
+    if (!tally) return;
+    DsaTrackedBlocks &blocks = dsa_tracked_blocks(p);
+    std::lock_guard<std::mutex> lock(blocks.mutex);
+    blocks.tallies[p] = tally;
+    dsa_tracked_block_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+/** Tally the freeing of the block p from allocator, if its allocation was tallied; call before freeing it. */
+inline void
+dsa_track_free(DsaAllocator allocator, void *p, size_t alignment) {
+    if (!p || dsa_tracked_block_count.load(std::memory_order_relaxed) == 0) return;
+    DsaTagTally *tally = nullptr;
+    {
+        DsaTrackedBlocks &blocks = dsa_tracked_blocks(p);
+        std::lock_guard<std::mutex> lock(blocks.mutex);
+        auto block = blocks.tallies.find(p);
+        if (block == blocks.tallies.end()) return;
+        tally = block->second;
+        blocks.tallies.erase(block);
+    }
+    dsa_tracked_block_count.fetch_sub(1, std::memory_order_relaxed);
+    dsa_tally_free(tally, allocator, p, alignment);
+}
+
+}; //namespace detail
+
 namespace ccb {
 
 enum class Register : std::size_t {
@@ -121,6 +322,8 @@ simd_allocator<T, Reg>::allocate(std::size_t n, size_t &actual) {
     actual = (sizeof(T) * n + ALN - 1)/ALN * ALN + ALN;
     void* ptr = detail::dsa_aligned_alloc(ALN, actual);
     if (!ptr) throw std::bad_alloc();
+    detail::dsa_note_allocation(actual);
+    detail::dsa_track_allocation(detail::DSA_SIMD_ALLOCATOR, ptr, ALN);
     memset(ptr, 0, actual);
     --actual;
     return reinterpret_cast<value_type *>(ptr);
@@ -130,6 +333,7 @@ template <typename T, Register Reg>
 constexpr void
 simd_allocator<T, Reg>::deallocate(value_type *ptr, std::size_t n) {
     (void)n;
+    detail::dsa_track_free(detail::DSA_SIMD_ALLOCATOR, ptr, static_cast<size_t>(Reg));
     detail::dsa_aligned_free(ptr);
 }
 
@@ -0,0 +1,63 @@
+/*
+Copyright 2024, The Broad Institute of MIT and Harvard
+
+Original Author: Charles C Bailey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "taskgraph.h"
+
+#include <cassert>
+
+namespace bio {
+
+TaskGraph::Node
+TaskGraph::add_node(std::function<void()> &&task, std::initializer_list<Node> after) {
+    const Node n = vertices_.size();
+    Vertex &v = vertices_.emplace_back();
+    v.task = std::move(task);
+    for (Node p : after) {
+        assert(p < n);
+        vertices_[p].successors.push_back(n);
+        ++v.predecessors;
+    }
+    return n;
+}
+
+void
+TaskGraph::launch(Node n) {
+    group_.run([this, n]{
+        Vertex &v = vertices_[n];
+        v.task();
+        for (Node s : v.successors) {
+            if (--vertices_[s].remaining == 0) launch(s);
+        }
+    });
+}
+
+void
+TaskGraph::run() {
+    for (Vertex &v : vertices_) v.remaining = v.predecessors;
+    for (Node n=0; n<vertices_.size(); ++n) {
+        if (vertices_[n].predecessors == 0) launch(n);
+    }
+    group_.wait();
+}
+
+}; //namespace bio
\ No newline at end of file
@@ -0,0 +1,88 @@
+/*
+Copyright 2024, The Broad Institute of MIT and Harvard
+
+Original Author: Charles C Bailey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef BIO_TASKGRAPH_H_
+#define BIO_TASKGRAPH_H_
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <vector>
+
+#include "threadpool.h"
+
+namespace bio {
+
+/** A directed acyclic graph of tasks run on a ThreadPool.
+  *
+  * Each task is added together with the tasks it must run after, so the graph
+  * is acyclic by construction. run() starts every task without predecessors
+  * and starts each other task as soon as the last of its predecessors has
+  * finished. Tasks are ordinary pool tasks, so independent branches overlap
+  * with each other and with any parallel algorithms they call without
+  * starting more threads than the pool has.
+  *
+  * If a task throws, the tasks that depend on it are not run and run()
+  * rethrows the first exception once the remaining tasks have finished.
+  */
+class TaskGraph {
+public:
+    using Node = size_t;
+
+    explicit TaskGraph(ThreadPool &pool=ThreadPool::current()) : group_(pool) {}
+    TaskGraph(const TaskGraph &) = delete;
+    TaskGraph &operator=(const TaskGraph &) = delete;
+
+    /** Add a task that runs after each of the (previously added) nodes in after. */
+    template<typename Function>
+    Node
+    add(Function &&f, std::initializer_list<Node> after={}) {
+        return add_node(std::function<void()>(std::forward<Function>(f)), after);
+    }
+
+    /** Number of tasks in the graph. */
+    size_t size() const { return vertices_.size(); }
+
+    /** Run every task and block until they have all finished. */
+    void run();
+
+private:
+    struct Vertex {
+        std::function<void()> task;
+        std::vector<Node> successors;
+        size_t predecessors = 0;
+        std::atomic<size_t> remaining = 0;
+    };
+
+    Node add_node(std::function<void()> &&task, std::initializer_list<Node> after);
+    void launch(Node n);
+
+    std::deque<Vertex> vertices_; //deque: Vertex holds an atomic so cannot be moved
+    TaskGroup group_;
+};
+
+}; //namespace bio
+
+#endif
\ No newline at end of file
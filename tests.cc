@@ -23,6 +23,9 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include "tests.h"
 
+#include <algorithm>
+#include <random>
+
 namespace bio {
 namespace test {
 
@@ -33,6 +36,27 @@ run_all() {
     aas_from_string();
     aas_from_nts();
     rc_nts();
+    columnar_alignment();
+    compact_alignment();
+    gzip_member();
+    thread_pool();
+    parallel_algorithms();
+    segmented_vector();
+    task_graph();
+    mpmc_queue();
+    numa_topology();
+    pipeline_config();
+    batch_manifest();
+    serve_jobs();
+    stage_profile();
+    trace_events();
+    perf_counters();
+    progress_metrics();
+    allocation_tallies();
+    polymer_arena();
+    polymer_small_buffer();
+    polymer_normalize();
+    polymer_view();
 }
 
 void
@@ -137,6 +161,176 @@ void rc_nts() {
     }
 }
 
+void
+columnar_alignment() {
+    const std::string alignment = "asML-VHqKA----" + std::string(100, 'W') + "ccccc";
+    const std::string cdns      = "0123 45678    " + std::string(100, '?') + "ABCDE";
+
+    std::string ops, residues, codons;
+    encode_alignment(alignment, ops, residues);
+    for (char c : cdns) if (c != ' ') codons.push_back(c);
+
+    if (decode_alignment(ops, residues) != alignment) throw test_failed_error("decode_alignment(encode_alignment()) failed");
+    if (decode_codons(ops, codons) != cdns) throw test_failed_error("decode_codons() failed");
+
+    const std::string barcode = "ACGTNACGTTGCAN";
+    std::string packed;
+    pack_barcode(barcode + "A", packed);
+    if (packed.size() != 8) throw test_failed_error("pack_barcode() wrong packed size");
+    if (unpack_barcode(reinterpret_cast<const uint8_t *>(packed.data()), 0, barcode.size() + 1) != barcode + "A") throw test_failed_error("unpack_barcode() failed");
+    if (unpack_barcode(reinterpret_cast<const uint8_t *>(packed.data()), 3, 5) != barcode.substr(3, 5)) throw test_failed_error("unpack_barcode() failed at odd offset");
+
+    //one alignment written as by write_columnar() reads back, and rows and offsets out of range are rejected
+    const fs::path path = fs::temp_directory_path() / ("dsa-test-" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) + ".col");
+    auto write = [&](uint64_t ops_end) {
+        ColumnarWriter w(path);
+        w.add("aln.template",         std::vector<uint32_t>{ColumnarFormat::NO_TEMPLATE}, 1);
+        w.add("aln.group_size",       std::vector<uint32_t>{3}, 1);
+        w.add("aln.barcode.offsets",  std::vector<uint64_t>{0, barcode.size() + 1}, 2);
+        w.add("aln.barcode",          ColumnType::U8, packed.data(), packed.size(), packed.size());
+        w.add("aln.ops.offsets",      std::vector<uint64_t>{0, ops_end}, 2);
+        w.add("aln.ops",              ColumnType::Bytes, ops.data(), ops.size(), 1);
+        w.add("aln.residues.offsets", std::vector<uint64_t>{0, residues.size()}, 2);
+        w.add("aln.residues",         ColumnType::Bytes, residues.data(), residues.size(), 1);
+        w.add("aln.codons.offsets",   std::vector<uint64_t>{0, codons.size()}, 2);
+        w.add("aln.codons",           ColumnType::Bytes, codons.data(), codons.size(), 1);
+    };
+    auto rejects = [](auto f)->bool {
+        try {
+            f();
+        } catch (const BadColumnarFile &) {
+            return true;
+        }
+        return false;
+    };
+
+    write(ops.size());
+    {
+        const ColumnarFile cf = ColumnarFile::open(path);
+        if (cf.alignment_count() != 1 || cf.template_id(0) != ColumnarFormat::NO_TEMPLATE || cf.group_size(0) != 3
+            || cf.barcode(0) != barcode + "A" || cf.alignment(0) != alignment || cf.codons(0) != cdns) {
+            throw test_failed_error("ColumnarFile did not read back what ColumnarWriter wrote");
+        }
+        if (!rejects([&]{ return cf.barcode(1); }) || !rejects([&]{ return cf.group_size(1); })) throw test_failed_error("ColumnarFile read a row out of range");
+    }
+    write(ops.size() + 1);
+    const bool corrupt = rejects([&]{ return ColumnarFile::open(path); });
+    fs::remove(path);
+    if (!corrupt) throw test_failed_error("ColumnarFile::open() accepted offsets past the end of a column");
+}
+
+void
+compact_alignment() {
+    const Cdns tcdns = Nts("ATGGCAACCATTCACAAAGCT");           //MATIHKA
+    const Cdns qcdns = Nts("GCTTCTATGCTGGTTCACCAGAAAGCT");     //ASMLVHQKA
+    const Aas  templ = tcdns;
+
+    const std::string alignment = "asML-VHqKA";
+    std::string cdns;
+    for (size_t q=0, i=0; q<alignment.size(); ++q) cdns.push_back(alignment[q] == '-' ? ' ' : static_cast<char>(qcdns[i++]));
+
+    const std::string compact = bio::compact_alignment(alignment, templ.as_string_view());
+    if (compact != "as.L-V.q.2") throw test_failed_error("compact_alignment() failed: result was '" + compact + "'");
+    if (expand_alignment(compact, templ.as_string_view()) != alignment) throw test_failed_error("expand_alignment() failed");
+
+    const std::string nts = compact_codons(alignment, cdns, tcdns.as_string_view());
+    if (nts != "GCTTCT.CTGGTT.CAG.2") throw test_failed_error("compact_codons() failed: result was '" + nts + "'");
+    if (expand_codons(alignment, nts, Nts(tcdns).as_string_view()) != qcdns.to_nts().as_string_view()) throw test_failed_error("expand_codons() failed");
+}
+
+void
+gzip_member() {
+    if (bio::crc32("123456789", 9) != 0xCBF43926) throw test_failed_error("crc32() failed");
+
+    std::string input;
+    for (int i=0; i<1000; ++i) input += "ACGTACGTTTGA";
+    const std::string gz = gzip_compress(input.data(), input.size());
+    if (gz.size() < 18 || gz.size() > input.size() / 10) throw test_failed_error("gzip_compress() failed: bad size");
+    if (gz.compare(0, 3, "\x1f\x8b\x08") != 0) throw test_failed_error("gzip_compress() failed: bad header");
+    uint32_t trailer[2];
+    std::memcpy(trailer, gz.data() + gz.size() - 8, 8);
+    if (trailer[0] != bio::crc32(input.data(), input.size()) || trailer[1] != input.size()) throw test_failed_error("gzip_compress() failed: bad trailer");
+}
+
+void
+thread_pool() {
+    std::vector<size_t> values(100000);
+    std::iota(values.begin(), values.end(), size_t(1));
+
+    const size_t sum = parallel_reduce(values.begin(), values.end(), [](auto first, auto last) {
+        return std::accumulate(first, last, size_t(0));
+    });
+    if (sum != values.size() * (values.size() + 1) / 2) throw test_failed_error("parallel_reduce() failed");
+
+    std::vector<size_t> squares;
+    parallel_transform(values.begin(), values.end(), std::back_inserter(squares), [](size_t v) { return v * v; });
+    for (size_t i=0; i<values.size(); ++i) {
+        if (squares[i] != values[i] * values[i]) throw test_failed_error("parallel_transform() failed");
+    }
+
+    TaskGroup group;
+    for (int i=0; i<8; ++i) group.run([i]{ if (i == 5) throw std::runtime_error("task failed"); });
+    bool caught = false;
+    try {
+        group.wait();
+    } catch (const std::runtime_error &) {
+        caught = true;
+    }
+    if (!caught) throw test_failed_error("TaskGroup::wait() did not rethrow");
+}
+
+void
+parallel_algorithms() {
+    ThreadPool::configure(4); //exercise the multithreaded paths even on one CPU
+
+    std::vector<std::pair<int, size_t>> values(50000);
+    uint32_t state = 12345;
+    for (size_t i=0; i<values.size(); ++i) {
+        state = state * 1103515245u + 12345u;
+        values[i] = {static_cast<int>((state >> 16) % 1000), i};
+    }
+    auto by_first = [](const auto &a, const auto &b) { return a.first < b.first; };
+
+    std::vector<std::pair<int, size_t>> sorted = values, expected = values;
+    parallel_sort(sorted.begin(), sorted.end(), by_first);
+    std::stable_sort(expected.begin(), expected.end(), by_first);
+    if (sorted != expected) throw test_failed_error("parallel_sort() failed");
+
+    //moved-from strings are empty, so this also catches reads of elements already moved by the merge
+    std::vector<std::string> words(values.size()), sorted_words;
+    for (size_t i=0; i<values.size(); ++i) words[i] = std::to_string(values[i].first);
+    sorted_words = words;
+    parallel_sort(sorted_words.begin(), sorted_words.end());
+    std::stable_sort(words.begin(), words.end());
+    if (sorted_words != words) throw test_failed_error("parallel_sort() failed on strings");
+
+    std::vector<std::pair<int, size_t>> moved = values;
+    vecvec<std::pair<int, size_t>> groups = parallel_group_by(moved.begin(), moved.end(), [](const auto &v) { return v.first; });
+    if (groups.size() != 1000) throw test_failed_error("parallel_group_by() failed: wrong group count");
+    size_t grouped = 0;
+    for (const auto &g : groups) {
+        grouped += g.size();
+        for (size_t i=1; i<g.size(); ++i) {
+            if (g[i].first != g[0].first || g[i].second < g[i-1].second) throw test_failed_error("parallel_group_by() failed");
+        }
+    }
+    if (grouped != values.size()) throw test_failed_error("parallel_group_by() lost elements");
+
+    std::vector<size_t> counts(values.size()), offsets(values.size()), serial(values.size());
+    for (size_t i=0; i<values.size(); ++i) counts[i] = values[i].first;
+    parallel_exclusive_scan(counts.begin(), counts.end(), offsets.begin(), size_t(7));
+    std::exclusive_scan(counts.begin(), counts.end(), serial.begin(), size_t(7));
+    if (offsets != serial) throw test_failed_error("parallel_exclusive_scan() failed");
+
+    std::vector<std::pair<int, size_t>> compacted(values.size()), kept;
+    auto odd = [](const auto &v) { return v.first % 2 == 1; };
+    compacted.erase(parallel_compact(values.begin(), values.end(), compacted.begin(), odd), compacted.end());
+    std::copy_if(values.begin(), values.end(), std::back_inserter(kept), odd);
+    if (compacted != kept) throw test_failed_error("parallel_compact() failed");
+
+    ThreadPool::configure(0);
+}
+
 void
 cdns_from_string() {
     const char8_t *utf8 = u8"Lorem ipsum dolor sit amet, consectetur adipiscing elit. Donec tincidunt, augue nec mattis porta,"
@@ -170,5 +364,520 @@ cdns_from_string() {
     }
 }
 
+void
+segmented_vector() {
+    vecvec<int> parts(3);
+    for (int i=0; i<10; ++i) parts[0].push_back(i);
+    for (int i=10; i<25; ++i) parts[2].push_back(i);
+
+    SegmentedVector<int> sv(std::move(parts));
+    if (sv.segment_count() != 2 || sv.size() != 25) throw test_failed_error("SegmentedVector failed: empty segments not dropped");
+    sv.append_segment(std::vector<int>{25, 26, 27});
+    sv.push_back(28);
+    if (sv.size() != 29 || sv.front() != 0 || sv.back() != 28) throw test_failed_error("SegmentedVector::push_back() failed");
+    for (size_t i=0; i<sv.size(); ++i) {
+        if (sv[i] != static_cast<int>(i)) throw test_failed_error("SegmentedVector::operator[] failed");
+    }
+    auto it = sv.begin() + 12;
+    if (*it != 12 || it[15] != 27 || sv.end() - it != 17 || *(it - 11) != 1) throw test_failed_error("SegmentedVector::iterator failed");
+    if (std::accumulate(sv.begin(), sv.end(), 0) != 28 * 29 / 2) throw test_failed_error("SegmentedVector iteration failed");
+
+    SegmentedVector<int> moved(std::move(sv));
+    if (moved.size() != 29 || sv.size() != 0 || !sv.empty()) throw test_failed_error("SegmentedVector move left the source unusable");
+    sv.push_back(1);
+    sv = std::move(moved);
+    if (sv.size() != 29 || moved.size() != 0 || sv[28] != 28) throw test_failed_error("SegmentedVector move assignment failed");
+}
+
+void
+task_graph() {
+    ThreadPool::configure(4);
+
+    //a diamond: a -> (b, c) -> d, plus an independent e
+    std::atomic<int> step = 0;
+    int a = -1, b = -1, c = -1, d = -1, e = -1;
+    TaskGraph graph;
+    TaskGraph::Node na = graph.add([&]{ a = step++; });
+    TaskGraph::Node nb = graph.add([&]{ b = step++; }, {na});
+    TaskGraph::Node nc = graph.add([&]{ c = step++; }, {na});
+    graph.add([&]{ d = step++; }, {nb, nc});
+    graph.add([&]{ e = step++; });
+    graph.run();
+    if (step != 5 || e < 0) throw test_failed_error("TaskGraph::run() failed: not every task ran");
+    if (!(a < b && a < c && b < d && c < d)) throw test_failed_error("TaskGraph::run() failed: dependency order violated");
+
+    //tasks after a failed task are skipped and the exception reaches run()
+    bool skipped = true, threw = false;
+    TaskGraph failing;
+    TaskGraph::Node bad = failing.add([]{ throw std::runtime_error("task failed"); });
+    failing.add([&]{ skipped = false; }, {bad});
+    try {
+        failing.run();
+    } catch (std::runtime_error &) {
+        threw = true;
+    }
+    if (!threw || !skipped) throw test_failed_error("TaskGraph::run() failed to propagate an exception");
+
+    ThreadPool::configure(0);
+}
+
+void
+mpmc_queue() {
+    MpmcQueue<size_t> queue(5);
+    if (queue.capacity() != 8) throw test_failed_error("MpmcQueue capacity not rounded up to a power of two");
+
+    //several producers and consumers; every item must come out exactly once
+    static constexpr size_t PRODUCERS = 3, CONSUMERS = 3, ITEMS = 20000;
+    std::vector<std::thread> producers, consumers;
+    std::vector<size_t> sums(CONSUMERS, 0), counts(CONSUMERS, 0);
+    for (size_t c=0; c<CONSUMERS; ++c) consumers.emplace_back([&, c]{
+        size_t v;
+        while (queue.pop(v)) { sums[c] += v; ++counts[c]; }
+    });
+    for (size_t p=0; p<PRODUCERS; ++p) producers.emplace_back([&, p]{
+        for (size_t i=0; i<ITEMS; ++i) queue.push(p * ITEMS + i + 1);
+    });
+    for (std::thread &t : producers) t.join();
+    queue.close();
+    for (std::thread &t : consumers) t.join();
+
+    const size_t n = PRODUCERS * ITEMS;
+    if (std::accumulate(counts.begin(), counts.end(), size_t(0)) != n) throw test_failed_error("MpmcQueue lost or duplicated items");
+    if (std::accumulate(sums.begin(), sums.end(), size_t(0)) != n * (n + 1) / 2) throw test_failed_error("MpmcQueue corrupted items");
+
+    const QueueStats stats = queue.stats();
+    if (stats.pushes != n || stats.max_size > queue.capacity()) throw test_failed_error("MpmcQueue::stats() failed");
+
+    size_t v;
+    if (queue.try_pop(v) || queue.pop(v)) throw test_failed_error("MpmcQueue::pop() failed on a closed, empty queue");
+}
+
+void
+numa_topology() {
+    const std::vector<int> cpus = parse_cpu_list("0-3,8,10-11\n");
+    if (cpus != std::vector<int>{0, 1, 2, 3, 8, 10, 11}) throw test_failed_error("parse_cpu_list() failed");
+    bool caught = false;
+    try {
+        parse_cpu_list("3-1");
+    } catch (const std::invalid_argument &) {
+        caught = true;
+    }
+    if (!caught) throw test_failed_error("parse_cpu_list() accepted a malformed list");
+
+    //node 1 is memory-only
+    const NumaTopology topology({"0-1,4-5", "", "2-3,6-7"});
+    if (topology.nodes() != 3 || topology.node_of_cpu(6) != 2 || topology.node_of_cpu(5) != 0) throw test_failed_error("NumaTopology::node_of_cpu() failed");
+
+    //a pinned pool must still run everything, whatever CPUs we are allowed
+    ThreadPool pool(4, true);
+    std::atomic<size_t> ran = 0;
+    {
+        TaskGroup group(pool);
+        for (int i=0; i<100; ++i) group.run([&]{ ++ran; });
+        group.wait();
+    }
+    if (ran != 100) throw test_failed_error("pinned ThreadPool lost tasks");
+}
+
+void
+pipeline_config() {
+    help::Params p;
+    p.min_overlap    = 4;
+    p.max_mismatches = 5;
+    bool caught = false;
+    try {
+        Pipeline pipeline(p);
+    } catch (const PipelineError &) {
+        caught = true;
+    }
+    if (!caught) throw test_failed_error("Pipeline accepted max_mismatches > min_overlap");
+
+    //each Pipeline keeps its own pool, bound only while it works
+    help::Params q;
+    q.fw_refs = {"NNNnnnnnn"};
+    q.rv_refs = {"NNNnnnnnn"};
+    q.threads = 2;
+    const Pipeline first(q);
+    q.threads = 3;
+    const Pipeline second(q);
+    if (first.pool().size() != 2 || second.pool().size() != 3) throw test_failed_error("Pipeline did not size its own ThreadPool");
+    {
+        ThreadPool::Use use(first.pool());
+        if (&ThreadPool::current() != &first.pool() || worker_count() != 2) throw test_failed_error("ThreadPool::Use did not bind the pool");
+    }
+    if (&ThreadPool::current() != &ThreadPool::instance()) throw test_failed_error("ThreadPool::Use did not unbind the pool");
+}
+
+void
+batch_manifest() {
+    std::istringstream manifest("# fw\trv\tout\n\na_R1.fastq\ta_R2.fastq\ta.tsv\r\nb_R1.fastq\tb_R2.fastq\tb.tsv.gz\n");
+    const std::vector<BatchSample> samples = parse_manifest(manifest, "manifest");
+    if (samples.size() != 2 || samples[0].rv_filename != "a_R2.fastq" || samples[0].output_filename != "a.tsv" ||
+        samples[1].output_filename != "b.tsv.gz") throw test_failed_error("parse_manifest() failed");
+
+    std::istringstream bad("a_R1.fastq\ta_R2.fastq\n");
+    bool caught = false;
+    try {
+        parse_manifest(bad, "manifest");
+    } catch (const PipelineError &) {
+        caught = true;
+    }
+    if (!caught) throw test_failed_error("parse_manifest() accepted a line without an output file");
+}
+
+void
+serve_jobs() {
+#ifdef DSA_TARGET_LINUX
+    help::Params p;
+    p.fw_refs = {"NNNnnnnnn"};
+    p.rv_refs = {"NNNnnnnnn"};
+    const Pipeline pipeline(p);
+    const std::string socket = (fs::temp_directory_path() / ("dsa-test-" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) + ".sock")).string();
+
+    std::ostringstream log;
+    ServeSummary summary;
+    std::thread server([&]{ summary = serve(pipeline, socket, 1, log); });
+
+    //a job whose reads cannot be read fails on the server, not in the client
+    std::ostringstream results, status;
+    bool ok = true;
+    for (int tries = 0; ; ++tries) {
+        try {
+            ok = submit(socket, {"no_such_R1.fastq", "no_such_R2.fastq", ""}, results, status);
+            break;
+        } catch (const ServerError &) {
+            if (tries == 100) { server.detach(); throw test_failed_error("serve() did not start listening"); }
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+    }
+    request_shutdown(socket);
+    server.join();
+
+    if (ok || status.str().rfind("#serve failed\t", 0) != 0) throw test_failed_error("submit() did not report a failed job");
+    if (summary.jobs != 1 || summary.failed != 1) throw test_failed_error("serve() miscounted jobs");
+    if (fs::exists(socket)) throw test_failed_error("serve() left its socket behind");
+#endif
+}
+
+void
+stage_profile() {
+    count_allocations(true);
+    const StageTimer timer("test", 10);
+    std::vector<int> *v = new std::vector<int>(1000);
+    const StageProfile profile = timer.stop(5);
+    delete v;
+    count_allocations(false);
+    if (profile.stage != "test" || profile.items_in != 10 || profile.items_out != 5) throw test_failed_error("StageTimer::stop() failed");
+    if (profile.bytes_allocated < 1000 * sizeof(int)) throw test_failed_error("StageTimer did not count allocations");
+
+    std::ostringstream section;
+    write_profile_section(section, {profile});
+    if (section.str().rfind("#Profile#\nStage\t", 0) != 0 || section.str().find("\ntest\t") == std::string::npos) {
+        throw test_failed_error("write_profile_section() failed");
+    }
+
+    //the wall clock time in the header once had hours = seconds / 60
+    help::Params p;
+    p.fw_refs = {"NNNnnnnnn"};
+    p.rv_refs = {"NNNnnnnnn"};
+    SampleResult result;
+    result.milliseconds = ((1 * 60 + 2) * 60 + 3) * 1000.0 + 4;
+    if (Pipeline(p).settings(result).find("#wall clock time\t01:02:03.004\n") == std::string::npos) {
+        throw test_failed_error("Pipeline::settings() wall clock time failed");
+    }
+}
+
+void
+trace_events() {
+    //spans are kept for the life of the process, so this trace is left running
+    trace::start();
+    {
+        trace::Label label("trace test");
+        parallel_guided(100, [](size_t, size_t, size_t) {});
+    }
+
+    std::ostringstream os;
+    trace::write(os);
+    const std::string json = os.str();
+    if (json.rfind("{\"displayTimeUnit\"", 0) != 0 || json.find("\"thread_name\"") == std::string::npos) {
+        throw test_failed_error("trace::write() failed");
+    }
+    //each chunk of parallel_guided() is a span named after the label of the thread that started it
+    size_t items = 0;
+    for (size_t pos = 0; (pos = json.find("{\"name\": \"trace test\", \"cat\": \"parallel_guided\"", pos)) != std::string::npos; ++pos) {
+        const size_t at = json.find("\"items\": ", pos) + std::strlen("\"items\": ");
+        items += std::stoul(json.substr(at, json.find('}', at) - at));
+    }
+    if (items != 100) throw test_failed_error("trace spans of parallel_guided() do not cover its items");
+}
+
+void
+perf_counters() {
+    std::string reason;
+    const bool hardware = PerfCounterSet::hardware_available(&reason);
+    if (!hardware && reason.empty()) throw test_failed_error("PerfCounterSet::hardware_available() gave no reason");
+
+    const PerfCounterSet set;
+    volatile uint64_t x = 0;
+    for (uint64_t i = 0; i < 10000000; ++i) x = x + i;
+    const PerfCounters counters = set.read();
+
+    //where perf events are off limits nothing is counted, which is not an error
+    if (counters.threads && counters.task_seconds <= 0.0) throw test_failed_error("PerfCounterSet did not count the task clock");
+    if (counters.hardware && (!hardware || counters.instructions < 10000000)) throw test_failed_error("PerfCounterSet miscounted instructions");
+}
+
+void
+progress_metrics() {
+    Progress &progress = Progress::instance();
+    const uint64_t parsed = progress.get(Progress::ReadsParsed);
+    progress.add(Progress::ReadsParsed, 42);
+    progress.stage("test", Progress::ReadsParsed);
+
+    const std::string metrics = ProgressReporter::metrics(1.0, 0.0);
+    if (metrics.find("\ndsa_reads_parsed_total " + std::to_string(parsed + 42) + "\n") == std::string::npos ||
+        metrics.find("\ndsa_stage_info{stage=\"test\"} 1\n") == std::string::npos) {
+        throw test_failed_error("ProgressReporter::metrics() failed");
+    }
+
+    //the last report is written when the reporter is destroyed
+    const std::string filename = (fs::temp_directory_path() / ("dsa-test-" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) + ".prom")).string();
+    {
+        std::ostringstream log;
+        const ProgressReporter reporter(&log, filename, std::chrono::seconds(60));
+        (void)reporter;
+    }
+    std::ifstream ifs(filename);
+    const std::string written((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    ifs.close();
+    fs::remove(filename);
+    if (written.find("dsa_reads_parsed_total " + std::to_string(parsed + 42) + "\n") == std::string::npos) {
+        throw test_failed_error("ProgressReporter did not write the metrics file");
+    }
+    progress.stage("starting");
+}
+
+void
+allocation_tallies() {
+    auto tally = [](const char *stage, const char *allocator) {
+        for (const AllocationTally &t : bio::allocation_tallies()) if (t.stage == stage && t.allocator == allocator) return t;
+        return AllocationTally{};
+    };
+
+    track_allocations(true);
+    {
+        trace::Label trace_label("test allocations");
+        std::vector<int> *v = new std::vector<int>(1000);
+        delete v;
+        ccb::simd_allocator<char, ccb::Register::YMM> alloc;
+        size_t actual;
+        char *p = alloc.allocate(100, actual);
+        alloc.deallocate(p, actual);
+    }
+    track_allocations(false);
+
+    const AllocationTally news = tally("test allocations", "operator new");
+    if (news.calls < 2 || news.bytes < 1000 * sizeof(int) || news.live != 0 || news.peak < static_cast<long long>(1000 * sizeof(int))) {
+        throw test_failed_error("operator new allocations were not tallied by stage");
+    }
+    const AllocationTally simd = tally("test allocations", "simd_allocator");
+    if (simd.calls != 1 || simd.bytes < 100 || simd.live != 0 || simd.peak < 100) {
+        throw test_failed_error("simd_allocator allocations were not tallied by stage");
+    }
+
+    //a block freed in another stage is taken back from the stage that allocated it
+    track_allocations(true);
+    std::string *moved;
+    {
+        trace::Label trace_label("test allocations made");
+        moved = new std::string(1000, 'x');
+    }
+    {
+        trace::Label trace_label("test allocations freed");
+        delete moved;
+    }
+    track_allocations(false);
+    if (tally("test allocations made", "operator new").live != 0 || tally("test allocations freed", "operator new").live != 0) {
+        throw test_failed_error("a free was not charged to the stage that allocated the block");
+    }
+
+    //tallies since a restart leave out what came before it, as for the samples of --batch
+    const std::vector<AllocationTally> start = restart_allocation_tallies();
+    track_allocations(true);
+    {
+        trace::Label trace_label("test allocations");
+        ccb::simd_allocator<char, ccb::Register::YMM> alloc;
+        size_t actual;
+        char *p = alloc.allocate(100, actual);
+        alloc.deallocate(p, actual);
+    }
+    track_allocations(false);
+    bool found = false;
+    for (const AllocationTally &t : bio::allocation_tallies(start)) {
+        if (t.stage != "test allocations" || t.allocator != "simd_allocator") continue;
+        found = true;
+        if (t.calls != 1 || t.bytes != simd.bytes || t.live != 0 || t.peak != simd.peak) {
+            throw test_failed_error("allocation tallies since a restart include earlier allocations");
+        }
+    }
+    if (!found) throw test_failed_error("allocations since a restart were not tallied");
+}
+
+void
+polymer_arena() {
+    //aligned and zeroed from the end of the monomers through the null terminator, as from ccb::simd_allocator
+    auto padded = [](const PolymerBase &p)->bool {
+        if (reinterpret_cast<uintptr_t>(p.c_data()) % ccb::REGISTER_SIZE) return false;
+        for (size_t i = p.size(); i <= p.capacity(); ++i) if (p.c_data()[i]) return false;
+        return true;
+    };
+
+    const size_t blocks = Arena::blocks();
+    const std::string expected(1000, 'G');
+    Nts kept, held;
+    {
+        Arena::Scope arena;
+        Nts grown;
+        while (grown.size() <= PolymerBase::LOCAL_SIZE) grown.push_back('G'); //past the local buffer
+        const char *first = grown.c_data();
+        while (grown.size() < expected.size()) grown.push_back('G');
+        if (grown.c_data() != first) throw test_failed_error("Arena::extend() did not grow the last buffer in place");
+        if (!padded(grown)) throw test_failed_error("arena buffer is not aligned and zero-padded");
+        if (Arena::blocks() != blocks + 1) throw test_failed_error("Arena::Scope did not start a block");
+
+        Nts copy(grown);
+        held = grown;
+        kept = copy;
+        if (held.as_string_view() != expected || kept.as_string_view() != expected) throw test_failed_error("copying an arena Nts failed");
+        kept.detach();
+        if (!padded(kept)) throw test_failed_error("PolymerBase::detach() lost the padding");
+
+        std::thread([](Nts &&dna) { Nts released = std::move(dna); }, std::move(copy)).join();
+    }
+    if (Arena::blocks() != blocks + 1) throw test_failed_error("arena block freed while a buffer is still held");
+    held = Nts();
+    if (Arena::blocks() != blocks) throw test_failed_error("arena block not freed after its scope and buffers");
+    if (kept.as_string_view() != expected) throw test_failed_error("detached Nts changed when its block was freed");
+}
+
+void
+polymer_small_buffer() {
+    auto local = [](const PolymerBase &p)->bool {
+        const char *object = reinterpret_cast<const char *>(&p);
+        return p.c_data() >= object && p.c_data() < object + sizeof(p);
+    };
+
+    Nts primer("TACAGTCGGTCCTCTCT");
+    if (!local(primer)) throw test_failed_error("short Nts not held in the local buffer");
+    if (reinterpret_cast<uintptr_t>(primer.c_data()) % ccb::REGISTER_SIZE) throw test_failed_error("local buffer not aligned");
+    if (primer.c_str()[primer.size()] != 0) throw test_failed_error("local buffer not null-terminated");
+
+    Nts moved(std::move(primer));
+    Nts longer(std::string(100, 'A'));
+    if (!local(moved) || moved.as_string_view() != "TACAGTCGGTCCTCTCT") throw test_failed_error("moving a local Nts failed");
+    if (local(longer)) throw test_failed_error("long Nts held in the local buffer");
+
+    std::swap(moved, longer);
+    if (local(moved) || moved.as_string_view() != std::string(100, 'A')) throw test_failed_error("swapping a local Nts with a heap one failed");
+    if (!local(longer) || longer.as_string_view() != "TACAGTCGGTCCTCTCT") throw test_failed_error("swapping a heap Nts with a local one failed");
+
+    Aas aas(Cdns(Nts("ATGAAACCCGGGTTT")));
+    if (aas.as_string_view() != "MKPGF") throw test_failed_error("translating a local Nts in place failed");
+
+    Nts grown;
+    while (local(grown)) grown.push_back('C');
+    if (grown.as_string_view() != std::string(PolymerBase::LOCAL_SIZE, 'C')) throw test_failed_error("growing out of the local buffer failed");
+}
+
+void
+polymer_normalize() {
+    //every byte value, over lengths that cover whole registers and scalar tails
+    std::mt19937 rng(1);
+    std::string input(300, '\0');
+    for (char &c : input) c = static_cast<char>(rng());
+    for (size_t i = 0; i < 256; ++i) input[i] = static_cast<char>(i);
+    std::shuffle(input.begin(), input.begin() + 256, rng);
+    input += "acgtnACGTN*mkpgfwy"; //make sure the tail has valid chars of every alphabet
+
+    auto check = [&](auto polymer, char (*normalize_char)(char), const char *name) {
+        for (size_t n : {size_t(0), size_t(5), size_t(32), size_t(63), size_t(64), size_t(100), input.size()}) {
+            std::string expected;
+            for (size_t i = 0; i < n; ++i) if (char c = normalize_char(input[i])) expected += c;
+            polymer.assign(input.data(), input.size()); //leave old contents behind for the next assign to clear
+            const size_t kept = polymer.assign(input.data(), n);
+            if (kept != expected.size() || polymer.as_string_view() != expected) {
+                throw test_failed_error(std::string(name) + "::normalize() disagrees with normalize_char()");
+            }
+            for (size_t i = polymer.size(); i <= polymer.capacity(); ++i) {
+                if (polymer.c_data()[i]) throw test_failed_error(std::string(name) + "::normalize() left bytes after the monomers");
+            }
+        }
+    };
+    check(Nts(), Nt::normalize_char, "Nt");
+    check(Aas(), Aa::normalize_char, "Aa");
+    check(Cdns(), Cdn::normalize_char, "Cdn");
+
+    size_t stripped = 0;
+    const std::string lines = "ACGTNacgtn\nACxGT";
+    Nts nts;
+    const char *next = getline(lines.data(), lines.data() + lines.size(), nts, stripped);
+    if (nts.as_string_view() != "ACGTNACGTN" || stripped != 0 || next != lines.data() + 11) throw test_failed_error("getline() into Nts failed");
+    next = getline(next, lines.data() + lines.size(), nts, stripped);
+    if (nts.as_string_view() != "ACGT" || stripped != 1 || next != lines.data() + lines.size()) throw test_failed_error("getline() into Nts failed to strip");
+}
+
+void
+polymer_view() {
+    std::mt19937 rng(2);
+    std::string acgt(301, 'A');
+    for (char &c : acgt) c = "ACGT"[rng() % 4];
+    const Nts  dna(acgt);
+    const Cdns cdns(dna);
+    const Aas  aas(cdns);
+
+    //translation leaves the buffers null terminated
+    if (std::strlen(cdns.c_str()) != cdns.size() || std::strlen(aas.c_str()) != aas.size()) {
+        throw test_failed_error("translation left bytes after the monomers");
+    }
+    const Cdns moved(Nts{acgt});
+    if (std::strlen(moved.c_str()) != moved.size() || !(moved == cdns)) throw test_failed_error("Cdns(Nts &&) failed");
+
+    //views share the buffer and agree with copies
+    const CdnsView cv = cdns.view(10, 20);
+    if (cv.data() != cdns.data() + 10 || cv.size() != 20) throw test_failed_error("Cdns::view() copied or misplaced the slice");
+    if (cv.as_string_view() != cdns.as_string_view().substr(10, 20)) throw test_failed_error("Cdns::view() has the wrong monomers");
+    if (cdns.view(90).size() != cdns.size() - 90 || !cdns.view(cdns.size()).empty()) throw test_failed_error("Cdns::view() past the end");
+
+    //the translation kernels read past the end of a view but only translate what is in it
+    if (!(Aas(cv) == aas.subclone(10, 20)) || std::strlen(Aas(cv).c_str()) != 20) throw test_failed_error("Aas(CdnsView) failed");
+    if (!(Cdns(dna.view(3, 61)) == Cdns(Nts(dna.subclone(3, 61))))) throw test_failed_error("Cdns(NtsView) failed");
+
+    CdnsView trimmed = cv;
+    trimmed.exo(2, 3);
+    if (!(trimmed == cdns.view(12, 15)) || *trimmed.begin() != cdns[12] || trimmed.back() != cdns[26]) {
+        throw test_failed_error("PolymerView::exo() failed");
+    }
+    if (*trimmed.crbegin() != cdns[26] || trimmed.crend() - trimmed.crbegin() != 15) throw test_failed_error("PolymerView reverse iterators failed");
+
+    //alignment takes views as it takes Polymers
+    const Aas query = aas.subclone(5, 40), templ = aas.subclone(0, 50);
+    Alignment copied, viewed;
+    nw_align<Aa>(query, templ, BLOSUM62, 4, copied);
+    nw_align<Aa>(aas.view(5, 40), aas.view(0, 50), BLOSUM62, 4, viewed);
+    if (copied.score != viewed.score || copied.aligned_query != viewed.aligned_query) throw test_failed_error("nw_align() on views failed");
+    if (viewed.build_string(aas.view(5, 40)) != copied.build_string(AasView(query))) throw test_failed_error("Alignment::build_string() on views failed");
+    if (nw_self_align_score<Aa>(query, BLOSUM62) != nw_self_align_score<Aa>(aas.view(5, 40), BLOSUM62)) {
+        throw test_failed_error("nw_self_align_score() on views failed");
+    }
+
+    std::shared_ptr<TemplateDatabase> db = TemplateDatabase::create_empty();
+    db->add_entry("whole", cdns, aas);
+    db->add_entry("slice", cdns.subclone(20, 40), aas.subclone(20, 40));
+    Alignment aln;
+    if (db->query_and_align(cdns.view(20, 40), aln) != 2 || db->query_and_align(aas.view(20, 40), aln) != 2 || db->query(cdns.view()) != 1) {
+        throw test_failed_error("TemplateDatabase queries with views failed");
+    }
+}
+
 }; //namespace test
 }; //namespace bio
@@ -29,6 +29,18 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "dna.h"
 
 #include "polymer.h"
+#include "abs.h"
+#include "align.h"
+#include "columnar.h"
+#include "compact.h"
+#include "gzip.h"
+#include "mpmc.h"
+#include "numa.h"
+#include "parallelism.h"
+#include "pipeline.h"
+#include "server.h"
+#include "taskgraph.h"
+#include "trace.h"
 
 namespace bio {
 namespace test {
@@ -44,6 +56,27 @@ void cdns_from_string();
 void aas_from_string();
 void aas_from_nts();
 void rc_nts();
+void columnar_alignment();
+void compact_alignment();
+void gzip_member();
+void thread_pool();
+void parallel_algorithms();
+void segmented_vector();
+void task_graph();
+void mpmc_queue();
+void numa_topology();
+void pipeline_config();
+void batch_manifest();
+void serve_jobs();
+void stage_profile();
+void trace_events();
+void perf_counters();
+void progress_metrics();
+void allocation_tallies();
+void polymer_arena();
+void polymer_small_buffer();
+void polymer_normalize();
+void polymer_view();
 
 };
 };
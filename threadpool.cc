@@ -0,0 +1,327 @@
+/*
+Copyright 2024, The Broad Institute of MIT and Harvard
+
+Original Author: Charles C Bailey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "threadpool.h"
+#include "numa.h"
+
+#include <cmath>
+#include <fstream>
+#include <string>
+
+#ifdef DSA_TARGET_LINUX
+#include <sched.h>
+#endif
+
+namespace bio {
+
+namespace {
+
+thread_local ThreadPool *this_pool  = nullptr; //pool owning the calling thread, if any
+thread_local size_t      this_index = 0;       //index of the calling thread's queue
+thread_local size_t      task_depth = 0;       //tasks the calling thread is inside of (they nest while waiting)
+thread_local ThreadPool *bound_pool = nullptr; //pool bound to the calling thread by a ThreadPool::Use, if any
+
+std::mutex                  instance_mutex;
+std::unique_ptr<ThreadPool> instance_pool;
+size_t                      instance_size = 0;
+bool                        instance_pin  = false;
+
+#ifdef DSA_TARGET_LINUX
+/** CPU limit from the cgroup quota/period files under dir, or 0 for none. */
+size_t
+cgroup_cpu_limit(const std::string &dir) {
+    double quota = -1.0, period = 0.0;
+
+    std::ifstream v2(dir + "/cpu.max");
+    if (v2) {
+        std::string q;
+        v2 >> q >> period;
+        if (!v2 || q == "max") return 0;
+        quota = std::stod(q);
+    } else {
+        std::ifstream q(dir + "/cpu.cfs_quota_us"), p(dir + "/cpu.cfs_period_us");
+        if (!(q >> quota) || !(p >> period)) return 0;
+    }
+
+    if (quota <= 0.0 || period <= 0.0) return 0;
+    return std::max<size_t>(1, static_cast<size_t>(std::ceil(quota / period)));
+}
+
+/** The tightest cgroup CPU limit that applies to this process, or 0 for none. */
+size_t
+cgroup_cpu_limit() {
+    std::vector<std::string> dirs;
+
+    //lines of /proc/self/cgroup are hierarchy-id:controllers:path
+    std::ifstream proc("/proc/self/cgroup");
+    for (std::string line; std::getline(proc, line); ) {
+        const size_t a = line.find(':'), b = line.find(':', a + 1);
+        if (a == std::string::npos || b == std::string::npos) continue;
+        const std::string controllers = line.substr(a + 1, b - a - 1);
+        const std::string path = line.substr(b + 1);
+        if (controllers.empty()) {
+            dirs.push_back("/sys/fs/cgroup" + path);
+        } else if (controllers.find("cpu") != std::string::npos) {
+            dirs.push_back("/sys/fs/cgroup/cpu" + path);
+            dirs.push_back("/sys/fs/cgroup/cpu,cpuacct" + path);
+        }
+    }
+    //inside a container the cgroup namespace usually puts us at the root
+    dirs.push_back("/sys/fs/cgroup");
+    dirs.push_back("/sys/fs/cgroup/cpu");
+    dirs.push_back("/sys/fs/cgroup/cpu,cpuacct");
+
+    size_t limit = 0;
+    for (const std::string &dir : dirs) {
+        const size_t n = cgroup_cpu_limit(dir);
+        if (n && (limit == 0 || n < limit)) limit = n;
+    }
+    return limit;
+}
+#endif
+
+}; //namespace
+
+size_t
+default_thread_count() {
+    size_t n = std::max(1u, std::thread::hardware_concurrency());
+
+#ifdef DSA_TARGET_LINUX
+    cpu_set_t mask;
+    if (sched_getaffinity(0, sizeof(mask), &mask) == 0) {
+        const int allowed = CPU_COUNT(&mask);
+        if (allowed > 0) n = std::min<size_t>(n, allowed);
+    }
+
+    const size_t quota = cgroup_cpu_limit();
+    if (quota) n = std::min(n, quota);
+#endif
+
+    return n;
+}
+
+ThreadPool &
+ThreadPool::instance() {
+    std::lock_guard<std::mutex> lock(instance_mutex);
+    if (!instance_pool) {
+        instance_pool = std::make_unique<ThreadPool>(instance_size ? instance_size : default_thread_count(), instance_pin);
+    }
+    return *instance_pool;
+}
+
+ThreadPool &
+ThreadPool::current() {
+    if (this_pool) return *this_pool;
+    if (bound_pool) return *bound_pool;
+    return instance();
+}
+
+ThreadPool::Use::Use(ThreadPool &pool) : previous_(bound_pool) {
+    bound_pool = &pool;
+}
+
+ThreadPool::Use::~Use() {
+    bound_pool = previous_;
+}
+
+void
+ThreadPool::configure(size_t threads, bool pin) {
+    std::lock_guard<std::mutex> lock(instance_mutex);
+    instance_size = threads;
+    instance_pin  = pin;
+    instance_pool.reset();
+}
+
+ThreadPool::ThreadPool(size_t threads, bool pin) : pinned_(pin) {
+    const size_t workers = threads > 1 ? threads - 1 : 0;
+    const size_t nqueues = std::max<size_t>(workers, 1);
+    for (size_t i=0; i<nqueues; ++i) queues_.push_back(std::make_unique<Queue>());
+    counters_ = std::make_unique<Counters[]>(workers + 1);
+
+    //the first CPU of the spread is left for the thread that waits on the pool
+    nodes_.assign(nqueues, 0);
+    if (pin) {
+        const NumaTopology &topology = NumaTopology::instance();
+        const std::vector<int> spread = topology.spread(workers + 1);
+        cpus_.assign(spread.begin() + 1, spread.end());
+        for (size_t i=0; i<workers; ++i) nodes_[i] = topology.node_of_cpu(cpus_[i]);
+    }
+
+    //steal from the queues on the same node, nearest first, then from the rest
+    victims_.resize(nqueues);
+    for (size_t i=0; i<nqueues; ++i) {
+        for (int remote=0; remote<2; ++remote) {
+            for (size_t k=1; k<=nqueues; ++k) {
+                const size_t j = (i + k) % nqueues;
+                if ((nodes_[j] != nodes_[i]) == static_cast<bool>(remote)) victims_[i].push_back(j);
+            }
+        }
+    }
+
+    for (size_t i=0; i<workers; ++i) threads_.emplace_back(&ThreadPool::work, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        stop_ = true;
+    }
+    sleep_cv_.notify_all();
+    for (std::thread &th : threads_) th.join();
+}
+
+void
+ThreadPool::submit(Task task) {
+    const size_t index = (this_pool == this) ? this_index : next_++ % queues_.size();
+    {
+        Queue &q = *queues_[index];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        q.tasks.push_back(std::move(task));
+    }
+    queued_ += 1;
+
+    //taking the lock orders this wakeup after any worker's check of queued_
+    { std::lock_guard<std::mutex> lock(sleep_mutex_); }
+    sleep_cv_.notify_one();
+}
+
+bool
+ThreadPool::pop(size_t index, Task &task) {
+    Queue &q = *queues_[index];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if (q.tasks.empty()) return false;
+    task = std::move(q.tasks.back());
+    q.tasks.pop_back();
+    queued_ -= 1;
+    return true;
+}
+
+bool
+ThreadPool::steal(size_t index, Task &task) {
+    for (size_t victim : victims_[index]) {
+        Queue &q = *queues_[victim];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (q.tasks.empty()) continue;
+        task = std::move(q.tasks.front());
+        q.tasks.pop_front();
+        queued_ -= 1;
+        return true;
+    }
+    return false;
+}
+
+bool
+ThreadPool::run_one() {
+    if (queued_ == 0) return false;
+    Task task;
+    const bool worker = this_pool == this;
+    const size_t index = worker ? this_index : next_++ % queues_.size();
+    if (!steal(index, task)) return false;
+    execute(task, worker ? this_index : threads_.size());
+    return true;
+}
+
+void
+ThreadPool::execute(Task &task, size_t slot) {
+    const auto start = std::chrono::steady_clock::now();
+    ++task_depth;
+    task();
+    --task_depth;
+
+    //a task run while waiting inside another task is already part of that task's time
+    if (task_depth == 0) {
+        const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        counters_[slot].busy_ns.fetch_add(static_cast<uint64_t>(ns), std::memory_order_relaxed);
+    }
+    counters_[slot].tasks.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::vector<ThreadStats>
+ThreadPool::stats() const {
+    std::vector<ThreadStats> result(threads_.size() + 1);
+    for (size_t i=0; i<result.size(); ++i) {
+        result[i].busy_seconds = counters_[i].busy_ns.load(std::memory_order_relaxed) * 1e-9;
+        result[i].tasks        = counters_[i].tasks.load(std::memory_order_relaxed);
+    }
+    return result;
+}
+
+void
+ThreadPool::reset_stats() {
+    for (size_t i=0; i<=threads_.size(); ++i) {
+        counters_[i].busy_ns.store(0, std::memory_order_relaxed);
+        counters_[i].tasks.store(0, std::memory_order_relaxed);
+    }
+}
+
+void
+ThreadPool::work(size_t index) {
+    this_pool  = this;
+    this_index = index;
+    if (pinned_) pin_current_thread(cpus_[index]);
+    trace::name_thread("pool worker " + std::to_string(index));
+
+    for (;;) {
+        Task task;
+        if (pop(index, task) || steal(index, task)) {
+            execute(task, index);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        sleep_cv_.wait(lock, [this]{ return stop_ || queued_ > 0; });
+        if (stop_ && queued_ == 0) return;
+    }
+}
+
+TaskGroup::~TaskGroup() {
+    join();
+}
+
+void
+TaskGroup::done(std::exception_ptr error) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (error && !error_) error_ = error;
+    if (--pending_ == 0) cv_.notify_all();
+}
+
+void
+TaskGroup::join() {
+    while (pending_ > 0 && pool_.run_one()) {}
+
+    //the lock also ensures the last task has left done() before we return
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this]{ return pending_ == 0; });
+}
+
+void
+TaskGroup::wait() {
+    join();
+    if (error_) {
+        std::exception_ptr error = error_;
+        error_ = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+}; //namespace bio
\ No newline at end of file
@@ -0,0 +1,227 @@
+/*
+Copyright 2024, The Broad Institute of MIT and Harvard
+
+Original Author: Charles C Bailey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef BIO_THREADPOOL_H_
+#define BIO_THREADPOOL_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "trace.h"
+
+namespace bio {
+
+/** Number of threads the process should use by default.
+  *
+  * This is std::thread::hardware_concurrency() limited by the CPU affinity
+  * mask and, on Linux, by the cgroup (v1 or v2) CPU quota, so that a container
+  * allotted 16 CPUs on a 128 core host gets 16 rather than 128.
+  */
+size_t
+default_thread_count();
+
+/** Time spent running tasks by one thread of a ThreadPool. */
+struct ThreadStats {
+    double busy_seconds = 0.0; ///< total time inside tasks
+    size_t tasks        = 0;   ///< number of tasks run
+};
+
+/** A work-stealing thread pool.
+  *
+  * Each worker thread owns a deque of tasks. Workers run tasks from the back
+  * of their own deque and, when it is empty, steal from the front of the
+  * others'. Tasks submitted from outside the pool are dealt round-robin.
+  * A pool of size n has n-1 worker threads; the n-th thread is whichever
+  * thread waits on a TaskGroup, which runs queued tasks while it waits.
+  *
+  * A pinned pool binds its workers to CPUs spread across the NUMA nodes (see
+  * numa.h) and splits them into one sub-pool per node: an idle worker steals
+  * from the workers on its own node before crossing to another socket, so
+  * tasks tend to run next to the memory their submitter just touched.
+  */
+class ThreadPool {
+public:
+    using Task = std::function<void()>;
+
+    /** The process-wide pool, used by parallel algorithms when no other is bound (see current()). */
+    static ThreadPool &instance();
+
+    /** The pool parallel algorithms called on this thread run on (see parallelism.h):
+      * the pool the thread works for, else the one bound to it by a ThreadPool::Use,
+      * else the process-wide pool.
+      */
+    static ThreadPool &current();
+
+    /** Binds a pool to the calling thread for as long as it lives, so that
+      * an object with a pool of its own (e.g. a Pipeline) runs its parallel
+      * algorithms there rather than on the process-wide pool. Nests.
+      */
+    class Use {
+    public:
+        explicit Use(ThreadPool &pool);
+        Use(const Use &) = delete;
+        Use &operator=(const Use &) = delete;
+        ~Use();
+
+    private:
+        ThreadPool *previous_;
+    };
+
+    /** Set the size of the process-wide pool (0 for default_thread_count())
+      * and whether its workers are pinned to CPUs.
+      * Replaces any existing pool, so must not be called while tasks are running.
+      */
+    static void configure(size_t threads, bool pin=false);
+
+    explicit ThreadPool(size_t threads, bool pin=false);
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+    ~ThreadPool();
+
+    /** Number of threads that run tasks, counting one waiting thread. */
+    size_t size() const { return threads_.size() + 1; }
+
+    /** Whether the workers are pinned to CPUs. */
+    bool pinned() const { return pinned_; }
+
+    /** NUMA node of worker i (always 0 in an unpinned pool). */
+    size_t node(size_t i) const { return nodes_[i]; }
+
+    /** Queue a task. Tasks must not throw; use TaskGroup for that. */
+    void submit(Task task);
+
+    /** Run one queued task on the calling thread. Returns false if there was none. */
+    bool run_one();
+
+    /** Busy time of each worker thread since the last reset_stats(), followed
+      * by one entry shared by all threads that ran tasks while waiting.
+      */
+    std::vector<ThreadStats> stats() const;
+
+    void reset_stats();
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    struct alignas(64) Counters {
+        std::atomic<uint64_t> busy_ns = 0;
+        std::atomic<uint64_t> tasks   = 0;
+    };
+
+    void work(size_t index);
+    void execute(Task &task, size_t slot);
+    bool pop(size_t index, Task &task);
+    bool steal(size_t index, Task &task);
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::vector<size_t>> victims_; //queues to steal from for each queue, same node first
+    std::vector<size_t> nodes_;
+    std::vector<int> cpus_; //CPU of each worker when pinned
+    std::vector<std::thread> threads_;
+    std::unique_ptr<Counters[]> counters_;
+    std::atomic<size_t> queued_ = 0;
+    std::atomic<size_t> next_   = 0;
+    std::mutex sleep_mutex_;
+    std::condition_variable sleep_cv_;
+    bool stop_   = false;
+    bool pinned_ = false;
+};
+
+/** A set of tasks run on a ThreadPool that can be waited on together.
+  *
+  * The first exception thrown by a task is rethrown by wait(). Each task
+  * runs under the trace label of the thread that queued it and, with
+  * --trace, is recorded as a span (see trace.h).
+  */
+class TaskGroup {
+public:
+    explicit TaskGroup(ThreadPool &pool=ThreadPool::current()) : pool_(pool) {}
+    TaskGroup(const TaskGroup &) = delete;
+    TaskGroup &operator=(const TaskGroup &) = delete;
+    ~TaskGroup();
+
+    template<typename Function>
+    void run(Function &&f) {
+        pending_ += 1;
+        pool_.submit([this, label=trace::label(), f=std::forward<Function>(f)]() mutable {
+            trace::Label trace_label(label);
+            trace::Span span("task");
+            std::exception_ptr error;
+            try {
+                f();
+            } catch (...) {
+                error = std::current_exception();
+            }
+            done(error);
+        });
+    }
+
+    /** Block until every task has finished, running queued tasks meanwhile. */
+    void wait();
+
+private:
+    void done(std::exception_ptr error);
+    void join();
+
+    ThreadPool &pool_;
+    std::atomic<size_t> pending_ = 0;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::exception_ptr error_;
+};
+
+/** Call f(i) for each i in [0, count) as separate tasks on the current pool. */
+template<typename Function>
+void
+parallel_for(size_t count, Function f) {
+    TaskGroup group;
+    for (size_t i=0; i<count; ++i) group.run([&f, i]{ f(i); });
+    group.wait();
+}
+
+/** Number of chunks to split n items into: several per thread so that
+  * work stealing can even out chunks that take longer than others.
+  */
+inline size_t
+chunk_count(size_t n) {
+    static constexpr size_t CHUNKS_PER_THREAD = 4;
+    return std::max<size_t>(1, std::min(n, ThreadPool::current().size() * CHUNKS_PER_THREAD));
+}
+
+}; //namespace bio
+
+#endif
\ No newline at end of file
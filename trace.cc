@@ -0,0 +1,150 @@
+/*
+Copyright 2024, The Broad Institute of MIT and Harvard
+
+Original Author: Charles C Bailey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "trace.h"
+
+#include "simdalloc.h"
+
+#include <chrono>
+#include <deque>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace bio {
+namespace trace {
+
+namespace {
+
+struct Event {
+    const char *label;
+    const char *category;
+    uint64_t start, stop; //ns since the trace started
+    size_t items;
+};
+
+/** The spans of one thread; only that thread appends to it. */
+struct ThreadBuffer {
+    size_t tid = 0;
+    std::string name;
+    std::vector<Event> events;
+};
+
+std::mutex                                  registry_mutex;
+std::deque<std::unique_ptr<ThreadBuffer>>   registry; //never shrinks, so buffers outlive their threads
+const std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now(); //timestamps count from here
+
+thread_local ThreadBuffer *this_buffer = nullptr;
+thread_local const char   *this_label  = "";
+
+ThreadBuffer &
+buffer() {
+    if (!this_buffer) {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        registry.push_back(std::make_unique<ThreadBuffer>());
+        this_buffer = registry.back().get();
+        this_buffer->tid = registry.size();
+        this_buffer->name = "thread " + std::to_string(this_buffer->tid);
+    }
+    return *this_buffer;
+}
+
+/** s as a quoted JSON string; labels and thread names are plain text. */
+std::string
+quoted(const std::string &s) {
+    std::string q = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') q += '\\';
+        if (static_cast<unsigned char>(c) >= 0x20) q += c;
+    }
+    return q + '"';
+}
+
+}; //namespace
+
+void
+start() {
+    impl::enabled = true;
+}
+
+void
+name_thread(const std::string &name) {
+    if (!enabled()) return;
+    ThreadBuffer &b = buffer();
+    b.name = name;
+}
+
+const char *
+label() {
+    return this_label;
+}
+
+Label::Label(const char *label) : previous_(this_label) {
+    this_label = label;
+    detail::dsa_allocation_tag = label; //allocations are tallied by stage too (see --track_allocations)
+}
+
+Label::~Label() {
+    this_label = previous_;
+    detail::dsa_allocation_tag = previous_;
+}
+
+uint64_t
+Span::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count();
+}
+
+void
+Span::record(const char *category, uint64_t start, uint64_t stop, size_t items) {
+    buffer().events.push_back({this_label, category, start, stop, items});
+}
+
+void
+write(std::ostream &os) {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    const std::ios_base::fmtflags flags = os.flags();
+    os << std::fixed << std::setprecision(3);
+    os << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    bool first = true;
+    for (const std::unique_ptr<ThreadBuffer> &b : registry) {
+        os << (first ? "\n" : ",\n")
+           << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << b->tid
+           << ", \"args\": {\"name\": " << quoted(b->name) << "}}";
+        first = false;
+        for (const Event &e : b->events) {
+            //timestamps and durations are in microseconds
+            os << ",\n{\"name\": " << quoted(*e.label ? e.label : e.category)
+               << ", \"cat\": " << quoted(e.category)
+               << ", \"ph\": \"X\", \"pid\": 1, \"tid\": " << b->tid
+               << ", \"ts\": " << e.start / 1000.0
+               << ", \"dur\": " << (e.stop - e.start) / 1000.0
+               << ", \"args\": {\"items\": " << e.items << "}}";
+        }
+    }
+    os << "\n]}" << std::endl;
+    os.flags(flags);
+}
+
+}; //namespace trace
+}; //namespace bio
\ No newline at end of file
@@ -0,0 +1,121 @@
+/*
+Copyright 2024, The Broad Institute of MIT and Harvard
+
+Original Author: Charles C Bailey
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef BIO_TRACE_H_
+#define BIO_TRACE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+namespace bio {
+
+/** A timeline of what every thread was doing, written in the Chrome trace
+  * event format for chrome://tracing or ui.perfetto.dev (see --trace).
+  *
+  * Every task of the parallel algorithms, every chunk of items they hand
+  * out, and every batch of the streaming front end becomes a span on the
+  * thread that ran it, with the number of items it covered. Spans are
+  * appended to a buffer owned by their thread, so recording takes no locks;
+  * a thread only takes a lock once, to register its buffer. Buffers outlive
+  * their threads and are read by write_trace() when the work is done.
+  */
+namespace trace {
+
+namespace impl {
+inline std::atomic<bool> enabled = false;
+}; //namespace impl
+
+/** Whether spans are being recorded; a relaxed load so that it is cheap to check. */
+inline bool
+enabled() {
+    return impl::enabled.load(std::memory_order_relaxed);
+}
+
+/** Start recording spans. Timestamps count from the start of the process. */
+void
+start();
+
+/** Name the calling thread in the trace (e.g. "pool worker 3"). */
+void
+name_thread(const std::string &name);
+
+/** The label of the calling thread's current region (see Label), or "" for none. */
+const char *
+label();
+
+/** Write every span recorded so far as a Chrome trace JSON document.
+  * Must not be called while spans are being recorded.
+  */
+void
+write(std::ostream &os);
+
+/** Labels the spans of the calling thread with what it is working on,
+  * e.g. "umi collapse", until the Label goes out of scope. The label must be
+  * a string literal, or otherwise outlive the trace. Parallel
+  * algorithms pass the label of the thread that starts them on to their
+  * tasks, so a task's spans are named after the stage it belongs to.
+  */
+class Label {
+public:
+    explicit Label(const char *label);
+    ~Label();
+    Label(const Label &) = delete;
+    Label &operator=(const Label &) = delete;
+
+private:
+    const char *previous_;
+};
+
+/** Records a span from construction to destruction on the calling thread,
+  * named after the current label, in category (e.g. "parallel_guided").
+  * Costs a relaxed load when tracing is off.
+  */
+class Span {
+public:
+    explicit Span(const char *category, size_t items=0)
+    :   category_(category), items_(items), start_(enabled() ? now() : UINT64_MAX) {}
+
+    ~Span() { if (start_ != UINT64_MAX) record(category_, start_, now(), items_); }
+
+    Span(const Span &) = delete;
+    Span &operator=(const Span &) = delete;
+
+    /** Set the number of items the span covers, if it was not known at the start. */
+    void items(size_t n) { items_ = n; }
+
+private:
+    static uint64_t now();
+    static void record(const char *category, uint64_t start, uint64_t stop, size_t items);
+
+    const char *category_;
+    size_t items_;
+    uint64_t start_;
+};
+
+}; //namespace trace
+}; //namespace bio
+
+#endif
\ No newline at end of file
@@ -37,8 +37,11 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include "aa.h"
 #include "cdn.h"
+#include "columnar.h"
+#include "compact.h"
 #include "dna.h"
 #include "defines.h"
+#include "sections.h"
 
 #ifdef DSA_TARGET_WIN64
 #include "local-getopt.h"
@@ -52,6 +55,8 @@ using bio::Aas;
 using bio::Cdns;
 
 void print_usage(std::ostream &);
+void run_dump_columnar(int, char *argv[]);
+void run_expand_compact(int, char *argv[]);
 void run_extract_aas (int, char *argv[]);
 void run_extract_cdns(int, char *argv[]);
 void run_venn_diagram(int, char *argv[]);
@@ -78,11 +83,30 @@ void
 run_print_help(int argc, char *argv[]) {
 std::cout <<
 "dsa-utils COMMAND [OPTIONS...]\n"
-"  Recognized COMMANDs: extract_aas, venn\n"
+"  Recognized COMMANDs: dump, expand, extract_aas, venn\n"
+"    dump : Print the contents of a columnar dsa output file (written with\n"
+"           dsa --output_format=columnar) as the text output of the same run,\n"
+"           with the same -c, --number_from and --compact_alignments. Only the\n"
+"           #Profile# and #Allocations# sections are not kept in the file.\n"
+"      OPTIONS:\n"
+"        --index\n"
+"          Print the list of column blocks in the file instead.\n"
+"      EXAMPLE: dsa-util dump dsa1.dsac > dsa1.csv\n"
+"\n"
+"    expand : Restore the full alignment and codon strings of a dsa text output\n"
+"             file written with --compact_alignments. Reads the file named on\n"
+"             the command line or stdin and writes the same output dsa would\n"
+"             have written without --compact_alignments.\n"
+"      OPTIONS:\n"
+"        --output (-o) FILENAME\n"
+"          Write output to FILENAME rather than stdout.\n"
+"      EXAMPLE: dsa-util expand dsa1.csv > dsa1_full.csv\n"
+"\n"
 "    extract_aas : Open one or more dsa output files compile create a list of\n"
 "                  unique amino sequences. Optionally filter and/or capture\n"
 "                  using a regular expression. Optionally add a label column\n"
-"                  to the output.\n"
+"                  to the output. Text and columnar dsa files are accepted;\n"
+"                  columnar files are memory mapped rather than parsed.\n"
 "      OPTIONS:\n" 
 "        --label (-l) LABEL\n"
 "          Output will be two columns separated by a tab character.\n"
@@ -122,6 +146,8 @@ std::cout <<
 }
 
 const static std::map<std::string_view, void(*)(int, char *[])> COMMAND_RUNNERS = {
+    {"dump",         run_dump_columnar},
+    {"expand",       run_expand_compact},
     {"extract_aas",  run_extract_aas },
     //{"extract_cdns", run_extract_cdns},
     {"venn",         run_venn_diagram},
@@ -253,6 +279,287 @@ run_venn_diagram(int argc, char *argv[]) {
     }
 }
 
+/** True if filename starts with the magic number of a columnar dsa file. */
+bool
+is_columnar_file(const std::string &filename) {
+    char magic[sizeof(bio::ColumnarFormat::HEADER_MAGIC)] = {};
+    std::ifstream ifs(filename, std::ios::binary);
+    ifs.read(magic, sizeof(magic));
+    return ifs && bio::ColumnarFile::is_columnar(magic, sizeof(magic));
+}
+
+void
+run_dump_columnar(int argc, char *argv[]) {
+    int index_only = 0;
+
+    static struct option long_options[] = {
+        {"index", no_argument, &index_only, 1},
+        {      0,           0,           0, 0}
+    };
+
+    for (;;) {
+        int option_index = 0;
+        int c = getopt_long(argc, argv, "", long_options, &option_index);
+        if (c == -1) break;
+        switch (c) {
+            case 0:
+                break;
+            case '?':
+                std::cerr << "unrecognized option: -" << optopt << std::endl;
+                break;
+            default:
+                exit (EXIT_FAILURE);
+        }
+    }
+
+    if (optind + 1 != argc) {
+        std::cerr << "dump requires exactly one columnar dsa file" << std::endl << std::endl;
+        print_usage(std::cerr);
+        exit (EXIT_FAILURE);
+    }
+
+    const std::string filename = argv[optind];
+    try {
+        bio::ColumnarFile cf = bio::ColumnarFile::open(filename);
+
+        if (index_only) {
+            static const char *type_names[] = {"bytes", "u8", "u32", "u64", "f32"};
+            std::cout << "Name	Type	Rows	Cols	Offset	Bytes" << std::endl;
+            for (const bio::ColumnIndexEntry &e : cf.index()) {
+                const size_t t = static_cast<size_t>(e.type);
+                std::cout << e.name << '\t'
+                          << (t < 5 ? type_names[t] : "?") << '\t'
+                          << e.rows << '\t'
+                          << e.cols << '\t'
+                          << e.offset << '\t'
+                          << e.bytes << std::endl;
+            }
+            return;
+        }
+
+        //the options that shaped the text output of the run; files written before they were kept get the old dump's
+        auto option = [&cf](const char *name, auto otherwise) {
+            using T = decltype(otherwise);
+            if (!cf.find(name)) return otherwise;
+            std::span<const T> values = cf.column<T>(name);
+            if (values.empty()) throw bio::BadColumnarFile(std::string("empty column '") + name + "'");
+            return values[0];
+        };
+        const uint32_t codon_format = option("text.codon_output", static_cast<uint32_t>(help::CodonOutput::Ascii));
+        if (codon_format > static_cast<uint32_t>(help::CodonOutput::Vertical)) throw bio::BadColumnarFile("unknown codon output format");
+        const help::CodonOutput codon_output = static_cast<help::CodonOutput>(codon_format);
+        const long number_from = static_cast<long>(static_cast<int64_t>(option("text.number_from", uint64_t(1))));
+        const bool compact     = option("text.compact_alignments", uint8_t(0));
+        const bool no_header   = option("text.no_header", uint8_t(0));
+        const bool unique      = option("text.unique_sequences", uint8_t(1));
+
+        if (!no_header) {
+            std::span<const char> settings = cf.column<char>("settings");
+            std::cout.write(settings.data(), settings.size());
+        }
+
+        std::span<const uint32_t> ids = cf.column<uint32_t>("templates.id");
+        std::unordered_map<uint32_t, size_t> template_index;
+        for (size_t i=0; i<ids.size(); ++i) template_index[ids[i]] = i;
+
+        const bool has_usage = cf.find("usage.split");
+        if (has_usage || !ids.empty()) {
+            std::cout << "#Templates#" << std::endl;
+            std::cout << "Template Id\tTemplate Name\tSequence" << (compact ? "\tNucleotides" : "") << std::endl;
+            for (size_t i=0; i<ids.size(); ++i) {
+                std::cout << ids[i] << '\t' << cf.string("templates.label", i) << '\t' << cf.string("templates.aas", i);
+                if (compact) std::cout << '\t' << bio::Cdns(std::string(cf.string("templates.cdns", i))).to_nts();
+                std::cout << std::endl;
+            }
+        }
+
+        if (has_usage) {
+            std::span<const uint32_t> splits = cf.column<uint32_t>("usage.split");
+            std::span<const uint64_t> counts = cf.column<uint64_t>("usage.count");
+            if (counts.size() != splits.size()) throw bio::BadColumnarFile("wrong number of rows in column 'usage.count'");
+            std::vector<uint64_t> totals;
+            for (size_t k=0; k<splits.size(); ++k) {
+                if (splits[k] >= totals.size()) totals.resize(splits[k] + 1);
+                totals[splits[k]] += counts[k];
+            }
+            std::cout << "#Template Usage#" << std::endl;
+            std::cout << "Split\tTemplate\tCount\tFrequency" << std::endl;
+            for (size_t k=0; k<splits.size(); ++k) {
+                std::cout << (splits[k] + 1) << '\t'
+                          << cf.string("usage.label", k) << '\t'
+                          << counts[k] << '\t'
+                          << counts[k] / static_cast<double>(totals[splits[k]]) << std::endl;
+            }
+        }
+
+        bio::UniqueSequences unique_sequences;
+        std::cout << "#Alignments#" << std::endl;
+        std::cout << "Template\tUMI Group Size\tBarcode\tSequence" << std::endl;
+        for (size_t i=0; i<cf.alignment_count(); ++i) {
+            const uint32_t id = cf.template_id(i);
+            const std::string alignment = cf.alignment(i);
+            const std::string codons    = cf.codons(i);
+            std::cout << (id == bio::ColumnarFormat::NO_TEMPLATE ? std::string() : std::to_string(id)) << '\t'
+                      << cf.group_size(i) << '\t'
+                      << cf.barcode(i) << '\t';
+            if (compact) {
+                //as dsa --compact_alignments writes them, relative to the template
+                const auto tpl = template_index.find(id);
+                const std::string_view taas  = tpl == template_index.end() ? std::string_view() : cf.string("templates.aas", tpl->second);
+                const std::string_view tcdns = tpl == template_index.end() ? std::string_view() : cf.string("templates.cdns", tpl->second);
+                std::cout << bio::compact_alignment(alignment, taas) << std::endl;
+                if (codon_output == help::CodonOutput::Horizontal) std::cout << "\t\t\t" << bio::compact_codons(alignment, codons, tcdns) << std::endl;
+            } else {
+                std::cout << alignment << std::endl;
+                bio::write_codons(std::cout, codons, codon_output);
+            }
+            if (unique) unique_sequences.add(alignment, codons, cf.group_size(i));
+        }
+
+        for (size_t i=0; i<ids.size(); ++i) {
+            std::string_view tpl = cf.string("templates.aas", i);
+            std::string_view label = cf.string("templates.label", i);
+
+            const std::string subs_name = "subs." + std::to_string(i);
+            if (const bio::ColumnIndexEntry *e = cf.find(subs_name)) {
+                std::span<const float> subs = cf.column<float>(subs_name);
+                if (e->cols > tpl.size() || subs.size() != e->rows * e->cols) throw bio::BadColumnarFile("wrong size of column '" + subs_name + "'");
+                std::cout << "#Substitutions (" << label << ")#" << std::endl;
+                for (size_t c=0; c<e->cols; ++c) std::cout << '\t' << tpl[c] << (c + number_from);
+                std::cout << std::endl;
+                for (size_t r=0; r<e->rows; ++r) {
+                    std::cout << bio::Aa::valid_chars[r];
+                    for (size_t c=0; c<e->cols; ++c) std::cout << '\t' << subs[r * e->cols + c];
+                    std::cout << std::endl;
+                }
+            }
+
+            const std::string mut_name = "mutations." + std::to_string(i);
+            if (const bio::ColumnIndexEntry *e = cf.find(mut_name)) {
+                static const char *row_names[] = {"Total", "Non-Coding", "Coding"};
+                std::span<const uint32_t> counts = cf.column<uint32_t>(mut_name);
+                if (e->cols > tpl.size() || counts.size() != 3 * e->cols) throw bio::BadColumnarFile("wrong size of column '" + mut_name + "'");
+                std::cout << "#Mutation Counts (" << label << ")#" << std::endl;
+                for (size_t c=0; c<e->cols; ++c) std::cout << '\t' << tpl[c] << (c + number_from);
+                std::cout << std::endl;
+                for (size_t r=0; r<3; ++r) {
+                    std::cout << row_names[r];
+                    for (size_t c=0; c<e->cols; ++c) std::cout << '\t' << counts[r * e->cols + c];
+                    std::cout << std::endl;
+                }
+            }
+        }
+
+        if (unique) unique_sequences.write(std::cout);
+    } catch (const bio::BadColumnarFile &ex) {
+        std::cerr << "Could not read '" << filename << "': " << ex.what() << std::endl;
+        exit (EXIT_FAILURE);
+    } catch (const bio::MappingException &) {
+        std::cerr << "Could not open '" << filename << "' for reading" << std::endl;
+        exit (EXIT_FAILURE);
+    }
+}
+
+void
+run_expand_compact(int argc, char *argv[]) {
+    const char *opt_chars = "o:";
+    std::string output_filename;
+
+    static struct option long_options[] = {
+        {"output", required_argument, 0, 'o'},
+        {       0,                 0, 0,  0 }
+    };
+
+    for (;;) {
+        int option_index = 0;
+        int c = getopt_long(argc, argv, opt_chars, long_options, &option_index);
+        if (c == -1) break;
+        switch (c) {
+            case 'o':
+                output_filename = optarg;
+                break;
+            case '?':
+                std::cerr << "unrecognized option: -" << optopt << std::endl;
+                break;
+            default:
+                exit (EXIT_FAILURE);
+        }
+    }
+
+    std::ifstream ifs;
+    if (optind < argc) {
+        ifs.open(argv[optind]);
+        if (!ifs) {
+            std::cerr << "Could not open '" << argv[optind] << "' for reading" << std::endl;
+            exit (EXIT_FAILURE);
+        }
+    }
+    std::istream &is = ifs.is_open() ? static_cast<std::istream &>(ifs) : std::cin;
+
+    std::ofstream ofs;
+    if (!output_filename.empty()) {
+        ofs.open(output_filename);
+        if (!ofs) {
+            std::cerr << "Could not open '" << output_filename << "' for writing" << std::endl;
+            exit (EXIT_FAILURE);
+        }
+    }
+    std::ostream &os = output_filename.empty() ? std::cout : ofs;
+
+    //template id -> (amino acids, nucleotides)
+    std::unordered_map<std::string, std::pair<std::string, std::string>> templates;
+    const std::pair<std::string, std::string> no_template;
+    const std::pair<std::string, std::string> *tpl = &no_template;
+
+    bool compact = false;
+    std::string section, alignment;
+    size_t line_no = 0;
+    for (std::string line; std::getline(is, line); ) {
+        ++line_no;
+        if (line.starts_with("#compact alignments")) {
+            compact = true;
+            continue;
+        }
+        if (line.size() > 1 && line.front() == '#' && line.back() == '#') {
+            section = line;
+            os << line << '\n';
+            continue;
+        }
+        if (!compact || line.starts_with("#")) {
+            os << line << '\n';
+            continue;
+        }
+
+        std::vector<std::string> fields;
+        for (size_t lo=0, hi=0; hi != std::string::npos; lo=hi+1) {
+            hi = line.find('\t', lo);
+            fields.push_back(line.substr(lo, hi == std::string::npos ? hi : hi-lo));
+        }
+
+        try {
+            if (section == "#Templates#" && fields.size() == 4) {
+                if (fields[0] != "Template Id") templates[fields[0]] = {fields[2], fields[3]};
+                os << fields[0] << '\t' << fields[1] << '\t' << fields[2] << '\n';
+            } else if (section == "#Alignments#" && fields.size() == 4 && fields[0] != "Template") {
+                if (fields[1].empty()) { //codon row
+                    os << "\t\t\t" << bio::expand_codons(alignment, fields[3], tpl->second) << '\n';
+                } else {
+                    auto ii = templates.find(fields[0]);
+                    tpl = (ii == templates.end()) ? &no_template : &ii->second;
+                    alignment = bio::expand_alignment(fields[3], tpl->first);
+                    os << fields[0] << '\t' << fields[1] << '\t' << fields[2] << '\t' << alignment << '\n';
+                }
+            } else {
+                os << line << '\n';
+            }
+        } catch (const bio::BadCompactAlignment &ex) {
+            std::cerr << "Bad compact alignment at line " << line_no << ": " << ex.what() << std::endl;
+            exit (EXIT_FAILURE);
+        }
+    }
+    os.flush();
+}
+
 void
 run_extract_aas(int argc, char *argv[]) {
     const char * opt_chars = "l:o:r:";
@@ -321,10 +628,41 @@ run_extract_aas(int argc, char *argv[]) {
     }
 
     std::unordered_set<Aas> unique_aas;
+
+    //apply the optional regex to the sequence text [begin, end) whose residues are aas and keep the result
+    auto insert_aas = [&](Aas &&aas, std::string::const_iterator begin, std::string::const_iterator end) {
+        if (rgx) {
+            std::match_results<std::string::const_iterator> match;
+            if (!std::regex_search(begin, end, match, *rgx)) return;
+            if (rgx->mark_count() != 0) {
+                auto sm = match[1];
+                auto left = sm.first - begin, right = end - sm.second;
+                aas.exo(left, right);
+            }
+        }
+        unique_aas.insert(std::move(aas));
+    };
+
     for (size_t i=0; i<input_filenames.size(); ++i) {
         const size_t label = i;
         const std::string &filename = input_filenames[i];
 
+        if (is_columnar_file(filename)) {
+            try {
+                bio::ColumnarFile cf = bio::ColumnarFile::open(filename);
+                for (size_t j=0; j<cf.alignment_count(); ++j) {
+                    //the #Unique Amino Acids# section lists alignments with gaps removed
+                    std::string seq = cf.alignment(j);
+                    std::erase(seq, '-');
+                    insert_aas(Aas(seq), seq.cbegin(), seq.cend());
+                }
+            } catch (const std::exception &) {
+                std::cerr << "Could not read columnar dsa file '" << filename << "'" << std::endl;
+                exit (EXIT_FAILURE);
+            }
+            continue;
+        }
+
         std::ifstream ifs(filename);
         if (!ifs) {
             std::cerr << "Could not open '" << filename << "' for reading" << std::endl << std::endl;
@@ -357,18 +695,7 @@ run_extract_aas(int argc, char *argv[]) {
                 std::cerr << "  Protein sequence contained invalid characters" << std::endl;
                 exit(EXIT_FAILURE);
             }
-            if (rgx) {
-                std::match_results<std::string::const_iterator> match;
-                const std::string::const_iterator begin = line.cbegin()+tab+1;
-                const std::string::const_iterator end   = line.cend();
-                if (!std::regex_search(begin, end, match, *rgx)) continue;
-                if (rgx->mark_count() != 0) {
-                    auto sm = match[1];
-                    auto left = sm.first - begin, right = end - sm.second;
-                    aas.exo(left, right);
-                }
-            }
-            unique_aas.insert(std::move(aas));
+            insert_aas(std::move(aas), line.cbegin()+tab+1, line.cend());
         }
         ifs.close();
     }